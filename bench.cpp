@@ -0,0 +1,631 @@
+//
+// Copyright (C) 2024  HiPES - Universidade Federal do Paraná
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/**
+ * @file bench.cpp
+ * @brief Micro-benchmarks of the buffers, the message passing and the BTB.
+ * @details Each benchmark is calibrated so a repetition runs for at least
+ * --min-time milliseconds, then repeated --repetitions times. The report shows
+ * the mean, median, standard deviation and minimum of the time per operation,
+ * either as a table or, with --json, as a JSON document meant to be diffed
+ * between versions.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "byteRing.hpp"
+#include "circularBuffer.hpp"
+#include "component.hpp"
+#include "engine.hpp"
+#include "interleavedBTB.hpp"
+#include "staticGraph.hpp"
+
+namespace {
+
+struct BenchOptions {
+    int repetitions;
+    double minTime; /**< Minimum time per repetition, in seconds. */
+    bool json;
+    const char* filter;
+};
+
+struct BenchResult {
+    std::string name;
+    long operations; /**< Operations per repetition. */
+    double mean;     /**< Nanoseconds per operation. */
+    double median;
+    double stddev;
+    double min;
+};
+
+/**
+ * @brief Defeats dead-code elimination of benchmark results.
+ */
+volatile unsigned long benchSink;
+
+/**
+ * @details The body receives the number of operations it must perform.
+ */
+typedef std::function<void(long)> BenchBody;
+
+double TimeBody(const BenchBody& body, long operations) {
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    body(operations);
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                         start)
+        .count();
+};
+
+void RunBench(const BenchOptions& options, const std::string& name,
+              const BenchBody& body, std::vector<BenchResult>& results) {
+    if (options.filter && !strstr(name.c_str(), options.filter)) return;
+
+    /* Calibration, which also serves as warm-up. */
+    long operations = 1;
+    for (;;) {
+        double elapsed = TimeBody(body, operations);
+        if (elapsed >= options.minTime || operations >= (1L << 40)) break;
+        double scale = (elapsed > 0) ? (options.minTime * 1.2 / elapsed) : 10;
+        operations = (long)(operations * std::min(std::max(scale, 2.0), 100.0));
+    }
+
+    std::vector<double> samples;
+    for (int i = 0; i < options.repetitions; ++i) {
+        samples.push_back(TimeBody(body, operations) * 1e9 / operations);
+    }
+    std::sort(samples.begin(), samples.end());
+
+    BenchResult result;
+    result.name = name;
+    result.operations = operations;
+    result.min = samples[0];
+    result.median = (samples.size() % 2)
+                        ? samples[samples.size() / 2]
+                        : (samples[samples.size() / 2 - 1] +
+                           samples[samples.size() / 2]) /
+                              2;
+
+    double sum = 0;
+    for (unsigned long i = 0; i < samples.size(); ++i) sum += samples[i];
+    result.mean = sum / samples.size();
+
+    double squares = 0;
+    for (unsigned long i = 0; i < samples.size(); ++i) {
+        squares += (samples[i] - result.mean) * (samples[i] - result.mean);
+    }
+    result.stddev = (samples.size() > 1)
+                        ? std::sqrt(squares / (samples.size() - 1))
+                        : 0;
+
+    if (!options.json) {
+        printf("%-44s %12.2f %10.2f %10.2f %10.2f %14.0f\n", name.c_str(),
+               result.mean, result.median, result.stddev, result.min,
+               1e9 / result.mean);
+        fflush(stdout);
+    }
+    results.push_back(result);
+};
+
+void PrintJSON(const BenchOptions& options,
+               const std::vector<BenchResult>& results) {
+    printf("{\n  \"repetitions\": %d,\n  \"min_time_ms\": %.1f,\n",
+           options.repetitions, options.minTime * 1e3);
+    printf("  \"benchmarks\": [\n");
+    for (unsigned long i = 0; i < results.size(); ++i) {
+        const BenchResult& r = results[i];
+        printf("    {\"name\": \"%s\", \"operations\": %ld, "
+               "\"ns_per_op\": %.4f, \"median_ns\": %.4f, "
+               "\"stddev_ns\": %.4f, \"min_ns\": %.4f, "
+               "\"ops_per_second\": %.1f}%s\n",
+               r.name.c_str(), r.operations, r.mean, r.median, r.stddev,
+               r.min, 1e9 / r.mean, (i + 1 < results.size()) ? "," : "");
+    }
+    printf("  ]\n}\n");
+};
+
+/* ==========================================================================
+    Components used by the benchmarks
+   ========================================================================== */
+
+/**
+ * @brief Exposes the message-passing API so the benchmark can drive it.
+ */
+class BenchEndpoint : public sinuca::Component<long> {
+  public:
+    int FinishSetup() { return 0; };
+    void Clock() {};
+
+    using Component<long>::SendRequestByHandle;
+    using Component<long>::SendResponseByHandle;
+    using Component<long>::ReceiveRequestByHandle;
+    using Component<long>::ReceiveResponseByHandle;
+    using Component<long>::ResolveConnectionToComponent;
+    using Component<long>::ResolveConnectionForAConnection;
+    using Component<long>::SendRequestToComponent;
+    using Component<long>::ReceiveResponseFromComponent;
+    using Component<long>::ReceiveRequestForAConnection;
+    using Component<long>::SendResponseForConnection;
+    using Component<long>::ForEachReadyRequest;
+};
+
+/**
+ * @brief One stage of a ring: sends a request to the next stage every cycle
+ * and answers the requests it receives from the previous one.
+ */
+class RingStage : public sinuca::Component<long> {
+  public:
+    sinuca::engine::ConnectionHandle next;
+    long received;
+
+    RingStage() : received(0){};
+    int FinishSetup() { return 0; };
+    void Clock() {
+        long message = 1;
+        this->SendRequestByHandle(this->next, &message);
+        while (this->ReceiveResponseByHandle(this->next, &message))
+            this->received += message;
+
+        const sinuca::engine::ConnectionHandle& input =
+            this->ResolveConnectionForAConnection(0);
+        while (this->ReceiveRequestByHandle(input, &message)) {
+            this->SendResponseByHandle(input, &message);
+        }
+    };
+};
+
+typedef sinuca::engine::StaticConnection<long, long, 4> StaticRingLink;
+
+/**
+ * @brief RingStage for a StaticGraph.
+ */
+class StaticRingStage {
+  public:
+    StaticRingLink* next;
+    StaticRingLink* previous;
+    long received;
+
+    StaticRingStage() : next(NULL), previous(NULL), received(0){};
+    void Clock() {
+        long message = 1;
+        this->next->SendRequest(message);
+        while (this->next->ReceiveResponse(&message)) this->received += message;
+
+        while (this->previous->ReceiveRequest(&message)) {
+            this->previous->SendResponse(message);
+        }
+    };
+};
+
+/* ==========================================================================
+    Benchmarks
+   ========================================================================== */
+
+void BenchCircularBuffer(const BenchOptions& options,
+                         std::vector<BenchResult>& results) {
+    static const int sizes[] = {4, 16, 64, 256};
+    static const int bufferSize = 64;
+
+    for (unsigned int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+        int messageSize = sizes[s];
+
+        RunBench(options,
+                 "circular_buffer/enqueue_dequeue/" +
+                     std::to_string(messageSize) + "B",
+                 [messageSize](long operations) {
+                     CircularBuffer buffer;
+                     buffer.Allocate(bufferSize, messageSize);
+                     std::vector<char> input(messageSize, 1);
+                     std::vector<char> output(messageSize);
+                     unsigned long sum = 0;
+
+                     for (long done = 0; done < operations;) {
+                         long batch = std::min<long>(bufferSize,
+                                                     operations - done);
+                         for (long i = 0; i < batch; ++i) {
+                             input[0] = (char)i;
+                             buffer.Enqueue(input.data());
+                         }
+                         for (long i = 0; i < batch; ++i) {
+                             buffer.Dequeue(output.data());
+                             sum += output[0];
+                         }
+                         done += batch;
+                     }
+                     benchSink = sum;
+                 },
+                 results);
+    }
+};
+
+/**
+ * @details Messages carrying 1 to 32 fetch targets, as a fixed-size buffer
+ * padded to the largest one and as a byte ring of the same capacity, which
+ * holds several times more of them.
+ */
+void BenchByteRing(const BenchOptions& options,
+                   std::vector<BenchResult>& results) {
+    static const int maxTargets = 32;
+    static const int maxSize = 16 + maxTargets * 8;
+    static const int bufferSize = 64;
+
+    std::vector<int> sizes(256);
+    unsigned long seed = 1;
+    for (unsigned int i = 0; i < sizes.size(); ++i) {
+        seed = seed * 6364136223846793005UL + 1442695040888963407UL;
+        sizes[i] = 16 + (1 + (seed >> 33) % maxTargets) * 8;
+    }
+
+    RunBench(options, "circular_buffer/padded_targets",
+             [&sizes](long operations) {
+                 CircularBuffer buffer;
+                 buffer.Allocate(bufferSize, maxSize);
+                 std::vector<char> input(maxSize, 1);
+                 std::vector<char> output(maxSize);
+                 unsigned long sum = 0;
+
+                 for (long done = 0; done < operations;) {
+                     long batch = 0;
+                     while (done + batch < operations &&
+                            buffer.Enqueue(input.data())) {
+                         input[0] = (char)sizes[batch & 255];
+                         ++batch;
+                     }
+                     for (long i = 0; i < batch; ++i) {
+                         buffer.Dequeue(output.data());
+                         sum += output[0];
+                     }
+                     done += batch;
+                 }
+                 benchSink = sum;
+             },
+             results);
+
+    RunBench(options, "byte_ring/variable_targets",
+             [&sizes](long operations) {
+                 ByteRing ring;
+                 ring.Allocate(bufferSize * maxSize);
+                 std::vector<char> input(maxSize, 1);
+                 std::vector<char> output(maxSize);
+                 unsigned long sum = 0;
+                 int length = 0;
+
+                 for (long done = 0; done < operations;) {
+                     long batch = 0;
+                     while (done + batch < operations &&
+                            ring.Enqueue(input.data(), sizes[batch & 255])) {
+                         input[0] = (char)sizes[batch & 255];
+                         ++batch;
+                     }
+                     for (long i = 0; i < batch; ++i) {
+                         ring.Dequeue(output.data(), maxSize, &length);
+                         sum += output[0] + length;
+                     }
+                     done += batch;
+                 }
+                 benchSink = sum;
+             },
+             results);
+};
+
+void BenchRoundTrip(const BenchOptions& options,
+                    std::vector<BenchResult>& results) {
+    static const int fanIn[] = {1, 8, 64};
+
+    for (unsigned int f = 0; f < sizeof(fanIn) / sizeof(fanIn[0]); ++f) {
+        int numberOfConnections = fanIn[f];
+
+        BenchEndpoint source, recipient;
+        std::vector<int> ids;
+        std::vector<sinuca::engine::ConnectionHandle> handles;
+        for (int i = 0; i < numberOfConnections; ++i) {
+            ids.push_back(recipient.ConnectToComponent(4));
+            handles.push_back(
+                source.ResolveConnectionToComponent(&recipient, ids.back()));
+        }
+
+        /* One operation is a request and its response on every connection.
+         */
+        RunBench(options,
+                 "linkable/round_trip_id/" +
+                     std::to_string(numberOfConnections) + "_connections",
+                 [&](long operations) {
+                     long message, sum = 0;
+                     for (long op = 0; op < operations; ++op) {
+                         for (int i = 0; i < numberOfConnections; ++i) {
+                             message = op;
+                             source.SendRequestToComponent(&recipient, ids[i],
+                                                           &message);
+                         }
+                         for (int i = 0; i < numberOfConnections; ++i) {
+                             recipient.ReceiveRequestForAConnection(i,
+                                                                    &message);
+                             recipient.SendResponseForConnection(i, &message);
+                         }
+                         for (int i = 0; i < numberOfConnections; ++i) {
+                             source.ReceiveResponseFromComponent(
+                                 &recipient, ids[i], &message);
+                             sum += message;
+                         }
+                     }
+                     benchSink = sum;
+                 },
+                 results);
+
+        RunBench(options,
+                 "linkable/round_trip_handle/" +
+                     std::to_string(numberOfConnections) + "_connections",
+                 [&](long operations) {
+                     long message, sum = 0;
+                     for (long op = 0; op < operations; ++op) {
+                         for (int i = 0; i < numberOfConnections; ++i) {
+                             message = op;
+                             source.SendRequestByHandle(handles[i], &message);
+                         }
+                         for (int i = 0; i < numberOfConnections; ++i) {
+                             const sinuca::engine::ConnectionHandle& input =
+                                 recipient.ResolveConnectionForAConnection(i);
+                             recipient.ReceiveRequestByHandle(input, &message);
+                             recipient.SendResponseByHandle(input, &message);
+                         }
+                         for (int i = 0; i < numberOfConnections; ++i) {
+                             source.ReceiveResponseByHandle(handles[i],
+                                                            &message);
+                             sum += message;
+                         }
+                     }
+                     benchSink = sum;
+                 },
+                 results);
+    }
+};
+
+void BenchReadyScan(const BenchOptions& options,
+                    std::vector<BenchResult>& results) {
+    static const int fanIn = 512;
+    static const int active[] = {1, 8, 64};
+
+    BenchEndpoint source, hub;
+    std::vector<sinuca::engine::ConnectionHandle> handles;
+    for (int i = 0; i < fanIn; ++i) {
+        int id = hub.ConnectToComponent(4);
+        handles.push_back(source.ResolveConnectionToComponent(&hub, id));
+    }
+
+    for (unsigned int a = 0; a < sizeof(active) / sizeof(active[0]); ++a) {
+        int numberOfActive = active[a];
+        int spacing = fanIn / numberOfActive;
+        std::string suffix = std::to_string(numberOfActive) + "_of_" +
+                             std::to_string(fanIn) + "_inputs";
+
+        /* One operation is one cycle of the hub: the active inputs get a
+         * request and the hub drains them. */
+        RunBench(options, "linkable/poll_all/" + suffix,
+                 [&](long operations) {
+                     long message, sum = 0;
+                     for (long op = 0; op < operations; ++op) {
+                         for (int i = 0; i < numberOfActive; ++i) {
+                             message = op;
+                             source.SendRequestByHandle(handles[i * spacing],
+                                                        &message);
+                         }
+                         for (int i = 0; i < fanIn; ++i) {
+                             if (hub.ReceiveRequestByHandle(
+                                     hub.ResolveConnectionForAConnection(i),
+                                     &message))
+                                 sum += message;
+                         }
+                     }
+                     benchSink = sum;
+                 },
+                 results);
+
+        RunBench(options, "linkable/ready_scan/" + suffix,
+                 [&](long operations) {
+                     long message, sum = 0;
+                     for (long op = 0; op < operations; ++op) {
+                         for (int i = 0; i < numberOfActive; ++i) {
+                             message = op;
+                             source.SendRequestByHandle(handles[i * spacing],
+                                                        &message);
+                         }
+                         hub.ForEachReadyRequest([&](int i) {
+                             hub.ReceiveRequestByHandle(
+                                 hub.ResolveConnectionForAConnection(i),
+                                 &message);
+                             sum += message;
+                         });
+                     }
+                     benchSink = sum;
+                 },
+                 results);
+    }
+};
+
+void BenchClockLoop(const BenchOptions& options,
+                    std::vector<BenchResult>& results) {
+    static const int counts[] = {2, 64, 1024};
+
+    for (unsigned int c = 0; c < sizeof(counts) / sizeof(counts[0]); ++c) {
+        int numberOfComponents = counts[c];
+
+        std::vector<RingStage*> stages;
+        sinuca::engine::Engine engine;
+        for (int i = 0; i < numberOfComponents; ++i) {
+            stages.push_back(new RingStage());
+            engine.AddComponent(stages.back());
+        }
+        for (int i = 0; i < numberOfComponents; ++i) {
+            RingStage* next = stages[(i + 1) % numberOfComponents];
+            int id = next->ConnectToComponent(4);
+            stages[i]->next = stages[i]->ResolveConnectionToComponent(next, id);
+        }
+
+        /* One operation is one cycle of the whole engine. */
+        RunBench(options,
+                 "engine/clock_loop/" + std::to_string(numberOfComponents) +
+                     "_components",
+                 [&](long operations) {
+                     engine.Simulate(operations);
+                     benchSink = stages[0]->received;
+                 },
+                 results);
+
+        for (int i = 0; i < numberOfComponents; ++i) delete stages[i];
+    }
+};
+
+/**
+ * @brief The ring of BenchClockLoop as a StaticGraph of Count stages.
+ */
+template <std::size_t Count>
+void BenchStaticClockLoop(const BenchOptions& options,
+                          std::vector<BenchResult>& results) {
+    typedef sinuca::engine::StaticGraph<
+        sinuca::engine::StaticRepeat<StaticRingStage, Count>,
+        sinuca::engine::StaticRepeat<StaticRingLink, Count> >
+        Graph;
+
+    /* Too large for the stack with many stages. */
+    Graph* graph = new Graph();
+    std::vector<StaticRingLink*> links;
+    graph->ForEachConnection(
+        [&](std::size_t, StaticRingLink& link) { links.push_back(&link); });
+    graph->ForEachComponent([&](std::size_t i, StaticRingStage& stage) {
+        stage.next = links[i];
+        stage.previous = links[(i + Count - 1) % Count];
+    });
+
+    RunBench(options,
+             "engine/static_clock_loop/" + std::to_string(Count) +
+                 "_components",
+             [&](long operations) {
+                 graph->Simulate(operations);
+                 benchSink = graph->template GetComponent<0>().received;
+             },
+             results);
+
+    delete graph;
+};
+
+void BenchBTB(const BenchOptions& options, std::vector<BenchResult>& results) {
+    static const unsigned int entryBits[] = {6, 10, 14};
+    static const unsigned int bankBits = 2;
+    static const int addresses = 4096;
+
+    for (unsigned int e = 0; e < sizeof(entryBits) / sizeof(entryBits[0]);
+         ++e) {
+        BranchTargetBuffer btb;
+        btb.allocate(bankBits, entryBits[e]);
+
+        /* Half of the addresses are registered, so lookups mix hits and
+         * misses. */
+        std::vector<uint64_t> fetchAddresses(addresses);
+        uint64_t targets[1 << bankBits];
+        bool executed[1 << bankBits];
+        srand(42);
+        for (int i = 0; i < addresses; ++i) {
+            fetchAddresses[i] = ((uint64_t)rand()) << bankBits;
+            for (int b = 0; b < (1 << bankBits); ++b) {
+                targets[b] = fetchAddresses[i] + 0x100;
+                executed[b] = (b % 2);
+            }
+            if (i % 2) btb.registerNewBlock(fetchAddresses[i], targets);
+        }
+
+        std::string suffix = std::to_string(1 << entryBits[e]) + "_entries";
+
+        RunBench(options, "btb/lookup/" + suffix,
+                 [&](long operations) {
+                     unsigned long sum = 0;
+                     for (long op = 0; op < operations; ++op) {
+                         sum += btb.fetchBTBEntry(
+                             fetchAddresses[op & (addresses - 1)]);
+                     }
+                     benchSink = sum + btb.getNextFetchBlock();
+                 },
+                 results);
+
+        RunBench(options, "btb/update/" + suffix,
+                 [&](long operations) {
+                     for (long op = 0; op < operations; ++op) {
+                         btb.updateBlock(fetchAddresses[op & (addresses - 1)],
+                                         executed);
+                     }
+                 },
+                 results);
+    }
+};
+
+void Usage(const char* program) {
+    fprintf(stderr,
+            "Usage: %s [--json] [--repetitions <n>] [--min-time <ms>] "
+            "[--filter <substring>]\n",
+            program);
+};
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    BenchOptions options;
+    options.repetitions = 10;
+    options.minTime = 0.02;
+    options.json = false;
+    options.filter = NULL;
+
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--json") == 0) {
+            options.json = true;
+        } else if (strcmp(argv[i], "--repetitions") == 0 && i + 1 < argc) {
+            options.repetitions = std::max(1, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--min-time") == 0 && i + 1 < argc) {
+            options.minTime = atof(argv[++i]) / 1e3;
+        } else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            options.filter = argv[++i];
+        } else {
+            Usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (!options.json) {
+        printf("%-44s %12s %10s %10s %10s %14s\n", "benchmark", "ns/op",
+               "median", "stddev", "min", "ops/s");
+    }
+
+    std::vector<BenchResult> results;
+    BenchCircularBuffer(options, results);
+    BenchByteRing(options, results);
+    BenchRoundTrip(options, results);
+    BenchReadyScan(options, results);
+    BenchClockLoop(options, results);
+    BenchStaticClockLoop<2>(options, results);
+    BenchStaticClockLoop<64>(options, results);
+    BenchBTB(options, results);
+
+    if (options.json) PrintJSON(options, results);
+
+    return 0;
+}
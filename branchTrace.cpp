@@ -0,0 +1,182 @@
+//
+// Copyright (C) 2024  HiPES - Universidade Federal do Paraná
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/**
+ * @file branchTrace.cpp
+ * @brief Implementation of the branch trace reader and generator.
+ */
+
+#include "branchTrace.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+static const char BRANCH_TRACE_MAGIC[8] = {'S', 'N', 'C', '3',
+                                           'B', 'R', 'T', '1'};
+static const unsigned long WRITE_CHUNK = 4096; /**< Records per fwrite. */
+
+sinuca::BranchTraceReader::BranchTraceReader()
+    : mapping(NULL), mappingSize(0), records(NULL), count(0){};
+
+int sinuca::BranchTraceReader::Open(const char* fileName) {
+    this->Close();
+
+    int file = open(fileName, O_RDONLY);
+    if (file < 0) {
+        fprintf(stderr, "Could not open branch trace %s: %s\n", fileName,
+                strerror(errno));
+        return 1;
+    }
+
+    struct stat status;
+    if (fstat(file, &status) != 0 ||
+        (unsigned long)status.st_size < sizeof(BranchTraceHeader)) {
+        fprintf(stderr, "%s is not a branch trace.\n", fileName);
+        close(file);
+        return 1;
+    }
+
+    void* mapping =
+        mmap(NULL, status.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+    close(file);
+    if (mapping == MAP_FAILED) {
+        fprintf(stderr, "Could not map branch trace %s: %s\n", fileName,
+                strerror(errno));
+        return 1;
+    }
+
+    const BranchTraceHeader* header = (const BranchTraceHeader*)mapping;
+    unsigned long available =
+        (status.st_size - sizeof(BranchTraceHeader)) / sizeof(BranchRecord);
+    if (memcmp(header->magic, BRANCH_TRACE_MAGIC, sizeof(BRANCH_TRACE_MAGIC)) !=
+            0 ||
+        header->count > available) {
+        fprintf(stderr, "%s is not a branch trace.\n", fileName);
+        munmap(mapping, status.st_size);
+        return 1;
+    }
+
+    /* The trace is read once, front to back, by every thread. */
+    madvise(mapping, status.st_size, MADV_SEQUENTIAL);
+
+    const BranchRecord* records = (const BranchRecord*)(header + 1);
+    for (unsigned long i = 0; i < header->count; ++i) {
+        if (records[i].asid >= BRANCH_TRACE_ASIDS) {
+            fprintf(stderr,
+                    "Record %lu of %s has ASID %u, ASIDs must be below %u.\n",
+                    i, fileName, records[i].asid, BRANCH_TRACE_ASIDS);
+            munmap(mapping, status.st_size);
+            return 1;
+        }
+    }
+
+    this->mapping = mapping;
+    this->mappingSize = status.st_size;
+    this->records = records;
+    this->count = header->count;
+
+    return 0;
+};
+
+void sinuca::BranchTraceReader::Close() {
+    if (this->mapping) munmap(this->mapping, this->mappingSize);
+    this->mapping = NULL;
+    this->mappingSize = 0;
+    this->records = NULL;
+    this->count = 0;
+};
+
+sinuca::BranchTraceReader::~BranchTraceReader() { this->Close(); };
+
+static inline uint64_t NextRandom(uint64_t* state) {
+    /* xorshift64*, good enough for synthetic traces. */
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 0x2545F4914F6CDD1DULL;
+};
+
+int sinuca::WriteSyntheticBranchTrace(const char* fileName,
+                                      unsigned long records,
+                                      unsigned long branches,
+                                      unsigned long seed,
+                                      unsigned long threads) {
+    if (!branches || !threads) {
+        fprintf(stderr,
+                "A synthetic trace needs at least one branch and thread.\n");
+        return 1;
+    }
+    if (threads > BRANCH_TRACE_ASIDS) {
+        fprintf(stderr, "A synthetic trace has at most %u threads.\n",
+                BRANCH_TRACE_ASIDS);
+        return 1;
+    }
+
+    FILE* output = fopen(fileName, "wb");
+    if (!output) {
+        fprintf(stderr, "Could not open %s: %s\n", fileName, strerror(errno));
+        return 1;
+    }
+
+    uint64_t state = seed ? seed : 1;
+    std::vector<BranchRecord> code(branches * threads);
+    std::vector<uint32_t> bias(branches * threads); /**< Taken probability,
+                                                       of 256. */
+    for (unsigned long i = 0; i < branches * threads; ++i) {
+        code[i].address = 0x100000 + NextRandom(&state) % (1UL << 24);
+        code[i].target = 0x100000 + NextRandom(&state) % (1UL << 24);
+        code[i].taken = 0;
+        code[i].asid = i / branches;
+        bias[i] = NextRandom(&state) % 257;
+    }
+
+    BranchTraceHeader header;
+    memcpy(header.magic, BRANCH_TRACE_MAGIC, sizeof(BRANCH_TRACE_MAGIC));
+    header.count = records;
+    fwrite(&header, sizeof(header), 1, output);
+
+    std::vector<BranchRecord> chunk;
+    chunk.reserve(WRITE_CHUNK);
+    for (unsigned long i = 0; i < records; ++i) {
+        /* The product of two uniform picks favors the low branches. */
+        unsigned long branch = (NextRandom(&state) % branches) *
+                               (NextRandom(&state) % branches) / branches;
+        if (threads > 1) branch += (NextRandom(&state) % threads) * branches;
+        BranchRecord record = code[branch];
+        record.taken = (NextRandom(&state) % 256) < bias[branch];
+        chunk.push_back(record);
+
+        if (chunk.size() == WRITE_CHUNK || i + 1 == records) {
+            fwrite(chunk.data(), sizeof(BranchRecord), chunk.size(), output);
+            chunk.clear();
+        }
+    }
+
+    if (fclose(output) != 0) {
+        fprintf(stderr, "Could not write %s: %s\n", fileName, strerror(errno));
+        return 1;
+    }
+
+    return 0;
+};
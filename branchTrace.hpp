@@ -0,0 +1,98 @@
+#ifndef SINUCA3_UTILS_BRANCH_TRACE_HPP_
+#define SINUCA3_UTILS_BRANCH_TRACE_HPP_
+
+//
+// Copyright (C) 2024  HiPES - Universidade Federal do Paraná
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/**
+ * @file branchTrace.hpp
+ * @brief Binary traces of executed branches, used to drive BTB models.
+ * @details A trace is a BranchTraceHeader followed by count fixed-size
+ * BranchRecords, so it can be mapped and read in place without decoding.
+ * Addresses count instructions, as the BTB banks do.
+ */
+
+#include <cstdint>
+
+namespace sinuca {
+
+struct BranchTraceHeader {
+    char magic[8];
+    uint64_t count; /**< Number of records. */
+};
+
+/** ASIDs of a trace are below this, the BTBs keep 8 bits of them. */
+static const uint32_t BRANCH_TRACE_ASIDS = 256;
+
+struct BranchRecord {
+    uint64_t address; /**< Address of the branch. */
+    uint64_t target;  /**< Target, meaningful when taken. */
+    uint32_t taken;
+    uint32_t asid; /**< Address space (process or hardware thread) of the
+                      branch, 0 in single-threaded traces. */
+};
+
+/**
+ * @brief Read-only view of a branch trace file.
+ * @details The file is mapped, so every thread reading the records shares the
+ * same pages and nothing is copied.
+ */
+class BranchTraceReader {
+  private:
+    void* mapping;
+    unsigned long mappingSize;
+    const BranchRecord* records;
+    unsigned long count;
+
+  public:
+    BranchTraceReader();
+
+    /**
+     * @brief Maps a trace file, and checks that its ASIDs are below
+     * BRANCH_TRACE_ASIDS.
+     * @returns Non-zero on error, 0 otherwise.
+     */
+    int Open(const char* fileName);
+
+    /**
+     * @brief Unmaps the file. Called by the destructor.
+     */
+    void Close();
+
+    inline const BranchRecord* GetRecords() const { return this->records; }
+    inline unsigned long GetCount() const { return this->count; }
+
+    ~BranchTraceReader();
+};
+
+/**
+ * @brief Writes a synthetic trace, for sweeps without a real trace at hand.
+ * @param branches Number of static branches. Each has a fixed target and a
+ * taken bias, and they are executed with a skewed frequency so that a small
+ * set of them is hot.
+ * @param threads Address spaces the records are spread over at random, up to
+ * BRANCH_TRACE_ASIDS. Each runs its own branches, laid out in the same range
+ * of addresses as the others, as processes of different programs would be.
+ * @returns Non-zero on error, 0 otherwise.
+ */
+int WriteSyntheticBranchTrace(const char* fileName, unsigned long records,
+                              unsigned long branches, unsigned long seed,
+                              unsigned long threads = 1);
+
+}  // namespace sinuca
+
+#endif  // SINUCA3_UTILS_BRANCH_TRACE_HPP_
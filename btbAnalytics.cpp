@@ -0,0 +1,213 @@
+#include "btbAnalytics.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <sys/types.h>
+
+/* ==========================================================================
+    Count-Min Sketch Methods
+   ========================================================================== */
+
+CountMinSketch::CountMinSketch() : counters(nullptr), widthBits(0), depth(0) {};
+
+void CountMinSketch::allocate(sinuca::memory::Account* account, uint widthBits, uint depth) {
+    this->widthBits = widthBits;
+    this->depth = depth;
+    this->counters = sinuca::memory::Allocate<uint32_t>(account, (unsigned long)depth << widthBits);
+    memset(counters, 0, getBytes());
+};
+
+uint32_t CountMinSketch::add(uint64_t address) {
+    uint32_t* rows[BTB_ANALYTICS_MAX_DEPTH];
+    uint32_t minimum = UINT32_MAX;
+
+    for (uint row = 0; row < depth; ++row) {
+        rows[row] = counter(row, address);
+        minimum = std::min(minimum, *rows[row]);
+    }
+
+    /* Conservative update: only the counters at the minimum can be exact, the others already overestimate. */
+    if (minimum == UINT32_MAX) {
+        return minimum;
+    }
+    for (uint row = 0; row < depth; ++row) {
+        if (*rows[row] == minimum) {
+            (*rows[row])++;
+        }
+    }
+
+    return minimum + 1;
+};
+
+uint32_t CountMinSketch::estimate(uint64_t address) {
+    uint32_t minimum = UINT32_MAX;
+
+    for (uint row = 0; row < depth; ++row) {
+        minimum = std::min(minimum, *counter(row, address));
+    }
+
+    return depth ? minimum : 0;
+};
+
+unsigned long CountMinSketch::getBytes() {
+    return ((unsigned long)depth << widthBits) * sizeof(uint32_t);
+};
+
+CountMinSketch::~CountMinSketch() {
+    sinuca::memory::Free(counters);
+};
+
+/* ==========================================================================
+    Space-Saving Methods
+   ========================================================================== */
+
+SpaceSaving::SpaceSaving() : slots(nullptr), capacity(0), used(0) {};
+
+void SpaceSaving::allocate(sinuca::memory::Account* account, uint capacity) {
+    this->capacity = capacity;
+    this->used = 0;
+    this->slots = sinuca::memory::Allocate<btb_hot_block>(account, capacity);
+};
+
+void SpaceSaving::add(uint64_t address) {
+    uint minimum = 0;
+
+    for (uint i = 0; i < used; ++i) {
+        if (slots[i].address == address) {
+            slots[i].count++;
+            return;
+        }
+        if (slots[i].count < slots[minimum].count) {
+            minimum = i;
+        }
+    }
+
+    if (used < capacity) {
+        slots[used].address = address;
+        slots[used].count = 1;
+        slots[used].error = 0;
+        used++;
+        return;
+    }
+
+    slots[minimum].address = address;
+    slots[minimum].error = slots[minimum].count;
+    slots[minimum].count++;
+};
+
+uint SpaceSaving::getTracked(btb_hot_block* tracked) {
+    std::copy(slots, slots + used, tracked);
+    return used;
+};
+
+unsigned long SpaceSaving::getBytes() {
+    return capacity * sizeof(btb_hot_block);
+};
+
+SpaceSaving::~SpaceSaving() {
+    sinuca::memory::Free(slots);
+};
+
+/* ==========================================================================
+    BTB Analytics Methods
+   ========================================================================== */
+
+BTBAnalytics::BTBAnalytics() : sorted(nullptr), topK(0), totalBanks(0), totalEntries(0), bankConflicts(nullptr),
+    indexConflicts(nullptr), misses(0), mispredictions(0), conflicts(0) {};
+
+void BTBAnalytics::allocate(sinuca::memory::Account* account, uint topK, uint widthBits, uint depth, uint totalBanks,
+                            uint totalEntries) {
+    this->topK = topK;
+    this->totalBanks = totalBanks;
+    this->totalEntries = totalEntries;
+
+    missSketch.allocate(account, widthBits, depth);
+    mispredictionSketch.allocate(account, widthBits, depth);
+    hotMisses.allocate(account, topK);
+    hotMispredictions.allocate(account, topK);
+    sorted = sinuca::memory::Allocate<btb_hot_block>(account, topK);
+    bankConflicts = sinuca::memory::Allocate<uint64_t>(account, totalBanks);
+    indexConflicts = sinuca::memory::Allocate<uint32_t>(account, totalEntries);
+    memset(bankConflicts, 0, totalBanks * sizeof(uint64_t));
+    memset(indexConflicts, 0, totalEntries * sizeof(uint32_t));
+};
+
+uint32_t BTBAnalytics::estimateMisses(uint64_t fetchAddress) {
+    return missSketch.estimate(fetchAddress);
+};
+
+uint32_t BTBAnalytics::estimateMispredictions(uint64_t fetchAddress) {
+    return mispredictionSketch.estimate(fetchAddress);
+};
+
+void BTBAnalytics::dumpHot(FILE* output, const char* prefix, const char* name, SpaceSaving& summary,
+                           CountMinSketch& sketch) {
+    uint count = summary.getTracked(sorted);
+
+    /* Both bound the real count from above, the tighter one is reported with the guaranteed minimum. */
+    for (uint i = 0; i < count; ++i) {
+        uint64_t lower = sorted[i].count - sorted[i].error;
+        sorted[i].count = std::min<uint64_t>(sorted[i].count, sketch.estimate(sorted[i].address));
+        sorted[i].error = sorted[i].count - std::min(lower, sorted[i].count);
+    }
+    std::sort(sorted, sorted + count, [](const btb_hot_block& a, const btb_hot_block& b) {
+        return (a.count != b.count) ? (a.count > b.count) : (a.address < b.address);
+    });
+
+    for (uint i = 0; i < count; ++i) {
+        fprintf(output, "%s.%s.%u: 0x%lx %lu (at least %lu)\n", prefix, name, i, (unsigned long)sorted[i].address,
+                (unsigned long)sorted[i].count, (unsigned long)(sorted[i].count - sorted[i].error));
+    }
+};
+
+void BTBAnalytics::dump(FILE* output, const char* prefix) {
+    fprintf(output, "%s.misses: %lu\n", prefix, (unsigned long)misses);
+    fprintf(output, "%s.mispredictions: %lu\n", prefix, (unsigned long)mispredictions);
+    fprintf(output, "%s.conflicts: %lu\n", prefix, (unsigned long)conflicts);
+    dumpHot(output, prefix, "hot_misses", hotMisses, missSketch);
+    dumpHot(output, prefix, "hot_mispredictions", hotMispredictions, mispredictionSketch);
+
+    for (uint bank = 0; bank < totalBanks; ++bank) {
+        fprintf(output, "%s.bank_conflicts.%u: %lu\n", prefix, bank, (unsigned long)bankConflicts[bank]);
+    }
+
+    /* Kept sorted by insertion, the list is short. */
+    uint32_t topIndices[BTB_ANALYTICS_TOP_INDICES];
+    uint numTop = 0;
+    for (uint32_t index = 0; index < totalEntries; ++index) {
+        if (!indexConflicts[index]) {
+            continue;
+        }
+
+        uint position = numTop;
+        while (position > 0 && indexConflicts[topIndices[position - 1]] < indexConflicts[index]) {
+            position--;
+        }
+        if (position >= BTB_ANALYTICS_TOP_INDICES) {
+            continue;
+        }
+
+        uint last = std::min(numTop, BTB_ANALYTICS_TOP_INDICES - 1);
+        for (uint i = last; i > position; --i) {
+            topIndices[i] = topIndices[i - 1];
+        }
+        topIndices[position] = index;
+        numTop = last + 1;
+    }
+    for (uint i = 0; i < numTop; ++i) {
+        fprintf(output, "%s.index_conflicts.%u: %u %u\n", prefix, i, topIndices[i], indexConflicts[topIndices[i]]);
+    }
+};
+
+unsigned long BTBAnalytics::getBytes() {
+    return missSketch.getBytes() + mispredictionSketch.getBytes() + hotMisses.getBytes() +
+           hotMispredictions.getBytes() + topK * sizeof(btb_hot_block) + totalBanks * sizeof(uint64_t) +
+           totalEntries * sizeof(uint32_t);
+};
+
+BTBAnalytics::~BTBAnalytics() {
+    sinuca::memory::Free(sorted);
+    sinuca::memory::Free(bankConflicts);
+    sinuca::memory::Free(indexConflicts);
+};
@@ -0,0 +1,166 @@
+#ifndef BTB_ANALYTICS
+#define BTB_ANALYTICS
+
+/**
+ * @file btbAnalytics.hpp
+ * @brief Per-address statistics of a BTB in constant memory
+ * @details Misses and mispredictions are counted per fetch address by a count-min sketch, which estimates the count
+ * of any address (never below the real one), and a space-saving summary, which keeps the topK addresses with the
+ * most events. Conflicts, lookups that found the entry of another block, are counted per bank and per index.
+ * Updating is a few multiplications and a scan of the topK slots, so the analytics can stay on during long runs.
+ */
+#include <cstdint>
+#include <cstdio>
+#include <sys/types.h>
+#include "memory.hpp"
+
+static const uint BTB_ANALYTICS_MAX_DEPTH = 8;
+static const uint BTB_ANALYTICS_TOP_INDICES = 8;   /**< Most conflicting indices dumped. */
+
+/**
+ * @brief A fetch address tracked by a space-saving summary
+ * @details The real count is between count - error and count.
+ */
+struct btb_hot_block {
+    uint64_t address;
+    uint64_t count;
+    uint64_t error;
+};
+
+/**
+ * @brief Count-min sketch of depth rows of 2^widthBits counters, with conservative update
+ */
+class CountMinSketch {
+    private:
+        uint32_t* counters;
+        uint widthBits, depth;
+
+        inline uint32_t* counter(uint row, uint64_t address) {
+            /* Multiply-shift hashing, one odd multiplier per row. */
+            static const uint64_t multipliers[BTB_ANALYTICS_MAX_DEPTH] = {
+                0x9e3779b97f4a7c15ULL, 0xbf58476d1ce4e5b9ULL, 0x94d049bb133111ebULL, 0xd6e8feb86659fd93ULL,
+                0xa0761d6478bd642fULL, 0xe7037ed1a0b428dbULL, 0x8ebc6af09c88c6e3ULL, 0x589965cc75374cc3ULL};
+            return &counters[((uint64_t)row << widthBits) + ((address * multipliers[row]) >> (64 - widthBits))];
+        };
+
+    public:
+        CountMinSketch();
+
+        void allocate(sinuca::memory::Account* account, uint widthBits, uint depth);
+
+        /**
+         * @brief Counts one event of an address
+         * @return The new estimate of the address
+         */
+        uint32_t add(uint64_t address);
+
+        /**
+         * @return An upper bound of the events of an address
+         */
+        uint32_t estimate(uint64_t address);
+
+        unsigned long getBytes();
+
+        ~CountMinSketch();
+};
+
+/**
+ * @brief Space-saving summary of the capacity most frequent addresses
+ * @details An address that is not tracked replaces the one with the lowest count, inheriting it as its error.
+ */
+class SpaceSaving {
+    private:
+        btb_hot_block* slots;
+        uint capacity, used;
+
+    public:
+        SpaceSaving();
+
+        void allocate(sinuca::memory::Account* account, uint capacity);
+
+        void add(uint64_t address);
+
+        /**
+         * @brief Copies the tracked addresses, in no particular order
+         * @return The number of tracked addresses
+         */
+        uint getTracked(btb_hot_block* tracked);
+
+        unsigned long getBytes();
+
+        ~SpaceSaving();
+};
+
+class BTBAnalytics {
+    private:
+        CountMinSketch missSketch, mispredictionSketch;
+        SpaceSaving hotMisses, hotMispredictions;
+        btb_hot_block* sorted;            /**< Scratch of dump. */
+        uint topK;
+        uint totalBanks, totalEntries;
+        uint64_t* bankConflicts;
+        uint32_t* indexConflicts;         /**< Summed over the banks. */
+        uint64_t misses, mispredictions, conflicts;
+
+        void dumpHot(FILE* output, const char* prefix, const char* name, SpaceSaving& summary, CountMinSketch& sketch);
+
+    public:
+        BTBAnalytics();
+
+        /**
+         * @brief Allocates the sketches and counters, charged to account
+         * @param topK Addresses kept by each summary
+         * @param widthBits, depth Geometry of the sketches, up to BTB_ANALYTICS_MAX_DEPTH rows
+         */
+        void allocate(sinuca::memory::Account* account, uint topK, uint widthBits, uint depth, uint totalBanks,
+                      uint totalEntries);
+
+        inline void recordMiss(uint64_t fetchAddress) {
+            misses++;
+            missSketch.add(fetchAddress);
+            hotMisses.add(fetchAddress);
+        };
+
+        /**
+         * @brief Counts a block whose executed instructions differ from the prediction of some bank
+         */
+        inline void recordMisprediction(uint64_t fetchAddress) {
+            mispredictions++;
+            mispredictionSketch.add(fetchAddress);
+            hotMispredictions.add(fetchAddress);
+        };
+
+        /**
+         * @brief Counts a lookup that found the entry of another block
+         */
+        inline void recordConflict(uint bank, uint32_t index) {
+            conflicts++;
+            bankConflicts[bank]++;
+            indexConflicts[index]++;
+        };
+
+        /**
+         * @return The estimated misses of a fetch address
+         */
+        uint32_t estimateMisses(uint64_t fetchAddress);
+
+        /**
+         * @return The estimated mispredictions of a fetch address
+         */
+        uint32_t estimateMispredictions(uint64_t fetchAddress);
+
+        /**
+         * @brief Prints the totals, the hot addresses, the conflicts per bank and the most conflicting indices
+         * @param prefix Of every line, e.g. "btb.analytics"
+         */
+        void dump(FILE* output, const char* prefix);
+
+        /**
+         * @return The memory used, which does not depend on the run
+         */
+        unsigned long getBytes();
+
+        ~BTBAnalytics();
+};
+
+#endif
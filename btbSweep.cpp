@@ -0,0 +1,264 @@
+//
+// Copyright (C) 2024  HiPES - Universidade Federal do Paraná
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/**
+ * @file btbSweep.cpp
+ * @brief Runs a branch trace through many BTB configurations in one pass.
+ * @details The configurations are the BranchTargetBuffer components of a
+ * topology file, e.g. one line per point of the sweep. The trace is mapped
+ * once and every thread walks it for its own chunk of configurations, so the
+ * cost of a sweep is one trace read plus the table updates of each point.
+ *
+ * Each thread also finishes the setup of its configurations, so their tables
+ * are first touched, and thus placed, on the NUMA node the thread runs on.
+ * With -H the tables can be put on huge pages.
+ */
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include "branchTrace.hpp"
+#include "configLoader.hpp"
+#include "interleavedBTB.hpp"
+#include "memory.hpp"
+
+/** Records run through one configuration before moving to the next, so the
+ * slice stays in cache while the configurations of a thread take turns. */
+static const unsigned long SWEEP_SLICE = 16384;
+
+/** Aligned so that threads never write to the same cache line. */
+struct alignas(64) SweepPoint {
+    const char* name;
+    BranchTargetBuffer* btb;
+    std::vector<uint64_t> targets; /**< One per bank. */
+    bool* executedBits;            /**< One per bank. */
+    unsigned long lookups;
+    unsigned long hits;
+    unsigned long taken;
+    unsigned long mispredictions; /**< Wrong direction or wrong target. */
+};
+
+static void Usage(const char* program) {
+    fprintf(stderr,
+            "Usage: %s -c <topology> -t <branch trace> [-j <threads>] "
+            "[-H default|thp|2m|1g] [-p <component>.<parameter>=<value>]...\n"
+            "       %s -t <branch trace> -g <records> [-b <branches>] "
+            "[-s <seed>] [-T <threads>]\n",
+            program, program);
+};
+
+/**
+ * @brief Feeds one record to a configuration.
+ * @details The whole block of the branch is allocated with its target, so a
+ * hit predicts the target and the predictor of the bank of the branch gives
+ * the direction.
+ */
+static inline void RunRecord(SweepPoint& point,
+                             const sinuca::BranchRecord& record) {
+    BranchTargetBuffer* btb = point.btb;
+    uint totalBanks = btb->getTotalBanks();
+    uint bank = record.address & (totalBanks - 1);
+
+    ++point.lookups;
+    point.taken += record.taken;
+
+    if (btb->fetchBTBEntry(record.address, record.asid) == ALLOCATED_ENTRY) {
+        ++point.hits;
+        bool predictedTaken = btb->getInstructionValidBits()[bank];
+        if (predictedTaken != (bool)record.taken ||
+            (record.taken && btb->getNextFetchBlock() != record.target)) {
+            ++point.mispredictions;
+        }
+    } else {
+        if (record.taken) ++point.mispredictions;
+        std::fill(point.targets.begin(), point.targets.end(), record.target);
+        btb->registerNewBlock(record.address, point.targets.data(),
+                              record.asid);
+    }
+
+    /* Only the branch itself may be skipped, the rest of the block runs. */
+    for (uint i = 0; i < totalBanks; ++i) point.executedBits[i] = true;
+    point.executedBits[bank] = record.taken;
+    btb->updateBlock(record.address, point.executedBits, record.asid);
+};
+
+/**
+ * @brief Finishes the setup of a chunk of points, then runs the trace
+ * through them.
+ * @details Failures are reported through the error flag and skip the run.
+ */
+static void RunPoints(sinuca::config::Topology* topology, SweepPoint* points,
+                      unsigned long first, unsigned long numberOfPoints,
+                      const sinuca::BranchRecord* records, unsigned long count,
+                      std::atomic<bool>* error) {
+    for (unsigned long p = 0; p < numberOfPoints; ++p) {
+        SweepPoint& point = points[p];
+        if (topology->FinishSetup(first + p)) {
+            error->store(true);
+            return;
+        }
+        point.targets.resize(point.btb->getTotalBanks());
+        point.executedBits = new bool[point.btb->getTotalBanks()]();
+    }
+
+    for (unsigned long start = 0; start < count; start += SWEEP_SLICE) {
+        unsigned long end = std::min(count, start + SWEEP_SLICE);
+        for (unsigned long p = 0; p < numberOfPoints; ++p) {
+            for (unsigned long i = start; i < end; ++i) {
+                RunRecord(points[p], records[i]);
+            }
+        }
+    }
+};
+
+int main(int argc, char** argv) {
+    const char* topologyFile = NULL;
+    const char* traceFile = NULL;
+    unsigned long threads = std::thread::hardware_concurrency();
+    unsigned long generate = 0;
+    unsigned long branches = 4096;
+    unsigned long seed = 1;
+    unsigned long traceThreads = 1;
+    std::vector<const char*> overrides;
+    sinuca::memory::PagePolicy pagePolicy = sinuca::memory::PagePolicyDefault;
+    int option;
+
+    while ((option = getopt(argc, argv, "c:t:j:p:g:b:s:T:H:h")) != -1) {
+        switch (option) {
+            case 'c':
+                topologyFile = optarg;
+                break;
+            case 't':
+                traceFile = optarg;
+                break;
+            case 'j':
+                threads = strtoul(optarg, NULL, 0);
+                break;
+            case 'p':
+                overrides.push_back(optarg);
+                break;
+            case 'g':
+                generate = strtoul(optarg, NULL, 0);
+                break;
+            case 'b':
+                branches = strtoul(optarg, NULL, 0);
+                break;
+            case 's':
+                seed = strtoul(optarg, NULL, 0);
+                break;
+            case 'T':
+                traceThreads = strtoul(optarg, NULL, 0);
+                break;
+            case 'H':
+                if (sinuca::memory::ParsePagePolicy(optarg, &pagePolicy))
+                    return 1;
+                break;
+            default:
+                Usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (traceFile && generate) {
+        return sinuca::WriteSyntheticBranchTrace(traceFile, generate, branches,
+                                                 seed, traceThreads);
+    }
+
+    if (!topologyFile || !traceFile) {
+        Usage(argv[0]);
+        return 1;
+    }
+    if (!threads) threads = 1;
+    sinuca::memory::SetPagePolicy(pagePolicy);
+
+    sinuca::config::Topology topology;
+    if (topology.ReadFile(topologyFile)) return 1;
+    for (unsigned long i = 0; i < overrides.size(); ++i) {
+        if (topology.SetOverride(overrides[i])) return 1;
+    }
+    if (topology.Build(false)) return 1;
+    if (!topology.GetNumberOfComponents()) {
+        fprintf(stderr, "%s has no configurations.\n", topologyFile);
+        return 1;
+    }
+
+    std::vector<SweepPoint> points(topology.GetNumberOfComponents());
+    for (long i = 0; i < topology.GetNumberOfComponents(); ++i) {
+        SweepPoint& point = points[i];
+        point.name = topology.GetComponentName(i);
+        point.btb = dynamic_cast<BranchTargetBuffer*>(topology.GetComponent(i));
+        if (!point.btb) {
+            fprintf(stderr, "%s is not a BranchTargetBuffer.\n", point.name);
+            return 1;
+        }
+
+        point.executedBits = NULL;
+        point.lookups = point.hits = point.taken = point.mispredictions = 0;
+    }
+
+    sinuca::BranchTraceReader trace;
+    if (trace.Open(traceFile)) return 1;
+
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+
+    /* Contiguous chunks of points, one per thread. */
+    threads = std::min(threads, (unsigned long)points.size());
+    std::vector<std::thread> workers;
+    std::atomic<bool> error(false);
+    unsigned long perThread = (points.size() + threads - 1) / threads;
+    for (unsigned long first = 0; first < points.size(); first += perThread) {
+        unsigned long chunk = std::min(perThread, points.size() - first);
+        workers.push_back(std::thread(RunPoints, &topology, &points[first],
+                                      first, chunk, trace.GetRecords(),
+                                      trace.GetCount(), &error));
+    }
+    for (unsigned long i = 0; i < workers.size(); ++i) workers[i].join();
+    if (error.load()) return 1;
+
+    double elapsed = std::chrono::duration<double, std::milli>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+    fprintf(stderr,
+            "Sweep: %lu configurations, %lu records, %lu threads, %.3f ms\n",
+            (unsigned long)points.size(), trace.GetCount(),
+            (unsigned long)workers.size(), elapsed);
+
+    for (unsigned long i = 0; i < points.size(); ++i) {
+        SweepPoint& point = points[i];
+        printf("# %s\n", point.name);
+        printf("sweep.lookups: %lu\n", point.lookups);
+        printf("sweep.hits: %lu\n", point.hits);
+        printf("sweep.hit_rate: %.4f\n",
+               point.lookups ? (double)point.hits / point.lookups : 0.0);
+        printf("sweep.taken: %lu\n", point.taken);
+        printf("sweep.mispredictions: %lu\n", point.mispredictions);
+        printf("sweep.misprediction_rate: %.4f\n",
+               point.lookups ? (double)point.mispredictions / point.lookups
+                             : 0.0);
+        delete[] point.executedBits;
+    }
+
+    return 0;
+}
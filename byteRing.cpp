@@ -0,0 +1,34 @@
+/**
+ * @file byteRing.cpp
+ * @brief Implementation of ByteRing class
+ */
+
+#include "byteRing.hpp"
+
+void ByteRing::Allocate(int capacity, void* storage) {
+    if (capacity <= 0) return;
+
+    this->capacity = RoundCapacity(capacity);
+    this->head = 0;
+    this->tail = 0;
+    this->used = 0;
+    this->records = 0;
+
+    if (storage) {
+        this->buffer = static_cast<char*>(storage);
+        this->ownsBuffer = false;
+        return;
+    }
+
+    this->buffer = reinterpret_cast<char*>(
+        new ByteRingRecord[this->capacity / sizeof(ByteRingRecord)]);
+    this->ownsBuffer = true;
+};
+
+void ByteRing::Deallocate() {
+    if (this->buffer) {
+        if (this->ownsBuffer)
+            delete[] reinterpret_cast<ByteRingRecord*>(this->buffer);
+        this->buffer = NULL;
+    }
+};
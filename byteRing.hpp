@@ -0,0 +1,289 @@
+#ifndef SINUCA3_UTILS_BYTE_RING_HPP_
+#define SINUCA3_UTILS_BYTE_RING_HPP_
+
+//
+// Copyright (C) 2024  HiPES - Universidade Federal do Paraná
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/**
+ * @file byteRing.hpp
+ * @brief Byte Ring Class
+ * @details A circular buffer of variable-length records, the storage of
+ * variable-length connections. Each record is a ByteRingRecord followed by
+ * its payload, padded so the next record stays aligned. A record is always
+ * contiguous: when it does not fit before the end of the ring, the tail is
+ * marked as skipped and the record starts over at offset 0, so the payload
+ * can be written and read in place.
+ */
+
+#include <cstddef>
+#include <cstring>
+
+struct ByteRingRecord {
+    unsigned int length; /**< Payload bytes, or BYTE_RING_SKIP. */
+    unsigned int reserved;
+};
+
+/** Alignment of records and payloads. */
+static const int BYTE_RING_ALIGNMENT = 8;
+/** Length marking the end of the ring as unused, see ByteRing. */
+static const unsigned int BYTE_RING_SKIP = ~0U;
+
+class ByteRing {
+  private:
+    char* buffer;       /**<The Buffer. */
+    int capacity;       /**<Size of the buffer, in bytes. */
+    int head;           /**<Offset of the oldest record. */
+    int tail;           /**<Offset of the next record. */
+    int used;           /**<Bytes taken by records and skipped ends. */
+    int records;        /**<Records committed and not released. */
+    bool ownsBuffer;    /**<False when the storage was provided by the caller. */
+    unsigned long* readyWord; /**<Optional flag word, see SetReadyFlag. */
+    unsigned long readyBit;   /**<Bit of the ring in readyWord. */
+
+  public:
+    ByteRing()
+        : buffer(NULL),
+          capacity(0),
+          head(0),
+          tail(0),
+          used(0),
+          records(0),
+          ownsBuffer(false),
+          readyWord(NULL),
+          readyBit(0){};
+
+    /**
+     * @brief Rounds a size in bytes up to the capacity of a ring.
+     */
+    static inline int RoundCapacity(int bytes) {
+        return (bytes + BYTE_RING_ALIGNMENT - 1) & ~(BYTE_RING_ALIGNMENT - 1);
+    };
+
+    /**
+     * @brief Bytes taken in the ring by a record of length bytes.
+     */
+    static inline int GetRecordSize(int length) {
+        return sizeof(ByteRingRecord) + RoundCapacity(length);
+    };
+
+    /**
+     * @brief Allocates the ring.
+     * @param capacity Size in bytes, rounded up with RoundCapacity.
+     * @param storage Optional pre-allocated region of RoundCapacity(capacity)
+     * bytes, aligned to BYTE_RING_ALIGNMENT. When provided, the ring uses it
+     * in place and never frees it, so its owner must outlive the ring.
+     */
+    void Allocate(int capacity, void* storage = NULL);
+
+    /**
+     * @brief Deallocates the ring.
+     */
+    void Deallocate();
+
+    /**
+     * @brief Returns a boolean indicating whether the ring is allocated.
+     */
+    inline bool IsAllocated() const { return (this->buffer != NULL); };
+
+    /**
+     * @brief Self-explanatory
+     */
+    inline int GetCapacity() const { return this->capacity; };
+
+    /**
+     * @brief Largest payload a record can have.
+     */
+    inline int GetMaxLength() const {
+        return this->capacity - (int)sizeof(ByteRingRecord);
+    };
+
+    /**
+     * @brief Bytes taken, including headers, padding and skipped ends.
+     */
+    inline int GetOccupation() const { return this->used; };
+
+    /**
+     * @brief Self-explanatory
+     */
+    inline int GetNumberOfRecords() const { return this->records; };
+
+    /**
+     * @brief Returns a boolean indicating whether the ring is empty.
+     */
+    inline bool IsEmpty() const { return (this->records == 0); };
+
+    /**
+     * @brief Same as CircularBuffer::SetReadyFlag, set while records are
+     * committed.
+     */
+    inline void SetReadyFlag(unsigned long* word, unsigned long bit) {
+        this->readyWord = word;
+        this->readyBit = bit;
+        if (word && !this->IsEmpty()) *word |= bit;
+    };
+
+    /**
+     * @brief Same as CircularBuffer::RefreshReadyFlag.
+     */
+    inline void RefreshReadyFlag() {
+        if (this->readyWord && !this->IsEmpty())
+            *this->readyWord |= this->readyBit;
+    };
+
+    /**
+     * @brief Reserves room for a record, to be written in place.
+     * @details The payload is invisible to the reader until Commit. A second
+     * Reserve before Commit replaces the reservation.
+     * @param length Payload bytes, or an upper bound of them.
+     * @return The contiguous payload, aligned to BYTE_RING_ALIGNMENT, or NULL
+     * if the ring has no room for it now.
+     */
+    inline void* Reserve(int length);
+
+    /**
+     * @brief Publishes the reserved record.
+     * @param length Payload bytes written, at most the length reserved.
+     */
+    inline void Commit(int length);
+
+    /**
+     * @brief Returns the oldest record, left in the ring.
+     * @param length Receives the payload bytes.
+     * @return The payload, writable until Release, or NULL if the ring is
+     * empty.
+     */
+    inline void* Front(int* length);
+
+    /**
+     * @brief Removes the oldest record. The ring must not be empty.
+     */
+    inline void Release();
+
+    /**
+     * @brief Copies a record in, with Reserve and Commit.
+     * @return 1 if successfuly, 0 otherwise.
+     */
+    inline bool Enqueue(const void* payload, int length);
+
+    /**
+     * @brief Copies the oldest record out and removes it.
+     * @param capacity Size of payload. A longer record stays in the ring.
+     * @param length Receives the payload bytes.
+     * @return 1 if successfuly, 0 if the ring is empty or the record does not
+     * fit.
+     */
+    inline bool Dequeue(void* payload, int capacity, int* length);
+
+    ~ByteRing() { Deallocate(); };
+};
+
+/*
+ * The fast path is defined here so it can be inlined, as with CircularBuffer.
+ * used counts every byte between head and tail, so capacity - used is the
+ * room left, split between the end of the ring and its start.
+ */
+
+inline void* ByteRing::Reserve(int length) {
+    int size = GetRecordSize(length);
+
+    /* An empty ring starts over at 0, which gives the largest contiguous
+     * room. */
+    if (!this->records) {
+        this->head = 0;
+        this->tail = 0;
+        this->used = 0;
+    }
+
+    if (this->tail + size > this->capacity) {
+        int skipped = this->capacity - this->tail;
+        if (this->used + skipped + size > this->capacity) return NULL;
+
+        reinterpret_cast<ByteRingRecord*>(this->buffer + this->tail)->length =
+            BYTE_RING_SKIP;
+        this->used += skipped;
+        this->tail = 0;
+    } else if (this->used + size > this->capacity) {
+        return NULL;
+    }
+
+    ByteRingRecord* record =
+        reinterpret_cast<ByteRingRecord*>(this->buffer + this->tail);
+    record->length = length;
+    record->reserved = 0;
+
+    return record + 1;
+};
+
+inline void ByteRing::Commit(int length) {
+    ByteRingRecord* record =
+        reinterpret_cast<ByteRingRecord*>(this->buffer + this->tail);
+    int size = GetRecordSize(length);
+
+    record->length = length;
+    this->tail += size;
+    if (this->tail == this->capacity) this->tail = 0;
+    this->used += size;
+    ++this->records;
+    if (this->readyWord) *this->readyWord |= this->readyBit;
+};
+
+inline void* ByteRing::Front(int* length) {
+    if (!this->records) return NULL;
+
+    ByteRingRecord* record =
+        reinterpret_cast<ByteRingRecord*>(this->buffer + this->head);
+    if (record->length == BYTE_RING_SKIP) {
+        this->used -= this->capacity - this->head;
+        this->head = 0;
+        record = reinterpret_cast<ByteRingRecord*>(this->buffer);
+    }
+
+    *length = record->length;
+    return record + 1;
+};
+
+inline void ByteRing::Release() {
+    int length = 0;
+    this->Front(&length);
+
+    int size = GetRecordSize(length);
+    this->head += size;
+    if (this->head == this->capacity) this->head = 0;
+    this->used -= size;
+    --this->records;
+    if (this->readyWord && !this->records) *this->readyWord &= ~this->readyBit;
+};
+
+inline bool ByteRing::Enqueue(const void* payload, int length) {
+    void* target = this->Reserve(length);
+    if (!target) return 0;
+
+    memcpy(target, payload, length);
+    this->Commit(length);
+    return 1;
+};
+
+inline bool ByteRing::Dequeue(void* payload, int capacity, int* length) {
+    void* source = this->Front(length);
+    if (!source || *length > capacity) return 0;
+
+    memcpy(payload, source, *length);
+    this->Release();
+    return 1;
+};
+
+#endif  // SINUCA3_UTILS_BYTE_RING_HPP_
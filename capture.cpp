@@ -0,0 +1,238 @@
+//
+// Copyright (C) 2024  HiPES - Universidade Federal do Paraná
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/**
+ * @file capture.cpp
+ * @brief Implementation of the message recorder and capture reader.
+ */
+
+#include "capture.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+
+static const char CAPTURE_MAGIC[8] = {'S', 'N', 'C', '3', 'C', 'A', 'P', '1'};
+static const unsigned long CAPTURE_FILE_BUFFER = 1UL << 20;
+
+static const sinuca::engine::MessageDirection DIRECTIONS[] = {
+    sinuca::engine::MessageRequestToDestination,
+    sinuca::engine::MessageResponseToSource,
+    sinuca::engine::MessageRequestToSource,
+    sinuca::engine::MessageResponseToDestination,
+};
+
+int sinuca::capture::MessageRecorder::AddStream(
+    const char* name, const char* destination, engine::Connection* connection,
+    engine::Linkable* recipient, int bufferSize, bool sourceFirst) {
+    if (strlen(name) >= CAPTURE_NAME_SIZE ||
+        strlen(destination) >= CAPTURE_NAME_SIZE) {
+        fprintf(stderr, "Cannot record %s, names are limited to %lu bytes.\n",
+                name, CAPTURE_NAME_SIZE - 1);
+        return 1;
+    }
+
+    if (connection->IsVariableLength()) {
+        fprintf(stderr,
+                "Cannot record %s, variable-length connections are not "
+                "supported.\n",
+                name);
+        return 1;
+    }
+
+    CaptureStream stream;
+    memset(&stream, 0, sizeof(stream));
+    strcpy(stream.connection, name);
+    strcpy(stream.destination, destination);
+    stream.bufferSize = bufferSize;
+    stream.messageSize = recipient->GetMessageSize();
+    stream.recordSize = recipient->GetMessageRecordSize();
+    stream.sourceFirst = sourceFirst;
+
+    this->streams.push_back(stream);
+    this->connections.push_back(connection);
+    this->recipients.push_back(recipient);
+
+    return 0;
+};
+
+int sinuca::capture::MessageRecorder::Start(const char* fileName,
+                                            const engine::Engine* engine) {
+    this->file = fopen(fileName, "wb");
+    if (!this->file) {
+        fprintf(stderr, "Could not open %s: %s\n", fileName, strerror(errno));
+        return 1;
+    }
+    setvbuf(this->file, NULL, _IOFBF, CAPTURE_FILE_BUFFER);
+    this->engine = engine;
+
+    CaptureFileHeader header;
+    memcpy(header.magic, CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC));
+    header.streams = this->streams.size();
+    header.reserved = 0;
+    fwrite(&header, sizeof(header), 1, this->file);
+    fwrite(this->streams.data(), sizeof(CaptureStream), this->streams.size(),
+           this->file);
+
+    unsigned long largest = 0;
+    for (unsigned long i = 0; i < this->streams.size(); ++i) {
+        if (this->streams[i].recordSize > largest)
+            largest = this->streams[i].recordSize;
+
+        for (unsigned long d = 0; d < 4; ++d) {
+            Channel channel;
+            channel.recorder = this;
+            channel.stream = i;
+            channel.direction = DIRECTIONS[d];
+            this->channels.push_back(channel);
+            this->connections[i]->SetObserver(DIRECTIONS[d], Observe,
+                                              &this->channels.back());
+        }
+    }
+    /* Zeroed once, so the padding of every record is zero. */
+    this->record.assign(sizeof(CaptureRecordHeader) +
+                            GetPaddedRecordSize(largest),
+                        0);
+
+    return 0;
+};
+
+void sinuca::capture::MessageRecorder::Observe(void* context,
+                                               const void* message) {
+    Channel* channel = static_cast<Channel*>(context);
+    MessageRecorder* recorder = channel->recorder;
+    const CaptureStream& stream = recorder->streams[channel->stream];
+
+    CaptureRecordHeader* header =
+        reinterpret_cast<CaptureRecordHeader*>(recorder->record.data());
+    header->cycle = recorder->engine->GetCycle();
+    header->stream = channel->stream;
+    header->direction = channel->direction;
+    recorder->recipients[channel->stream]->EncodeMessage(message, header + 1);
+
+    fwrite(header, 1,
+           sizeof(CaptureRecordHeader) +
+               GetPaddedRecordSize(stream.recordSize),
+           recorder->file);
+    ++recorder->messages;
+};
+
+void sinuca::capture::MessageRecorder::Stop() {
+    if (!this->file) return;
+
+    for (unsigned long i = 0; i < this->connections.size(); ++i) {
+        for (unsigned long d = 0; d < 4; ++d)
+            this->connections[i]->SetObserver(DIRECTIONS[d], NULL, NULL);
+    }
+    fclose(this->file);
+    this->file = NULL;
+};
+
+sinuca::capture::MessageRecorder::~MessageRecorder() { this->Stop(); };
+
+sinuca::capture::CaptureReader::CaptureReader()
+    : mapping(NULL),
+      mappingSize(0),
+      streams(NULL),
+      numberOfStreams(0),
+      records(NULL),
+      recordsEnd(NULL){};
+
+int sinuca::capture::CaptureReader::Open(const char* fileName) {
+    this->Close();
+
+    int file = open(fileName, O_RDONLY);
+    if (file < 0) {
+        fprintf(stderr, "Could not open capture %s: %s\n", fileName,
+                strerror(errno));
+        return 1;
+    }
+
+    struct stat status;
+    if (fstat(file, &status) != 0 ||
+        (unsigned long)status.st_size < sizeof(CaptureFileHeader)) {
+        fprintf(stderr, "%s is not a capture.\n", fileName);
+        close(file);
+        return 1;
+    }
+
+    void* mapping = mmap(NULL, status.st_size, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE, file, 0);
+    close(file);
+    if (mapping == MAP_FAILED) {
+        fprintf(stderr, "Could not map capture %s: %s\n", fileName,
+                strerror(errno));
+        return 1;
+    }
+    this->mapping = mapping;
+    this->mappingSize = status.st_size;
+
+    const CaptureFileHeader* header =
+        static_cast<const CaptureFileHeader*>(mapping);
+    char* end = static_cast<char*>(mapping) + status.st_size;
+    if (memcmp(header->magic, CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC)) != 0 ||
+        (unsigned long)status.st_size <
+            sizeof(CaptureFileHeader) +
+                header->streams * sizeof(CaptureStream)) {
+        fprintf(stderr, "%s is not a capture.\n", fileName);
+        this->Close();
+        return 1;
+    }
+
+    this->streams = reinterpret_cast<const CaptureStream*>(header + 1);
+    this->numberOfStreams = header->streams;
+    this->records = static_cast<char*>(mapping) + sizeof(CaptureFileHeader) +
+                    header->streams * sizeof(CaptureStream);
+    this->recordsEnd = end;
+
+    /* Checked once, so GetNextRecord can trust the file. */
+    char* position = this->records;
+    while (position < end) {
+        CaptureRecordHeader* record =
+            reinterpret_cast<CaptureRecordHeader*>(position);
+        if (position + sizeof(CaptureRecordHeader) > end ||
+            record->stream >= this->numberOfStreams ||
+            record->direction > engine::MessageResponseToDestination) {
+            break;
+        }
+        position += sizeof(CaptureRecordHeader) +
+                    GetPaddedRecordSize(this->streams[record->stream].recordSize);
+    }
+    if (position != end) {
+        fprintf(stderr, "%s is truncated or corrupted.\n", fileName);
+        this->Close();
+        return 1;
+    }
+
+    return 0;
+};
+
+void sinuca::capture::CaptureReader::Close() {
+    if (this->mapping) munmap(this->mapping, this->mappingSize);
+    this->mapping = NULL;
+    this->mappingSize = 0;
+    this->streams = NULL;
+    this->numberOfStreams = 0;
+    this->records = NULL;
+    this->recordsEnd = NULL;
+};
+
+sinuca::capture::CaptureReader::~CaptureReader() { this->Close(); };
@@ -0,0 +1,194 @@
+#ifndef SINUCA3_UTILS_CAPTURE_HPP_
+#define SINUCA3_UTILS_CAPTURE_HPP_
+
+//
+// Copyright (C) 2024  HiPES - Universidade Federal do Paraná
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/**
+ * @file capture.hpp
+ * @brief Recording of the messages of connections, for replay.
+ * @details A capture file is a CaptureFileHeader, one CaptureStream per
+ * recorded connection and then, in the order they were sent, the messages:
+ * each one a CaptureRecordHeader followed by the record of its stream,
+ * padded to 8 bytes. Records are written by the EncodeMessage of the
+ * recipient of the connection, so messages that point to arrays carry them.
+ */
+
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <vector>
+
+#include "engine.hpp"
+
+namespace sinuca {
+namespace capture {
+
+static const unsigned long CAPTURE_NAME_SIZE = 64;
+
+struct CaptureFileHeader {
+    char magic[8];
+    uint32_t streams;
+    uint32_t reserved;
+};
+
+struct CaptureStream {
+    char connection[CAPTURE_NAME_SIZE];  /**< <source>.<parameter>. */
+    char destination[CAPTURE_NAME_SIZE]; /**< Name of the recipient. */
+    uint32_t bufferSize;
+    uint32_t messageSize;
+    uint32_t recordSize;  /**< GetMessageRecordSize of the recipient. */
+    uint32_t sourceFirst; /**< Whether the source was clocked before the
+                              recipient, so its messages were seen by the
+                              recipient in the cycle they were sent. */
+};
+
+struct CaptureRecordHeader {
+    uint64_t cycle;     /**< Cycle the message was sent. */
+    uint32_t stream;    /**< Index of its CaptureStream. */
+    uint32_t direction; /**< An engine::MessageDirection. */
+};
+
+/**
+ * @brief Space taken by a record in the file.
+ */
+inline unsigned long GetPaddedRecordSize(unsigned long recordSize) {
+    return (recordSize + 7) & ~7UL;
+};
+
+/**
+ * @brief Records every message sent on a set of connections.
+ * @details Add the streams, then Start. The connections are observed until
+ * Stop, which the destructor calls.
+ */
+class MessageRecorder {
+  private:
+    struct Channel {
+        MessageRecorder* recorder;
+        uint32_t stream;
+        uint32_t direction;
+    };
+
+    FILE* file;
+    const engine::Engine* engine;
+    std::vector<CaptureStream> streams;
+    std::vector<engine::Connection*> connections;
+    std::vector<engine::Linkable*> recipients;
+    std::deque<Channel> channels; /**< Contexts of the observers. */
+    std::vector<char> record;     /**< Header and record being written. */
+    unsigned long messages;
+
+    static void Observe(void* context, const void* message);
+
+  public:
+    MessageRecorder() : file(NULL), engine(NULL), messages(0){};
+
+    /**
+     * @brief Selects a connection, before Start.
+     * @param name <source>.<parameter>, as in the topology file.
+     * @param destination Name of the recipient.
+     * @returns Non-zero on error, 0 otherwise.
+     */
+    int AddStream(const char* name, const char* destination,
+                  engine::Connection* connection, engine::Linkable* recipient,
+                  int bufferSize, bool sourceFirst);
+
+    /**
+     * @brief Writes the header and starts observing the connections.
+     * @param engine Gives the cycle of each message.
+     * @returns Non-zero on error, 0 otherwise.
+     */
+    int Start(const char* fileName, const engine::Engine* engine);
+
+    /**
+     * @brief Stops observing and closes the file.
+     */
+    void Stop();
+
+    inline unsigned long GetNumberOfMessages() const {
+        return this->messages;
+    };
+
+    ~MessageRecorder();
+};
+
+/**
+ * @brief A capture file, mapped.
+ * @details The mapping is private and writable, so decoded messages may
+ * point into their records.
+ */
+class CaptureReader {
+  private:
+    void* mapping;
+    unsigned long mappingSize;
+    const CaptureStream* streams;
+    unsigned long numberOfStreams;
+    char* records;    /**< First record. */
+    char* recordsEnd; /**< Past the last record. */
+
+  public:
+    CaptureReader();
+
+    /**
+     * @brief Maps and validates a capture file.
+     * @returns Non-zero on error, 0 otherwise.
+     */
+    int Open(const char* fileName);
+
+    /**
+     * @brief Unmaps the file. Called by the destructor.
+     */
+    void Close();
+
+    inline unsigned long GetNumberOfStreams() const {
+        return this->numberOfStreams;
+    };
+    inline const CaptureStream& GetStream(unsigned long index) const {
+        return this->streams[index];
+    };
+
+    /**
+     * @brief Walks the records in the order they were sent.
+     * @param previous NULL to get the first record.
+     * @returns NULL after the last record.
+     */
+    inline CaptureRecordHeader* GetNextRecord(
+        CaptureRecordHeader* previous) const {
+        char* next = this->records;
+        if (previous) {
+            next = reinterpret_cast<char*>(previous + 1) +
+                   GetPaddedRecordSize(
+                       this->streams[previous->stream].recordSize);
+        }
+        if (next >= this->recordsEnd) return NULL;
+        return reinterpret_cast<CaptureRecordHeader*>(next);
+    };
+
+    /**
+     * @brief The record after a header.
+     */
+    static inline void* GetRecord(CaptureRecordHeader* header) {
+        return header + 1;
+    };
+
+    ~CaptureReader();
+};
+
+}  // namespace capture
+}  // namespace sinuca
+
+#endif  // SINUCA3_UTILS_CAPTURE_HPP_
@@ -6,89 +6,62 @@
 #include "circularBuffer.hpp"
 #include <cstring>
 
-inline bool CircularBuffer::IsAllocated() const {
-    return (this->buffer != NULL);
-};
-
-inline int CircularBuffer::GetSize() const { return (this->bufferSize); };
-
-inline int CircularBuffer::GetOccupation() const { return (this->occupation); };
-
-inline bool CircularBuffer::IsFull() const {
-    return (this->occupation == this->bufferSize);
-};
-
-inline bool CircularBuffer::IsEmpty() const { return (this->occupation == 0); };
-
-void CircularBuffer::Allocate(int bufferSize, int messageSize) {
+void CircularBuffer::Allocate(int bufferSize, int messageSize,
+                              void* storage) {
     if ((bufferSize == 0) || (messageSize == 0)) return;
 
     this->occupation = 0;
+    this->highWaterMark = 0;
+    this->fullEvents = 0;
     this->startOfBuffer = 0;
     this->endOfBuffer = 0;
     this->bufferSize = bufferSize;
     this->messageSize = messageSize;
+
+    if (storage) {
+        this->buffer = storage;
+        this->ownsBuffer = false;
+        return;
+    }
+
     this->buffer = (void*)new char[bufferSize * messageSize];
+    this->ownsBuffer = true;
 
     if (!(this->buffer)) {
         this->buffer = NULL;
     }
 };
 
+bool CircularBuffer::Resize(int bufferSize) {
+    if (!this->buffer || bufferSize <= 0 || bufferSize < this->occupation)
+        return 0;
+    if (bufferSize == this->bufferSize) return 1;
+
+    char* resized = new char[bufferSize * this->messageSize];
+    char* current = static_cast<char*>(this->buffer);
+
+    /* The queued messages wrap at most once: from the start to the end of
+     * the storage, then from its beginning. */
+    int first = this->bufferSize - this->startOfBuffer;
+    if (first > this->occupation) first = this->occupation;
+    memcpy(resized, current + this->startOfBuffer * this->messageSize,
+           first * this->messageSize);
+    memcpy(resized + first * this->messageSize, current,
+           (this->occupation - first) * this->messageSize);
+
+    if (this->ownsBuffer) delete[] current;
+    this->buffer = resized;
+    this->ownsBuffer = true;
+    this->bufferSize = bufferSize;
+    this->startOfBuffer = 0;
+    this->endOfBuffer = this->occupation % bufferSize;
+
+    return 1;
+};
+
 void CircularBuffer::Deallocate() {
     if (this->buffer) {
-        delete[] (char*)this->buffer;
+        if (this->ownsBuffer) delete[] (char*)this->buffer;
         this->buffer = NULL;
     }
 };
-
-bool CircularBuffer::Enqueue(void* elementInput) {
-    if (!(this->IsFull())) {
-        /*
-         * Target stores the memory address where the element should be
-         * inserted, based on pointer arithmetic. After its definition, memcpy
-         * stores the element in the most recent position in the buffer.
-         */
-        void* memoryAddress =
-            static_cast<char*>(buffer) + (endOfBuffer * messageSize);
-
-        memcpy(memoryAddress, elementInput, messageSize);
-        ++occupation;
-        ++endOfBuffer;
-
-        if (endOfBuffer == bufferSize) {
-            endOfBuffer = 0;
-        }
-
-        return 1;
-    }
-
-    return 0;
-};
-
-bool CircularBuffer::Dequeue(void* elementOutput) {
-    if (!(this->IsEmpty())) {
-        /*
-         * Element stores the memory address of the oldest element in the Buffer
-         * (the one that should be removed). Although there is no need to clear
-         * the space of this element, the buffer limits are readjusted to avoid
-         * unauthorized access.
-         */
-        void* memoryAddress =
-            static_cast<char*>(buffer) + (startOfBuffer * messageSize);
-
-        memcpy(elementOutput, memoryAddress, messageSize);
-        --occupation;
-        ++startOfBuffer;
-
-        if (startOfBuffer == bufferSize) {
-            startOfBuffer = 0;
-        }
-
-        return 1;
-    }
-
-    memset(elementOutput, 0, messageSize);
-
-    return 0;
-};
\ No newline at end of file
@@ -29,6 +29,12 @@
 #include <cstring>
 
 class CircularBuffer {
+  public:
+    /**
+     * @brief Called with each message enqueued, see SetObserver.
+     */
+    typedef void (*Observer)(void* context, const void* message);
+
   private:
     void* buffer;      /**<The Buffer. */
     int occupation;    /**<Buffer's current occupancy */
@@ -36,6 +42,13 @@ class CircularBuffer {
     int messageSize;   /**<The message size supported by the buffer. */
     int startOfBuffer; /**<Sentinel to the start of the buffer. */
     int endOfBuffer;   /*<Sentinel for the end of the buffer. */
+    bool ownsBuffer;   /**<False when the storage was provided by the caller. */
+    unsigned long* readyWord; /**<Optional flag word, see SetReadyFlag. */
+    unsigned long readyBit;   /**<Bit of the buffer in readyWord. */
+    Observer observer;        /**<Optional, e.g. to record the messages. */
+    void* observerContext;    /**<Given to observer. */
+    int highWaterMark;        /**<Largest occupation reached. */
+    unsigned long fullEvents; /**<Senders that found it full. */
 
   public:
     CircularBuffer()
@@ -44,7 +57,14 @@ class CircularBuffer {
           bufferSize(0),
           messageSize(0),
           startOfBuffer(0),
-          endOfBuffer(0){};
+          endOfBuffer(0),
+          ownsBuffer(false),
+          readyWord(NULL),
+          readyBit(0),
+          observer(NULL),
+          observerContext(NULL),
+          highWaterMark(0),
+          fullEvents(0){};
 
     /**
      * @brief Returns a boolean indicating whether the Buffer is allocated.
@@ -61,11 +81,49 @@ class CircularBuffer {
      */
     inline int GetOccupation() const;
 
+    /**
+     * @brief Returns the size of each message.
+     */
+    inline int GetMessageSize() const { return this->messageSize; };
+
+    /**
+     * @brief Returns the largest occupation of the Buffer so far.
+     */
+    inline int GetHighWaterMark() const { return this->highWaterMark; };
+
+    /**
+     * @brief Returns how many times a sender stalled on the Buffer: Enqueues
+     * refused because it was full, and IsFullForSender calls that found it
+     * full.
+     */
+    inline unsigned long GetFullEvents() const { return this->fullEvents; };
+
+    /**
+     * @brief Returns a queued message without removing it.
+     * @param position 0 for the oldest message, up to the occupation.
+     */
+    inline const void* Peek(int position) const {
+        int slot = this->startOfBuffer + position;
+        if (slot >= this->bufferSize) slot -= this->bufferSize;
+        return static_cast<const char*>(this->buffer) +
+               slot * this->messageSize;
+    };
+
     /**
      * @brief Returns a boolean indicating whether the Buffer is full.
      */
     inline bool IsFull() const;
 
+    /**
+     * @brief IsFull for a sender that checks before it commits to sending,
+     * e.g. before receiving the request it answers. Counts a stall when full.
+     */
+    inline bool IsFullForSender() {
+        if (!this->IsFull()) return false;
+        ++this->fullEvents;
+        return true;
+    };
+
     /**
      * @brief Returns a boolean indicating whether the Buffer is empty.
      */
@@ -75,8 +133,49 @@ class CircularBuffer {
      * @brief Allocates the structure of a Circular Buffer.
      * @param bufferSize self-explanatory.
      * @param messageSize self-explanatory.
+     * @param storage Optional pre-allocated region of at least bufferSize *
+     * messageSize bytes. When provided, the buffer uses it in place and never
+     * frees it, so its owner must outlive the buffer.
+     */
+    void Allocate(int bufferSize, int messageSize, void* storage = NULL);
+
+    /**
+     * @brief Changes the capacity of an allocated Buffer, keeping the queued
+     * messages in order.
+     * @details The messages move to storage owned by the buffer, even if it
+     * was provided to Allocate. The high-water mark and full events are kept.
+     * @param bufferSize The new capacity, at least the occupation.
+     * @return 1 if successfuly, 0 otherwise.
+     */
+    bool Resize(int bufferSize);
+
+    /**
+     * @brief Keeps a bit of a word set while the buffer is not empty.
+     * @details Lets the owner of many buffers find the non-empty ones by
+     * scanning words instead of buffers. The word must outlive the buffer or
+     * be replaced before it moves.
+     * @param word The word, or NULL to stop flagging.
+     * @param bit A mask with the single bit of *this* buffer.
+     */
+    inline void SetReadyFlag(unsigned long* word, unsigned long bit);
+
+    /**
+     * @brief Sets the flag again if the buffer is not empty, for a word the
+     * writer of the buffer could not reach.
+     */
+    inline void RefreshReadyFlag() {
+        if (this->readyWord && !this->IsEmpty())
+            *this->readyWord |= this->readyBit;
+    };
+
+    /**
+     * @brief Calls observer(context, message) after each successful Enqueue.
+     * @param observer The observer, or NULL to stop observing.
      */
-    void Allocate(int bufferSize, int messageSize);
+    inline void SetObserver(Observer observer, void* context) {
+        this->observer = observer;
+        this->observerContext = context;
+    };
 
     /**
      * @brief Deallocates the Circular Buffer.
@@ -90,7 +189,7 @@ class CircularBuffer {
      * @param elementInput A pointer to the element to be inserted.
      * @return 1 if successfuly, 0 otherwise.
      */
-    bool Enqueue(void* elementInput);
+    inline bool Enqueue(void* elementInput);
 
     /**
      * @brief Removes and returns the element contained in the "base" of the
@@ -99,9 +198,91 @@ class CircularBuffer {
      * will be returned.
      * @return 1 if successfuly, 0 otherwise.
      */
-    bool Dequeue(void* elementOutput);
+    inline bool Dequeue(void* elementOutput);
 
     ~CircularBuffer() { Deallocate(); };
 };
 
+/*
+ * The accessors, Enqueue and Dequeue are defined here so they can be inlined
+ * in the message-passing fast path of the engine.
+ */
+
+inline bool CircularBuffer::IsAllocated() const {
+    return (this->buffer != NULL);
+};
+
+inline int CircularBuffer::GetSize() const { return (this->bufferSize); };
+
+inline int CircularBuffer::GetOccupation() const { return (this->occupation); };
+
+inline bool CircularBuffer::IsFull() const {
+    return (this->occupation == this->bufferSize);
+};
+
+inline bool CircularBuffer::IsEmpty() const { return (this->occupation == 0); };
+
+inline void CircularBuffer::SetReadyFlag(unsigned long* word,
+                                         unsigned long bit) {
+    this->readyWord = word;
+    this->readyBit = bit;
+    if (word && !this->IsEmpty()) *word |= bit;
+};
+
+inline bool CircularBuffer::Enqueue(void* elementInput) {
+    if (!(this->IsFull())) {
+        /*
+         * Target stores the memory address where the element should be
+         * inserted, based on pointer arithmetic. After its definition, memcpy
+         * stores the element in the most recent position in the buffer.
+         */
+        void* memoryAddress =
+            static_cast<char*>(buffer) + (endOfBuffer * messageSize);
+
+        memcpy(memoryAddress, elementInput, messageSize);
+        ++occupation;
+        ++endOfBuffer;
+        if (occupation > highWaterMark) highWaterMark = occupation;
+        if (readyWord) *readyWord |= readyBit;
+        if (observer) observer(observerContext, elementInput);
+
+        if (endOfBuffer == bufferSize) {
+            endOfBuffer = 0;
+        }
+
+        return 1;
+    }
+
+    ++fullEvents;
+    return 0;
+};
+
+inline bool CircularBuffer::Dequeue(void* elementOutput) {
+    if (!(this->IsEmpty())) {
+        /*
+         * Element stores the memory address of the oldest element in the Buffer
+         * (the one that should be removed). Although there is no need to clear
+         * the space of this element, the buffer limits are readjusted to avoid
+         * unauthorized access.
+         */
+        void* memoryAddress =
+            static_cast<char*>(buffer) + (startOfBuffer * messageSize);
+
+        memcpy(elementOutput, memoryAddress, messageSize);
+        --occupation;
+        ++startOfBuffer;
+        if (readyWord && !occupation) *readyWord &= ~readyBit;
+
+        if (startOfBuffer == bufferSize) {
+            startOfBuffer = 0;
+        }
+
+        return 1;
+    }
+
+    memset(elementOutput, 0, messageSize);
+
+    return 0;
+};
+
 #endif
\ No newline at end of file
@@ -25,6 +25,7 @@
 
 #include "linkable.hpp"
 #include <cstdio>
+#include <cstring>
 
 namespace sinuca {
 
@@ -63,6 +64,13 @@ class Component : public engine::Linkable {
         return this->Connect(bufferSize);
     };
 
+    /**
+     * @brief Wrapper to ConnectVariable method
+     */
+    inline int ConnectVariableToComponent(int capacity) {
+        return this->ConnectVariable(capacity);
+    };
+
     /**
      * @brief Wrapper to SendRequestToLinkable method
      */
@@ -132,6 +140,141 @@ class Component : public engine::Linkable {
         return this->ReceiveResponseFromConnection(connectionID, messageOutput);
     };
 
+    /**
+     * @brief Wrapper to ResolveConnectionToLinkable method
+     */
+    inline engine::ConnectionHandle ResolveConnectionToComponent(
+        Linkable* component, int connectionID) {
+        return this->ResolveConnectionToLinkable(component, connectionID);
+    };
+
+    /**
+     * @brief Wrapper to ResolveConnection method
+     */
+    inline engine::ConnectionHandle ResolveConnectionForAConnection(
+        int connectionID) {
+        return this->ResolveConnection(connectionID);
+    };
+
+    /**
+     * @brief Wrapper to SendRequestToHandle method
+     */
+    inline bool SendRequestByHandle(const engine::ConnectionHandle& handle,
+                                    void* messageInput) {
+        bool done = this->SendRequestToHandle(handle, messageInput);
+        if (done)
+            SINUCA3_TRACE_EVENT(TraceEventSendRequest, this->GetTraceID(),
+                                handle.connectionID);
+        return done;
+    };
+
+    /**
+     * @brief Wrapper to SendResponseToHandle method
+     */
+    inline bool SendResponseByHandle(const engine::ConnectionHandle& handle,
+                                     void* messageInput) {
+        bool done = this->SendResponseToHandle(handle, messageInput);
+        if (done)
+            SINUCA3_TRACE_EVENT(TraceEventSendResponse, this->GetTraceID(),
+                                handle.connectionID);
+        return done;
+    };
+
+    /**
+     * @brief Wrapper to ReceiveRequestFromHandle method
+     */
+    inline bool ReceiveRequestByHandle(const engine::ConnectionHandle& handle,
+                                       void* messageOutput) {
+        bool done = this->ReceiveRequestFromHandle(handle, messageOutput);
+        if (done)
+            SINUCA3_TRACE_EVENT(TraceEventReceiveRequest, this->GetTraceID(),
+                                handle.connectionID);
+        return done;
+    };
+
+    /**
+     * @brief Wrapper to ReceiveResponseFromHandle method
+     */
+    inline bool ReceiveResponseByHandle(const engine::ConnectionHandle& handle,
+                                        void* messageOutput) {
+        bool done = this->ReceiveResponseFromHandle(handle, messageOutput);
+        if (done)
+            SINUCA3_TRACE_EVENT(TraceEventReceiveResponse, this->GetTraceID(),
+                                handle.connectionID);
+        return done;
+    };
+
+    /**
+     * @brief Wrapper to ReserveRequestToHandle method
+     */
+    inline void* ReserveRequestByHandle(const engine::ConnectionHandle& handle,
+                                        int length) {
+        return this->ReserveRequestToHandle(handle, length);
+    };
+
+    /**
+     * @brief Wrapper to CommitRequestToHandle method
+     */
+    inline void CommitRequestByHandle(const engine::ConnectionHandle& handle,
+                                      int length) {
+        this->CommitRequestToHandle(handle, length);
+        SINUCA3_TRACE_EVENT(TraceEventSendRequest, this->GetTraceID(),
+                            handle.connectionID);
+    };
+
+    /**
+     * @brief Wrapper to ReserveResponseToHandle method
+     */
+    inline void* ReserveResponseByHandle(
+        const engine::ConnectionHandle& handle, int length) {
+        return this->ReserveResponseToHandle(handle, length);
+    };
+
+    /**
+     * @brief Wrapper to CommitResponseToHandle method
+     */
+    inline void CommitResponseByHandle(const engine::ConnectionHandle& handle,
+                                       int length) {
+        this->CommitResponseToHandle(handle, length);
+        SINUCA3_TRACE_EVENT(TraceEventSendResponse, this->GetTraceID(),
+                            handle.connectionID);
+    };
+
+    /**
+     * @brief Wrapper to PeekRequestFromHandle method
+     */
+    inline void* PeekRequestByHandle(const engine::ConnectionHandle& handle,
+                                     int* length) {
+        return this->PeekRequestFromHandle(handle, length);
+    };
+
+    /**
+     * @brief Wrapper to ReleaseRequestFromHandle method
+     */
+    inline void ReleaseRequestByHandle(const engine::ConnectionHandle& handle) {
+        this->ReleaseRequestFromHandle(handle);
+        SINUCA3_TRACE_EVENT(TraceEventReceiveRequest, this->GetTraceID(),
+                            handle.connectionID);
+    };
+
+    /**
+     * @brief Wrapper to PeekResponseFromHandle method
+     */
+    inline void* PeekResponseByHandle(const engine::ConnectionHandle& handle,
+                                      int* length) {
+        return this->PeekResponseFromHandle(handle, length);
+    };
+
+    /**
+     * @brief Wrapper to ReleaseResponseFromHandle method
+     */
+    inline void ReleaseResponseByHandle(
+        const engine::ConnectionHandle& handle) {
+        this->ReleaseResponseFromHandle(handle);
+        SINUCA3_TRACE_EVENT(TraceEventReceiveResponse, this->GetTraceID(),
+                            handle.connectionID);
+    };
+
     inline ~Component() {};
 };
 
@@ -140,9 +283,18 @@ class EngineDebugComponent
   public:
     bool send;
     int connectionID;
-    EngineDebugComponent* otherComponent;
+    engine::Linkable* otherComponent;
     inline EngineDebugComponent() : send(false), connectionID(0), otherComponent(nullptr) {};
-    int FinishSetup() { return 1; };
+    int SetConfigParameter(const char* parameter, config::ConfigValue value) {
+        if (strcmp(parameter, "otherComponent") == 0 &&
+            value.type == config::ConfigValueTypeComponentReference) {
+            otherComponent = value.value.reference.component;
+            connectionID = value.value.reference.connectionID;
+            return 0;
+        }
+        return engine::Linkable::SetConfigParameter(parameter, value);
+    };
+    int FinishSetup() { return 0; };
     void Clock() {
         printf("CLOCK!\n");
         int messsageOutput, messageInput;
@@ -155,11 +307,11 @@ class EngineDebugComponent
             } else {
                 this->ReceiveResponseFromComponent(otherComponent, connectionID, &messageInput);
                 if (messageInput) {
-                    printf("Mensagem Recebida: %d\n", messsageOutput);
+                    printf("Mensagem Recebida: %d\n", messageInput);
                 }
             }
         } else {
-            for (unsigned int i = 0; i < this->connections.size(); ++i) {
+            this->ForEachReadyRequest([&](int i) {
                 this->ReceiveRequestForAConnection(i, &messsageOutput);
                 if (messsageOutput) {
                     printf("Mensagem Recebida de Conexão: %d\n", messsageOutput);
@@ -167,7 +319,7 @@ class EngineDebugComponent
                     this->SendResponseForConnection(i, &messsageOutput);
                     printf("Mensagem Enviada para Conexão: %d\n", messsageOutput);
                 }
-            }
+            });
         }
     };
 
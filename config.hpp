@@ -0,0 +1,73 @@
+#ifndef SINUCA3_CONFIG_CONFIG_HPP_
+#define SINUCA3_CONFIG_CONFIG_HPP_
+
+//
+// Copyright (C) 2024  HiPES - Universidade Federal do Paraná
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/**
+ * @file config.hpp
+ * @brief Values passed from the configuration file to the components.
+ */
+
+namespace sinuca {
+
+namespace engine {
+class Linkable;
+}
+
+namespace config {
+
+enum ConfigValueType {
+    ConfigValueTypeInteger,
+    ConfigValueTypeNumber,
+    ConfigValueTypeBoolean,
+    ConfigValueTypeString,
+    ConfigValueTypeComponentReference,
+};
+
+/**
+ * @brief A reference to another component, created by a connection in the
+ * configuration file.
+ * @details The connection is already established when the reference is handed
+ * to the source component, so connectionID can be used directly with the
+ * SendRequestToComponent family of methods.
+ */
+struct ComponentReference {
+    engine::Linkable* component;
+    int connectionID;
+};
+
+/**
+ * @brief A single parameter value read from the configuration file.
+ * @details Strings point to memory owned by the loader and are only valid
+ * during the SetConfigParameter call, so components must copy them if needed.
+ */
+struct ConfigValue {
+    ConfigValueType type;
+    union {
+        long integer;
+        double number;
+        bool boolean;
+        const char* string;
+        ComponentReference reference;
+    } value;
+};
+
+}  // namespace config
+}  // namespace sinuca
+
+#endif  // SINUCA3_CONFIG_CONFIG_HPP_
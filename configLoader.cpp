@@ -0,0 +1,706 @@
+//
+// Copyright (C) 2024  HiPES - Universidade Federal do Paraná
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/**
+ * @file configLoader.cpp
+ * @brief Implementation of the component registry and topology loader.
+ */
+
+#include "configLoader.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "component.hpp"
+
+static const long STORAGE_ALIGNMENT = 64; /**< Keeps each ring on its own
+                                               cache lines. */
+static const int MAX_TOKENS = 64;
+
+using sinuca::EngineDebugComponent;
+SINUCA3_REGISTER_COMPONENT(EngineDebugComponent);
+
+/**
+ * @details Function-local so registration from other translation units does
+ * not depend on static initialization order.
+ */
+static std::unordered_map<std::string, sinuca::config::ComponentFactory>&
+GetRegistry() {
+    static std::unordered_map<std::string, sinuca::config::ComponentFactory>
+        registry;
+    return registry;
+};
+
+int sinuca::config::ComponentRegistry::Register(const char* typeName,
+                                                ComponentFactory factory) {
+    GetRegistry()[typeName] = factory;
+    return 0;
+};
+
+sinuca::config::ComponentFactory sinuca::config::ComponentRegistry::Find(
+    const char* typeName) {
+    std::unordered_map<std::string, ComponentFactory>::iterator it =
+        GetRegistry().find(typeName);
+    if (it == GetRegistry().end()) return NULL;
+    return it->second;
+};
+
+/**
+ * @brief Splits a line in whitespace-separated tokens, in place.
+ * @details Double quotes group a token with spaces; the quotes are kept so the
+ * value parser can tell strings apart. Everything after a # is a comment.
+ * @return The number of tokens, or -1 if there are too many or a quote is not
+ * closed.
+ */
+static int Tokenize(char* line, char** tokens) {
+    int count = 0;
+    char* cursor = line;
+
+    while (*cursor) {
+        while (*cursor == ' ' || *cursor == '\t' || *cursor == '\r' ||
+               *cursor == '\n')
+            ++cursor;
+        if (*cursor == '\0' || *cursor == '#') break;
+        if (count == MAX_TOKENS) return -1;
+
+        tokens[count++] = cursor;
+        bool quoted = false;
+        while (*cursor) {
+            if (*cursor == '"') quoted = !quoted;
+            if (!quoted && (*cursor == ' ' || *cursor == '\t' ||
+                            *cursor == '\r' || *cursor == '\n'))
+                break;
+            ++cursor;
+        }
+        if (quoted) return -1;
+        if (*cursor) *cursor++ = '\0';
+    }
+
+    return count;
+};
+
+/**
+ * @brief Converts the textual value of a parameter.
+ * @details Quoted strings have the quotes removed in the returned storage.
+ */
+static sinuca::config::ConfigValue ParseValue(const std::string& text,
+                                              std::string& storage) {
+    sinuca::config::ConfigValue value;
+    const char* begin = text.c_str();
+    char* end;
+
+    if (text == "true" || text == "false") {
+        value.type = sinuca::config::ConfigValueTypeBoolean;
+        value.value.boolean = (text == "true");
+        return value;
+    }
+
+    errno = 0;
+    long integer = strtol(begin, &end, 0);
+    if (*begin && *end == '\0' && errno == 0) {
+        value.type = sinuca::config::ConfigValueTypeInteger;
+        value.value.integer = integer;
+        return value;
+    }
+
+    double number = strtod(begin, &end);
+    if (*begin && *end == '\0') {
+        value.type = sinuca::config::ConfigValueTypeNumber;
+        value.value.number = number;
+        return value;
+    }
+
+    if (text.size() >= 2 && text[0] == '"' && text[text.size() - 1] == '"') {
+        storage = text.substr(1, text.size() - 2);
+    } else {
+        storage = text;
+    }
+    value.type = sinuca::config::ConfigValueTypeString;
+    value.value.string = storage.c_str();
+    return value;
+};
+
+void sinuca::config::Topology::PrintError(int lineNumber, const char* format,
+                                          ...) {
+    va_list args;
+    va_start(args, format);
+
+    if (lineNumber > 0) {
+        fprintf(stderr, "%s:%d: ", this->fileName.c_str(), lineNumber);
+    } else {
+        fprintf(stderr, "%s: ", this->fileName.c_str());
+    }
+    vfprintf(stderr, format, args);
+    fputc('\n', stderr);
+
+    va_end(args);
+};
+
+std::string sinuca::config::Topology::ParameterKey(int component,
+                                                  const std::string& name) {
+    return std::to_string(component) + '.' + name;
+};
+
+int sinuca::config::Topology::AddParameter(int component,
+                                           const char* assignment,
+                                           int lineNumber) {
+    const char* equals = strchr(assignment, '=');
+    if (!equals || equals == assignment || equals[1] == '\0') {
+        this->PrintError(lineNumber, "expected <parameter>=<value>, got \"%s\"",
+                         assignment);
+        return 1;
+    }
+
+    std::string name(assignment, equals - assignment);
+    std::string key = ParameterKey(component, name);
+    std::unordered_map<std::string, int>::iterator it =
+        this->parameterIndex.find(key);
+    if (it != this->parameterIndex.end()) {
+        this->parameters[it->second].value = equals + 1;
+        this->parameters[it->second].line = lineNumber;
+        return 0;
+    }
+
+    ParameterEntry entry;
+    entry.component = component;
+    entry.name = name;
+    entry.value = equals + 1;
+    entry.line = lineNumber;
+    this->parameterIndex[key] = this->parameters.size();
+    this->parameters.push_back(entry);
+
+    return 0;
+};
+
+int sinuca::config::Topology::ParseLine(char* line, int lineNumber) {
+    char* tokens[MAX_TOKENS];
+    int count = Tokenize(line, tokens);
+
+    if (count < 0) {
+        this->PrintError(lineNumber, "malformed line");
+        return 1;
+    }
+    if (count == 0) return 0;
+
+    if (strcmp(tokens[0], "component") == 0) {
+        if (count < 3) {
+            this->PrintError(lineNumber,
+                             "expected component <Type> <name> "
+                             "[<parameter>=<value>]...");
+            return 1;
+        }
+        if (this->componentIndex.count(tokens[2])) {
+            this->PrintError(lineNumber, "component \"%s\" already defined",
+                             tokens[2]);
+            return 1;
+        }
+
+        ComponentEntry entry;
+        entry.type = tokens[1];
+        entry.name = tokens[2];
+        entry.component = NULL;
+        entry.line = lineNumber;
+        entry.partition = -1;
+
+        int index = this->components.size();
+        this->components.push_back(entry);
+        this->componentIndex[entry.name] = index;
+
+        for (int i = 3; i < count; ++i) {
+            if (this->AddParameter(index, tokens[i], lineNumber)) return 1;
+        }
+        return 0;
+    }
+
+    if (strcmp(tokens[0], "connect") == 0) {
+        char* dot = (count == 4) ? strchr(tokens[1], '.') : NULL;
+        if (!dot || dot == tokens[1] || dot[1] == '\0') {
+            this->PrintError(lineNumber,
+                             "expected connect <source>.<parameter> "
+                             "<destination> <bufferSize>");
+            return 1;
+        }
+        *dot = '\0';
+
+        /* A size in bytes, e.g. 4096B, asks for a variable-length
+         * connection. */
+        char* end;
+        long bufferSize = strtol(tokens[3], &end, 0);
+        bool variableLength = (*end == 'B');
+        if (variableLength) ++end;
+        if (*end != '\0' || bufferSize <= 0 || bufferSize > 0x7ffffff0L) {
+            this->PrintError(lineNumber, "invalid buffer size \"%s\"",
+                             tokens[3]);
+            return 1;
+        }
+
+        std::unordered_map<std::string, int>::iterator source =
+            this->componentIndex.find(tokens[1]);
+        std::unordered_map<std::string, int>::iterator destination =
+            this->componentIndex.find(tokens[2]);
+        if (source == this->componentIndex.end()) {
+            this->PrintError(lineNumber, "unknown component \"%s\"",
+                             tokens[1]);
+            return 1;
+        }
+        if (destination == this->componentIndex.end()) {
+            this->PrintError(lineNumber, "unknown component \"%s\"",
+                             tokens[2]);
+            return 1;
+        }
+
+        ConnectionEntry entry;
+        entry.source = source->second;
+        entry.parameter = dot + 1;
+        entry.destination = destination->second;
+        entry.bufferSize = variableLength
+                               ? ByteRing::RoundCapacity(bufferSize)
+                               : bufferSize;
+        entry.variableLength = variableLength;
+        entry.line = lineNumber;
+        entry.storageOffset = 0;
+        entry.connectionID = -1;
+        entry.resizeTo = 0;
+        entry.resized = false;
+        this->connections.push_back(entry);
+        return 0;
+    }
+
+    if (strcmp(tokens[0], "partition") == 0) {
+        char* end = NULL;
+        long partition = (count == 3) ? strtol(tokens[2], &end, 0) : -1;
+        if (count != 3 || *end != '\0' || partition < 0 ||
+            partition > 0xffff) {
+            this->PrintError(lineNumber, "expected partition <component> "
+                                         "<index>");
+            return 1;
+        }
+
+        std::unordered_map<std::string, int>::iterator component =
+            this->componentIndex.find(tokens[1]);
+        if (component == this->componentIndex.end()) {
+            this->PrintError(lineNumber, "unknown component \"%s\"",
+                             tokens[1]);
+            return 1;
+        }
+        this->components[component->second].partition = partition;
+        return 0;
+    }
+
+    this->PrintError(lineNumber, "unknown directive \"%s\"", tokens[0]);
+    return 1;
+};
+
+int sinuca::config::Topology::ReadFile(const char* fileName) {
+    this->fileName = fileName;
+
+    FILE* file = fopen(fileName, "r");
+    if (!file) {
+        this->PrintError(0, "%s", strerror(errno));
+        return 1;
+    }
+
+    char* line = NULL;
+    size_t capacity = 0;
+    int lineNumber = 0;
+    int error = 0;
+
+    while (getline(&line, &capacity, file) != -1) {
+        ++lineNumber;
+        if (this->ParseLine(line, lineNumber)) {
+            error = 1;
+            break;
+        }
+    }
+
+    free(line);
+    fclose(file);
+
+    return error;
+};
+
+int sinuca::config::Topology::AddLine(const std::string& line) {
+    if (this->fileName.empty()) this->fileName = "<generated>";
+
+    std::vector<char> copy(line.begin(), line.end());
+    copy.push_back('\0');
+    return this->ParseLine(copy.data(), ++this->addedLines);
+};
+
+int sinuca::config::Topology::SetOverride(const char* assignment) {
+    const char* dot = strchr(assignment, '.');
+    if (!dot || dot == assignment) {
+        fprintf(stderr,
+                "Expected <component>.<parameter>=<value>, got \"%s\".\n",
+                assignment);
+        return 1;
+    }
+
+    std::unordered_map<std::string, int>::iterator it =
+        this->componentIndex.find(std::string(assignment, dot - assignment));
+    if (it == this->componentIndex.end()) {
+        fprintf(stderr, "Unknown component in override \"%s\".\n",
+                assignment);
+        return 1;
+    }
+
+    return this->AddParameter(it->second, dot + 1, 0);
+};
+
+int sinuca::config::Topology::SetResize(const char* assignment) {
+    const char* equals = strchr(assignment, '=');
+    char* end;
+    long size = equals ? strtol(equals + 1, &end, 0) : 0;
+    if (!equals || equals == assignment || *end != '\0' || size <= 0 ||
+        size > INT_MAX) {
+        fprintf(stderr, "Expected <source>.<parameter>=<size>, got \"%s\".\n",
+                assignment);
+        return 1;
+    }
+
+    std::string name(assignment, equals - assignment);
+    for (unsigned long i = 0; i < this->connections.size(); ++i) {
+        if (this->GetConnectionName(i) == name) {
+            this->connections[i].resizeTo = size;
+            return 0;
+        }
+    }
+
+    fprintf(stderr, "Unknown connection in resize \"%s\".\n", assignment);
+    return 1;
+};
+
+int sinuca::config::Topology::Validate() {
+    int error = 0;
+
+    for (unsigned long i = 0; i < this->components.size(); ++i) {
+        if (!ComponentRegistry::Find(this->components[i].type.c_str())) {
+            this->PrintError(this->components[i].line,
+                             "unknown component type \"%s\"",
+                             this->components[i].type.c_str());
+            error = 1;
+        }
+    }
+
+    std::unordered_map<std::string, int> connectedParameters;
+    for (unsigned long i = 0; i < this->connections.size(); ++i) {
+        const ConnectionEntry& connection = this->connections[i];
+        std::string key = ParameterKey(connection.source, connection.parameter);
+        const char* sourceName =
+            this->components[connection.source].name.c_str();
+
+        if (this->parameterIndex.count(key)) {
+            this->PrintError(connection.line,
+                             "parameter \"%s\" of \"%s\" is both a value "
+                             "and a connection",
+                             connection.parameter.c_str(), sourceName);
+            error = 1;
+        }
+
+        std::unordered_map<std::string, int>::iterator previous =
+            connectedParameters.find(key);
+        if (previous != connectedParameters.end()) {
+            this->PrintError(connection.line,
+                             "parameter \"%s\" of \"%s\" already "
+                             "connected at line %d",
+                             connection.parameter.c_str(), sourceName,
+                             previous->second);
+            error = 1;
+        } else {
+            connectedParameters[key] = connection.line;
+        }
+    }
+
+    return error;
+};
+
+int sinuca::config::Topology::Instantiate() {
+    for (unsigned long i = 0; i < this->components.size(); ++i) {
+        ComponentFactory factory =
+            ComponentRegistry::Find(this->components[i].type.c_str());
+        this->components[i].component = factory();
+        this->components[i].component->GetMemoryAccount()->parent =
+            &this->memoryAccount;
+    }
+
+    return 0;
+};
+
+int sinuca::config::Topology::LayOutConnections() {
+    std::vector<long> connectionsPerComponent(this->components.size(), 0);
+    long offset = 0;
+    /* Shared connections are constructed right before their buffers. */
+    long placementSize =
+        this->sharedConnections
+            ? (sizeof(engine::Connection) + STORAGE_ALIGNMENT - 1) &
+                  ~(STORAGE_ALIGNMENT - 1)
+            : 0;
+
+    for (unsigned long i = 0; i < this->connections.size(); ++i) {
+        ConnectionEntry& connection = this->connections[i];
+        offset += placementSize;
+        long messageSize =
+            this->components[connection.destination].component->GetMessageSize();
+        long size =
+            connection.variableLength
+                ? engine::Connection::GetByteRingStorageSize(
+                      connection.bufferSize)
+                : engine::Connection::GetStorageSize(connection.bufferSize,
+                                                     messageSize);
+
+        connection.storageOffset = offset;
+        offset += (size + STORAGE_ALIGNMENT - 1) & ~(STORAGE_ALIGNMENT - 1);
+        ++connectionsPerComponent[connection.destination];
+        this->components[connection.source].connections.push_back(i);
+        this->components[connection.destination].connections.push_back(i);
+    }
+
+    if (offset > 0) {
+        /* Mapped pages are page aligned and untouched, so FinishSetup decides
+         * where each ring lives. */
+        this->connectionStorage = static_cast<char*>(
+            this->sharedConnections
+                ? memory::MapSharedPages(offset,
+                                         &this->connectionStorageMapped)
+                : memory::MapPages(offset, &this->connectionStorageMapped));
+        if (!this->connectionStorage) {
+            this->PrintError(0, "could not allocate %ld bytes for connections",
+                             offset);
+            return 1;
+        }
+    }
+    this->connectionStorageSize = offset;
+
+    for (unsigned long i = 0; i < this->components.size(); ++i) {
+        if (connectionsPerComponent[i])
+            this->components[i].component->ReserveConnections(
+                connectionsPerComponent[i]);
+    }
+
+    for (unsigned long i = 0; i < this->connections.size(); ++i) {
+        ConnectionEntry& connection = this->connections[i];
+        engine::Linkable* destination =
+            this->components[connection.destination].component;
+
+        ConfigValue value;
+        value.type = ConfigValueTypeComponentReference;
+        value.value.reference.component = destination;
+        char* storage = this->connectionStorage + connection.storageOffset;
+        void* placement = placementSize ? storage - placementSize : NULL;
+        value.value.reference.connectionID =
+            connection.variableLength
+                ? destination->ConnectVariablePreallocated(
+                      connection.bufferSize, storage, placement)
+                : destination->ConnectPreallocated(connection.bufferSize,
+                                                   storage, placement);
+        connection.connectionID = value.value.reference.connectionID;
+
+        if (this->components[connection.source].component->SetConfigParameter(
+                connection.parameter.c_str(), value)) {
+            this->PrintError(connection.line,
+                             "\"%s\" rejected the connection \"%s\"",
+                             this->components[connection.source].name.c_str(),
+                             connection.parameter.c_str());
+            return 1;
+        }
+    }
+
+    return 0;
+};
+
+int sinuca::config::Topology::ApplyParameters() {
+    int error = 0;
+    std::string storage;
+
+    for (unsigned long i = 0; i < this->parameters.size(); ++i) {
+        const ParameterEntry& parameter = this->parameters[i];
+        const ComponentEntry& component =
+            this->components[parameter.component];
+
+        if (component.component->SetConfigParameter(
+                parameter.name.c_str(), ParseValue(parameter.value, storage))) {
+            this->PrintError(parameter.line,
+                             "\"%s\" rejected the parameter %s=%s",
+                             component.name.c_str(), parameter.name.c_str(),
+                             parameter.value.c_str());
+            error = 1;
+        }
+    }
+
+    return error;
+};
+
+int sinuca::config::Topology::Build(bool finishSetup) {
+    if (this->Validate()) return 1;
+    if (this->Instantiate()) return 1;
+    if (this->LayOutConnections()) return 1;
+    if (this->ApplyParameters()) return 1;
+
+    int error = 0;
+    for (unsigned long i = 0; i < this->connections.size(); ++i) {
+        if (this->connections[i].resizeTo &&
+            this->ResizeConnection(i, this->connections[i].resizeTo)) {
+            error = 1;
+        }
+    }
+    if (error || !finishSetup) return error;
+
+    for (unsigned long i = 0; i < this->components.size(); ++i) {
+        if (this->FinishSetup(i)) error = 1;
+    }
+
+    return error;
+};
+
+int sinuca::config::Topology::FinishSetup(long index) {
+    ComponentEntry& entry = this->components[index];
+
+    for (unsigned long i = 0; i < entry.connections.size(); ++i) {
+        const ConnectionEntry& connection =
+            this->connections[entry.connections[i]];
+        if (connection.resized) continue;
+        engine::Connection::TouchStorage(
+            this->connectionStorage + connection.storageOffset,
+            connection.bufferSize,
+            connection.variableLength ? 1
+                                      : this->components[connection.destination]
+                                            .component->GetMessageSize(),
+            (connection.destination == index) ? DEST_ID : SOURCE_ID);
+    }
+
+    if (entry.component->FinishSetup()) {
+        this->PrintError(entry.line, "\"%s\" failed to finish setup",
+                         entry.name.c_str());
+        return 1;
+    }
+
+    return 0;
+};
+
+sinuca::engine::Linkable* sinuca::config::Topology::FindComponent(
+    const char* name) const {
+    std::unordered_map<std::string, int>::const_iterator it =
+        this->componentIndex.find(name);
+    if (it == this->componentIndex.end()) return NULL;
+    return this->components[it->second].component;
+};
+
+std::string sinuca::config::Topology::GetConnectionName(long index) const {
+    const ConnectionEntry& connection = this->connections[index];
+    return this->components[connection.source].name + '.' +
+           connection.parameter;
+};
+
+sinuca::engine::Connection* sinuca::config::Topology::GetConnection(
+    long index) const {
+    const ConnectionEntry& connection = this->connections[index];
+    return this->components[connection.destination].component->GetConnection(
+        connection.connectionID);
+};
+
+int sinuca::config::Topology::ResizeConnection(long index, int bufferSize) {
+    ConnectionEntry& entry = this->connections[index];
+    if (this->GetConnection(index)->Resize(bufferSize)) {
+        fprintf(stderr, "%s:%d: connection %s was not resized.\n",
+                this->fileName.c_str(), entry.line,
+                this->GetConnectionName(index).c_str());
+        return 1;
+    }
+    entry.bufferSize = bufferSize;
+    entry.resized = true;
+    return 0;
+};
+
+void sinuca::config::Topology::PrintMemoryUsage(FILE* output,
+                                                const char* when,
+                                                long maxComponents) const {
+    fprintf(output,
+            "Memory at %s: %lu bytes (peak %lu), %lu live allocations, %lu "
+            "bytes of connections\n",
+            when, this->memoryAccount.currentBytes.load(),
+            this->memoryAccount.peakBytes.load(),
+            this->memoryAccount.liveAllocations.load(),
+            this->memoryAccount.connectionBytes.load());
+
+    /* The largest components first, they are the ones worth shrinking. */
+    std::vector<long> order(this->components.size());
+    for (unsigned long i = 0; i < order.size(); ++i) order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [this](long a, long b) {
+        return this->components[a].component->GetMemoryAccount()->currentBytes >
+               this->components[b].component->GetMemoryAccount()->currentBytes;
+    });
+
+    long shown = std::min(maxComponents, (long)order.size());
+    for (long i = 0; i < shown; ++i) {
+        const ComponentEntry& entry = this->components[order[i]];
+        const memory::Account* account = entry.component->GetMemoryAccount();
+        fprintf(output,
+                "  %s: %lu bytes (peak %lu), %lu live allocations, %lu bytes "
+                "of connections\n",
+                entry.name.c_str(), account->currentBytes.load(),
+                account->peakBytes.load(), account->liveAllocations.load(),
+                account->connectionBytes.load());
+    }
+    if ((long)order.size() > shown)
+        fprintf(output, "  ... %ld more components\n",
+                (long)order.size() - shown);
+};
+
+void sinuca::config::Topology::PrintBufferSizing(FILE* output) const {
+    long currentBytes = 0, recommendedBytes = 0;
+
+    fprintf(output, "Buffer sizing:\n");
+    for (unsigned long i = 0; i < this->connections.size(); ++i) {
+        const ConnectionEntry& entry = this->connections[i];
+        if (entry.variableLength) continue;
+
+        const engine::Connection* connection = this->GetConnection(i);
+        int highWaterMark = connection->GetHighWaterMark();
+        unsigned long fullEvents = connection->GetFullEvents();
+        int recommended = fullEvents ? 2 * entry.bufferSize : highWaterMark;
+        if (recommended < 1) recommended = 1;
+
+        fprintf(output,
+                "  %s: size %d, high-water %d, full %lu, recommended %d\n",
+                this->GetConnectionName(i).c_str(), entry.bufferSize,
+                highWaterMark, fullEvents, recommended);
+
+        long messageSize =
+            this->components[entry.destination].component->GetMessageSize();
+        currentBytes +=
+            engine::Connection::GetStorageSize(entry.bufferSize, messageSize);
+        recommendedBytes +=
+            engine::Connection::GetStorageSize(recommended, messageSize);
+    }
+    fprintf(output, "  %ld bytes of buffers, %ld as recommended\n",
+            currentBytes, recommendedBytes);
+};
+
+sinuca::config::Topology::~Topology() {
+    /* Components go first, their connections point into connectionStorage. */
+    for (unsigned long i = 0; i < this->components.size(); ++i) {
+        delete this->components[i].component;
+    }
+    if (this->connectionStorage)
+        memory::UnmapPages(this->connectionStorage,
+                           this->connectionStorageMapped);
+};
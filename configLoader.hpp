@@ -0,0 +1,335 @@
+#ifndef SINUCA3_CONFIG_CONFIG_LOADER_HPP_
+#define SINUCA3_CONFIG_CONFIG_LOADER_HPP_
+
+//
+// Copyright (C) 2024  HiPES - Universidade Federal do Paraná
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/**
+ * @file configLoader.hpp
+ * @brief Component registry and topology loader.
+ * @details A topology file is a list of lines, each one being either empty, a
+ * comment (starting with #), a component, a connection or a partition:
+ *
+ *     component <Type> <name> [<parameter>=<value>]...
+ *     connect <source>.<parameter> <destination> <bufferSize>
+ *     partition <component> <index>
+ *
+ * Values are integers, numbers, true/false or strings (optionally quoted). A
+ * connection makes <source> connect to <destination>, which becomes the
+ * recipient, and hands <source> a ComponentReference as <parameter>. A
+ * bufferSize ending in B (e.g. 4096B) is a size in bytes and makes a
+ * variable-length connection (see Linkable::ConnectVariable). A partition
+ * only matters when the topology runs in several processes (see
+ * partition.hpp).
+ */
+
+#include "config.hpp"
+#include "linkable.hpp"
+#include <cstdio>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace sinuca {
+namespace config {
+
+typedef engine::Linkable* (*ComponentFactory)();
+
+/**
+ * @brief Helper used by SINUCA3_REGISTER_COMPONENT.
+ */
+template <typename Type>
+engine::Linkable* CreateComponent() {
+    return new Type();
+}
+
+/**
+ * @brief Maps component type names, as written in the topology file, to the
+ * function that instantiates them.
+ */
+class ComponentRegistry {
+  public:
+    /**
+     * @brief Registers a component type.
+     * @param typeName The name used in the topology file.
+     * @param factory self-explanatory.
+     * @return Always 0, so it can initialize a static variable.
+     */
+    static int Register(const char* typeName, ComponentFactory factory);
+
+    /**
+     * @brief Self-explanatory
+     * @return The factory, or NULL if the type was never registered.
+     */
+    static ComponentFactory Find(const char* typeName);
+};
+
+/**
+ * @brief Builds the component graph described by a topology file.
+ * @details Loading happens in two steps. ReadFile parses the whole file
+ * without instantiating anything, so SetOverride can change parameters
+ * afterwards (e.g., when sweeping a parameter from the command line). Build
+ * then validates the graph, instantiates the components, allocates the storage
+ * of every connection in a single contiguous region, sets the parameters and
+ * calls FinishSetup on each component. The topology owns the components.
+ *
+ * The connection region is mapped under the page policy of memory::MapPages
+ * and left untouched. FinishSetup of a component first writes the buffers it
+ * consumes, so a driver that runs FinishSetup on the thread clocking each
+ * component (see Build) gets the tables and buffers of the component placed
+ * on that thread's NUMA node.
+ */
+class Topology {
+  private:
+    struct ComponentEntry {
+        std::string type;
+        std::string name;
+        engine::Linkable* component;
+        int line;
+        std::vector<int> connections; /**< Connections it is an end of. */
+        int partition;                /**< -1 if not given. */
+    };
+
+    struct ParameterEntry {
+        int component;
+        std::string name;
+        std::string value;
+        int line;
+    };
+
+    struct ConnectionEntry {
+        int source;
+        std::string parameter;
+        int destination;
+        int bufferSize; /**< Bytes of each ring when variableLength. */
+        bool variableLength;
+        int line;
+        long storageOffset;
+        int connectionID; /**< On the destination. */
+        int resizeTo;     /**< Set by SetResize, 0 to keep bufferSize. */
+        bool resized;     /**< Its buffers left connectionStorage. */
+    };
+
+    std::string fileName;
+    std::vector<ComponentEntry> components;
+    std::vector<ParameterEntry> parameters;
+    std::vector<ConnectionEntry> connections;
+    std::unordered_map<std::string, int> componentIndex;
+    std::unordered_map<std::string, int> parameterIndex; /**< Keyed by
+                                                            ParameterKey. */
+    char* connectionStorage;    /**< Backs the buffers of all connections. */
+    long connectionStorageSize; /**< Self-explanatory. */
+    unsigned long connectionStorageMapped; /**< Bytes mapped, for unmapping. */
+    memory::Account memoryAccount; /**< Parent of the component accounts. */
+    int addedLines;                /**< Given to AddLine. */
+    bool sharedConnections;        /**< See SetSharedConnections. */
+
+    static std::string ParameterKey(int component, const std::string& name);
+    int ParseLine(char* line, int lineNumber);
+    int AddParameter(int component, const char* assignment, int lineNumber);
+    int Validate();
+    int Instantiate();
+    int LayOutConnections();
+    int ApplyParameters();
+    void PrintError(int lineNumber, const char* format, ...);
+
+  public:
+    Topology()
+        : connectionStorage(NULL),
+          connectionStorageSize(0),
+          connectionStorageMapped(0),
+          addedLines(0),
+          sharedConnections(false){};
+
+    /**
+     * @brief Parses a topology file.
+     * @returns Non-zero on error, 0 otherwise.
+     */
+    int ReadFile(const char* fileName);
+
+    /**
+     * @brief Parses one line, as if read from a file, so tools can generate
+     * topologies (see trafficTopology.hpp). Lines are numbered in the order
+     * they are added.
+     * @returns Non-zero on error, 0 otherwise.
+     */
+    int AddLine(const std::string& line);
+
+    /**
+     * @brief Sets or replaces a parameter after the file was read.
+     * @param assignment A string in the form <component>.<parameter>=<value>.
+     * @returns Non-zero on error, 0 otherwise.
+     */
+    int SetOverride(const char* assignment);
+
+    /**
+     * @brief Makes Build resize a connection after the file was read, with
+     * ResizeConnection, before any component finishes its setup.
+     * @param assignment A string in the form <source>.<parameter>=<size>, the
+     * connection as named by GetConnectionName.
+     * @returns Non-zero on error, 0 otherwise.
+     */
+    int SetResize(const char* assignment);
+
+    /**
+     * @brief Makes Build place the connections, not only their buffers, in
+     * POSIX shared memory, so processes forked after Build share them.
+     */
+    inline void SetSharedConnections(bool shared) {
+        this->sharedConnections = shared;
+    };
+
+    /**
+     * @brief Validates and instantiates the graph.
+     * @param finishSetup When false, FinishSetup is left to the caller, e.g.
+     * so each worker thread finishes the components it clocks.
+     * @returns Non-zero on error, 0 otherwise.
+     */
+    int Build(bool finishSetup = true);
+
+    /**
+     * @brief Touches the connection buffers a component consumes, then calls
+     * its FinishSetup. Components may be finished from different threads.
+     * @returns Non-zero on error, 0 otherwise.
+     */
+    int FinishSetup(long index);
+
+    /**
+     * @brief Self-explanatory
+     */
+    inline long GetNumberOfComponents() const {
+        return this->components.size();
+    };
+
+    /**
+     * @brief Self-explanatory
+     */
+    inline engine::Linkable* GetComponent(long index) const {
+        return this->components[index].component;
+    };
+
+    /**
+     * @brief Self-explanatory
+     */
+    inline const char* GetComponentName(long index) const {
+        return this->components[index].name.c_str();
+    };
+
+    /**
+     * @return The partition given in the file, or -1.
+     */
+    inline int GetComponentPartition(long index) const {
+        return this->components[index].partition;
+    };
+
+    /**
+     * @brief Self-explanatory
+     */
+    inline long GetConnectionStorageSize() const {
+        return this->connectionStorageSize;
+    };
+
+    /**
+     * @brief Self-explanatory
+     */
+    inline long GetNumberOfConnections() const {
+        return this->connections.size();
+    };
+
+    /**
+     * @return The source component index of a connection, the one that
+     * connected.
+     */
+    inline long GetConnectionSource(long index) const {
+        return this->connections[index].source;
+    };
+
+    /**
+     * @return The destination component index of a connection, the recipient.
+     */
+    inline long GetConnectionDestination(long index) const {
+        return this->connections[index].destination;
+    };
+
+    /**
+     * @brief Self-explanatory
+     */
+    inline int GetConnectionBufferSize(long index) const {
+        return this->connections[index].bufferSize;
+    };
+
+    /**
+     * @return The name of a connection as written in the file,
+     * <source>.<parameter>.
+     */
+    std::string GetConnectionName(long index) const;
+
+    /**
+     * @brief Self-explanatory
+     */
+    engine::Connection* GetConnection(long index) const;
+
+    /**
+     * @brief Changes the capacity of a connection, keeping its queued
+     * messages (see engine::Connection::Resize). Components that size
+     * their own queues from their connections do it in FinishSetup, so
+     * resize before it, as SetResize does.
+     * @returns Non-zero on error, 0 otherwise.
+     */
+    int ResizeConnection(long index, int bufferSize);
+
+    /**
+     * @return The component with the given name, or NULL.
+     */
+    engine::Linkable* FindComponent(const char* name) const;
+
+    /**
+     * @brief Prints the memory charged to the components: the total, then
+     * the largest components.
+     * @param when Names the moment of the report, e.g. "setup".
+     * @param maxComponents Components listed at most.
+     */
+    void PrintMemoryUsage(FILE* output, const char* when,
+                          long maxComponents = 10) const;
+
+    /**
+     * @brief Prints, for each connection of fixed-size messages, its size,
+     * the largest occupation of its buffers, the Enqueues they refused and a
+     * recommended size, then the bytes the recommendations would save.
+     * @details A connection that never filled up is recommended its
+     * high-water mark, the smallest size that would not have stalled in the
+     * same run. One that filled up is recommended twice its size, to be
+     * checked with another run.
+     */
+    void PrintBufferSizing(FILE* output) const;
+
+    ~Topology();
+};
+
+}  // namespace config
+}  // namespace sinuca
+
+/**
+ * @brief Registers a component type in the ComponentRegistry.
+ * @details Shall be used once, in the source file of the component.
+ */
+#define SINUCA3_REGISTER_COMPONENT(Type)                       \
+    static const int sinuca3Registered##Type =                 \
+        sinuca::config::ComponentRegistry::Register(           \
+            #Type, sinuca::config::CreateComponent<Type>)
+
+#endif  // SINUCA3_CONFIG_CONFIG_LOADER_HPP_
@@ -0,0 +1,339 @@
+#ifndef SINUCA3_ENGINE_COROUTINE_COMPONENT_HPP_
+#define SINUCA3_ENGINE_COROUTINE_COMPONENT_HPP_
+
+//
+// Copyright (C) 2024  HiPES - Universidade Federal do Paraná
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/**
+ * @file coroutineComponent.hpp
+ * @brief Optional coroutine API for components, requires C++20 (build with
+ * make COROUTINES=1).
+ */
+
+#if !defined(__cpp_impl_coroutine)
+#error "coroutineComponent.hpp requires C++20 coroutines, build with COROUTINES=1."
+#endif
+
+#include <coroutine>
+#include <cstdlib>
+#include <deque>
+#include <vector>
+
+#include "component.hpp"
+
+namespace sinuca {
+
+/**
+ * @brief Return type of the coroutines of a CoroutineComponent.
+ * @details A task starts suspended and is owned by the component once given
+ * to Spawn. Tasks do not await each other, concurrent work is spawned.
+ */
+class Task {
+  public:
+    struct promise_type {
+        Task get_return_object() {
+            return Task(
+                std::coroutine_handle<promise_type>::from_promise(*this));
+        };
+        std::suspend_always initial_suspend() noexcept { return {}; };
+        std::suspend_always final_suspend() noexcept { return {}; };
+        void return_void(){};
+        void unhandled_exception() { abort(); };
+    };
+
+  private:
+    std::coroutine_handle<promise_type> coroutine;
+
+  public:
+    explicit Task(std::coroutine_handle<promise_type> coroutine)
+        : coroutine(coroutine){};
+    Task(Task&& other) : coroutine(other.coroutine) {
+        other.coroutine = nullptr;
+    };
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+
+    /**
+     * @brief Gives up the coroutine, its new owner destroys it.
+     */
+    inline std::coroutine_handle<> Release() {
+        std::coroutine_handle<> released = this->coroutine;
+        this->coroutine = nullptr;
+        return released;
+    };
+
+    ~Task() {
+        if (this->coroutine) this->coroutine.destroy();
+    };
+};
+
+/**
+ * @brief A component written as coroutines instead of a state machine.
+ * @details Instead of Clock, the component implements Run, which is spawned
+ * on the first cycle, and may Spawn more tasks, e.g. one per outstanding
+ * request. Inside a task:
+ *
+ *     MessageType response = co_await this->SendRequest(dest, id, request);
+ *     co_await this->NextCycle();
+ *     ReceivedRequest request = co_await this->NextRequest();
+ *
+ * Every cycle, Clock resumes only the tasks whose wait is over: those that
+ * yielded the previous cycle, those whose response arrived and those waiting
+ * for a request when one is ready. Nothing is polled per task: a send that
+ * finds the connection full is retried by Clock, and responses come back in
+ * the order the requests were sent on each connection, so they are handed to
+ * the waiting tasks in that order.
+ *
+ * Requests and responses share MessageType, like the rest of the engine.
+ */
+template <typename MessageType>
+class CoroutineComponent : public Component<MessageType> {
+  public:
+    struct ReceivedRequest {
+        int connectionID;
+        MessageType message;
+    };
+
+    class ResponseAwaiter;
+    class RequestAwaiter;
+
+  private:
+    /** Requests sent through one connection whose responses are awaited. */
+    struct PendingConnection {
+        engine::Linkable* dest;
+        int connectionID;
+        engine::ConnectionHandle handle;
+        std::deque<ResponseAwaiter*> unsent; /**< Waiting for room. */
+        std::deque<ResponseAwaiter*> sent;   /**< Waiting for the response. */
+    };
+
+    std::vector<std::coroutine_handle<>> tasks;  /**< Owned, alive. */
+    std::vector<std::coroutine_handle<>> nextCycle;
+    std::vector<std::coroutine_handle<>> resumable; /**< Scratch of Clock. */
+    std::vector<PendingConnection> pending;
+    std::deque<RequestAwaiter*> requestWaiters;
+    int nextRequest; /**< Round-robin start of NextRequest. */
+    bool started;
+
+    PendingConnection& FindPending(engine::Linkable* dest, int connectionID) {
+        for (unsigned long i = 0; i < this->pending.size(); ++i) {
+            if (this->pending[i].dest == dest &&
+                this->pending[i].connectionID == connectionID)
+                return this->pending[i];
+        }
+        this->pending.push_back(PendingConnection());
+        this->pending.back().dest = dest;
+        this->pending.back().connectionID = connectionID;
+        this->pending.back().handle =
+            this->ResolveConnectionToComponent(dest, connectionID);
+        return this->pending.back();
+    };
+
+    /**
+     * @details Sends right away when nothing is queued on the connection, so
+     * a request issued during a cycle leaves in that cycle.
+     */
+    void QueueRequest(ResponseAwaiter* awaiter) {
+        PendingConnection& connection =
+            this->FindPending(awaiter->dest, awaiter->connectionID);
+        if (connection.unsent.empty() &&
+            this->SendRequestByHandle(connection.handle, &awaiter->request)) {
+            connection.sent.push_back(awaiter);
+        } else {
+            connection.unsent.push_back(awaiter);
+        }
+    };
+
+    void Reap(std::coroutine_handle<> task) {
+        for (unsigned long i = 0; i < this->tasks.size(); ++i) {
+            if (this->tasks[i] == task) {
+                this->tasks[i] = this->tasks.back();
+                this->tasks.pop_back();
+                break;
+            }
+        }
+        task.destroy();
+    };
+
+  public:
+    /**
+     * @brief Awaitable of SendRequest, resumes with the response.
+     */
+    class ResponseAwaiter {
+        friend class CoroutineComponent;
+
+      private:
+        CoroutineComponent* owner;
+        engine::Linkable* dest;
+        int connectionID;
+        MessageType request;
+        MessageType response;
+        std::coroutine_handle<> task;
+
+      public:
+        ResponseAwaiter(CoroutineComponent* owner, engine::Linkable* dest,
+                        int connectionID, MessageType request)
+            : owner(owner),
+              dest(dest),
+              connectionID(connectionID),
+              request(request){};
+        bool await_ready() { return false; };
+        void await_suspend(std::coroutine_handle<> task) {
+            this->task = task;
+            this->owner->QueueRequest(this);
+        };
+        MessageType await_resume() { return this->response; };
+    };
+
+    /**
+     * @brief Awaitable of NextRequest, resumes with a request received.
+     */
+    class RequestAwaiter {
+        friend class CoroutineComponent;
+
+      private:
+        CoroutineComponent* owner;
+        ReceivedRequest received;
+        std::coroutine_handle<> task;
+
+      public:
+        RequestAwaiter(CoroutineComponent* owner) : owner(owner){};
+        bool await_ready() { return false; };
+        void await_suspend(std::coroutine_handle<> task) {
+            this->task = task;
+            this->owner->requestWaiters.push_back(this);
+        };
+        ReceivedRequest await_resume() { return this->received; };
+    };
+
+    /**
+     * @brief Awaitable of NextCycle.
+     */
+    class CycleAwaiter {
+      private:
+        CoroutineComponent* owner;
+
+      public:
+        CycleAwaiter(CoroutineComponent* owner) : owner(owner){};
+        bool await_ready() { return false; };
+        void await_suspend(std::coroutine_handle<> task) {
+            this->owner->nextCycle.push_back(task);
+        };
+        void await_resume(){};
+    };
+
+    CoroutineComponent() : nextRequest(0), started(false){};
+
+    /**
+     * @brief The main task, spawned on the first cycle.
+     */
+    virtual Task Run() = 0;
+
+    /**
+     * @brief Takes a task, which starts running on the next cycle.
+     */
+    void Spawn(Task task) {
+        std::coroutine_handle<> coroutine = task.Release();
+        this->tasks.push_back(coroutine);
+        this->nextCycle.push_back(coroutine);
+    };
+
+    /**
+     * @brief Sends a request to dest and suspends until its response.
+     * @param connectionID The connection ID obtained from dest.
+     */
+    ResponseAwaiter SendRequest(engine::Linkable* dest, int connectionID,
+                                MessageType request) {
+        return ResponseAwaiter(this, dest, connectionID, request);
+    };
+
+    /**
+     * @brief Suspends until one of the connections of *this* component has a
+     * request, taken in round-robin order. Answer it with
+     * SendResponseForConnection.
+     */
+    RequestAwaiter NextRequest() { return RequestAwaiter(this); };
+
+    /**
+     * @brief Suspends until the next cycle.
+     */
+    CycleAwaiter NextCycle() { return CycleAwaiter(this); };
+
+    /**
+     * @brief Number of tasks not finished yet.
+     */
+    inline long GetNumberOfTasks() const { return this->tasks.size(); };
+
+    /**
+     * @details Decides which tasks resume before resuming any, so tasks
+     * resumed this cycle only add work for the next one.
+     */
+    void Clock() final {
+        if (!this->started) {
+            this->started = true;
+            this->Spawn(this->Run());
+        }
+
+        this->resumable.swap(this->nextCycle);
+
+        for (unsigned long i = 0; i < this->pending.size(); ++i) {
+            PendingConnection& connection = this->pending[i];
+            while (!connection.unsent.empty() &&
+                   this->SendRequestByHandle(connection.handle,
+                                             &connection.unsent.front()
+                                                  ->request)) {
+                connection.sent.push_back(connection.unsent.front());
+                connection.unsent.pop_front();
+            }
+            while (!connection.sent.empty() &&
+                   this->ReceiveResponseByHandle(
+                       connection.handle,
+                       &connection.sent.front()->response)) {
+                this->resumable.push_back(connection.sent.front()->task);
+                connection.sent.pop_front();
+            }
+        }
+
+        while (!this->requestWaiters.empty()) {
+            int id = this->FindReadyRequest(this->nextRequest);
+            if (id < 0) break;
+
+            RequestAwaiter* awaiter = this->requestWaiters.front();
+            this->requestWaiters.pop_front();
+            this->ReceiveRequestForAConnection(id, &awaiter->received.message);
+            awaiter->received.connectionID = id;
+            this->resumable.push_back(awaiter->task);
+            this->nextRequest = id + 1;
+        }
+
+        for (unsigned long i = 0; i < this->resumable.size(); ++i) {
+            std::coroutine_handle<> task = this->resumable[i];
+            task.resume();
+            if (task.done()) this->Reap(task);
+        }
+        this->resumable.clear();
+    };
+
+    virtual ~CoroutineComponent() {
+        for (unsigned long i = 0; i < this->tasks.size(); ++i)
+            this->tasks[i].destroy();
+    };
+};
+
+}  // namespace sinuca
+
+#endif  // SINUCA3_ENGINE_COROUTINE_COMPONENT_HPP_
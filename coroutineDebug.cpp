@@ -0,0 +1,108 @@
+//
+// Copyright (C) 2024  HiPES - Universidade Federal do Paraná
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/**
+ * @file coroutineDebug.cpp
+ * @brief EngineDebugComponent written as coroutines. Compiled in with
+ * COROUTINES=1, empty otherwise.
+ */
+
+#ifdef SINUCA3_COROUTINES
+
+#include <cstdio>
+#include <cstring>
+
+#include "configLoader.hpp"
+#include "coroutineComponent.hpp"
+
+namespace sinuca {
+
+/**
+ * @brief Sends requests to otherComponent and prints the responses, or, when
+ * not connected, answers each request with its value plus one.
+ * @details Parameters: otherComponent (connection), requests per worker
+ * (default 3) and workers, the tasks with a request outstanding at once
+ * (default 1).
+ */
+class CoroutineDebugComponent : public CoroutineComponent<int> {
+  private:
+    engine::Linkable* otherComponent;
+    int connectionID;
+    long requests;
+    long workers;
+
+    Task Worker(long worker) {
+        for (long i = 0; i < this->requests; ++i) {
+            int request = 10 * (worker + 1) + i;
+            int response =
+                co_await this->SendRequest(this->otherComponent,
+                                           this->connectionID, request);
+            printf("Worker %ld: %d -> %d\n", worker, request, response);
+            co_await this->NextCycle();
+        }
+    };
+
+    Task Serve() {
+        for (;;) {
+            ReceivedRequest received = co_await this->NextRequest();
+            int response = received.message + 1;
+            this->SendResponseForConnection(received.connectionID, &response);
+        }
+    };
+
+  public:
+    CoroutineDebugComponent()
+        : otherComponent(NULL), connectionID(0), requests(3), workers(1){};
+
+    int SetConfigParameter(const char* parameter, config::ConfigValue value) {
+        if (strcmp(parameter, "otherComponent") == 0 &&
+            value.type == config::ConfigValueTypeComponentReference) {
+            this->otherComponent = value.value.reference.component;
+            this->connectionID = value.value.reference.connectionID;
+            return 0;
+        }
+        if ((strcmp(parameter, "requests") == 0 ||
+             strcmp(parameter, "workers") == 0) &&
+            value.type == config::ConfigValueTypeInteger &&
+            value.value.integer > 0) {
+            if (parameter[0] == 'r') {
+                this->requests = value.value.integer;
+            } else {
+                this->workers = value.value.integer;
+            }
+            return 0;
+        }
+        return engine::Linkable::SetConfigParameter(parameter, value);
+    };
+
+    int FinishSetup() { return 0; };
+
+    Task Run() {
+        if (!this->otherComponent) {
+            this->Spawn(this->Serve());
+            co_return;
+        }
+        for (long i = 0; i < this->workers; ++i) this->Spawn(this->Worker(i));
+    };
+};
+
+}  // namespace sinuca
+
+using sinuca::CoroutineDebugComponent;
+SINUCA3_REGISTER_COMPONENT(CoroutineDebugComponent);
+
+#endif  // SINUCA3_COROUTINES
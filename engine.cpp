@@ -0,0 +1,101 @@
+//
+// Copyright (C) 2024  HiPES - Universidade Federal do Paraná
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/**
+ * @file engine.cpp
+ * @brief Implementation of the Engine class.
+ */
+
+#include "engine.hpp"
+
+#include "trace.hpp"
+
+void sinuca::engine::Engine::AddComponent(Linkable* component) {
+    component->SetTraceID(this->components.size());
+    this->components.push_back(component);
+};
+
+void sinuca::engine::Engine::Clock() {
+    unsigned long size = this->components.size();
+
+    for (unsigned long i = 0; i < size; ++i) this->components[i]->PreClock();
+    SINUCA3_TRACE_EVENT(TraceEventCycle, 0, this->cycle);
+    for (unsigned long i = 0; i < size; ++i) {
+        SINUCA3_TRACE_EVENT(TraceEventClockBegin, i, 0);
+        this->components[i]->Clock();
+        SINUCA3_TRACE_EVENT(TraceEventClockEnd, i, 0);
+    }
+    for (unsigned long i = 0; i < size; ++i) this->components[i]->PosClock();
+
+    ++this->cycle;
+};
+
+void sinuca::engine::Engine::Simulate(unsigned long cycles) {
+    for (unsigned long i = 0; i < cycles; ++i) this->Clock();
+};
+
+unsigned long sinuca::engine::Engine::SimulateInstructions(
+    unsigned long instructions) {
+    unsigned long start = this->GetInstructionCount();
+    unsigned long consumed = 0;
+
+    while (consumed < instructions && !this->IsFinished()) {
+        this->Clock();
+        consumed = this->GetInstructionCount() - start;
+    }
+
+    return consumed;
+};
+
+void sinuca::engine::Engine::Drain() {
+    unsigned long size = this->components.size();
+
+    for (unsigned long i = 0; i < size; ++i)
+        this->components[i]->SetDraining(true);
+    while (!this->IsDrained()) this->Clock();
+    for (unsigned long i = 0; i < size; ++i)
+        this->components[i]->SetDraining(false);
+};
+
+unsigned long sinuca::engine::Engine::FastForward(unsigned long instructions) {
+    unsigned long skipped = 0;
+    this->Drain();
+    for (unsigned long i = 0; i < this->components.size(); ++i)
+        skipped += this->components[i]->FastForward(instructions);
+    return skipped;
+};
+
+unsigned long sinuca::engine::Engine::GetInstructionCount() const {
+    unsigned long count = 0;
+    for (unsigned long i = 0; i < this->components.size(); ++i)
+        count += this->components[i]->GetInstructionCount();
+    return count;
+};
+
+bool sinuca::engine::Engine::IsFinished() const {
+    for (unsigned long i = 0; i < this->components.size(); ++i) {
+        if (!this->components[i]->IsFinished()) return false;
+    }
+    return true;
+};
+
+bool sinuca::engine::Engine::IsDrained() const {
+    for (unsigned long i = 0; i < this->components.size(); ++i) {
+        if (!this->components[i]->IsDrained()) return false;
+    }
+    return true;
+};
@@ -0,0 +1,114 @@
+#ifndef SINUCA3_ENGINE_ENGINE_HPP_
+#define SINUCA3_ENGINE_ENGINE_HPP_
+
+//
+// Copyright (C) 2024  HiPES - Universidade Federal do Paraná
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/**
+ * @file engine.hpp
+ * @brief Public API of the simulation engine.
+ */
+
+#include "linkable.hpp"
+#include <vector>
+
+namespace sinuca {
+namespace engine {
+
+/**
+ * @brief Drives the clock of a set of components.
+ * @details The engine does not own the components, it only keeps a reference
+ * to them. Every cycle it calls PreClock on all components, then Clock, then
+ * PosClock, always in the order they were added.
+ *
+ * Besides this timing mode, the engine can fast-forward the components
+ * functionally (see Linkable::FastForward), so a run can alternate between
+ * functional warm-up and detailed intervals measured in instructions.
+ */
+class Engine {
+  private:
+    std::vector<Linkable*> components; /**< Components clocked each cycle. */
+    unsigned long cycle;               /**< Current cycle. */
+
+  public:
+    Engine() : cycle(0){};
+
+    /**
+     * @brief Adds a component to the clock loop.
+     * @param component self-explanatory.
+     */
+    void AddComponent(Linkable* component);
+
+    /**
+     * @brief Self-explanatory
+     */
+    inline unsigned long GetCycle() const { return this->cycle; };
+
+    /**
+     * @brief Simulates a single clock cycle.
+     */
+    void Clock();
+
+    /**
+     * @brief Simulates the given number of cycles.
+     * @param cycles self-explanatory.
+     */
+    void Simulate(unsigned long cycles);
+
+    /**
+     * @brief Clocks the components until they consume the given number of
+     * instructions or all of them are finished.
+     * @returns The instructions consumed.
+     */
+    unsigned long SimulateInstructions(unsigned long instructions);
+
+    /**
+     * @brief Clocks the components, without taking new instructions, until
+     * none has work in flight (see Linkable::IsDrained).
+     */
+    void Drain();
+
+    /**
+     * @brief Drains the components, then skips instructions in functional
+     * mode, where no cycle passes.
+     * @details Draining first keeps the writes still in flight from landing
+     * after the functional ones, and the instructions already taken from
+     * being counted twice.
+     * @returns The instructions skipped, summed over the components.
+     */
+    unsigned long FastForward(unsigned long instructions);
+
+    /**
+     * @brief Instructions consumed by all components, in both modes.
+     */
+    unsigned long GetInstructionCount() const;
+
+    /**
+     * @brief Whether every component is finished.
+     */
+    bool IsFinished() const;
+
+    /**
+     * @brief Whether every component is drained.
+     */
+    bool IsDrained() const;
+};
+
+}  // namespace engine
+}  // namespace sinuca
+
+#endif  // SINUCA3_ENGINE_ENGINE_HPP_
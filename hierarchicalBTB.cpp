@@ -0,0 +1,380 @@
+#include "hierarchicalBTB.hpp"
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sys/types.h>
+#include "configLoader.hpp"
+
+SINUCA3_REGISTER_COMPONENT(HierarchicalBTB);
+
+/* ==========================================================================
+    Hierarchical BTB Methods
+   ========================================================================== */
+
+HierarchicalBTB::HierarchicalBTB() : sinuca::Component<BTBMessage>(), numBanks(2), numLevels(2), policy(HBTB_INCLUSIVE),
+    nextFetchBlock(0), instructionValidBits(nullptr), lastLatency(0), currentCycle(0), flushes(0), totalLatency(0), totalLookups(0),
+    blockTargets(nullptr), blockStates(nullptr), victimTargets(nullptr), victimStates(nullptr), warmUpTargets(nullptr),
+    warmUpExecuted(nullptr), responseValidBits(nullptr), responseSlots(0), nextResponseSlot(0) {
+    for (uint level = 0; level < HBTB_MAX_LEVELS; ++level) {
+        levels[level].table = nullptr;
+        levels[level].numEntries = (level == 0) ? 4 : 10;
+        levels[level].latency = (level == 0) ? 0 : 2;
+        levels[level].residentAddresses = nullptr;
+        levels[level].lookups = 0;
+        levels[level].hits = 0;
+        levels[level].fills = 0;
+        levels[level].victims = 0;
+    }
+};
+
+int HierarchicalBTB::SetConfigParameter(const char* parameter, sinuca::config::ConfigValue value) {
+    if (strcmp(parameter, "policy") == 0) {
+        if (value.type == sinuca::config::ConfigValueTypeString && strcmp(value.value.string, "inclusive") == 0) {
+            policy = HBTB_INCLUSIVE;
+        } else if (value.type == sinuca::config::ConfigValueTypeString && strcmp(value.value.string, "exclusive") == 0) {
+            policy = HBTB_EXCLUSIVE;
+        } else {
+            fprintf(stderr, "HierarchicalBTB: policy must be inclusive or exclusive.\n");
+            return 1;
+        }
+        return 0;
+    }
+
+    /* Per level parameters: l<N>Entries and l<N>Latency. */
+    bool isEntries = false, isLatency = false;
+    uint level = 0;
+    if (parameter[0] == 'l' && parameter[1] >= '0' && parameter[1] < (char)('0' + HBTB_MAX_LEVELS)) {
+        level = parameter[1] - '0';
+        isEntries = (strcmp(parameter + 2, "Entries") == 0);
+        isLatency = (strcmp(parameter + 2, "Latency") == 0);
+    }
+    bool isBanks = (strcmp(parameter, "numBanks") == 0);
+    bool isLevels = (strcmp(parameter, "numLevels") == 0);
+
+    if (!(isEntries || isLatency || isBanks || isLevels)) {
+        return Linkable::SetConfigParameter(parameter, value);
+    }
+
+    if (value.type != sinuca::config::ConfigValueTypeInteger || value.value.integer < 0) {
+        fprintf(stderr, "HierarchicalBTB: %s must be a non-negative integer.\n", parameter);
+        return 1;
+    }
+
+    if ((isBanks || isEntries) && (value.value.integer < 1 || value.value.integer > 24)) {
+        fprintf(stderr, "HierarchicalBTB: %s must be an integer between 1 and 24 (bits).\n", parameter);
+        return 1;
+    }
+
+    if (isLevels && (value.value.integer < 1 || value.value.integer > (long)HBTB_MAX_LEVELS)) {
+        fprintf(stderr, "HierarchicalBTB: numLevels must be an integer between 1 and %u.\n", HBTB_MAX_LEVELS);
+        return 1;
+    }
+
+    if (isBanks) {
+        numBanks = value.value.integer;
+    } else if (isLevels) {
+        numLevels = value.value.integer;
+    } else if (isEntries) {
+        levels[level].numEntries = value.value.integer;
+    } else {
+        levels[level].latency = value.value.integer;
+    }
+
+    return 0;
+};
+
+int HierarchicalBTB::FinishSetup() {
+    uint totalBanks = (1 << numBanks);
+
+    for (uint level = 0; level < numLevels; ++level) {
+        /* The levels are not in the topology, their memory is charged to the hierarchy. */
+        levels[level].table = new BranchTargetBuffer();
+        levels[level].table->GetMemoryAccount()->parent = GetMemoryAccount();
+        levels[level].table->allocate(numBanks, levels[level].numEntries);
+
+        /* Victims need their full address: exclusive levels move them down, inclusive ones invalidate them above. */
+        bool hasVictims = (policy == HBTB_EXCLUSIVE) ? (level + 1 < numLevels) : (level > 0);
+        if (hasVictims) {
+            levels[level].residentAddresses = AllocateArray<uint64_t>(1 << levels[level].numEntries);
+        }
+    }
+
+    /* A connection brings at most a buffer of requests per cycle, each answered within the latency of every level,
+     * and its requests wait while a response does not fit. */
+    uint totalLatency = 0;
+    for (uint level = 0; level < numLevels; ++level) {
+        totalLatency += levels[level].latency;
+    }
+    responseSlots = 1;
+    for (uint i = 0; i < connections.size(); ++i) {
+        const sinuca::engine::ConnectionHandle& handle = ResolveConnection(i);
+        if (handle.requestInput && handle.responseOutput) {
+            responseSlots += handle.requestInput->GetSize() * (totalLatency + 1) + handle.responseOutput->GetSize();
+        }
+    }
+    stalledConnections.assign(connections.size(), false);
+
+    instructionValidBits = AllocateArray<bool>(totalBanks);
+    blockTargets = AllocateArray<uint64_t>(totalBanks);
+    blockStates = AllocateArray<uint8_t>(totalBanks);
+    victimTargets = AllocateArray<uint64_t>(totalBanks * numLevels);
+    victimStates = AllocateArray<uint8_t>(totalBanks * numLevels);
+    warmUpTargets = AllocateArray<uint64_t>(totalBanks);
+    warmUpExecuted = AllocateArray<bool>(totalBanks);
+    responseValidBits = AllocateArray<bool>((unsigned long)responseSlots * totalBanks);
+
+    return 0;
+};
+
+void HierarchicalBTB::fillLevel(uint level, uint64_t fetchAddress, uint64_t* fetchTargets,
+                                const uint8_t* predictorStates) {
+    hbtb_level& current = levels[level];
+
+    if (current.residentAddresses) {
+        uint32_t index = current.table->getIndex(fetchAddress);
+        uint64_t victim = current.residentAddresses[index];
+        uint64_t* targets = &victimTargets[level * (1 << numBanks)];
+        uint8_t* states = &victimStates[level * (1 << numBanks)];
+
+        /* The victim is read before it is overwritten, then written one level down, or dropped from the levels
+         * above. Slots never written hold 0, which only names a real block in slot 0. */
+        bool resident = (victim != fetchAddress) && (current.table->getIndex(victim) == index);
+        if (resident && current.table->readBlock(victim, targets, 0, states)) {
+            ++current.victims;
+            if (policy == HBTB_EXCLUSIVE) {
+                fillLevel(level + 1, victim, targets, states);
+            } else {
+                for (uint upper = 0; upper < level; ++upper) {
+                    levels[upper].table->invalidateBlock(victim);
+                }
+            }
+        }
+        current.residentAddresses[index] = fetchAddress;
+    }
+
+    ++current.fills;
+    current.table->registerNewBlock(fetchAddress, fetchTargets, 0, predictorStates);
+};
+
+uint HierarchicalBTB::lookup(uint64_t fetchAddress) {
+    uint totalBanks = (1 << numBanks);
+    uint hitLevel = numLevels;
+
+    for (uint level = 0; level < numLevels; ++level) {
+        BranchTargetBuffer* table = levels[level].table;
+
+        ++levels[level].lookups;
+        TypeBTBMessage result = table->fetchBTBEntry(fetchAddress);
+
+        /* The last level visited gives the prediction, sequential on a miss. */
+        nextFetchBlock = table->getNextFetchBlock();
+        memcpy(instructionValidBits, table->getInstructionValidBits(), totalBanks * sizeof(bool));
+
+        if (result == ALLOCATED_ENTRY) {
+            ++levels[level].hits;
+            hitLevel = level;
+            break;
+        }
+    }
+
+    lastLatency = 0;
+    for (uint level = 0; level < numLevels && level <= hitLevel; ++level) {
+        lastLatency += levels[level].latency;
+    }
+    ++totalLookups;
+    totalLatency += lastLatency;
+
+    if (hitLevel == 0 || hitLevel == numLevels) {
+        return hitLevel;
+    }
+
+    /* Promotion, with the predictors: inclusive fills every level above the hit, from the lowest so the victims
+     * invalidated above are never the block, exclusive moves the block to L0. */
+    levels[hitLevel].table->readBlock(fetchAddress, blockTargets, 0, blockStates);
+    if (policy == HBTB_EXCLUSIVE) {
+        levels[hitLevel].table->invalidateBlock(fetchAddress);
+        fillLevel(0, fetchAddress, blockTargets, blockStates);
+    } else {
+        for (uint level = hitLevel; level-- > 0;) {
+            fillLevel(level, fetchAddress, blockTargets, blockStates);
+        }
+    }
+
+    return hitLevel;
+};
+
+TypeBTBMessage HierarchicalBTB::fetchBTBEntry(uint64_t fetchAddress) {
+    return (lookup(fetchAddress) < numLevels) ? ALLOCATED_ENTRY : UNALLOCATED_ENTRY;
+};
+
+void HierarchicalBTB::registerNewBlock(uint64_t fetchAddress, uint64_t* fetchTargets) {
+    if (policy == HBTB_EXCLUSIVE) {
+        fillLevel(0, fetchAddress, fetchTargets, nullptr);
+        return;
+    }
+
+    for (uint level = numLevels; level-- > 0;) {
+        fillLevel(level, fetchAddress, fetchTargets, nullptr);
+    }
+};
+
+void HierarchicalBTB::updateBlock(uint64_t fetchAddress, bool* executedInstructions) {
+    for (uint level = 0; level < numLevels; ++level) {
+        levels[level].table->updateBlock(fetchAddress, executedInstructions);
+    }
+};
+
+void HierarchicalBTB::flush() {
+    for (uint level = 0; level < numLevels; ++level) {
+        levels[level].table->flushAsid(0);
+    }
+    ++flushes;
+};
+
+uint HierarchicalBTB::getTotalBanks() {
+    return (1 << numBanks);
+};
+
+TypeBTBMessage HierarchicalBTB::warmUpBranch(uint64_t address, uint64_t target, bool taken, uint8_t) {
+    uint totalBanks = (1 << numBanks);
+    TypeBTBMessage result = fetchBTBEntry(address);
+
+    if (result == UNALLOCATED_ENTRY) {
+        for (uint bank = 0; bank < totalBanks; ++bank) {
+            warmUpTargets[bank] = target;
+        }
+        registerNewBlock(address, warmUpTargets);
+    }
+
+    for (uint bank = 0; bank < totalBanks; ++bank) {
+        warmUpExecuted[bank] = true;
+    }
+    warmUpExecuted[address & (totalBanks - 1)] = taken;
+    updateBlock(address, warmUpExecuted);
+
+    return result;
+};
+
+uint64_t HierarchicalBTB::getNextFetchBlock() {
+    return nextFetchBlock;
+};
+
+bool* HierarchicalBTB::getInstructionValidBits() {
+    return instructionValidBits;
+};
+
+void HierarchicalBTB::Clock() {
+    uint totalBanks = (1 << numBanks);
+    uint numConnections = connections.size();
+    hbtb_inflight_response response;
+    ++currentCycle;
+
+    for (uint connection = 0; connection < numConnections; ++connection) {
+        const sinuca::engine::ConnectionHandle& handle = ResolveConnection(connection);
+
+        while (!stalledConnections[connection] && ReceiveRequestByHandle(handle, &response.message)) {
+            BTBMessage& message = response.message;
+
+            switch (message.messageType) {
+                case BTB_REQUEST: {
+                    uint hitLevel = lookup(message.fetchAddress);
+                    message.messageType = (hitLevel < numLevels) ? ALLOCATED_ENTRY : UNALLOCATED_ENTRY;
+                    message.nextBlock = nextFetchBlock;
+
+                    bool* slot = &responseValidBits[(unsigned long)nextResponseSlot * totalBanks];
+                    memcpy(slot, instructionValidBits, totalBanks * sizeof(bool));
+                    nextResponseSlot = (nextResponseSlot + 1) % responseSlots;
+                    message.validBits = slot;
+
+                    response.connection = connection;
+                    response.readyCycle = currentCycle + lastLatency;
+                    inflightResponses.push_back(response);
+                    break;
+                }
+                case BTB_ALLOCATION_REQUEST:
+                    registerNewBlock(message.fetchAddress, message.fetchTargets);
+                    break;
+                case BTB_UPDATE_REQUEST:
+                    updateBlock(message.fetchAddress, message.executedInstructions);
+                    break;
+                case BTB_FLUSH_REQUEST:
+                    flush();
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+
+    /* Responses leave in the order they became ready; a zero latency lookup answers in this cycle. One that does not
+     * fit stays, and so do the later ones of its connection. */
+    stalledConnections.assign(numConnections, false);
+    uint kept = 0;
+    for (uint i = 0; i < inflightResponses.size(); ++i) {
+        hbtb_inflight_response& inflight = inflightResponses[i];
+        if (inflight.readyCycle <= currentCycle && !stalledConnections[inflight.connection]) {
+            if (SendResponseByHandle(ResolveConnection(inflight.connection), &inflight.message)) {
+                continue;
+            }
+            stalledConnections[inflight.connection] = true;
+        }
+        inflightResponses[kept++] = inflight;
+    }
+    inflightResponses.resize(kept);
+};
+
+void HierarchicalBTB::PrintStatistics() {
+    printf("hbtb.policy: %s\n", (policy == HBTB_EXCLUSIVE) ? "exclusive" : "inclusive");
+    printf("hbtb.lookups: %lu\n", (unsigned long)totalLookups);
+    printf("hbtb.average_latency: %.3f\n", totalLookups ? (double)totalLatency / totalLookups : 0.0);
+    if (flushes) {
+        printf("hbtb.flushes: %lu\n", (unsigned long)flushes);
+    }
+
+    for (uint level = 0; level < numLevels; ++level) {
+        hbtb_level& current = levels[level];
+        printf("hbtb.l%u.entries: %u\n", level, (1U << numBanks) * (1U << current.numEntries));
+        printf("hbtb.l%u.lookups: %lu\n", level, (unsigned long)current.lookups);
+        printf("hbtb.l%u.hits: %lu\n", level, (unsigned long)current.hits);
+        printf("hbtb.l%u.hit_rate: %.4f\n", level, current.lookups ? (double)current.hits / current.lookups : 0.0);
+        printf("hbtb.l%u.fills: %lu\n", level, (unsigned long)current.fills);
+        printf("hbtb.l%u.victims: %lu\n", level, (unsigned long)current.victims);
+    }
+};
+
+unsigned long HierarchicalBTB::GetMessageRecordSize() const {
+    return getBTBMessageRecordSize(1 << numBanks);
+};
+
+void HierarchicalBTB::EncodeMessage(const void* message, void* record) const {
+    encodeBTBMessage(1 << numBanks, static_cast<const BTBMessage*>(message), record);
+};
+
+void HierarchicalBTB::DecodeMessage(void* record, void* message) const {
+    decodeBTBMessage(1 << numBanks, record, static_cast<BTBMessage*>(message));
+};
+
+bool HierarchicalBTB::ExpectsResponse(const void* request) const {
+    return static_cast<const BTBMessage*>(request)->messageType == BTB_REQUEST;
+};
+
+bool HierarchicalBTB::IsDrained() const {
+    return inflightResponses.empty() && !GetNumberOfReadyRequests();
+};
+
+HierarchicalBTB::~HierarchicalBTB() {
+    for (uint level = 0; level < HBTB_MAX_LEVELS; ++level) {
+        delete levels[level].table;
+        sinuca::memory::Free(levels[level].residentAddresses);
+    }
+
+    sinuca::memory::Free(instructionValidBits);
+    sinuca::memory::Free(blockTargets);
+    sinuca::memory::Free(blockStates);
+    sinuca::memory::Free(victimTargets);
+    sinuca::memory::Free(victimStates);
+    sinuca::memory::Free(warmUpTargets);
+    sinuca::memory::Free(warmUpExecuted);
+    sinuca::memory::Free(responseValidBits);
+};
@@ -0,0 +1,172 @@
+#ifndef HIERARCHICAL_BTB
+#define HIERARCHICAL_BTB
+
+/**
+ * @file hierarchicalBTB.hpp
+ * @brief Implementation of a multi-level Branch Target Buffer
+ */
+#include <cstdint>
+#include <sys/types.h>
+#include <vector>
+#include "interleavedBTB.hpp"
+
+static const uint HBTB_MAX_LEVELS = 4;
+
+enum TypeHBTBPolicy {
+    HBTB_INCLUSIVE, /**< Every level holds the blocks of the levels above it, its victims leave them too. */
+    HBTB_EXCLUSIVE  /**< A block lives in a single level, victims move down. */
+};
+
+/**
+ * @brief A response waiting for the latency of the level that produced it
+ */
+struct hbtb_inflight_response {
+    BTBMessage message;
+    uint connection;
+    uint64_t readyCycle;
+};
+
+/**
+ * @brief Per level bookkeeping
+ * @details residentAddresses keeps the full fetch address of each block, because the partial tags of the BTB can't
+ * be turned back into an address when a victim has to move to the level below (exclusive) or be invalidated in the
+ * levels above (inclusive).
+ */
+struct hbtb_level {
+    BranchTargetBuffer* table;
+    uint numEntries;              /**< Bits used to index the entries. */
+    uint latency;                 /**< Cycles added by a lookup in this level. */
+    uint64_t* residentAddresses;  /**< Only for the levels that have victims to move, 0 when empty. */
+    uint64_t lookups;
+    uint64_t hits;
+    uint64_t fills;
+    uint64_t victims;
+};
+
+class HierarchicalBTB : public sinuca::Component<BTBMessage>, public BTBFunctionalInterface {
+    private:
+        uint numBanks;
+        uint numLevels;
+        TypeHBTBPolicy policy;
+        hbtb_level levels[HBTB_MAX_LEVELS];
+
+        uint64_t nextFetchBlock;
+        bool* instructionValidBits;
+        uint lastLatency;                 /**< Cycles taken by the last lookup. */
+
+        uint64_t currentCycle;
+        uint64_t flushes;
+        uint64_t totalLatency;
+        uint64_t totalLookups;
+        std::vector<hbtb_inflight_response> inflightResponses;
+        std::vector<bool> stalledConnections; /**< A response found the connection full in the last cycle. */
+        uint64_t* blockTargets;           /**< Scratch array of one target per bank. */
+        uint8_t* blockStates;             /**< Scratch array of one predictor state per bank. */
+        uint64_t* victimTargets;          /**< One scratch array per level, victims cascade down. */
+        uint8_t* victimStates;
+        uint64_t* warmUpTargets;          /**< Scratch arrays of warmUpBranch, one per bank. */
+        bool* warmUpExecuted;
+        bool* responseValidBits;          /**< responseSlots arrays of one bit per bank. */
+        uint responseSlots;               /**< Responses that can be in flight or in a connection. */
+        uint nextResponseSlot;
+
+        /**
+         * @brief Writes a block in a level, moving the victim down in exclusive mode and invalidating it in the
+         * levels above in inclusive mode
+         * @param predictorStates Of a block moved from another level, null for a new block
+         */
+        void fillLevel(uint level, uint64_t fetchAddress, uint64_t* fetchTargets, const uint8_t* predictorStates);
+
+        /**
+         * @brief Looks the block up level by level, promoting it to the levels above the one that hit
+         * @return The level that hit, or numLevels on a miss
+         */
+        uint lookup(uint64_t fetchAddress);
+
+    public:
+        HierarchicalBTB();
+
+        /**
+         * @brief Reads numBanks, numLevels, policy and, for each level N, lNEntries and lNLatency
+         */
+        int SetConfigParameter(const char* parameter, sinuca::config::ConfigValue value) override;
+
+        /**
+         * @brief Allocates every level
+         */
+        int FinishSetup() override;
+
+        /**
+         * @brief Looks up a block, as BranchTargetBuffer::fetchBTBEntry does
+         * @details Sets the next fetch block and valid bits of the level that hit, readable with getNextFetchBlock
+         * and getInstructionValidBits.
+         */
+        TypeBTBMessage fetchBTBEntry(uint64_t fetchAddress);
+
+        /**
+         * @brief Registers a new block in the first level (and every level, when inclusive)
+         */
+        void registerNewBlock(uint64_t fetchAddress, uint64_t* fetchTargets);
+
+        /**
+         * @brief Updates the predictors of the block in every level that holds it
+         */
+        void updateBlock(uint64_t fetchAddress, bool* executedInstructions);
+
+        /**
+         * @brief Invalidates every block of every level
+         * @details The levels hold a single address space, so the flush of any ASID drops them all.
+         */
+        void flush();
+
+        uint getTotalBanks() override;
+
+        /**
+         * @brief The levels hold a single address space, asid is ignored
+         */
+        TypeBTBMessage warmUpBranch(uint64_t address, uint64_t target, bool taken, uint8_t asid) override;
+
+        /**
+         * @return The address of next instruction block of the last lookup
+         */
+        uint64_t getNextFetchBlock();
+
+        /**
+         * @return The instructions predicted as executable by the last lookup
+         */
+        bool* getInstructionValidBits();
+
+        /**
+         * @brief The behavior of the hierarchy during a clock cycle
+         * @details Requests from every connection are served in the cycle they arrive. Lookup responses are held
+         * for the latency of every level visited, so an L0 hit with latency 0 answers in the same cycle. A response
+         * that finds its connection full is held until it is sent, and the connection's requests wait meanwhile.
+         */
+        void Clock() override;
+
+        /**
+         * @brief Prints lookups, hits and hit rate per level and the average lookup latency, and the flushes if any
+         */
+        void PrintStatistics() override;
+
+        /**
+         * @brief Recorded messages carry the per-bank arrays, see encodeBTBMessage
+         */
+        unsigned long GetMessageRecordSize() const override;
+        void EncodeMessage(const void* message, void* record) const override;
+        void DecodeMessage(void* record, void* message) const override;
+
+        /**
+         * @brief Only lookups are answered
+         */
+        bool ExpectsResponse(const void* request) const override;
+
+        /**
+         * @return True when no response is held and no request waits in a connection
+         */
+        bool IsDrained() const override;
+
+        ~HierarchicalBTB();
+};
+
+#endif
@@ -1,7 +1,13 @@
 #include "interleavedBTB.hpp"
 #include <cstdint>
+#include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <sys/types.h>
+#include "configLoader.hpp"
+#include "trace.hpp"
+
+SINUCA3_REGISTER_COMPONENT(BranchTargetBuffer);
 
 /* ==========================================================================
     Two Bit Predictor Methods
@@ -23,6 +29,14 @@ void TwoBitPredictor::updatePrediction(bool branchTaken) {
     }
 };
 
+uint8_t TwoBitPredictor::getState() {
+    return prediction;
+};
+
+void TwoBitPredictor::setState(uint8_t state) {
+    prediction = state;
+};
+
 TwoBitPredictor::~TwoBitPredictor() {};
 
 
@@ -30,13 +44,15 @@ TwoBitPredictor::~TwoBitPredictor() {};
     BTB Entry Methods
    ========================================================================== */
 
-btb_entry::btb_entry() : validBit(false), simplePredictor(nullptr) {};
+btb_entry::btb_entry() : validBit(false), targetRegion(0), asid(0), tag(0), targetOffset(0) {};
 
 void btb_entry::allocate() {
     validBit = false;
+    targetRegion = 0;
+    simplePredictor = TwoBitPredictor();
+    asid = 0;
     tag = 0;
-    fetchTarget = 0;
-    simplePredictor = new TwoBitPredictor();
+    targetOffset = 0;
 };
 
 bool btb_entry::getValid() {
@@ -47,49 +63,389 @@ uint32_t btb_entry::getTag() {
     return tag;
 };
 
-uint32_t btb_entry::getTarget() {
-    return fetchTarget;
+uint8_t btb_entry::getAsid() {
+    return asid;
+};
+
+bool btb_entry::matches(uint32_t tag, uint8_t asid) {
+    return validBit && this->tag == tag && this->asid == asid;
+};
+
+uint8_t btb_entry::getTargetRegion() {
+    return targetRegion;
+};
+
+uint32_t btb_entry::getTargetOffset() {
+    return targetOffset;
 };
 
 bool btb_entry::getPrediction() {
-    return simplePredictor->getPrediction();
+    return simplePredictor.getPrediction();
+};
+
+uint8_t btb_entry::getPredictorState() {
+    return simplePredictor.getState();
+};
+
+void btb_entry::setPredictorState(uint8_t state) {
+    simplePredictor.setState(state);
 };
 
-void btb_entry::setEntry(uint32_t tag, uint32_t fetchTarget) {
+void btb_entry::setEntry(uint32_t tag, uint8_t asid, uint8_t targetRegion, uint32_t targetOffset) {
     this->validBit = true;
+    this->asid = asid;
     this->tag = tag;
-    this->fetchTarget = fetchTarget;
+    this->targetRegion = targetRegion;
+    this->targetOffset = targetOffset;
 };
 
 void btb_entry::updatePrediction(bool branchTaken) {
-    simplePredictor->updatePrediction(branchTaken);
+    simplePredictor.updatePrediction(branchTaken);
 };
 
-btb_entry::~btb_entry() {
-    delete simplePredictor;
+btb_entry::~btb_entry() {};
+
+/* ==========================================================================
+    BTB Message Records
+   ========================================================================== */
+
+/* A record is this header followed by the targets, valid bits and executed bits of every bank. */
+struct btb_message_record {
+    uint64_t fetchAddress;
+    uint64_t nextBlock;
+    int32_t channelID;
+    uint32_t messageType;
+    uint32_t arrays;                      /**< Bit 0 targets, bit 1 valid bits, bit 2 executed bits. */
+    uint32_t asid;
+};
+
+unsigned long getBTBMessageRecordSize(uint totalBanks) {
+    return sizeof(btb_message_record) + totalBanks * (sizeof(uint64_t) + 2);
+};
+
+void encodeBTBMessage(uint totalBanks, const BTBMessage* message, void* record) {
+    btb_message_record* header = static_cast<btb_message_record*>(record);
+    uint64_t* targets = reinterpret_cast<uint64_t*>(header + 1);
+    uint8_t* validBits = reinterpret_cast<uint8_t*>(targets + totalBanks);
+    uint8_t* executed = validBits + totalBanks;
+
+    /* Every byte is written, so equal messages give equal records. Only the fields the type uses are kept,
+     * the others may be left over from the request a response was built from. */
+    memset(record, 0, getBTBMessageRecordSize(totalBanks));
+    header->fetchAddress = message->fetchAddress;
+    header->channelID = message->channelID;
+    header->messageType = message->messageType;
+    header->asid = message->asid;
+
+    switch (message->messageType) {
+        case UNALLOCATED_ENTRY:
+        case ALLOCATED_ENTRY:
+            header->nextBlock = message->nextBlock;
+            header->arrays = 2;
+            for (uint bank = 0; bank < totalBanks; ++bank) validBits[bank] = message->validBits[bank];
+            break;
+        case BTB_ALLOCATION_REQUEST:
+            header->arrays = 1;
+            for (uint bank = 0; bank < totalBanks; ++bank) targets[bank] = message->fetchTargets[bank];
+            break;
+        case BTB_UPDATE_REQUEST:
+            header->arrays = 4;
+            for (uint bank = 0; bank < totalBanks; ++bank) executed[bank] = message->executedInstructions[bank];
+            break;
+        default:
+            break;
+    }
+};
+
+void decodeBTBMessage(uint totalBanks, void* record, BTBMessage* message) {
+    btb_message_record* header = static_cast<btb_message_record*>(record);
+    uint64_t* targets = reinterpret_cast<uint64_t*>(header + 1);
+    /* bool and uint8_t share the representation of 0 and 1. */
+    bool* validBits = reinterpret_cast<bool*>(targets + totalBanks);
+    bool* executed = validBits + totalBanks;
+
+    message->fetchAddress = header->fetchAddress;
+    message->nextBlock = header->nextBlock;
+    message->channelID = header->channelID;
+    message->messageType = (TypeBTBMessage)header->messageType;
+    message->asid = header->asid;
+    message->fetchTargets = (header->arrays & 1) ? targets : nullptr;
+    message->validBits = (header->arrays & 2) ? validBits : nullptr;
+    message->executedInstructions = (header->arrays & 4) ? executed : nullptr;
 };
 
 /* ==========================================================================
     Interleaved BTB Methods
    ========================================================================== */
 
-BranchTargetBuffer::BranchTargetBuffer() : Component<BTBMessage>(), instructionValidBits(nullptr), banks(nullptr) {};
+BranchTargetBuffer::BranchTargetBuffer() : sinuca::Component<BTBMessage>(), instructionValidBits(nullptr), banks(nullptr), entryStorage(nullptr), numBanks(0), numEntries(0),
+    indexBits(0), sharing(BTB_SHARED), numThreads(1), repartitionInterval(65536), lookupsSinceRepartition(0), threads(nullptr),
+    repartitions(0), asidFlushes(0), flushedRows(0),
+    tagBits(16), targetOffsetBits(24), numRegions(16), regionTable(nullptr), usedRegions(0), nextRegionVictim(0), regionReplacements(0),
+    readPorts(1), writePorts(1), queueSize(32), nextConnection(0), currentCycle(0), bankPorts(nullptr), responseValidBits(nullptr), responseSlots(0),
+    nextResponseSlot(0),
+    warmUpTargets(nullptr), warmUpExecuted(nullptr), servedReads(0), servedWrites(0), bankConflicts(0), invalidRequests(0), totalWaitCycles(0), maxPendingRequests(0),
+    bankReadAccesses(0), bankWriteAccesses(0), analyticsEnabled(false), analyticsTopK(16), analyticsWidthBits(12),
+    analyticsDepth(4), analyticsInterval(0), analyticsOutput(nullptr), analytics(nullptr) {};
+
+int BranchTargetBuffer::SetConfigParameter(const char* parameter, sinuca::config::ConfigValue value) {
+    bool isBanks = (strcmp(parameter, "numBanks") == 0);
+    bool isEntries = (strcmp(parameter, "numEntries") == 0);
+    bool isPorts = (strcmp(parameter, "readPorts") == 0) || (strcmp(parameter, "writePorts") == 0);
+    bool isQueue = (strcmp(parameter, "queueSize") == 0);
+    bool isTagBits = (strcmp(parameter, "tagBits") == 0);
+    bool isOffsetBits = (strcmp(parameter, "targetOffsetBits") == 0);
+    bool isRegions = (strcmp(parameter, "numRegions") == 0);
+
+    if (strncmp(parameter, "analytics", strlen("analytics")) == 0) {
+        return setAnalyticsParameter(parameter, value);
+    }
+
+    if (strcmp(parameter, "sharing") == 0 || strcmp(parameter, "numThreads") == 0 ||
+        strcmp(parameter, "repartitionInterval") == 0) {
+        return setSharingParameter(parameter, value);
+    }
+
+    if (!(isBanks || isEntries || isPorts || isQueue || isTagBits || isOffsetBits || isRegions)) {
+        return Linkable::SetConfigParameter(parameter, value);
+    }
+
+    if (value.type != sinuca::config::ConfigValueTypeInteger || value.value.integer <= 0) {
+        fprintf(stderr, "BranchTargetBuffer: %s must be a positive integer.\n", parameter);
+        return 1;
+    }
+
+    if ((isBanks || isEntries) && value.value.integer > 24) {
+        fprintf(stderr, "BranchTargetBuffer: %s must be an integer between 1 and 24 (bits).\n", parameter);
+        return 1;
+    }
+
+    if ((isTagBits || isOffsetBits) && value.value.integer > 32) {
+        fprintf(stderr, "BranchTargetBuffer: %s must be an integer between 1 and 32.\n", parameter);
+        return 1;
+    }
+
+    if (isRegions && value.value.integer > 256) {
+        fprintf(stderr, "BranchTargetBuffer: numRegions must be an integer between 1 and 256.\n");
+        return 1;
+    }
+
+    if (isTagBits) {
+        tagBits = value.value.integer;
+    } else if (isOffsetBits) {
+        targetOffsetBits = value.value.integer;
+    } else if (isRegions) {
+        numRegions = value.value.integer;
+    } else if (isBanks) {
+        numBanks = value.value.integer;
+    } else if (isEntries) {
+        numEntries = value.value.integer;
+    } else if (strcmp(parameter, "readPorts") == 0) {
+        readPorts = value.value.integer;
+    } else if (isPorts) {
+        writePorts = value.value.integer;
+    } else {
+        queueSize = value.value.integer;
+    }
+
+    return 0;
+};
+
+int BranchTargetBuffer::setSharingParameter(const char* parameter, sinuca::config::ConfigValue value) {
+    if (strcmp(parameter, "sharing") == 0) {
+        const char* mode = (value.type == sinuca::config::ConfigValueTypeString) ? value.value.string : "";
+
+        if (strcmp(mode, "shared") == 0) {
+            sharing = BTB_SHARED;
+        } else if (strcmp(mode, "static") == 0) {
+            sharing = BTB_STATIC_PARTITIONS;
+        } else if (strcmp(mode, "dynamic") == 0) {
+            sharing = BTB_DYNAMIC_PARTITIONS;
+        } else {
+            fprintf(stderr, "BranchTargetBuffer: sharing must be shared, static or dynamic.\n");
+            return 1;
+        }
+        return 0;
+    }
+
+    if (value.type != sinuca::config::ConfigValueTypeInteger || value.value.integer <= 0) {
+        fprintf(stderr, "BranchTargetBuffer: %s must be a positive integer.\n", parameter);
+        return 1;
+    }
+
+    if (strcmp(parameter, "numThreads") == 0) {
+        if (value.value.integer > BTB_MAX_THREADS || (value.value.integer & (value.value.integer - 1))) {
+            fprintf(stderr, "BranchTargetBuffer: numThreads must be a power of two up to %u.\n", BTB_MAX_THREADS);
+            return 1;
+        }
+        numThreads = value.value.integer;
+    } else {
+        repartitionInterval = value.value.integer;
+    }
+
+    return 0;
+};
+
+int BranchTargetBuffer::setAnalyticsParameter(const char* parameter, sinuca::config::ConfigValue value) {
+    const char* name = parameter + strlen("analytics");
+
+    if (strcmp(name, "") == 0) {
+        if (value.type != sinuca::config::ConfigValueTypeBoolean) {
+            fprintf(stderr, "BranchTargetBuffer: analytics must be true or false.\n");
+            return 1;
+        }
+        analyticsEnabled = value.value.boolean;
+        return 0;
+    }
+
+    if (strcmp(name, "File") == 0) {
+        if (value.type != sinuca::config::ConfigValueTypeString) {
+            fprintf(stderr, "BranchTargetBuffer: analyticsFile must be a file name.\n");
+            return 1;
+        }
+        analyticsFile = value.value.string;
+        return 0;
+    }
+
+    bool isTopK = (strcmp(name, "TopK") == 0);
+    bool isWidth = (strcmp(name, "WidthBits") == 0);
+    bool isDepth = (strcmp(name, "Depth") == 0);
+    bool isInterval = (strcmp(name, "Interval") == 0);
+    if (!(isTopK || isWidth || isDepth || isInterval)) {
+        return Linkable::SetConfigParameter(parameter, value);
+    }
+
+    if (value.type != sinuca::config::ConfigValueTypeInteger || value.value.integer < (isInterval ? 0 : 1)) {
+        fprintf(stderr, "BranchTargetBuffer: %s must be a positive integer.\n", parameter);
+        return 1;
+    }
+    if ((isTopK && value.value.integer > 4096) || (isWidth && value.value.integer > 24) ||
+        (isDepth && value.value.integer > BTB_ANALYTICS_MAX_DEPTH)) {
+        fprintf(stderr, "BranchTargetBuffer: %s must be at most %u.\n", parameter,
+                isTopK ? 4096 : (isWidth ? 24 : BTB_ANALYTICS_MAX_DEPTH));
+        return 1;
+    }
+
+    if (isTopK) {
+        analyticsTopK = value.value.integer;
+    } else if (isWidth) {
+        analyticsWidthBits = value.value.integer;
+    } else if (isDepth) {
+        analyticsDepth = value.value.integer;
+    } else {
+        analyticsInterval = value.value.integer;
+    }
+
+    return 0;
+};
+
+int BranchTargetBuffer::FinishSetup() {
+    if (!(numBanks) || !(numEntries)) {
+        fprintf(stderr, "BranchTargetBuffer: numBanks and numEntries are required.\n");
+        return 1;
+    }
 
-uint32_t BranchTargetBuffer::calculateTag(uint32_t fetchAddress) {
-    uint32_t tag = fetchAddress;
-    tag = tag >> numBanks;
+    if (sharing == BTB_STATIC_PARTITIONS && numThreads >= (1U << numEntries)) {
+        fprintf(stderr, "BranchTargetBuffer: static partitioning needs more entries than numThreads.\n");
+        return 1;
+    }
+
+    allocate(numBanks, numEntries);
+
+    if (analyticsEnabled) {
+        analytics = new BTBAnalytics();
+        analytics->allocate(GetMemoryAccount(), analyticsTopK, analyticsWidthBits, analyticsDepth, 1 << numBanks,
+                            1 << numEntries);
+
+        analyticsOutput = stderr;
+        if (!analyticsFile.empty()) {
+            analyticsOutput = fopen(analyticsFile.c_str(), "w");
+            if (!analyticsOutput) {
+                fprintf(stderr, "BranchTargetBuffer: could not open %s.\n", analyticsFile.c_str());
+                return 1;
+            }
+        }
+    }
+
+    return 0;
+};
+
+uint32_t BranchTargetBuffer::calculateTag(uint64_t fetchAddress) {
+    uint64_t upperBits = fetchAddress >> (numBanks + indexBits);
+    uint64_t mask = (tagBits >= 32) ? 0xffffffffULL : ((1ULL << tagBits) - 1);
+    uint32_t tag = 0;
+
+    while (upperBits) {
+        tag ^= (upperBits & mask);
+        upperBits = upperBits >> tagBits;
+    }
 
     return tag;
 };
 
-uint32_t BranchTargetBuffer::calculateIndex(uint32_t fetchAddress) {
-    uint32_t index = fetchAddress;
+uint32_t BranchTargetBuffer::calculateIndex(uint64_t fetchAddress, uint8_t asid) {
+    uint64_t index = fetchAddress;
     index = index >> numBanks;
-    index = index & ((1 << numEntries) - 1);
+    index = index & ((1 << indexBits) - 1);
+
+    /* The partition bits sit on top, so each partition gets a contiguous range of indices. */
+    if (sharing == BTB_STATIC_PARTITIONS) {
+        index |= (uint64_t)(asid & (numThreads - 1)) << indexBits;
+    }
 
     return index;
 };
 
+void BranchTargetBuffer::repartition() {
+    uint32_t totalRows = 1U << indexBits;
+    uint32_t minimum = totalRows / (4 * numThreads);
+    uint64_t spare = totalRows - (uint64_t)minimum * numThreads;
+    uint64_t totalMisses = 0;
+
+    for (uint i = 0; i < numThreads; ++i) {
+        totalMisses += threads[i].intervalMisses;
+    }
+
+    /* Without misses the quotas are still right. */
+    if (totalMisses) {
+        for (uint i = 0; i < numThreads; ++i) {
+            threads[i].quota = minimum + spare * threads[i].intervalMisses / totalMisses;
+        }
+        repartitions++;
+    }
+
+    for (uint i = 0; i < numThreads; ++i) {
+        threads[i].intervalMisses = 0;
+    }
+    lookupsSinceRepartition = 0;
+};
+
+uint8_t BranchTargetBuffer::findTargetRegion(uint64_t target) {
+    uint64_t region = target >> targetOffsetBits;
+
+    for (uint i = 0; i < usedRegions; ++i) {
+        if (regionTable[i] == region) {
+            return i;
+        }
+    }
+
+    uint victim;
+    if (usedRegions < numRegions) {
+        victim = usedRegions++;
+    } else {
+        victim = nextRegionVictim;
+        nextRegionVictim = (nextRegionVictim + 1) % numRegions;
+        regionReplacements++;
+    }
+    regionTable[victim] = region;
+
+    return victim;
+};
+
+uint64_t BranchTargetBuffer::decodeTarget(btb_entry& entry) {
+    return (regionTable[entry.getTargetRegion()] << targetOffsetBits) | entry.getTargetOffset();
+};
+
 void BranchTargetBuffer::allocate(uint numBanks, uint numEntries) {
     this->numBanks = numBanks;
     this->numEntries = numEntries;
@@ -97,13 +453,38 @@ void BranchTargetBuffer::allocate(uint numBanks, uint numEntries) {
     this->totalHits = 0;
     this->nextFetchBlock = 0;
 
+    /* Static partitions take their bits from the index, so the tags get them back. */
+    uint threadBits = __builtin_ctz(numThreads);
+    this->indexBits = (sharing == BTB_STATIC_PARTITIONS) ? numEntries - threadBits : numEntries;
+    this->threads = AllocateArray<btb_thread>(numThreads);
+    for (uint i = 0; i < numThreads; ++i) {
+        this->threads[i].quota = (1U << indexBits) / numThreads;
+    }
+
     int totalBanks = (1 << numBanks);
     int totalEntries = (1 << numEntries);
-    this->instructionValidBits = new bool[totalBanks];
-    this->banks = new btb_bank[totalBanks];
+    this->bankPorts = AllocateArray<btb_bank_ports>(totalBanks);
+    this->regionTable = AllocateArray<uint64_t>(numRegions);
+    this->usedRegions = 0;
+    /* A slot is in use from the lookup until the response was received: pending, or in a connection. */
+    this->responseSlots = queueSize;
+    for (uint i = 0; i < connections.size(); ++i) {
+        const sinuca::engine::ConnectionHandle& handle = ResolveConnection(i);
+        if (handle.responseOutput) {
+            this->responseSlots += handle.responseOutput->GetSize();
+        }
+    }
+    this->responseValidBits = AllocateArray<bool>((unsigned long)responseSlots * totalBanks);
+    this->pendingRequests.reserve(queueSize);
+    this->deferredRequests.reserve(queueSize);
+    this->warmUpTargets = AllocateArray<uint64_t>(totalBanks);
+    this->warmUpExecuted = AllocateArray<bool>(totalBanks);
+    this->instructionValidBits = AllocateArray<bool>(totalBanks);
+    this->banks = AllocateArray<btb_bank>(totalBanks);
+    this->entryStorage = AllocateLargeArray<btb_entry>((unsigned long)totalBanks * totalEntries);
     for (int bank = 0; bank < totalBanks; ++bank) {
         this->instructionValidBits[bank] = false;
-        this->banks[bank] = new btb_entry[totalEntries];
+        this->banks[bank] = &this->entryStorage[(unsigned long)bank * totalEntries];
 
         for (int entries = 0; entries < totalEntries; ++entries) {
             this->banks[bank][entries].allocate();
@@ -111,37 +492,79 @@ void BranchTargetBuffer::allocate(uint numBanks, uint numEntries) {
     }
 };
 
-uint32_t BranchTargetBuffer::getNextFetchBlock() {
+uint64_t BranchTargetBuffer::getNextFetchBlock() {
     return nextFetchBlock;
 };
 
+uint32_t BranchTargetBuffer::getIndex(uint64_t fetchAddress, uint8_t asid) {
+    return calculateIndex(fetchAddress, asid);
+};
+
+uint BranchTargetBuffer::getTotalBanks() {
+    return (1 << numBanks);
+};
+
 bool* BranchTargetBuffer::getInstructionValidBits() {
     return instructionValidBits;
 };
 
-void BranchTargetBuffer::registerNewBlock(uint32_t fetchAddress, uint32_t* fetchTargets) {
+void BranchTargetBuffer::registerNewBlock(uint64_t fetchAddress, uint64_t* fetchTargets, uint8_t asid,
+                                          const uint8_t* predictorStates) {
     uint32_t currentTag = calculateTag(fetchAddress);
-    uint32_t index = calculateIndex(fetchAddress);
+    uint32_t index = calculateIndex(fetchAddress, asid);
+
+    uint totalBanks = (1 << numBanks);
 
-    for (uint bank = 0; bank < numBanks; ++bank) {
-        banks[bank][index].setEntry(currentTag, fetchTargets[bank]);
+    /* Every bank of a row holds the same block, so the first one tells whose row it is. */
+    btb_thread& thread = threads[asid & (numThreads - 1)];
+    btb_entry& row = banks[0][index];
+    if (row.getValid()) {
+        btb_thread& owner = threads[row.getAsid() & (numThreads - 1)];
+
+        if (sharing == BTB_DYNAMIC_PARTITIONS && &owner != &thread && thread.rows >= thread.quota &&
+            owner.rows <= owner.quota) {
+            thread.denials++;
+            return;
+        }
+        owner.rows--;
+    }
+    thread.rows++;
+
+    uint64_t offsetMask = (targetOffsetBits >= 32) ? 0xffffffffULL : ((1ULL << targetOffsetBits) - 1);
+
+    for (uint bank = 0; bank < totalBanks; ++bank) {
+        uint8_t region = findTargetRegion(fetchTargets[bank]);
+        banks[bank][index].setEntry(currentTag, asid, region, fetchTargets[bank] & offsetMask);
+        if (predictorStates) {
+            banks[bank][index].setPredictorState(predictorStates[bank]);
+        }
     }
 };
 
-TypeBTBMessage BranchTargetBuffer::fetchBTBEntry(uint32_t fetchAddress) {
+TypeBTBMessage BranchTargetBuffer::fetchBTBEntry(uint64_t fetchAddress, uint8_t asid) {
     bool alocated = true;
-    uint32_t nextBlock = 0;
+    uint64_t nextBlock = 0;
     uint32_t currentTag = calculateTag(fetchAddress);
-    uint32_t index = calculateIndex(fetchAddress);
+    uint32_t index = calculateIndex(fetchAddress, asid);
+    uint totalBanks = (1 << numBanks);
+    btb_thread& thread = threads[asid & (numThreads - 1)];
+
+    thread.lookups++;
+    if (sharing == BTB_DYNAMIC_PARTITIONS && ++lookupsSinceRepartition >= repartitionInterval) {
+        repartition();
+    }
 
-    for (uint i = 0; i < numBanks; ++i) {
+    for (uint i = 0; i < totalBanks; ++i) {
         if (banks[i][index].getValid()) {
-            if (banks[i][index].getTag() == currentTag) {
-                nextBlock = banks[i][index].getTarget();
+            if (banks[i][index].matches(currentTag, asid)) {
+                nextBlock = decodeTarget(banks[i][index]);
                 instructionValidBits[i] = banks[i][index].getPrediction();
             } else {
                 alocated = false;
                 instructionValidBits[i] = true;
+                if (analytics) {
+                    analytics->recordConflict(i, index);
+                }
             }
         } else {
             alocated = false;
@@ -156,41 +579,385 @@ TypeBTBMessage BranchTargetBuffer::fetchBTBEntry(uint32_t fetchAddress) {
     }
 
     if (alocated) {
+        SINUCA3_TRACE_EVENT(TraceEventBTBHit, GetTraceID(), fetchAddress);
         return ALLOCATED_ENTRY;
     }
 
+    SINUCA3_TRACE_EVENT(TraceEventBTBMiss, GetTraceID(), fetchAddress);
+    thread.misses++;
+    thread.intervalMisses++;
+    if (analytics) {
+        analytics->recordMiss(fetchAddress);
+    }
     return UNALLOCATED_ENTRY;
 };
 
-void BranchTargetBuffer::updateBlock(uint32_t fetchAddress, bool* executedInstructions) {
+bool BranchTargetBuffer::readBlock(uint64_t fetchAddress, uint64_t* fetchTargets, uint8_t asid,
+                                   uint8_t* predictorStates) {
+    uint32_t currentTag = calculateTag(fetchAddress);
+    uint32_t index = calculateIndex(fetchAddress, asid);
+    uint totalBanks = (1 << numBanks);
+
+    for (uint bank = 0; bank < totalBanks; ++bank) {
+        if (!banks[bank][index].matches(currentTag, asid)) {
+            return false;
+        }
+    }
+
+    for (uint bank = 0; bank < totalBanks; ++bank) {
+        fetchTargets[bank] = decodeTarget(banks[bank][index]);
+        if (predictorStates) {
+            predictorStates[bank] = banks[bank][index].getPredictorState();
+        }
+    }
+
+    return true;
+};
+
+void BranchTargetBuffer::invalidateBlock(uint64_t fetchAddress, uint8_t asid) {
     uint32_t currentTag = calculateTag(fetchAddress);
-    uint32_t index = calculateIndex(fetchAddress);
+    uint32_t index = calculateIndex(fetchAddress, asid);
+    uint totalBanks = (1 << numBanks);
 
-    for (uint bank = 0; bank < numBanks; ++bank) {
+    if (banks[0][index].matches(currentTag, asid)) {
+        threads[asid & (numThreads - 1)].rows--;
+    }
+
+    for (uint bank = 0; bank < totalBanks; ++bank) {
+        if (banks[bank][index].matches(currentTag, asid)) {
+            banks[bank][index].allocate();
+        }
+    }
+};
+
+uint32_t BranchTargetBuffer::flushAsid(uint8_t asid) {
+    uint totalBanks = (1 << numBanks);
+    uint32_t first = 0;
+    uint32_t last = 1U << numEntries;
+    uint32_t flushed = 0;
+
+    if (sharing == BTB_STATIC_PARTITIONS) {
+        first = (uint32_t)(asid & (numThreads - 1)) << indexBits;
+        last = first + (1U << indexBits);
+    }
+
+    for (uint32_t index = first; index < last; ++index) {
+        if (!banks[0][index].getValid() || banks[0][index].getAsid() != asid) {
+            continue;
+        }
+        for (uint bank = 0; bank < totalBanks; ++bank) {
+            banks[bank][index].allocate();
+        }
+        flushed++;
+    }
+
+    threads[asid & (numThreads - 1)].rows -= flushed;
+    asidFlushes++;
+    flushedRows += flushed;
+
+    return flushed;
+};
+
+void BranchTargetBuffer::updateBlock(uint64_t fetchAddress, bool* executedInstructions, uint8_t asid) {
+    uint32_t currentTag = calculateTag(fetchAddress);
+    uint32_t index = calculateIndex(fetchAddress, asid);
+    uint totalBanks = (1 << numBanks);
+
+    bool mispredicted = false;
+
+    for (uint bank = 0; bank < totalBanks; ++bank) {
         if (banks[bank][index].getValid()) {
-            if (banks[bank][index].getTag() == currentTag) {
+            if (banks[bank][index].matches(currentTag, asid)) {
+                if (analytics && banks[bank][index].getPrediction() != executedInstructions[bank]) {
+                    mispredicted = true;
+                }
                 banks[bank][index].updatePrediction(executedInstructions[bank]);
             }
         }
     }
+
+    if (mispredicted) {
+        analytics->recordMisprediction(fetchAddress);
+    }
+};
+
+TypeBTBMessage BranchTargetBuffer::warmUpBranch(uint64_t address, uint64_t target, bool taken, uint8_t asid) {
+    uint totalBanks = (1 << numBanks);
+    TypeBTBMessage result = fetchBTBEntry(address, asid);
+
+    if (result == UNALLOCATED_ENTRY) {
+        for (uint bank = 0; bank < totalBanks; ++bank) {
+            warmUpTargets[bank] = target;
+        }
+        registerNewBlock(address, warmUpTargets, asid);
+    }
+
+    for (uint bank = 0; bank < totalBanks; ++bank) {
+        warmUpExecuted[bank] = true;
+    }
+    warmUpExecuted[address & (totalBanks - 1)] = taken;
+    updateBlock(address, warmUpExecuted, asid);
+
+    return result;
+};
+
+bool BranchTargetBuffer::claimPorts(bool write) {
+    uint totalBanks = (1 << numBanks);
+
+    for (uint bank = 0; bank < totalBanks; ++bank) {
+        btb_bank_ports& ports = bankPorts[bank];
+        if (ports.cycle != currentCycle) {
+            continue;
+        }
+
+        if (write ? (ports.writesUsed >= writePorts) : (ports.readsUsed >= readPorts)) {
+            return false;
+        }
+    }
+
+    for (uint bank = 0; bank < totalBanks; ++bank) {
+        btb_bank_ports& ports = bankPorts[bank];
+        if (ports.cycle != currentCycle) {
+            ports.cycle = currentCycle;
+            ports.readsUsed = 0;
+            ports.writesUsed = 0;
+        }
+
+        if (write) {
+            ports.writesUsed++;
+            bankWriteAccesses++;
+        } else {
+            ports.readsUsed++;
+            bankReadAccesses++;
+        }
+    }
+
+    return true;
 };
 
-void BranchTargetBuffer::componentClock() {
+TypeBTBAccess BranchTargetBuffer::getAccessKind(TypeBTBMessage type) {
+    switch (type) {
+        case BTB_REQUEST:
+            return BTB_READ_ACCESS;
+        case BTB_ALLOCATION_REQUEST:
+        case BTB_UPDATE_REQUEST:
+        case BTB_FLUSH_REQUEST:
+            return BTB_WRITE_ACCESS;
+        default:
+            return BTB_INVALID_ACCESS;
+    }
+};
 
+bool BranchTargetBuffer::isOrderBlocked(const btb_pending_request& request) {
+    return responseStalls[request.connection] == currentCycle || deferredConnections[request.connection] == currentCycle;
+};
+
+bool BranchTargetBuffer::serveRequest(btb_pending_request& request) {
+    BTBMessage& message = request.message;
+    uint totalBanks = (1 << numBanks);
+
+    switch (message.messageType) {
+        case BTB_REQUEST: {
+            message.messageType = fetchBTBEntry(message.fetchAddress, message.asid);
+            message.nextBlock = nextFetchBlock;
+
+            bool* slot = &responseValidBits[(unsigned long)nextResponseSlot * totalBanks];
+            memcpy(slot, instructionValidBits, totalBanks * sizeof(bool));
+            nextResponseSlot = (nextResponseSlot + 1) % responseSlots;
+            message.validBits = slot;
+
+            if (!SendResponseByHandle(ResolveConnection(request.connection), &message)) {
+                request.responded = true;
+                return false;
+            }
+            break;
+        }
+        case BTB_ALLOCATION_REQUEST:
+            registerNewBlock(message.fetchAddress, message.fetchTargets, message.asid);
+            break;
+        case BTB_UPDATE_REQUEST:
+            updateBlock(message.fetchAddress, message.executedInstructions, message.asid);
+            break;
+        case BTB_FLUSH_REQUEST:
+            flushAsid(message.asid);
+            break;
+        default:
+            break;
+    }
+
+    return true;
+};
+
+void BranchTargetBuffer::Clock() {
+    uint numConnections = connections.size();
+    ++currentCycle;
+
+    /* Batches the new requests, starting from a different channel each cycle so none of them is favored. */
+    if (numConnections) {
+        btb_pending_request request;
+        request.arrivalCycle = currentCycle;
+        request.responded = false;
+
+        for (uint i = 0; i < numConnections && pendingRequests.size() < queueSize; ++i) {
+            request.connection = (nextConnection + i) % numConnections;
+            const sinuca::engine::ConnectionHandle& handle = ResolveConnection(request.connection);
+
+            while (pendingRequests.size() < queueSize && ReceiveRequestByHandle(handle, &request.message)) {
+                pendingRequests.push_back(request);
+            }
+        }
+        nextConnection = (nextConnection + 1) % numConnections;
+    }
+
+    if (pendingRequests.size() > maxPendingRequests) {
+        maxPendingRequests = pendingRequests.size();
+    }
+
+    deferredConnections.resize(numConnections, 0);
+    responseStalls.resize(numConnections, 0);
+
+    /* Oldest first; every request touches every bank of its row, so once a bank is out of ports of a kind, the
+     * requests of that kind wait for the next cycle, and so do the later ones of the same connection, which must
+     * not overtake them. */
+    deferredRequests.clear();
+    for (uint i = 0; i < pendingRequests.size(); ++i) {
+        btb_pending_request& request = pendingRequests[i];
+
+        if (request.responded) {
+            if (responseStalls[request.connection] == currentCycle ||
+                !SendResponseByHandle(ResolveConnection(request.connection), &request.message)) {
+                responseStalls[request.connection] = currentCycle;
+                deferredRequests.push_back(request);
+            }
+            continue;
+        }
+
+        TypeBTBAccess access = getAccessKind(request.message.messageType);
+        if (access == BTB_INVALID_ACCESS) {
+            ++invalidRequests;
+            continue;
+        }
+
+        bool write = (access == BTB_WRITE_ACCESS);
+        if (isOrderBlocked(request) || !claimPorts(write)) {
+            ++bankConflicts;
+            deferredConnections[request.connection] = currentCycle;
+            deferredRequests.push_back(request);
+            continue;
+        }
+
+        if (write) {
+            ++servedWrites;
+        } else {
+            ++servedReads;
+        }
+        totalWaitCycles += currentCycle - request.arrivalCycle;
+        if (!serveRequest(request)) {
+            responseStalls[request.connection] = currentCycle;
+            deferredRequests.push_back(request);
+        }
+    }
+    pendingRequests.swap(deferredRequests);
+
+    if (analytics && analyticsInterval && currentCycle % analyticsInterval == 0) {
+        fprintf(analyticsOutput, "# btb analytics at cycle %lu\n", (unsigned long)currentCycle);
+        analytics->dump(analyticsOutput, "btb.analytics");
+        fflush(analyticsOutput);
+    }
+};
+
+BTBAnalytics* BranchTargetBuffer::getAnalytics() {
+    return analytics;
+};
+
+void BranchTargetBuffer::PrintStatistics() {
+    uint totalBanks = (1 << numBanks);
+    uint64_t served = servedReads + servedWrites;
+    double readCapacity = (double)currentCycle * totalBanks * readPorts;
+    double writeCapacity = (double)currentCycle * totalBanks * writePorts;
+
+    printf("btb.cycles: %lu\n", (unsigned long)currentCycle);
+    printf("btb.served_reads: %lu\n", (unsigned long)servedReads);
+    printf("btb.served_writes: %lu\n", (unsigned long)servedWrites);
+    printf("btb.bank_conflicts: %lu\n", (unsigned long)bankConflicts);
+    printf("btb.max_pending_requests: %lu\n", (unsigned long)maxPendingRequests);
+    printf("btb.average_wait_cycles: %.3f\n", served ? (double)totalWaitCycles / served : 0.0);
+    printf("btb.read_port_utilization: %.4f\n", readCapacity ? bankReadAccesses / readCapacity : 0.0);
+    printf("btb.write_port_utilization: %.4f\n", writeCapacity ? bankWriteAccesses / writeCapacity : 0.0);
+    printf("btb.bytes_per_entry: %lu\n", (unsigned long)sizeof(btb_entry));
+    printf("btb.table_bytes: %lu\n", (unsigned long)sizeof(btb_entry) * totalBanks * (1UL << numEntries) +
+           numRegions * sizeof(uint64_t));
+    printf("btb.region_replacements: %lu\n", (unsigned long)regionReplacements);
+    if (invalidRequests) {
+        printf("btb.invalid_requests: %lu\n", (unsigned long)invalidRequests);
+    }
+
+    if (numThreads > 1 || asidFlushes) {
+        static const char* sharingNames[] = {"shared", "static", "dynamic"};
+        printf("btb.sharing: %s\n", sharingNames[sharing]);
+        for (uint i = 0; i < numThreads; ++i) {
+            printf("btb.thread.%u.lookups: %lu\n", i, (unsigned long)threads[i].lookups);
+            printf("btb.thread.%u.misses: %lu\n", i, (unsigned long)threads[i].misses);
+            printf("btb.thread.%u.rows: %u\n", i, threads[i].rows);
+            if (sharing == BTB_DYNAMIC_PARTITIONS) {
+                printf("btb.thread.%u.quota: %u\n", i, threads[i].quota);
+                printf("btb.thread.%u.denials: %lu\n", i, (unsigned long)threads[i].denials);
+            }
+        }
+        if (sharing == BTB_DYNAMIC_PARTITIONS) {
+            printf("btb.repartitions: %lu\n", (unsigned long)repartitions);
+        }
+        printf("btb.asid_flushes: %lu\n", (unsigned long)asidFlushes);
+        printf("btb.flushed_rows: %lu\n", (unsigned long)flushedRows);
+    }
+
+    if (analytics) {
+        printf("btb.analytics.bytes: %lu\n", analytics->getBytes());
+        analytics->dump(stdout, "btb.analytics");
+    }
+};
+
+unsigned long BranchTargetBuffer::GetMessageRecordSize() const {
+    return getBTBMessageRecordSize(1 << numBanks);
+};
+
+void BranchTargetBuffer::EncodeMessage(const void* message, void* record) const {
+    encodeBTBMessage(1 << numBanks, static_cast<const BTBMessage*>(message), record);
+};
+
+void BranchTargetBuffer::DecodeMessage(void* record, void* message) const {
+    decodeBTBMessage(1 << numBanks, record, static_cast<BTBMessage*>(message));
+};
+
+bool BranchTargetBuffer::ExpectsResponse(const void* request) const {
+    return static_cast<const BTBMessage*>(request)->messageType == BTB_REQUEST;
+};
+
+bool BranchTargetBuffer::IsDrained() const {
+    return pendingRequests.empty() && !GetNumberOfReadyRequests();
 };
 
 BranchTargetBuffer::~BranchTargetBuffer() {
+    delete analytics;
+    if (analyticsOutput && analyticsOutput != stderr) {
+        fclose(analyticsOutput);
+    }
+
+    sinuca::memory::Free(bankPorts);
+    sinuca::memory::Free(regionTable);
+    sinuca::memory::Free(responseValidBits);
+    sinuca::memory::Free(warmUpTargets);
+    sinuca::memory::Free(warmUpExecuted);
+    sinuca::memory::Free(threads);
+
     if (instructionValidBits) {
-        delete[] instructionValidBits;
+        sinuca::memory::Free(instructionValidBits);
         instructionValidBits = nullptr;
     }
 
-    int totalBanks = (1 << numBanks);
+    sinuca::memory::Free(entryStorage);
     if (banks) {
-        for (int i = 0; i < totalBanks; ++i) {
-            delete[] banks[i];
-        }
-        delete[] banks;
+        sinuca::memory::Free(banks);
         banks = nullptr;
     }
 };
\ No newline at end of file
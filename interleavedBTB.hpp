@@ -7,8 +7,14 @@
  */
 #include <cstdint>
 #include <sys/types.h>
+#include <string>
+#include <vector>
+#include "btbAnalytics.hpp"
 #include "component.hpp"
 
+static const uint BTB_RESPONSE_SLOTS = 64;
+static const uint BTB_MAX_THREADS = 64;   /**< Partitions of a table, see TypeBTBSharing. */
+
 class TwoBitPredictor {
     private:
         uint8_t prediction;
@@ -17,6 +23,13 @@ class TwoBitPredictor {
         TwoBitPredictor();
         bool getPrediction();
         void updatePrediction(bool branchTaken);
+
+        /**
+         * @brief The counter, to move it with its block
+         */
+        uint8_t getState();
+        void setState(uint8_t state);
+
         ~TwoBitPredictor();
 };
 
@@ -25,28 +38,129 @@ enum TypeBTBMessage {
     UNALLOCATED_ENTRY,
     ALLOCATED_ENTRY,
     BTB_ALLOCATION_REQUEST,
-    BTB_UPDATE_REQUEST
+    BTB_UPDATE_REQUEST,
+    BTB_FLUSH_REQUEST                     /**< Invalidates the blocks of the address space of the message. */
+};
+
+/**
+ * @brief How the threads (address spaces) of a trace share the table of a BTB
+ * @details Entries are tagged with the ASID in every mode, so threads never hit on each other's blocks. ASIDs map to
+ * numThreads partitions by their low bits.
+ */
+enum TypeBTBSharing {
+    BTB_SHARED,                           /**< Any thread may replace any block. */
+    BTB_STATIC_PARTITIONS,                /**< Each partition owns an equal range of indices. */
+    BTB_DYNAMIC_PARTITIONS                /**< Shared indices, but a partition over its quota can't evict others. */
 };
 
 struct BTBMessage {
     int channelID;
-    uint32_t fetchAddress;
-    uint32_t nextBlock;
-    uint32_t* fetchTargets;
+    uint64_t fetchAddress;
+    uint64_t nextBlock;
+    uint64_t* fetchTargets;
     bool* validBits;
     bool* executedInstructions;
     TypeBTBMessage messageType;
+    uint8_t asid;                         /**< Address space (process or hardware thread) of the block. */
+};
+
+/**
+ * @brief Size of a recorded BTBMessage, whose arrays hold one element per bank
+ */
+unsigned long getBTBMessageRecordSize(uint totalBanks);
+
+/**
+ * @brief Records a BTBMessage with the arrays it points to, see sinuca::engine::Linkable::EncodeMessage
+ */
+void encodeBTBMessage(uint totalBanks, const BTBMessage* message, void* record);
+
+/**
+ * @brief Rebuilds a recorded BTBMessage, its pointers point into the record
+ */
+void decodeBTBMessage(uint totalBanks, void* record, BTBMessage* message);
+
+/**
+ * @brief Functional interface of the BTBs
+ * @details Used by trace-driven components during fast-forward, with no message passing and no port timing.
+ */
+class BTBFunctionalInterface {
+    public:
+        /**
+         * @return The number of banks (not bits)
+         */
+        virtual uint getTotalBanks() = 0;
+
+        /**
+         * @brief Looks a branch up, allocates its block on a miss and trains the predictor of its bank
+         * @param address The address of the branch, also used as the fetch address
+         * @param target The target of the branch, stored for the whole block
+         * @param taken Whether the branch was taken; the other instructions of the block are executed
+         * @param asid Address space of the branch
+         * @return The result of the lookup, before the allocation
+         */
+        virtual TypeBTBMessage warmUpBranch(uint64_t address, uint64_t target, bool taken, uint8_t asid) = 0;
+
+        virtual ~BTBFunctionalInterface() {};
 };
 
 struct btb_entry;
 typedef btb_entry* btb_bank;
 
+/**
+ * @brief A request waiting for the BTB ports
+ */
+struct btb_pending_request {
+    BTBMessage message;
+    uint connection;
+    uint64_t arrivalCycle;
+    bool responded;                       /**< Served, the response waits for room in the connection. */
+};
+
+/**
+ * @brief The ports a request claims, see BranchTargetBuffer::getAccessKind
+ */
+enum TypeBTBAccess {
+    BTB_READ_ACCESS,
+    BTB_WRITE_ACCESS,
+    BTB_INVALID_ACCESS                    /**< Not a request, dropped. */
+};
+
+/**
+ * @brief Ports used in a bank during the current cycle
+ * @details The counters are only valid if cycle is the current cycle, so they don't need to be cleared every cycle.
+ */
+struct btb_bank_ports {
+    uint64_t cycle;
+    uint readsUsed;
+    uint writesUsed;
+};
+
+/**
+ * @brief Per partition bookkeeping, see TypeBTBSharing
+ * @details Rows are indices, whose entries in every bank hold the same block.
+ */
+struct btb_thread {
+    uint64_t lookups;
+    uint64_t misses;
+    uint64_t intervalMisses;              /**< Since the last repartition. */
+    uint64_t denials;                     /**< Allocations dropped for being over the quota. */
+    uint32_t rows;                        /**< Rows holding blocks of the partition. */
+    uint32_t quota;                       /**< Rows the partition may take from others. */
+};
+
+/**
+ * @brief A BTB entry, 12 bytes
+ * @details The tag is a partial tag of up to 32 bits and the target is stored as an offset inside a region
+ * of the BTB's shared region table, which holds the upper bits of the targets. The ASID fits in what was padding.
+ */
 struct btb_entry {
     private:
         bool validBit;
+        uint8_t targetRegion;
+        TwoBitPredictor simplePredictor;
+        uint8_t asid;
         uint32_t tag;
-        uint32_t fetchTarget;
-        TwoBitPredictor* simplePredictor;
+        uint32_t targetOffset;
 
     public:
         btb_entry();
@@ -67,19 +181,40 @@ struct btb_entry {
         uint32_t getTag();
 
         /**
-         * @brief Gets the fetch target
+         * @brief Gets the address space of the entry
+         */
+        uint8_t getAsid();
+
+        /**
+         * @return True if the entry is valid and holds the block of tag in asid
          */
-        uint32_t getTarget();
+        bool matches(uint32_t tag, uint8_t asid);
+
+        /**
+         * @brief Gets the region table index of the fetch target
+         */
+        uint8_t getTargetRegion();
+
+        /**
+         * @brief Gets the offset of the fetch target inside its region
+         */
+        uint32_t getTargetOffset();
 
         /**
          * @brief Wrapper to TwoBitPredictor Method
          */
         bool getPrediction();
 
+        /**
+         * @brief Wrappers to TwoBitPredictor Methods
+         */
+        uint8_t getPredictorState();
+        void setPredictorState(uint8_t state);
+
         /**
          * @brief Defines the input fields
          */
-        void setEntry(uint32_t tag, uint32_t fetchTarget);
+        void setEntry(uint32_t tag, uint8_t asid, uint8_t targetRegion, uint32_t targetOffset);
 
         /**
          * @brief Wrapper to TwoBitPredictor Method
@@ -89,32 +224,153 @@ struct btb_entry {
         ~btb_entry();
 };
 
-class BranchTargetBuffer : public Component<BTBMessage> {
+class BranchTargetBuffer : public sinuca::Component<BTBMessage>, public BTBFunctionalInterface {
     private:
         uint totalBranches;
         uint32_t totalHits;
-        uint32_t nextFetchBlock;
+        uint64_t nextFetchBlock;
         bool* instructionValidBits;
         btb_bank* banks;
+        btb_entry* entryStorage;          /**< All banks, contiguous, so large tables can sit on huge pages. */
         uint numBanks, numEntries;
+        uint indexBits;                   /**< numEntries, less the partition bits of static partitioning. */
+
+        TypeBTBSharing sharing;
+        uint numThreads;                  /**< Partitions, a power of two. */
+        uint64_t repartitionInterval;     /**< Lookups between quota updates of dynamic partitioning. */
+        uint64_t lookupsSinceRepartition;
+        btb_thread* threads;
+        uint64_t repartitions;
+        uint64_t asidFlushes;
+        uint64_t flushedRows;
+
+        uint tagBits;                     /**< Width of the partial tags, up to 32. */
+        uint targetOffsetBits;            /**< Target bits stored in the entry, up to 32. */
+        uint numRegions;                  /**< Entries of the region table, up to 256. */
+        uint64_t* regionTable;            /**< Upper bits of the targets (address >> targetOffsetBits). */
+        uint usedRegions;
+        uint nextRegionVictim;            /**< Round-robin replacement of the region table. */
+        uint64_t regionReplacements;
+
+        uint readPorts, writePorts;       /**< Ports per bank. */
+        uint queueSize;                   /**< Maximum pending requests. */
+        uint nextConnection;              /**< Round-robin start of the batching. */
+        uint64_t currentCycle;
+        std::vector<btb_pending_request> pendingRequests;
+        std::vector<btb_pending_request> deferredRequests;
+        std::vector<uint64_t> deferredConnections; /**< Per connection, the last cycle a request was deferred. */
+        std::vector<uint64_t> responseStalls; /**< Per connection, the last cycle a response found it full. */
+        btb_bank_ports* bankPorts;
+        bool* responseValidBits;          /**< responseSlots arrays of totalBanks bits. */
+        uint responseSlots;               /**< queueSize, plus the responses every connection holds. */
+        uint nextResponseSlot;
+        uint64_t* warmUpTargets;          /**< Scratch arrays of warmUpBranch, one per bank. */
+        bool* warmUpExecuted;
+
+        uint64_t servedReads, servedWrites;
+        uint64_t bankConflicts;           /**< Times a request was deferred. */
+        uint64_t invalidRequests;
+        uint64_t totalWaitCycles;
+        uint64_t maxPendingRequests;
+        uint64_t bankReadAccesses;        /**< Read ports used, summed over banks. */
+        uint64_t bankWriteAccesses;
+
+        bool analyticsEnabled;
+        uint analyticsTopK, analyticsWidthBits, analyticsDepth;
+        uint64_t analyticsInterval;       /**< Cycles between dumps, 0 for none. */
+        std::string analyticsFile;        /**< Of the interval dumps, stderr if empty. */
+        FILE* analyticsOutput;
+        BTBAnalytics* analytics;          /**< Null unless enabled, so the lookups only pay a test. */
+
+        /**
+         * @brief Claims a port of a kind in every bank
+         * @details Lookups read, and allocations and updates write, the whole row: every bank holds the tag and one
+         * instruction of the block.
+         * @return False if some bank has no free port of that kind left in this cycle, in which case nothing is claimed.
+         */
+        bool claimPorts(bool write);
+
+        /**
+         * @brief Lookups read; allocations, updates and flushes write
+         */
+        TypeBTBAccess getAccessKind(TypeBTBMessage type);
+
+        /**
+         * @brief Whether an older request of the same connection was deferred in this cycle, or a response of the
+         * connection is waiting
+         * @details Requests of a connection are served in order, so a lookup never overtakes the allocation or
+         * update of its block.
+         */
+        bool isOrderBlocked(const btb_pending_request& request);
+
+        /**
+         * @brief Performs a request that was granted its ports
+         * @return False if its response could not be sent, in which case it is marked as responded
+         */
+        bool serveRequest(btb_pending_request& request);
+
+        /**
+         * @brief Reads sharing, numThreads and repartitionInterval
+         */
+        int setSharingParameter(const char* parameter, sinuca::config::ConfigValue value);
+
+        /**
+         * @brief Gives each partition a share of the rows proportional to its misses since the last call, with a
+         * floor of a quarter of an equal share
+         */
+        void repartition();
+
+        /**
+         * @brief Reads the parameters whose name starts with analytics
+         */
+        int setAnalyticsParameter(const char* parameter, sinuca::config::ConfigValue value);
 
         /**
          * @brief Calculates the tag used to verify the BTB entry
          * @param FetchAddress Address used to access BTB
-         * @details This method aligns the address with the interleaving factor and returns the value
+         * @details The address bits above the bank and index bits are folded with XOR into tagBits bits.
          */
-        uint32_t calculateTag(uint32_t fetchAddress);
+        uint32_t calculateTag(uint64_t fetchAddress);
         /**
          * @brief Calculate the index to access the correct BTB entry
          * @param fetchAddress Address used to access BTB
+         * @param asid Selects the range of indices of its partition when statically partitioned
          * @details The method calculates an index within a fixed range by applying bitwise shifts and masks. 
          * Aligning the fetch address with the interleaving factor and obtaining the index of the respective BTB entry for the fetch address.
          * @return The index to access BTB
          */
-        uint32_t calculateIndex(uint32_t fetchAddress);
+        uint32_t calculateIndex(uint64_t fetchAddress, uint8_t asid);
+
+        /**
+         * @brief Finds or inserts the region of a target in the region table
+         * @details When the table is full, a region is replaced in round-robin order. Entries still pointing to it
+         * will predict targets in the new region, as a real region table would.
+         */
+        uint8_t findTargetRegion(uint64_t target);
+
+        /**
+         * @brief Rebuilds a full target address from an entry
+         */
+        uint64_t decodeTarget(btb_entry& entry);
     public:
         BranchTargetBuffer();
 
+        /**
+         * @brief Reads numBanks, numEntries, readPorts, writePorts, queueSize, tagBits, targetOffsetBits and
+         * numRegions from the configuration file
+         * @details Also reads sharing (shared, static or dynamic, see TypeBTBSharing), numThreads (partitions, a
+         * power of two up to BTB_MAX_THREADS, default 1) and repartitionInterval (lookups, default 65536).
+         * Also reads analytics (true to keep the statistics of btbAnalytics.hpp), analyticsTopK (default
+         * 16), analyticsWidthBits and analyticsDepth of the sketches (default 12 and 4), analyticsInterval (cycles
+         * between dumps, default 0 for only the end of the run) and analyticsFile (of the dumps, default stderr).
+         */
+        int SetConfigParameter(const char* parameter, sinuca::config::ConfigValue value) override;
+
+        /**
+         * @brief Allocates the BTB with the configured geometry, and the analytics if enabled
+         */
+        int FinishSetup() override;
+
         /**
          * @brief Allocate the BTB
          * @param numBanks Number of bits used to index the banks (2 bits = 4 banks)
@@ -125,7 +381,17 @@ class BranchTargetBuffer : public Component<BTBMessage> {
         /**
          * @return The address of next instruction block
          */
-        uint32_t getNextFetchBlock();
+        uint64_t getNextFetchBlock();
+
+        /**
+         * @return The entry index used by a fetch address, the same in every bank
+         */
+        uint32_t getIndex(uint64_t fetchAddress, uint8_t asid = 0);
+
+        /**
+         * @return The number of banks (not bits)
+         */
+        uint getTotalBanks() override;
 
         /**
          * @return The instructions predicted as executable from the instruction block
@@ -136,9 +402,15 @@ class BranchTargetBuffer : public Component<BTBMessage> {
          * @brief Register a new entry in BTB
          * @param fetchAddress The fetch address used to instruction block
          * @param fetchTargets The array of targets for each instruction in the new block
-         * @details This method registers a new block in the BTB, defining the tag and target addresses.
+         * @param asid Address space of the block
+         * @param predictorStates One predictor state per bank, for a block moved from another BTB, or null to keep
+         * the predictors of the entries
+         * @details This method registers a new block in the BTB, defining the tag and target addresses. With dynamic
+         * partitioning, the block is dropped if it would evict another partition's block while its own partition
+         * is over its quota and the other is not.
          */
-        void registerNewBlock(uint32_t fetchAddress, uint32_t* fetchTargets);
+        void registerNewBlock(uint64_t fetchAddress, uint64_t* fetchTargets, uint8_t asid = 0,
+                              const uint8_t* predictorStates = nullptr);
 
         /**
          * @brief Make a query on BTB from an address
@@ -147,21 +419,80 @@ class BranchTargetBuffer : public Component<BTBMessage> {
          * If the entry is not yet allocated, it assumes that the next fetch block is sequential and that all instructions will be executed.
          * @return Returns a message to the procedure calling the method, indicating whether the BTB entry is allocated or not allocated, as these cases require different procedures later.
          */
-        TypeBTBMessage fetchBTBEntry(uint32_t fetchAddress);
+        TypeBTBMessage fetchBTBEntry(uint64_t fetchAddress, uint8_t asid = 0);
+
+        /**
+         * @brief Reads the targets of a block without changing the BTB state
+         * @param fetchAddress The address used to fetch block
+         * @param fetchTargets Array of one target per bank, filled if the block is allocated
+         * @param predictorStates Array of one predictor state per bank, filled as well unless null
+         * @return True if every bank holds the block
+         */
+        bool readBlock(uint64_t fetchAddress, uint64_t* fetchTargets, uint8_t asid = 0,
+                       uint8_t* predictorStates = nullptr);
+
+        /**
+         * @brief Invalidates the entries of a block, if the BTB holds it
+         * @param fetchAddress The address used to fetch block
+         */
+        void invalidateBlock(uint64_t fetchAddress, uint8_t asid = 0);
+
+        /**
+         * @brief Invalidates every block of an address space, e.g. when it is torn down or its ASID is reused
+         * @details Only the rows of its partition are scanned when statically partitioned.
+         * @return The rows invalidated
+         */
+        uint32_t flushAsid(uint8_t asid);
 
         /**
          * @brief Updates the BTB block based on the instructions that were executed
          * @param fetchAddress The address used to fetch block
          * @param executedInstructions An array of booleans indicating which instructions were actually executed
          */
-        void updateBlock(uint32_t fetchAddress, bool* executedInstructions);
-        
+        void updateBlock(uint64_t fetchAddress, bool* executedInstructions, uint8_t asid = 0);
+
+        TypeBTBMessage warmUpBranch(uint64_t address, uint64_t target, bool taken, uint8_t asid) override;
+
         /**
          * @brief The behavior of the BTB during a clock cycle
-         * @details The BTB receives several messages during a cycle from different components, 
-         * in this method the message queue is emptied while the BTB receives the message and updates its state.
+         * @details The BTB receives several messages during a cycle from different components (channels).
+         * All of them are batched, up to queueSize, and served oldest first. Each bank has readPorts read ports
+         * (lookups) and writePorts write ports (allocations, updates and flushes), and every request touches every
+         * bank of its row; a request that finds a bank without a free port is deferred to the next cycle, and so are
+         * the later requests of its connection. Responses to lookups are sent on the same connection, and a response that finds it full
+         * is sent again in the next cycles, before any later request of the connection is served. validBits stays
+         * valid until the response was received.
+         */
+        void Clock() override;
+
+        /**
+         * @return The analytics, null if not enabled
+         */
+        BTBAnalytics* getAnalytics();
+
+        /**
+         * @brief Prints the served requests, bank conflicts, port utilization and storage per entry, the lookups,
+         * misses and rows of each partition when there are several or ASIDs were flushed, then the analytics if
+         * enabled
+         */
+        void PrintStatistics() override;
+
+        /**
+         * @brief Recorded messages carry the per-bank arrays, see encodeBTBMessage
+         */
+        unsigned long GetMessageRecordSize() const override;
+        void EncodeMessage(const void* message, void* record) const override;
+        void DecodeMessage(void* record, void* message) const override;
+
+        /**
+         * @brief Only lookups are answered
+         */
+        bool ExpectsResponse(const void* request) const override;
+
+        /**
+         * @return True when no request is queued or waiting in a connection
          */
-        void componentClock() override;
+        bool IsDrained() const override;
 
         ~BranchTargetBuffer();
 };
@@ -0,0 +1,189 @@
+//
+// Copyright (C) 2024  HiPES - Universidade Federal do Paraná
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/**
+ * @file latency.cpp
+ * @brief Implementation of the latency histograms.
+ */
+
+#include "latency.hpp"
+
+#include <cmath>
+
+/** The directions observed, requests first, and the answerer of each. */
+static const sinuca::engine::MessageDirection DIRECTIONS[4] = {
+    sinuca::engine::MessageRequestToDestination,
+    sinuca::engine::MessageRequestToSource,
+    sinuca::engine::MessageResponseToSource,
+    sinuca::engine::MessageResponseToDestination,
+};
+
+unsigned long sinuca::latency::LatencyHistogram::GetBucket(
+    unsigned long value) {
+    if (value < LATENCY_SUB_BUCKETS) return value;
+
+    int shift = (63 - __builtin_clzl(value)) - LATENCY_SUB_BUCKET_BITS;
+    return (shift + 1) * LATENCY_SUB_BUCKETS +
+           ((value >> shift) - LATENCY_SUB_BUCKETS);
+};
+
+unsigned long sinuca::latency::LatencyHistogram::GetBucketEnd(
+    unsigned long bucket) {
+    if (bucket < 2 * LATENCY_SUB_BUCKETS) return bucket;
+
+    int shift = bucket / LATENCY_SUB_BUCKETS - 1;
+    unsigned long start = (LATENCY_SUB_BUCKETS + bucket % LATENCY_SUB_BUCKETS)
+                          << shift;
+    return start + (1UL << shift) - 1;
+};
+
+void sinuca::latency::LatencyHistogram::Add(unsigned long value) {
+    unsigned long bucket = GetBucket(value);
+    if (bucket >= this->buckets.size()) this->buckets.resize(bucket + 1, 0);
+
+    ++this->buckets[bucket];
+    ++this->count;
+    this->sum += value;
+    if (value > this->max) this->max = value;
+};
+
+unsigned long sinuca::latency::LatencyHistogram::GetPercentile(
+    double fraction) const {
+    if (!this->count) return 0;
+
+    unsigned long rank = (unsigned long)ceil(fraction * this->count);
+    if (rank < 1) rank = 1;
+
+    unsigned long seen = 0;
+    for (unsigned long i = 0; i < this->buckets.size(); ++i) {
+        seen += this->buckets[i];
+        if (seen >= rank) {
+            unsigned long end = GetBucketEnd(i);
+            return (end < this->max) ? end : this->max;
+        }
+    }
+    return this->max;
+};
+
+int sinuca::latency::LatencyMonitor::AddStream(
+    const char* name, engine::Connection* connection,
+    const engine::Linkable* source, const engine::Linkable* recipient) {
+    if (this->started) {
+        fprintf(stderr, "Streams must be added before the monitor starts.\n");
+        return 1;
+    }
+    if (connection->IsVariableLength()) {
+        fprintf(stderr, "%s is a variable-length connection, its latency "
+                        "cannot be measured.\n",
+                name);
+        return 1;
+    }
+
+    Stream stream;
+    stream.name = name;
+    stream.connection = connection;
+    stream.answerers[0] = recipient;
+    stream.answerers[1] = source;
+    stream.unmatched = 0;
+    this->streams.push_back(stream);
+
+    return 0;
+};
+
+void sinuca::latency::LatencyMonitor::Start(const engine::Engine* engine) {
+    this->engine = engine;
+    this->started = true;
+
+    for (unsigned long i = 0; i < this->streams.size(); ++i) {
+        for (unsigned long d = 0; d < 4; ++d) {
+            Channel channel;
+            channel.monitor = this;
+            channel.stream = i;
+            channel.direction = DIRECTIONS[d];
+            this->channels.push_back(channel);
+            this->streams[i].connection->SetObserver(DIRECTIONS[d], Observe,
+                                                     &this->channels.back());
+        }
+    }
+};
+
+void sinuca::latency::LatencyMonitor::Observe(void* context,
+                                              const void* message) {
+    Channel* channel = static_cast<Channel*>(context);
+    Stream& stream = channel->monitor->streams[channel->stream];
+    unsigned long cycle = channel->monitor->engine->GetCycle();
+
+    switch (channel->direction) {
+        case engine::MessageRequestToDestination:
+        case engine::MessageRequestToSource: {
+            int answerer =
+                (channel->direction == engine::MessageRequestToSource);
+            if (stream.answerers[answerer]->ExpectsResponse(message))
+                stream.pending[answerer].push_back(cycle);
+            break;
+        }
+        case engine::MessageResponseToSource:
+        case engine::MessageResponseToDestination: {
+            /* A response to the source answers a request to the
+             * destination, and the other way around. */
+            std::deque<unsigned long>& pending =
+                stream.pending[channel->direction ==
+                               engine::MessageResponseToDestination];
+            if (pending.empty()) {
+                ++stream.unmatched;
+                break;
+            }
+            stream.histogram.Add(cycle - pending.front());
+            pending.pop_front();
+            break;
+        }
+    }
+};
+
+void sinuca::latency::LatencyMonitor::Stop() {
+    if (!this->started) return;
+
+    for (unsigned long i = 0; i < this->streams.size(); ++i) {
+        for (unsigned long d = 0; d < 4; ++d)
+            this->streams[i].connection->SetObserver(DIRECTIONS[d], NULL,
+                                                     NULL);
+    }
+    this->started = false;
+};
+
+void sinuca::latency::LatencyMonitor::PrintStatistics(FILE* output) const {
+    for (unsigned long i = 0; i < this->streams.size(); ++i) {
+        const Stream& stream = this->streams[i];
+        const LatencyHistogram& histogram = stream.histogram;
+        if (!histogram.GetCount() && !stream.unmatched) continue;
+
+        const char* name = stream.name.c_str();
+        fprintf(output, "latency.%s.responses: %lu\n", name,
+                histogram.GetCount());
+        fprintf(output, "latency.%s.mean: %.2f\n", name, histogram.GetMean());
+        fprintf(output, "latency.%s.p50: %lu\n", name,
+                histogram.GetPercentile(0.50));
+        fprintf(output, "latency.%s.p99: %lu\n", name,
+                histogram.GetPercentile(0.99));
+        fprintf(output, "latency.%s.max: %lu\n", name, histogram.GetMax());
+        if (stream.unmatched)
+            fprintf(output, "latency.%s.unmatched: %lu\n", name,
+                    stream.unmatched);
+    }
+};
+
+sinuca::latency::LatencyMonitor::~LatencyMonitor() { this->Stop(); };
@@ -0,0 +1,166 @@
+#ifndef SINUCA3_UTILS_LATENCY_HPP_
+#define SINUCA3_UTILS_LATENCY_HPP_
+
+//
+// Copyright (C) 2024  HiPES - Universidade Federal do Paraná
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/**
+ * @file latency.hpp
+ * @brief Request-to-response latency distributions of connections.
+ * @details The monitor observes the buffers of a connection the way the
+ * MessageRecorder does, so the messages keep their types and a run without
+ * monitor pays nothing beyond the observer test every Enqueue already makes.
+ * The cycle a request is sent is kept out of band, in a queue per direction,
+ * if its recipient ExpectsResponse. The next response in the other direction
+ * is matched to the oldest queued request, so responses must leave in the
+ * order their requests arrived on the connection. Variable-length connections
+ * are not observed.
+ */
+
+#include <cstdio>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "engine.hpp"
+
+namespace sinuca {
+namespace latency {
+
+/** Sub-buckets of each power of two, as bits: 16 keeps every value within
+ * 1/16 of the bucket it is reported as. */
+static const int LATENCY_SUB_BUCKET_BITS = 4;
+static const unsigned long LATENCY_SUB_BUCKETS = 1UL
+                                                 << LATENCY_SUB_BUCKET_BITS;
+
+/**
+ * @brief Log-bucketed histogram of cycles, in the manner of HdrHistogram.
+ * @details Values below 2 * LATENCY_SUB_BUCKETS are exact. Above, each power
+ * of two is split in LATENCY_SUB_BUCKETS buckets. Buckets are added as
+ * larger values arrive, so the memory follows the largest value only.
+ */
+class LatencyHistogram {
+  private:
+    std::vector<unsigned long> buckets;
+    unsigned long count;
+    unsigned long sum;
+    unsigned long max;
+
+    static unsigned long GetBucket(unsigned long value);
+
+    /**
+     * @return The largest value that falls in a bucket.
+     */
+    static unsigned long GetBucketEnd(unsigned long bucket);
+
+  public:
+    LatencyHistogram() : count(0), sum(0), max(0){};
+
+    void Add(unsigned long value);
+
+    inline unsigned long GetCount() const { return this->count; };
+
+    inline unsigned long GetMax() const { return this->max; };
+
+    inline double GetMean() const {
+        return this->count ? (double)this->sum / this->count : 0.0;
+    };
+
+    /**
+     * @param fraction Between 0 and 1, e.g. 0.99.
+     * @return A value at least as large as the given fraction of the values,
+     * the end of the bucket it falls in and never above the maximum.
+     */
+    unsigned long GetPercentile(double fraction) const;
+};
+
+/**
+ * @brief Measures the latency of the responses of a set of connections.
+ * @details Add the streams, then Start. The connections are observed until
+ * Stop, which the destructor calls. A connection can only have one observer,
+ * so a monitored connection cannot be recorded at the same time.
+ */
+class LatencyMonitor {
+  private:
+    struct Stream {
+        std::string name;
+        engine::Connection* connection;
+        const engine::Linkable* answerers[2]; /**< Recipient, then source. */
+        std::deque<unsigned long> pending[2]; /**< Send cycles of the
+                                                 requests awaiting a
+                                                 response, per direction. */
+        LatencyHistogram histogram;
+        unsigned long unmatched; /**< Responses with no request queued. */
+    };
+
+    struct Channel {
+        LatencyMonitor* monitor;
+        unsigned long stream;
+        engine::MessageDirection direction;
+    };
+
+    const engine::Engine* engine;
+    std::vector<Stream> streams;
+    std::deque<Channel> channels; /**< Contexts of the observers. */
+    bool started;
+
+    static void Observe(void* context, const void* message);
+
+  public:
+    LatencyMonitor() : engine(NULL), started(false){};
+
+    /**
+     * @brief Selects a connection, before Start.
+     * @param name Reported with the statistics, e.g. <source>.<parameter>.
+     * @returns Non-zero on error, 0 otherwise.
+     */
+    int AddStream(const char* name, engine::Connection* connection,
+                  const engine::Linkable* source,
+                  const engine::Linkable* recipient);
+
+    /**
+     * @brief Starts observing the connections.
+     * @param engine Gives the cycle of each message.
+     */
+    void Start(const engine::Engine* engine);
+
+    /**
+     * @brief Stops observing.
+     */
+    void Stop();
+
+    inline unsigned long GetNumberOfStreams() const {
+        return this->streams.size();
+    };
+
+    inline const LatencyHistogram& GetHistogram(unsigned long stream) const {
+        return this->streams[stream].histogram;
+    };
+
+    /**
+     * @brief Prints the count, mean, p50, p99 and maximum of every stream
+     * that saw a response.
+     */
+    void PrintStatistics(FILE* output) const;
+
+    ~LatencyMonitor();
+};
+
+}  // namespace latency
+}  // namespace sinuca
+
+#endif  // SINUCA3_UTILS_LATENCY_HPP_
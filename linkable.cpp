@@ -22,10 +22,33 @@
 
 #include "linkable.hpp"
 
+#include <cstdio>
+#include <cstring>
+#include <new>
+
 void sinuca::engine::Connection::CreateBuffers(int bufferSize,
-                                               int messageSize) {
+                                               int messageSize, void* storage,
+                                               memory::Account* account) {
     this->bufferSize = bufferSize;
     this->messageSize = messageSize;
+    this->account = account;
+
+    /* Shared storage is charged too, it exists because of this connection. */
+    memory::Charge(account, GetStorageSize(bufferSize, messageSize), true);
+
+    if (storage) {
+        char* region = static_cast<char*>(storage);
+        long stride = (long)bufferSize * messageSize;
+
+        this->requestBuffers[0].Allocate(bufferSize, messageSize, region);
+        this->requestBuffers[1].Allocate(bufferSize, messageSize,
+                                         region + stride);
+        this->responseBuffers[0].Allocate(bufferSize, messageSize,
+                                          region + 2 * stride);
+        this->responseBuffers[1].Allocate(bufferSize, messageSize,
+                                          region + 3 * stride);
+        return;
+    }
 
     this->requestBuffers[0].Allocate(bufferSize, messageSize);
     this->requestBuffers[1].Allocate(bufferSize, messageSize);
@@ -34,12 +57,144 @@ void sinuca::engine::Connection::CreateBuffers(int bufferSize,
     this->responseBuffers[1].Allocate(bufferSize, messageSize);
 };
 
+void sinuca::engine::Connection::CreateByteRings(int capacity, void* storage,
+                                                 memory::Account* account) {
+    this->bufferSize = ByteRing::RoundCapacity(capacity);
+    this->messageSize = 1;
+    this->variableLength = true;
+    this->account = account;
+
+    memory::Charge(account, GetByteRingStorageSize(capacity), true);
+
+    char* region = static_cast<char*>(storage);
+    long stride = this->bufferSize;
+    if (storage) {
+        this->requestRings[0].Allocate(capacity, region);
+        this->requestRings[1].Allocate(capacity, region + stride);
+        this->responseRings[0].Allocate(capacity, region + 2 * stride);
+        this->responseRings[1].Allocate(capacity, region + 3 * stride);
+        return;
+    }
+
+    this->requestRings[0].Allocate(capacity);
+    this->requestRings[1].Allocate(capacity);
+
+    this->responseRings[0].Allocate(capacity);
+    this->responseRings[1].Allocate(capacity);
+};
+
+void sinuca::engine::Connection::TouchStorage(void* storage, int bufferSize,
+                                              int messageSize, int id) {
+    /* An end consumes requestBuffers[id] and responseBuffers[id]. */
+    char* region = static_cast<char*>(storage);
+    long stride = (long)bufferSize * messageSize;
+
+    memset(region + id * stride, 0, stride);
+    memset(region + (2 + id) * stride, 0, stride);
+};
+
+void sinuca::engine::Connection::SetObserver(
+    MessageDirection direction, CircularBuffer::Observer observer,
+    void* context) {
+    switch (direction) {
+        case MessageRequestToDestination:
+            this->requestBuffers[DEST_ID].SetObserver(observer, context);
+            break;
+        case MessageResponseToSource:
+            this->responseBuffers[SOURCE_ID].SetObserver(observer, context);
+            break;
+        case MessageRequestToSource:
+            this->requestBuffers[SOURCE_ID].SetObserver(observer, context);
+            break;
+        case MessageResponseToDestination:
+            this->responseBuffers[DEST_ID].SetObserver(observer, context);
+            break;
+    }
+};
+
+void sinuca::engine::Connection::SetRequestReadyFlag(unsigned long* word,
+                                                     unsigned long bit) {
+    /* Only one of the two is allocated, the other never gets a request. */
+    this->requestBuffers[DEST_ID].SetReadyFlag(word, bit);
+    this->requestRings[DEST_ID].SetReadyFlag(word, bit);
+};
+
+void sinuca::engine::Connection::RefreshRequestReadyFlag() {
+    this->requestBuffers[DEST_ID].RefreshReadyFlag();
+    this->requestRings[DEST_ID].RefreshReadyFlag();
+};
+
 void sinuca::engine::Connection::DeleteBuffers() {
+    if (this->requestBuffers[0].IsAllocated() ||
+        this->requestRings[0].IsAllocated()) {
+        memory::Release(this->account,
+                        GetStorageSize(this->bufferSize, this->messageSize),
+                        true);
+    }
+
     this->requestBuffers[0].Deallocate();
     this->requestBuffers[1].Deallocate();
 
     this->responseBuffers[0].Deallocate();
     this->responseBuffers[1].Deallocate();
+
+    this->requestRings[0].Deallocate();
+    this->requestRings[1].Deallocate();
+
+    this->responseRings[0].Deallocate();
+    this->responseRings[1].Deallocate();
+};
+
+int sinuca::engine::Connection::Resize(int bufferSize) {
+    if (this->variableLength || this->external) {
+        fprintf(stderr, "Only private connections of fixed-size messages can "
+                        "be resized.\n");
+        return 1;
+    }
+    if (bufferSize <= 0 || bufferSize < this->GetLargestOccupation()) {
+        fprintf(stderr, "Cannot resize a connection to %d messages.\n",
+                bufferSize);
+        return 1;
+    }
+
+    memory::Release(this->account,
+                    GetStorageSize(this->bufferSize, this->messageSize), true);
+    this->requestBuffers[0].Resize(bufferSize);
+    this->requestBuffers[1].Resize(bufferSize);
+    this->responseBuffers[0].Resize(bufferSize);
+    this->responseBuffers[1].Resize(bufferSize);
+    this->bufferSize = bufferSize;
+    memory::Charge(this->account,
+                   GetStorageSize(this->bufferSize, this->messageSize), true);
+
+    return 0;
+};
+
+int sinuca::engine::Connection::GetLargestOccupation() const {
+    int occupation = 0;
+    for (int i = 0; i < 2; ++i) {
+        occupation =
+            std::max(occupation, this->requestBuffers[i].GetOccupation());
+        occupation =
+            std::max(occupation, this->responseBuffers[i].GetOccupation());
+    }
+    return occupation;
+};
+
+int sinuca::engine::Connection::GetHighWaterMark() const {
+    int mark = 0;
+    for (int i = 0; i < 2; ++i) {
+        mark = std::max(mark, this->requestBuffers[i].GetHighWaterMark());
+        mark = std::max(mark, this->responseBuffers[i].GetHighWaterMark());
+    }
+    return mark;
+};
+
+unsigned long sinuca::engine::Connection::GetFullEvents() const {
+    return this->requestBuffers[0].GetFullEvents() +
+           this->requestBuffers[1].GetFullEvents() +
+           this->responseBuffers[0].GetFullEvents() +
+           this->responseBuffers[1].GetFullEvents();
 };
 
 inline int sinuca::engine::Connection::GetBufferSize() const {
@@ -50,6 +205,35 @@ inline int sinuca::engine::Connection::GetMessageSize() const {
     return this->messageSize;
 };
 
+sinuca::engine::ConnectionHandle sinuca::engine::Connection::GetHandle(
+    int id) {
+    /*
+     * Each end writes to the buffers indexed by the id of the other end and
+     * reads from the buffers indexed by its own id.
+     */
+    int other = (id == SOURCE_ID) ? DEST_ID : SOURCE_ID;
+    ConnectionHandle handle;
+
+    handle.requestOutput = &this->requestBuffers[other];
+    handle.responseOutput = &this->responseBuffers[other];
+    handle.requestInput = &this->requestBuffers[id];
+    handle.responseInput = &this->responseBuffers[id];
+    handle.requestOutputRing = NULL;
+    handle.responseOutputRing = NULL;
+    handle.requestInputRing = NULL;
+    handle.responseInputRing = NULL;
+    handle.connectionID = 0;
+
+    if (this->variableLength) {
+        handle.requestOutputRing = &this->requestRings[other];
+        handle.responseOutputRing = &this->responseRings[other];
+        handle.requestInputRing = &this->requestRings[id];
+        handle.responseInputRing = &this->responseRings[id];
+    }
+
+    return handle;
+};
+
 bool sinuca::engine::Connection::SendRequest(int id, void* messageInput) {
     return this->requestBuffers[id].Enqueue(messageInput);
 };
@@ -67,86 +251,228 @@ bool sinuca::engine::Connection::ReceiveResponse(int id, void* messageOutput) {
 };
 
 sinuca::engine::Linkable::Linkable(int messageSize)
-    : messageSize(messageSize), numberOfConnections(0){};
+    : messageSize(messageSize),
+      traceID(0),
+      nextReadyRequest(0){};
 
 void sinuca::engine::Linkable::AllocateConnectionsBuffer(
     long numberOfConnections) {
-    this->numberOfConnections = numberOfConnections;
     this->connections.reserve(numberOfConnections);
+    this->sourceHandles.reserve(numberOfConnections);
+    this->recipientHandles.reserve(numberOfConnections);
+    this->GrowReadyRequests((numberOfConnections + 63) >> 6);
+};
+
+void sinuca::engine::Linkable::GrowReadyRequests(unsigned long words) {
+    if (this->readyRequests.size() >= words) return;
+
+    this->readyRequests.resize(words, 0);
+    for (unsigned long i = 0; i < this->connections.size(); ++i)
+        this->connections[i]->SetRequestReadyFlag(&this->readyRequests[i >> 6],
+                                                  1UL << (i & 63));
 };
 
 void sinuca::engine::Linkable::DeallocateConnectionsBuffer() {
     for (unsigned int i = 0; i < this->connections.size(); ++i) {
         this->connections[i]->DeleteBuffers();
-        delete this->connections[i];
+        if (this->connections[i]->IsExternal()) {
+            this->connections[i]->~Connection();
+        } else {
+            memory::Free(this->connections[i]);
+        }
     }
+    this->connections.clear();
+    this->sourceHandles.clear();
+    this->recipientHandles.clear();
+    this->readyRequests.clear();
+    this->nextReadyRequest = 0;
 };
 
 void sinuca::engine::Linkable::AddConnection(Connection* newConnection) {
     int connectionsSize = this->connections.size();
     this->connections.push_back(newConnection);
+    this->sourceHandles.push_back(newConnection->GetHandle(SOURCE_ID));
+    this->recipientHandles.push_back(newConnection->GetHandle(DEST_ID));
+    this->sourceHandles.back().connectionID = connectionsSize;
+    this->recipientHandles.back().connectionID = connectionsSize;
+
+    this->GrowReadyRequests((connectionsSize >> 6) + 1);
+    newConnection->SetRequestReadyFlag(
+        &this->readyRequests[connectionsSize >> 6],
+        1UL << (connectionsSize & 63));
+};
 
-    if (connectionsSize > this->numberOfConnections)
-        this->numberOfConnections = connectionsSize;
+int sinuca::engine::Linkable::Connect(int bufferSize, void* storage) {
+    int index = this->connections.size();
+
+    Connection* newConnection =
+        memory::Allocate<Connection>(&this->memoryAccount, 1);
+    newConnection->CreateBuffers(bufferSize, this->messageSize, storage,
+                                 &this->memoryAccount);
+    this->AddConnection(newConnection);
+
+    return index;
 };
 
-int sinuca::engine::Linkable::Connect(int bufferSize) {
+int sinuca::engine::Linkable::ConnectVariable(int capacity, void* storage) {
     int index = this->connections.size();
 
-    Connection* newConnection = new Connection();
-    newConnection->CreateBuffers(bufferSize, this->messageSize);
+    Connection* newConnection =
+        memory::Allocate<Connection>(&this->memoryAccount, 1);
+    newConnection->CreateByteRings(capacity, storage, &this->memoryAccount);
+    this->AddConnection(newConnection);
+
+    return index;
+};
+
+void sinuca::engine::Linkable::ReserveConnections(long numberOfConnections) {
+    this->AllocateConnectionsBuffer(numberOfConnections);
+};
+
+int sinuca::engine::Linkable::ConnectPreallocated(int bufferSize,
+                                                  void* storage,
+                                                  void* placement) {
+    if (!placement) return this->Connect(bufferSize, storage);
+
+    int index = this->connections.size();
+    Connection* newConnection = new (placement) Connection(true);
+    newConnection->CreateBuffers(bufferSize, this->messageSize, storage,
+                                 &this->memoryAccount);
+    this->AddConnection(newConnection);
+
+    return index;
+};
+
+int sinuca::engine::Linkable::ConnectVariablePreallocated(int capacity,
+                                                          void* storage,
+                                                          void* placement) {
+    if (!placement) return this->ConnectVariable(capacity, storage);
+
+    int index = this->connections.size();
+    Connection* newConnection = new (placement) Connection(true);
+    newConnection->CreateByteRings(capacity, storage, &this->memoryAccount);
     this->AddConnection(newConnection);
 
     return index;
 };
 
+int sinuca::engine::Linkable::SetConfigParameter(const char* parameter,
+                                                 config::ConfigValue value) {
+    (void)value;
+    fprintf(stderr, "Component does not accept the parameter \"%s\".\n",
+            parameter);
+    return 1;
+};
+
 bool sinuca::engine::Linkable::SendRequestToLinkable(Linkable* dest,
                                                      int connectionID,
                                                      void* messageInput) {
-    return dest->connections[connectionID]->SendRequest(DEST_ID, messageInput);
+    bool done = SendRequestToHandle(dest->sourceHandles[connectionID],
+                                    messageInput);
+    if (done)
+        SINUCA3_TRACE_EVENT(TraceEventSendRequest, this->traceID, connectionID);
+    return done;
 };
 
 bool sinuca::engine::Linkable::SendResponseToLinkable(Linkable* dest,
                                                       int connectionID,
                                                       void* messageInput) {
-    return dest->connections[connectionID]->SendResponse(DEST_ID, messageInput);
+    bool done = SendResponseToHandle(dest->sourceHandles[connectionID],
+                                     messageInput);
+    if (done)
+        SINUCA3_TRACE_EVENT(TraceEventSendResponse, this->traceID, connectionID);
+    return done;
 };
 
 bool sinuca::engine::Linkable::ReceiveRequestFromLinkable(Linkable* dest,
                                                           int connectionID,
                                                           void* messageOutput) {
-    return dest->connections[connectionID]->ReceiveRequest(SOURCE_ID,
-                                                           messageOutput);
+    bool done = ReceiveRequestFromHandle(dest->sourceHandles[connectionID],
+                                         messageOutput);
+    if (done)
+        SINUCA3_TRACE_EVENT(TraceEventReceiveRequest, this->traceID, connectionID);
+    return done;
 };
 
 bool sinuca::engine::Linkable::ReceiveResponseFromLinkable(
     Linkable* dest, int connectionID, void* messageOutput) {
-    return dest->connections[connectionID]->ReceiveResponse(SOURCE_ID,
-                                                            messageOutput);
+    bool done = ReceiveResponseFromHandle(dest->sourceHandles[connectionID],
+                                          messageOutput);
+    if (done)
+        SINUCA3_TRACE_EVENT(TraceEventReceiveResponse, this->traceID, connectionID);
+    return done;
 };
 
 bool sinuca::engine::Linkable::SendRequestToConnection(int connectionID,
                                                        void* messageInput) {
-    return this->connections[connectionID]->SendRequest(SOURCE_ID,
-                                                        messageInput);
+    bool done = SendRequestToHandle(this->recipientHandles[connectionID],
+                                    messageInput);
+    if (done)
+        SINUCA3_TRACE_EVENT(TraceEventSendRequest, this->traceID, connectionID);
+    return done;
 };
 
 bool sinuca::engine::Linkable::SendResponseToConnection(int connectionID,
                                                         void* messageInput) {
-    return this->connections[connectionID]->SendResponse(SOURCE_ID,
-                                                         messageInput);
+    bool done = SendResponseToHandle(this->recipientHandles[connectionID],
+                                     messageInput);
+    if (done)
+        SINUCA3_TRACE_EVENT(TraceEventSendResponse, this->traceID, connectionID);
+    return done;
 };
 
 bool sinuca::engine::Linkable::ReceiveRequestFromConnection(
     int connectionID, void* messageOutput) {
-    return this->connections[connectionID]->ReceiveRequest(DEST_ID,
-                                                           messageOutput);
+    bool done = ReceiveRequestFromHandle(this->recipientHandles[connectionID],
+                                         messageOutput);
+    if (done)
+        SINUCA3_TRACE_EVENT(TraceEventReceiveRequest, this->traceID, connectionID);
+    return done;
 };
 
 bool sinuca::engine::Linkable::ReceiveResponseFromConnection(
     int connectionID, void* messageOutput) {
-    return this->connections[connectionID]->ReceiveResponse(DEST_ID,
-                                                            messageOutput);
+    bool done = ReceiveResponseFromHandle(this->recipientHandles[connectionID],
+                                          messageOutput);
+    if (done)
+        SINUCA3_TRACE_EVENT(TraceEventReceiveResponse, this->traceID, connectionID);
+    return done;
+};
+
+void sinuca::engine::Linkable::PrintStatistics() {}
+
+unsigned long sinuca::engine::Linkable::FastForward(
+    unsigned long instructions) {
+    (void)instructions;
+    return 0;
+};
+
+unsigned long sinuca::engine::Linkable::GetInstructionCount() const {
+    return 0;
+};
+
+bool sinuca::engine::Linkable::IsFinished() const { return true; };
+
+bool sinuca::engine::Linkable::IsDrained() const { return true; };
+
+void sinuca::engine::Linkable::SetDraining(bool draining) { (void)draining; };
+
+bool sinuca::engine::Linkable::ExpectsResponse(const void*) const {
+    return true;
+};
+
+unsigned long sinuca::engine::Linkable::GetMessageRecordSize() const {
+    return this->messageSize;
+};
+
+void sinuca::engine::Linkable::EncodeMessage(const void* message,
+                                             void* record) const {
+    memcpy(record, message, this->messageSize);
+};
+
+void sinuca::engine::Linkable::DecodeMessage(void* record,
+                                             void* message) const {
+    memcpy(message, record, this->messageSize);
 };
 
 void sinuca::engine::Linkable::PreClock() {}
@@ -23,7 +23,11 @@
  * @brief Public API of the Linkable class.
  */
 
+#include "byteRing.hpp"
 #include "circularBuffer.hpp"
+#include "config.hpp"
+#include "memory.hpp"
+#include "trace.hpp"
 #include <vector>
 
 static const int SOURCE_ID = 0;
@@ -32,30 +36,157 @@ static const int DEST_ID = 1;
 namespace sinuca {
 namespace engine {
 
+/**
+ * @brief The four message streams of a connection. The source is the
+ * Linkable that connected, the destination the recipient.
+ */
+enum MessageDirection {
+    MessageRequestToDestination,
+    MessageResponseToSource,
+    MessageRequestToSource,
+    MessageResponseToDestination,
+};
+
+/**
+ * @brief Pointers to the buffers of a connection, as seen from one of its ends.
+ * @details Resolved once at setup time, so sending or receiving a message
+ * through a handle costs a single load of the buffer pointer followed by the
+ * copy, instead of going through the connections array of the recipient and
+ * the Connection object. A handle is valid while the recipient is alive.
+ */
+struct ConnectionHandle {
+    CircularBuffer* requestOutput;  /**< Buffer where requests are sent. */
+    CircularBuffer* responseOutput; /**< Buffer where responses are sent. */
+    CircularBuffer* requestInput;   /**< Buffer requests are received from. */
+    CircularBuffer* responseInput;  /**< Buffer responses are received from. */
+    ByteRing* requestOutputRing;  /**< Variable-length connections only, as */
+    ByteRing* responseOutputRing; /**< the buffers above. NULL otherwise. */
+    ByteRing* requestInputRing;
+    ByteRing* responseInputRing;
+    int connectionID; /**< ID on the recipient. */
+};
+
+/**
+ * @details A connection carries either fixed-size messages, in
+ * CircularBuffers, or variable-length ones, in ByteRings (see
+ * CreateByteRings). The two never mix in one connection.
+ */
 struct Connection {
   private:
-    int bufferSize;
+    int bufferSize; /**< Messages, or bytes when variable-length. */
     int messageSize;
+    bool variableLength;
     CircularBuffer requestBuffers[2];  /**<Array of the request buffers, swapped
                                            each cycle.*/
     CircularBuffer responseBuffers[2]; /**<Array of the response buffers,
                                            swapped each cycle.*/
+    ByteRing requestRings[2];  /**< Used instead of requestBuffers by
+                                   variable-length connections. */
+    ByteRing responseRings[2]; /**< Same, for responseBuffers. */
+    memory::Account* account;  /**< Charged with the buffers. */
+    bool external; /**< Constructed in storage of the topology, which the
+                       Linkable does not free. */
+
+    int GetLargestOccupation() const;
 
   public:
-    Connection() : bufferSize(0), messageSize(0){};
+    explicit Connection(bool external = false)
+        : bufferSize(0),
+          messageSize(0),
+          variableLength(false),
+          account(NULL),
+          external(external){};
 
     /**
      * @brief Allocate the buffers used to channels
      * @param bufferSize self-explanatory.
      * @param messageSize self-explanatory.
+     * @param storage Optional region of GetStorageSize(bufferSize,
+     * messageSize) bytes that backs the four buffers. It is not freed by the
+     * connection.
+     * @param account Optional account charged with the buffers, either way.
+     */
+    void CreateBuffers(int bufferSize, int messageSize, void* storage = NULL,
+                       memory::Account* account = NULL);
+
+    /**
+     * @brief Makes *this* a variable-length connection: each of the four
+     * buffers is a ByteRing of capacity bytes.
+     * @param storage Optional region of GetByteRingStorageSize(capacity)
+     * bytes, aligned to BYTE_RING_ALIGNMENT. It is not freed by the
+     * connection.
+     * @param account Optional account charged with the rings, either way.
+     */
+    void CreateByteRings(int capacity, void* storage = NULL,
+                         memory::Account* account = NULL);
+
+    /**
+     * @brief Bytes needed by the four buffers of a connection.
+     */
+    static inline long GetStorageSize(int bufferSize, int messageSize) {
+        return 4L * bufferSize * messageSize;
+    };
+
+    /**
+     * @brief Bytes needed by the four rings of a variable-length connection.
+     */
+    static inline long GetByteRingStorageSize(int capacity) {
+        return 4L * ByteRing::RoundCapacity(capacity);
+    };
+
+    /**
+     * @brief Writes the two buffers consumed by one end of a connection, in
+     * storage laid out as CreateBuffers does.
+     * @details Called before CreateBuffers by the thread that will clock that
+     * end, so the first touch places the pages near it. Rings share pages,
+     * so the placement is best effort. For variable-length connections,
+     * bufferSize is the rounded capacity and messageSize 1.
+     * @param id SOURCE_ID or DEST_ID.
      */
-    void CreateBuffers(int bufferSize, int messageSize);
+    static void TouchStorage(void* storage, int bufferSize, int messageSize,
+                             int id);
+
+    /**
+     * @brief Observes the messages of one direction (see
+     * CircularBuffer::SetObserver). Variable-length connections are not
+     * observed.
+     */
+    void SetObserver(MessageDirection direction,
+                     CircularBuffer::Observer observer, void* context);
+
+    /**
+     * @brief Flags the buffer of the requests received by the recipient (see
+     * CircularBuffer::SetReadyFlag).
+     */
+    void SetRequestReadyFlag(unsigned long* word, unsigned long bit);
 
     /**
      * @brief Free the memory allocated for the buffers.
      */
     void DeleteBuffers();
 
+    /**
+     * @brief Changes the capacity of the four buffers, keeping the queued
+     * messages (see CircularBuffer::Resize).
+     * @details Handles stay valid, they point to the buffers and not to their
+     * storage. Variable-length connections and connections placed in shared
+     * storage for other processes cannot be resized.
+     * @param bufferSize At least the occupation of every buffer.
+     * @returns Non-zero on error, 0 otherwise.
+     */
+    int Resize(int bufferSize);
+
+    /**
+     * @return The largest occupation reached by any of the four buffers.
+     */
+    int GetHighWaterMark() const;
+
+    /**
+     * @return The Enqueues refused by the four buffers because they were
+     * full.
+     */
+    unsigned long GetFullEvents() const;
+
     /**
      * @brief Self-explanatory
      */
@@ -66,6 +197,32 @@ struct Connection {
      */
     inline int GetMessageSize() const;
 
+    /**
+     * @brief Whether the buffers are ByteRings, see CreateByteRings.
+     */
+    inline bool IsVariableLength() const { return this->variableLength; };
+
+    /**
+     * @brief Whether *this* was constructed in place by
+     * Linkable::ConnectPreallocated.
+     */
+    inline bool IsExternal() const { return this->external; };
+
+    /**
+     * @brief Sets the ready flag of the requests received by the recipient
+     * again, from the occupation of their buffer.
+     * @details For a recipient whose sources run in other processes: their
+     * Enqueue flags the word in their own copy of the recipient.
+     */
+    void RefreshRequestReadyFlag();
+
+    /**
+     * @brief Builds the handle used by one of the ends of the connection.
+     * @param id SOURCE_ID for the Linkable that connected, DEST_ID for the
+     * recipient.
+     */
+    ConnectionHandle GetHandle(int id);
+
     /**
      * @brief Send a request to a certain requestBuffer.
      * @param id The id of the certain buffer.
@@ -128,12 +285,22 @@ struct Connection {
 class Linkable {
   private:
     long messageSize;
-    long numberOfConnections; /**< Counts how much connections other components
-                                  have initialized. */
+    int traceID; /**< Identifies the Linkable in traces. */
+    memory::Account memoryAccount; /**< Tables and connections of the
+                                       Linkable. */
+    std::vector<unsigned long>
+        readyRequests; /**< One bit per connection ID, set while requests are
+                           waiting in it. Kept by the buffers themselves. */
+    int nextReadyRequest; /**< Visited first by ForEachReadyRequest. */
 
   protected:
     std::vector<Connection*>
     connections; /**< Array of all connections buffers.*/
+    std::vector<ConnectionHandle>
+        sourceHandles; /**< Handles of the sources, indexed by connection ID. */
+    std::vector<ConnectionHandle>
+        recipientHandles; /**< Handles of *this* component, indexed by
+                              connection ID. */
 
     /**
      * @brief Allocates the buffers with the specified number of connections.
@@ -141,6 +308,13 @@ class Linkable {
      */
     void AllocateConnectionsBuffer(long numberOfConnections);
 
+    /**
+     * @brief Grows readyRequests to at least the given number of words.
+     * @details Growing moves the words, so every connection is pointed at
+     * its flag again.
+     */
+    void GrowReadyRequests(unsigned long words);
+
     /**
      * @brief Frees memory allocated for connections
      */
@@ -152,6 +326,26 @@ class Linkable {
      */
     void AddConnection(Connection* newConnection);
 
+    /**
+     * @brief Allocates a value-initialized array charged to *this* component.
+     * @details Free it with memory::Free. Use it for tables and other large
+     * structures, so the memory report can point at the component.
+     * @param count Number of elements.
+     */
+    template <typename Type>
+    inline Type* AllocateArray(unsigned long count) {
+        return memory::Allocate<Type>(&this->memoryAccount, count);
+    };
+
+    /**
+     * @brief Like AllocateArray, but follows the page policy (see
+     * memory::AllocateLarge). Meant for the big tables of a component.
+     */
+    template <typename Type>
+    inline Type* AllocateLargeArray(unsigned long count) {
+        return memory::AllocateLarge<Type>(&this->memoryAccount, count);
+    };
+
     /**
      * @brief Connect to *this* component.
      * @param bufferSize The size of the buffer used in the connection.
@@ -161,7 +355,101 @@ class Linkable {
      * to received messages.
      * @return Returns the id of connection on the receiving component
      */
-    int Connect(int bufferSize);
+    int Connect(int bufferSize, void* storage = NULL);
+
+    /**
+     * @brief Connect to *this* component with a variable-length connection.
+     * @details Messages of any length up to about capacity bytes travel
+     * inline in ByteRings, instead of being padded to GetMessageSize() or
+     * pointing elsewhere. They are sent and received with the Reserve,
+     * Commit, Peek and Release handle methods.
+     * @param capacity Bytes of each ring.
+     * @return Returns the id of connection on the receiving component
+     */
+    int ConnectVariable(int capacity, void* storage = NULL);
+
+    /* Ready Requests */
+
+    /**
+     * @brief Finds a connection with requests waiting, so a recipient with
+     * many connections does not poll each one of them.
+     * @details Gives fixed priority to the lowest IDs when from is 0, or
+     * round-robin when from is the one after the last connection served.
+     * @param from First connection ID considered, the search wraps around.
+     * @return The connection ID, or -1 if no request is waiting.
+     */
+    inline int FindReadyRequest(int from) const {
+        long words = this->readyRequests.size();
+        if (!words) return -1;
+        if (from >= (long)this->connections.size()) from = 0;
+
+        long word = from >> 6;
+        unsigned long bits = this->readyRequests[word] & (~0UL << (from & 63));
+        for (long i = 0; i <= words; ++i) {
+            if (bits) return (word << 6) + __builtin_ctzl(bits);
+            word = (word + 1 == words) ? 0 : word + 1;
+            bits = this->readyRequests[word];
+        }
+        return -1;
+    };
+
+    /**
+     * @brief Calls visit(connectionID) once for each connection with
+     * requests waiting.
+     * @details The work is proportional to the ready connections, not to all
+     * of them. The order is round-robin: each call starts after the
+     * connection visited first by the previous call. visit may receive from
+     * the connection or leave its requests waiting.
+     * @return The number of connections visited.
+     */
+    template <typename Visitor>
+    inline long ForEachReadyRequest(Visitor visit) {
+        long words = this->readyRequests.size();
+        if (!words) return 0;
+
+        long startWord = this->nextReadyRequest >> 6;
+        unsigned long high = ~0UL << (this->nextReadyRequest & 63);
+        long visited = 0;
+        int first = 0;
+
+        /* The start word is visited twice: its high bits first, its low
+         * bits last. */
+        for (long i = 0; i <= words; ++i) {
+            long word = startWord + i;
+            if (word >= words) word -= words;
+
+            unsigned long bits = this->readyRequests[word];
+            if (i == 0) {
+                bits &= high;
+            } else if (i == words) {
+                bits &= ~high;
+            }
+
+            while (bits) {
+                int id = (word << 6) + __builtin_ctzl(bits);
+                bits &= bits - 1;
+                if (!visited) first = id;
+                ++visited;
+                visit(id);
+            }
+        }
+
+        if (visited) {
+            this->nextReadyRequest =
+                (first + 1 < (long)this->connections.size()) ? first + 1 : 0;
+        }
+        return visited;
+    };
+
+    /**
+     * @brief Number of connections with requests waiting.
+     */
+    inline long GetNumberOfReadyRequests() const {
+        long count = 0;
+        for (unsigned long i = 0; i < this->readyRequests.size(); ++i)
+            count += __builtin_popcountl(this->readyRequests[i]);
+        return count;
+    };
 
     /* Source Methods */
 
@@ -255,8 +543,222 @@ class Linkable {
      */
     bool ReceiveResponseFromConnection(int connectionID, void* messageOutput);
 
+    /* Handle Methods */
+
+    /**
+     * @brief Resolves the handle a Linkable Source uses to talk to dest.
+     * @details Should be called once, after the connection is established
+     * (e.g., in FinishSetup), and the handle kept by the component. It is a
+     * copy: the handles of dest move when dest gains a connection, the
+     * buffers they point to do not.
+     * @param dest The pointer to Linkable.
+     * @param connectionID The connection ID obtained by the Connect method with
+     * the desired Linkable.
+     */
+    static inline ConnectionHandle ResolveConnectionToLinkable(
+        Linkable* dest, int connectionID) {
+        return dest->sourceHandles[connectionID];
+    };
+
+    /**
+     * @brief Resolves the handle a recipient Linkable uses to talk to one of
+     * its connections, a copy as ResolveConnectionToLinkable.
+     * @param connectionID self-explanatory.
+     */
+    inline ConnectionHandle ResolveConnection(int connectionID) const {
+        return this->recipientHandles[connectionID];
+    };
+
+    /**
+     * @brief Sends a request through a resolved handle.
+     * @return 1 if successfuly, 0 otherwise.
+     */
+    static inline bool SendRequestToHandle(const ConnectionHandle& handle,
+                                           void* messageInput) {
+        return handle.requestOutput->Enqueue(messageInput);
+    };
+
+    /**
+     * @brief Sends a response through a resolved handle.
+     * @return 1 if successfuly, 0 otherwise.
+     */
+    static inline bool SendResponseToHandle(const ConnectionHandle& handle,
+                                            void* messageInput) {
+        return handle.responseOutput->Enqueue(messageInput);
+    };
+
+    /**
+     * @brief Receives a request through a resolved handle.
+     * @return 1 if successfuly, 0 otherwise.
+     */
+    static inline bool ReceiveRequestFromHandle(const ConnectionHandle& handle,
+                                                void* messageOutput) {
+        return handle.requestInput->Dequeue(messageOutput);
+    };
+
+    /**
+     * @brief Receives a response through a resolved handle.
+     * @return 1 if successfuly, 0 otherwise.
+     */
+    static inline bool ReceiveResponseFromHandle(
+        const ConnectionHandle& handle, void* messageOutput) {
+        return handle.responseInput->Dequeue(messageOutput);
+    };
+
+    /* Variable-Length Handle Methods */
+
+    /**
+     * @brief Reserves a request of up to length bytes in a variable-length
+     * connection, to be written in place and sent with CommitRequestToHandle.
+     * @return The contiguous message, or NULL if there is no room for it.
+     */
+    static inline void* ReserveRequestToHandle(const ConnectionHandle& handle,
+                                               int length) {
+        return handle.requestOutputRing->Reserve(length);
+    };
+
+    /**
+     * @brief Sends the reserved request.
+     * @param length Bytes written, at most the ones reserved.
+     */
+    static inline void CommitRequestToHandle(const ConnectionHandle& handle,
+                                             int length) {
+        handle.requestOutputRing->Commit(length);
+    };
+
+    /**
+     * @brief Same as ReserveRequestToHandle, for a response.
+     */
+    static inline void* ReserveResponseToHandle(const ConnectionHandle& handle,
+                                                int length) {
+        return handle.responseOutputRing->Reserve(length);
+    };
+
+    /**
+     * @brief Same as CommitRequestToHandle, for a response.
+     */
+    static inline void CommitResponseToHandle(const ConnectionHandle& handle,
+                                              int length) {
+        handle.responseOutputRing->Commit(length);
+    };
+
+    /**
+     * @brief Returns the oldest request of a variable-length connection, in
+     * place. It stays there until ReleaseRequestFromHandle.
+     * @param length Receives its bytes.
+     * @return The message, or NULL if there is none.
+     */
+    static inline void* PeekRequestFromHandle(const ConnectionHandle& handle,
+                                              int* length) {
+        return handle.requestInputRing->Front(length);
+    };
+
+    /**
+     * @brief Removes the request returned by PeekRequestFromHandle.
+     */
+    static inline void ReleaseRequestFromHandle(
+        const ConnectionHandle& handle) {
+        handle.requestInputRing->Release();
+    };
+
+    /**
+     * @brief Same as PeekRequestFromHandle, for a response.
+     */
+    static inline void* PeekResponseFromHandle(const ConnectionHandle& handle,
+                                               int* length) {
+        return handle.responseInputRing->Front(length);
+    };
+
+    /**
+     * @brief Same as ReleaseRequestFromHandle, for a response.
+     */
+    static inline void ReleaseResponseFromHandle(
+        const ConnectionHandle& handle) {
+        handle.responseInputRing->Release();
+    };
+
   public:
     Linkable(int messageSize);
+
+    /**
+     * @brief Self-explanatory
+     */
+    inline long GetMessageSize() const { return this->messageSize; };
+
+    /**
+     * @brief Self-explanatory
+     */
+    inline int GetTraceID() const { return this->traceID; };
+
+    /**
+     * @brief Don't call this method.
+     * @details The engine numbers its components when they are added.
+     */
+    inline void SetTraceID(int traceID) { this->traceID = traceID; };
+
+    /**
+     * @brief Memory charged to *this* component: its arrays allocated with
+     * AllocateArray and the connections made to it.
+     */
+    inline memory::Account* GetMemoryAccount() {
+        return &this->memoryAccount;
+    };
+
+    /**
+     * @brief Don't call this method.
+     * @details Gives tools, such as the message recorder, access to a
+     * connection made to *this* component.
+     */
+    inline Connection* GetConnection(int connectionID) {
+        return this->connections[connectionID];
+    };
+
+    /**
+     * @brief Don't call this method.
+     * @details The configuration loader calls this method once the whole
+     * graph is known, so the connections array is sized only once.
+     * @param numberOfConnections Self-explanatory.
+     */
+    void ReserveConnections(long numberOfConnections);
+
+    /**
+     * @brief Don't call this method.
+     * @details The configuration loader calls this method to connect to *this*
+     * component using storage carved from its own contiguous region.
+     * @param bufferSize The size of the buffer used in the connection.
+     * @param storage Region of Connection::GetStorageSize(bufferSize,
+     * GetMessageSize()) bytes.
+     * @param placement Optional region of sizeof(Connection) bytes where the
+     * Connection itself is constructed, e.g. so that it is shared by
+     * processes along with its buffers.
+     * @return Returns the id of connection on the receiving component
+     */
+    int ConnectPreallocated(int bufferSize, void* storage,
+                            void* placement = NULL);
+
+    /**
+     * @brief Don't call this method.
+     * @details Same as ConnectPreallocated, for a variable-length connection.
+     * @param storage Region of Connection::GetByteRingStorageSize(capacity)
+     * bytes.
+     */
+    int ConnectVariablePreallocated(int capacity, void* storage,
+                                    void* placement = NULL);
+
+    /**
+     * @brief Receives a parameter from the configuration file.
+     * @details Called once per parameter, before FinishSetup. Connections
+     * declared in the configuration file arrive as values of type
+     * ConfigValueTypeComponentReference. The default implementation rejects
+     * every parameter. The component is responsible for printing a proper
+     * error message describing what happened.
+     * @param parameter The parameter name.
+     * @param value The parameter value.
+     * @returns Non-zero on error, 0 otherwise.
+     */
+    virtual int SetConfigParameter(const char* parameter,
+                                   config::ConfigValue value);
+
     /**
      * @brief Don't call this method.
      * @details The engine calls this method before each clock cycle to swap the
@@ -272,7 +774,7 @@ class Linkable {
     /**
      * @brief This method should be declared here so the simulator can send the
      * finish setup message.
-     * @details This method is called after the config file is and all
+     * @details This method is called after the config file is read and all
      * parameters are set, so to finish any setup required by the component.
      * Non-zero should be returned if any problem occurred (e.g., a required
      * configuration parameter was not provided). The component is responsible
@@ -287,6 +789,87 @@ class Linkable {
      */
     virtual void Clock() = 0;
 
+    /**
+     * @brief Called by the simulator at the end of the simulation, so the
+     * component can print its statistics to stdout.
+     * @details The default implementation prints nothing.
+     */
+    virtual void PrintStatistics();
+
+    /**
+     * @brief Advances the component functionally, without clock cycles or
+     * messages.
+     * @details Components that read an instruction stream (e.g., a trace)
+     * consume up to the given number of instructions and call the functional
+     * interfaces of the components they feed directly, so those keep warm
+     * state. The default implementation does nothing.
+     * @param instructions Instructions to skip.
+     * @returns The instructions actually skipped.
+     */
+    virtual unsigned long FastForward(unsigned long instructions);
+
+    /**
+     * @brief Instructions consumed so far, in both modes.
+     * @details The default implementation returns 0.
+     */
+    virtual unsigned long GetInstructionCount() const;
+
+    /**
+     * @brief Size of a message once recorded by EncodeMessage.
+     * @details The default implementation returns GetMessageSize().
+     */
+    virtual unsigned long GetMessageRecordSize() const;
+
+    /**
+     * @brief Writes a message received by *this* component in a form that
+     * stays meaningful in another run, for record and replay.
+     * @details The default implementation copies the bytes, which is only
+     * right for messages without pointers or padding. Components whose
+     * messages point to arrays copy the arrays into the record, and write
+     * equal messages as equal bytes, since records are compared with memcmp.
+     * @param record GetMessageRecordSize() bytes.
+     */
+    virtual void EncodeMessage(const void* message, void* record) const;
+
+    /**
+     * @brief Rebuilds a message from its record.
+     * @details Pointers of the message may point into the record, which is
+     * writable and outlives the message. The default implementation copies
+     * the bytes.
+     */
+    virtual void DecodeMessage(void* record, void* message) const;
+
+    /**
+     * @brief Whether *this* component answers a request it received.
+     * @details Used to pair requests with their responses, which are assumed
+     * to leave in the order their requests arrived on each connection (see
+     * latency.hpp). The default implementation returns true.
+     */
+    virtual bool ExpectsResponse(const void* request) const;
+
+    /**
+     * @brief Whether the component has nothing left to do.
+     * @details Used to stop instruction-bounded simulations when the input
+     * ends. The default implementation returns true.
+     */
+    virtual bool IsFinished() const;
+
+    /**
+     * @brief Whether the component has no work in flight: no message waiting
+     * to be sent or received, no request queued.
+     * @details Used to drain the components before fast-forwarding, since the
+     * functional interfaces bypass the messages. The default implementation
+     * returns true.
+     */
+    virtual bool IsDrained() const;
+
+    /**
+     * @brief While draining, a component that reads an instruction stream
+     * finishes the instructions it took but takes no new ones.
+     * @details The default implementation does nothing.
+     */
+    virtual void SetDraining(bool draining);
+
     virtual ~Linkable();
 };
 
@@ -0,0 +1,175 @@
+//
+// Copyright (C) 2024  HiPES - Universidade Federal do Paraná
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/**
+ * @file memory.cpp
+ * @brief Page policies of the accounting allocator.
+ */
+
+#include "memory.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+
+static const unsigned long SMALL_PAGE = 4096;
+static const unsigned long HUGE_PAGE_2M = 2UL << 20;
+static const unsigned long HUGE_PAGE_1G = 1UL << 30;
+
+static sinuca::memory::PagePolicy pagePolicy =
+    sinuca::memory::PagePolicyDefault;
+static std::atomic<bool> warnedFallback(false);
+static std::atomic<unsigned long> sharedObjects(0);
+
+static inline unsigned long RoundUp(unsigned long bytes, unsigned long page) {
+    return (bytes + page - 1) & ~(page - 1);
+};
+
+void sinuca::memory::SetPagePolicy(PagePolicy policy) { pagePolicy = policy; };
+
+sinuca::memory::PagePolicy sinuca::memory::GetPagePolicy() {
+    return pagePolicy;
+};
+
+int sinuca::memory::ParsePagePolicy(const char* name, PagePolicy* policy) {
+    if (strcmp(name, "default") == 0) {
+        *policy = PagePolicyDefault;
+    } else if (strcmp(name, "thp") == 0) {
+        *policy = PagePolicyTransparent;
+    } else if (strcmp(name, "2m") == 0) {
+        *policy = PagePolicyHuge2M;
+    } else if (strcmp(name, "1g") == 0) {
+        *policy = PagePolicyHuge1G;
+    } else {
+        fprintf(stderr,
+                "Unknown page policy \"%s\", use default, thp, 2m or 1g.\n",
+                name);
+        return 1;
+    }
+    return 0;
+};
+
+static void* MapAnonymous(unsigned long bytes, int flags) {
+    void* pages = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | flags, -1, 0);
+    return (pages == MAP_FAILED) ? NULL : pages;
+};
+
+/**
+ * @details Over-maps by a huge page and trims, so the region is aligned and
+ * the kernel can back it with transparent huge pages.
+ */
+static void* MapTransparent(unsigned long bytes, unsigned long* mappedBytes) {
+    unsigned long size = RoundUp(bytes, HUGE_PAGE_2M);
+    char* pages = static_cast<char*>(MapAnonymous(size + HUGE_PAGE_2M, 0));
+    if (!pages) return NULL;
+
+    char* aligned = reinterpret_cast<char*>(
+        RoundUp(reinterpret_cast<unsigned long>(pages), HUGE_PAGE_2M));
+    if (aligned > pages) munmap(pages, aligned - pages);
+    munmap(aligned + size, (pages + size + HUGE_PAGE_2M) - (aligned + size));
+
+#ifdef MADV_HUGEPAGE
+    madvise(aligned, size, MADV_HUGEPAGE);
+#endif
+
+    *mappedBytes = size;
+    return aligned;
+};
+
+void* sinuca::memory::MapPages(unsigned long bytes,
+                               unsigned long* mappedBytes) {
+    PagePolicy policy = pagePolicy;
+    if (policy == PagePolicyHuge1G && bytes < HUGE_PAGE_1G / 2)
+        policy = PagePolicyHuge2M;
+
+#ifdef MAP_HUGETLB
+    if (policy == PagePolicyHuge1G || policy == PagePolicyHuge2M) {
+        unsigned long page =
+            (policy == PagePolicyHuge1G) ? HUGE_PAGE_1G : HUGE_PAGE_2M;
+        int shift = (policy == PagePolicyHuge1G) ? 30 : 21;
+        unsigned long size = RoundUp(bytes, page);
+        void* pages =
+            MapAnonymous(size, MAP_HUGETLB | (shift << MAP_HUGE_SHIFT));
+        if (pages) {
+            *mappedBytes = size;
+            return pages;
+        }
+    }
+#endif
+
+    if (policy == PagePolicyHuge1G || policy == PagePolicyHuge2M) {
+        if (!warnedFallback.exchange(true))
+            fprintf(stderr,
+                    "Huge pages are not available, using transparent huge "
+                    "pages.\n");
+        policy = PagePolicyTransparent;
+    }
+
+    if (policy == PagePolicyTransparent) {
+        void* pages = MapTransparent(bytes, mappedBytes);
+        if (pages) return pages;
+    }
+
+    unsigned long size = RoundUp(bytes, SMALL_PAGE);
+    void* pages = MapAnonymous(size, 0);
+    if (pages) *mappedBytes = size;
+    return pages;
+};
+
+void sinuca::memory::UnmapPages(void* pages, unsigned long mappedBytes) {
+    munmap(pages, mappedBytes);
+};
+
+void* sinuca::memory::MapSharedPages(unsigned long bytes,
+                                     unsigned long* mappedBytes) {
+    char name[64];
+    snprintf(name, sizeof(name), "/sinuca3-%d-%lu", (int)getpid(),
+             sharedObjects.fetch_add(1));
+
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0) {
+        fprintf(stderr, "Could not create shared memory %s: %s.\n", name,
+                strerror(errno));
+        return NULL;
+    }
+    shm_unlink(name);
+
+    unsigned long size = RoundUp(bytes, SMALL_PAGE);
+    void* pages = MAP_FAILED;
+    if (ftruncate(fd, size) == 0) {
+        pages = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    if (pages == MAP_FAILED) {
+        fprintf(stderr, "Could not map %lu bytes of shared memory: %s.\n",
+                size, strerror(errno));
+        close(fd);
+        return NULL;
+    }
+    close(fd);
+
+    *mappedBytes = size;
+    return pages;
+};
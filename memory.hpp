@@ -0,0 +1,232 @@
+#ifndef SINUCA3_UTILS_MEMORY_HPP_
+#define SINUCA3_UTILS_MEMORY_HPP_
+
+//
+// Copyright (C) 2024  HiPES - Universidade Federal do Paraná
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/**
+ * @file memory.hpp
+ * @brief Accounting allocator, so memory can be attributed to components.
+ * @details Arrays allocated with Allocate or AllocateLarge carry a small
+ * header with their size and account, so Free needs neither. Accounts are
+ * updated atomically, because components may be set up by different worker
+ * threads while sharing a parent account.
+ *
+ * AllocateLarge is meant for big tables and buffers: under a page policy
+ * other than PagePolicyDefault it maps whole pages, huge if possible, and
+ * leaves them untouched until the array is first written, so the thread
+ * that initializes the array decides its NUMA node.
+ */
+
+#include <atomic>
+#include <cstddef>
+#include <new>
+
+namespace sinuca {
+namespace memory {
+
+struct Account {
+    std::atomic<unsigned long> currentBytes;
+    std::atomic<unsigned long> peakBytes;
+    std::atomic<unsigned long> allocations; /**< Allocations made, never
+                                                decremented. */
+    std::atomic<unsigned long> liveAllocations;
+    std::atomic<unsigned long> connectionBytes; /**< Part of currentBytes in
+                                                    connections. */
+    Account* parent; /**< Also charged, e.g. the owner of an inner component. */
+
+    Account()
+        : currentBytes(0),
+          peakBytes(0),
+          allocations(0),
+          liveAllocations(0),
+          connectionBytes(0),
+          parent(NULL){};
+};
+
+/**
+ * @brief Charges bytes to an account and its parents. Accepts NULL.
+ * @param connection Whether the bytes are connection buffers.
+ */
+inline void Charge(Account* account, unsigned long bytes,
+                   bool connection = false) {
+    for (; account; account = account->parent) {
+        unsigned long current =
+            account->currentBytes.fetch_add(bytes, std::memory_order_relaxed) +
+            bytes;
+        if (connection)
+            account->connectionBytes.fetch_add(bytes,
+                                               std::memory_order_relaxed);
+        account->allocations.fetch_add(1, std::memory_order_relaxed);
+        account->liveAllocations.fetch_add(1, std::memory_order_relaxed);
+
+        unsigned long peak = account->peakBytes.load(std::memory_order_relaxed);
+        while (current > peak &&
+               !account->peakBytes.compare_exchange_weak(
+                   peak, current, std::memory_order_relaxed)) {
+        }
+    }
+};
+
+/**
+ * @brief Returns bytes charged with Charge. Accepts NULL.
+ */
+inline void Release(Account* account, unsigned long bytes,
+                    bool connection = false) {
+    for (; account; account = account->parent) {
+        account->currentBytes.fetch_sub(bytes, std::memory_order_relaxed);
+        if (connection)
+            account->connectionBytes.fetch_sub(bytes,
+                                               std::memory_order_relaxed);
+        account->liveAllocations.fetch_sub(1, std::memory_order_relaxed);
+    }
+};
+
+enum PagePolicy {
+    PagePolicyDefault,     /**< The heap, like new[]. */
+    PagePolicyTransparent, /**< Mapped pages with madvise(MADV_HUGEPAGE). */
+    PagePolicyHuge2M,      /**< MAP_HUGETLB 2MB pages. */
+    PagePolicyHuge1G,      /**< MAP_HUGETLB 1GB pages. */
+};
+
+/**
+ * @brief Sets the policy of AllocateLarge. Call it before the setup.
+ */
+void SetPagePolicy(PagePolicy policy);
+
+PagePolicy GetPagePolicy();
+
+/**
+ * @brief Parses "default", "thp", "2m" or "1g".
+ * @returns Non-zero on error, 0 otherwise.
+ */
+int ParsePagePolicy(const char* name, PagePolicy* policy);
+
+/**
+ * @brief Maps at least bytes bytes under the current policy, falling back to
+ * transparent huge pages and then to normal pages when huge pages are not
+ * available. 1GB pages are only used for at least half a gigabyte. The pages
+ * are not touched.
+ * @param mappedBytes Receives the size to give to UnmapPages.
+ * @returns NULL if not even normal pages could be mapped.
+ */
+void* MapPages(unsigned long bytes, unsigned long* mappedBytes);
+
+void UnmapPages(void* pages, unsigned long mappedBytes);
+
+/**
+ * @brief Maps at least bytes bytes of POSIX shared memory, shared with the
+ * processes forked afterwards at the same address. The object is unlinked
+ * right away, so nothing is left behind when the processes exit. Normal pages
+ * only, the page policy does not apply.
+ * @param mappedBytes Receives the size to give to UnmapPages.
+ * @returns NULL on error, after printing it.
+ */
+void* MapSharedPages(unsigned long bytes, unsigned long* mappedBytes);
+
+/**
+ * @brief Placed right before every array.
+ */
+struct alignas(16) AllocationHeader {
+    Account* account;
+    unsigned long bytes;
+    unsigned long mappedBytes; /**< 0 if the array is in the heap. */
+};
+
+/** Offset of an array in its pages, keeps it 64-byte aligned. */
+static const unsigned long PAGE_ARRAY_OFFSET = 64;
+/** Smaller arrays stay in the heap, pages of their own would waste memory. */
+static const unsigned long LARGE_ALLOCATION_MIN = 256UL << 10;
+
+/**
+ * @brief Allocates and value-initializes an array charged to an account.
+ * @details Throws std::bad_alloc like new[]. Release with Free.
+ * @param account May be NULL, in which case nothing is charged.
+ */
+template <typename Type>
+Type* Allocate(Account* account, unsigned long count) {
+    static_assert(alignof(Type) <= alignof(AllocationHeader),
+                  "The header would misalign the array.");
+
+    unsigned long bytes = count * sizeof(Type);
+    AllocationHeader* header = static_cast<AllocationHeader*>(
+        ::operator new(sizeof(AllocationHeader) + bytes));
+    header->account = account;
+    header->bytes = bytes;
+    header->mappedBytes = 0;
+    Charge(account, bytes);
+
+    Type* array = reinterpret_cast<Type*>(header + 1);
+    for (unsigned long i = 0; i < count; ++i) new (&array[i]) Type();
+
+    return array;
+};
+
+/**
+ * @brief Like Allocate, but in pages of their own when the page policy is
+ * not PagePolicyDefault.
+ * @details The array is initialized by the calling thread, which is the
+ * first to touch its pages.
+ */
+template <typename Type>
+Type* AllocateLarge(Account* account, unsigned long count) {
+    unsigned long bytes = count * sizeof(Type);
+    if (GetPagePolicy() == PagePolicyDefault || bytes < LARGE_ALLOCATION_MIN)
+        return Allocate<Type>(account, count);
+
+    unsigned long mappedBytes;
+    char* pages =
+        static_cast<char*>(MapPages(PAGE_ARRAY_OFFSET + bytes, &mappedBytes));
+    if (!pages) throw std::bad_alloc();
+
+    Type* array = reinterpret_cast<Type*>(pages + PAGE_ARRAY_OFFSET);
+    AllocationHeader* header = reinterpret_cast<AllocationHeader*>(array) - 1;
+    header->account = account;
+    header->bytes = bytes;
+    header->mappedBytes = mappedBytes;
+    Charge(account, bytes);
+
+    for (unsigned long i = 0; i < count; ++i) new (&array[i]) Type();
+
+    return array;
+};
+
+/**
+ * @brief Destroys and frees an array from Allocate or AllocateLarge. Accepts
+ * NULL.
+ */
+template <typename Type>
+void Free(Type* array) {
+    if (!array) return;
+
+    AllocationHeader* header = reinterpret_cast<AllocationHeader*>(array) - 1;
+    unsigned long count = header->bytes / sizeof(Type);
+    for (unsigned long i = 0; i < count; ++i) array[i].~Type();
+
+    Release(header->account, header->bytes);
+    if (header->mappedBytes) {
+        UnmapPages(reinterpret_cast<char*>(array) - PAGE_ARRAY_OFFSET,
+                   header->mappedBytes);
+    } else {
+        ::operator delete(header);
+    }
+};
+
+}  // namespace memory
+}  // namespace sinuca
+
+#endif  // SINUCA3_UTILS_MEMORY_HPP_
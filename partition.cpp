@@ -0,0 +1,298 @@
+//
+// Copyright (C) 2024  HiPES - Universidade Federal do Paraná
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/**
+ * @file partition.cpp
+ * @brief Implementation of the PartitionedEngine.
+ */
+
+#include "partition.hpp"
+
+#include <sched.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <new>
+
+namespace sinuca {
+namespace partition {
+
+/**
+ * @brief Shared by the processes of a PartitionedEngine.
+ * @details Turns are numbered phase * runs + run, where phase 0 finishes the
+ * setup, phases 1 to cycles clock and the last one prints the statistics.
+ * The release of PassTurn and the acquire of WaitTurn order the writes of a
+ * run to the connections before the reads of the next one.
+ */
+struct alignas(64) PartitionControl {
+    std::atomic<unsigned long> turn;
+    std::atomic<int> failed; /**< Set when a process fails, so the others
+                                 stop instead of waiting forever. */
+
+    PartitionControl() : turn(0), failed(0){};
+};
+
+}  // namespace partition
+}  // namespace sinuca
+
+/** Exit status of a process stopped because another one failed. */
+static const int STOPPED = 2;
+/** Checks of the turn before yielding the CPU. */
+static const int SPINS_BEFORE_YIELD = 64;
+
+int sinuca::partition::PartitionedEngine::AssignPartitions(
+    int numberOfPartitions) {
+    long count = this->topology->GetNumberOfComponents();
+    if (numberOfPartitions < 1 || numberOfPartitions > count) {
+        fprintf(stderr,
+                "The number of partitions must be between 1 and the number "
+                "of components (%ld).\n",
+                count);
+        return 1;
+    }
+
+    bool given = false;
+    for (long i = 0; i < count; ++i) {
+        if (this->topology->GetComponentPartition(i) >= 0) given = true;
+    }
+
+    this->partitions.assign(count, 0);
+    int previous = 0;
+    for (long i = 0; i < count; ++i) {
+        int partition = given ? this->topology->GetComponentPartition(i)
+                              : (int)(i * numberOfPartitions / count);
+        if (partition < 0) partition = previous;
+        if (partition >= numberOfPartitions) {
+            fprintf(stderr,
+                    "%s is in partition %d, but there are %d partitions.\n",
+                    this->topology->GetComponentName(i), partition,
+                    numberOfPartitions);
+            return 1;
+        }
+        this->partitions[i] = previous = partition;
+    }
+
+    std::vector<bool> used(numberOfPartitions, false);
+    this->runs.clear();
+    for (long i = 0; i < count; ++i) {
+        used[this->partitions[i]] = true;
+        if (!this->runs.empty() &&
+            this->runs.back().partition == this->partitions[i]) {
+            this->runs.back().end = i + 1;
+            continue;
+        }
+        Run run;
+        run.partition = this->partitions[i];
+        run.first = i;
+        run.end = i + 1;
+        this->runs.push_back(run);
+    }
+    for (int i = 0; i < numberOfPartitions; ++i) {
+        if (!used[i]) {
+            fprintf(stderr, "Partition %d has no components.\n", i);
+            return 1;
+        }
+    }
+
+    this->numberOfPartitions = numberOfPartitions;
+    return 0;
+};
+
+int sinuca::partition::PartitionedEngine::SetPartitions(
+    int numberOfPartitions) {
+    for (long i = 0; i < this->topology->GetNumberOfConnections(); ++i) {
+        if (!this->topology->GetConnection(i)->IsExternal()) {
+            fprintf(stderr, "Partitions need a topology built with shared "
+                            "connections.\n");
+            return 1;
+        }
+    }
+    if (this->AssignPartitions(numberOfPartitions)) return 1;
+
+    this->inbound.assign(numberOfPartitions,
+                         std::vector<engine::Connection*>());
+    for (long i = 0; i < this->topology->GetNumberOfConnections(); ++i) {
+        int source = this->partitions[this->topology->GetConnectionSource(i)];
+        int destination =
+            this->partitions[this->topology->GetConnectionDestination(i)];
+        if (source != destination)
+            this->inbound[destination].push_back(
+                this->topology->GetConnection(i));
+    }
+
+    return 0;
+};
+
+int sinuca::partition::PartitionedEngine::MapControl() {
+    if (!this->control) {
+        void* pages = memory::MapSharedPages(sizeof(PartitionControl),
+                                             &this->controlMapped);
+        if (!pages) return 1;
+        this->control = new (pages) PartitionControl();
+    }
+    this->control->turn.store(0);
+    this->control->failed.store(0);
+    return 0;
+};
+
+int sinuca::partition::PartitionedEngine::WaitTurn(unsigned long turn) {
+    int spins = 0;
+    while (this->control->turn.load(std::memory_order_acquire) != turn) {
+        if (this->control->failed.load(std::memory_order_relaxed)) return 1;
+        if (++spins >= SPINS_BEFORE_YIELD) {
+            sched_yield();
+            spins = 0;
+        }
+    }
+    return 0;
+};
+
+void sinuca::partition::PartitionedEngine::PassTurn(unsigned long turn) {
+    this->control->turn.store(turn + 1, std::memory_order_release);
+};
+
+void sinuca::partition::PartitionedEngine::Fail() {
+    this->control->failed.store(1);
+};
+
+bool sinuca::partition::PartitionedEngine::HasFailed() const {
+    return this->control->failed.load(std::memory_order_relaxed);
+};
+
+int sinuca::partition::PartitionedEngine::RunPartition(int partition,
+                                                       unsigned long cycles) {
+    std::vector<long> ownRuns;
+    for (unsigned long i = 0; i < this->runs.size(); ++i) {
+        if (this->runs[i].partition == partition) ownRuns.push_back(i);
+    }
+    const std::vector<engine::Connection*>& inbound = this->inbound[partition];
+    unsigned long numberOfRuns = this->runs.size();
+
+    for (unsigned long phase = 0; phase <= cycles + 1; ++phase) {
+        for (unsigned long r = 0; r < ownRuns.size(); ++r) {
+            unsigned long turn = phase * numberOfRuns + ownRuns[r];
+            if (this->WaitTurn(turn)) return STOPPED;
+            const Run& run = this->runs[ownRuns[r]];
+
+            if (phase == 0) {
+                for (long i = run.first; i < run.end; ++i) {
+                    if (this->topology->FinishSetup(i)) {
+                        this->Fail();
+                        return 1;
+                    }
+                }
+            } else if (phase <= cycles) {
+                /* The sources flagged the requests in their own copy of the
+                 * recipients. */
+                for (unsigned long i = 0; i < inbound.size(); ++i)
+                    inbound[i]->RefreshRequestReadyFlag();
+
+                for (long i = run.first; i < run.end; ++i)
+                    this->topology->GetComponent(i)->PreClock();
+                for (long i = run.first; i < run.end; ++i)
+                    this->topology->GetComponent(i)->Clock();
+                for (long i = run.first; i < run.end; ++i)
+                    this->topology->GetComponent(i)->PosClock();
+            } else {
+                for (long i = run.first; i < run.end; ++i) {
+                    printf("# %s\n", this->topology->GetComponentName(i));
+                    this->topology->GetComponent(i)->PrintStatistics();
+                }
+            }
+
+            /* Output goes out in turn order too. */
+            fflush(stdout);
+            this->PassTurn(turn);
+        }
+    }
+
+    return 0;
+};
+
+int sinuca::partition::PartitionedEngine::Simulate(unsigned long cycles) {
+    if (!this->numberOfPartitions) {
+        fprintf(stderr, "No partitions were set.\n");
+        return 1;
+    }
+
+    if (this->MapControl()) return 1;
+
+    /* Otherwise buffered output would be written by every process. */
+    fflush(stdout);
+    fflush(stderr);
+
+    std::vector<pid_t> processes;
+    int error = 0;
+    for (int i = 0; i < this->numberOfPartitions; ++i) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            int status = this->RunPartition(i, cycles);
+            fflush(stdout);
+            /* The topology and its shared connections belong to the
+             * parent. */
+            _exit(status);
+        }
+        if (pid < 0) {
+            fprintf(stderr, "Could not fork partition %d: %s.\n", i,
+                    strerror(errno));
+            this->Fail();
+            error = 1;
+            break;
+        }
+        processes.push_back(pid);
+    }
+
+    for (unsigned long remaining = processes.size(); remaining > 0;) {
+        int status;
+        pid_t pid = waitpid(-1, &status, 0);
+        if (pid < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+
+        int partition = -1;
+        for (unsigned long i = 0; i < processes.size(); ++i) {
+            if (processes[i] == pid) partition = i;
+        }
+        if (partition < 0) continue;
+        --remaining;
+
+        if (WIFEXITED(status) && WEXITSTATUS(status) == 0) continue;
+        this->Fail();
+        error = 1;
+        if (WIFSIGNALED(status)) {
+            fprintf(stderr, "Partition %d was killed by signal %d (%s).\n",
+                    partition, WTERMSIG(status), strsignal(WTERMSIG(status)));
+        } else if (WEXITSTATUS(status) != STOPPED) {
+            fprintf(stderr, "Partition %d failed.\n", partition);
+        }
+    }
+
+    return error;
+};
+
+sinuca::partition::PartitionedEngine::~PartitionedEngine() {
+    if (this->control) {
+        this->control->~PartitionControl();
+        memory::UnmapPages(this->control, this->controlMapped);
+    }
+};
@@ -0,0 +1,159 @@
+#ifndef SINUCA3_ENGINE_PARTITION_HPP_
+#define SINUCA3_ENGINE_PARTITION_HPP_
+
+//
+// Copyright (C) 2024  HiPES - Universidade Federal do Paraná
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/**
+ * @file partition.hpp
+ * @brief Clocks the partitions of a topology in separate processes of the
+ * same host.
+ * @details The topology is built with shared connections (see
+ * config::Topology::SetSharedConnections) but not finished, then one process
+ * is forked per partition. Each process finishes the components of its
+ * partition, so their tables live in its own address space, and clocks them.
+ * A connection between two partitions is a pair of single-producer,
+ * single-consumer rings in POSIX shared memory, mapped at the same address in
+ * every process.
+ *
+ * Components are clocked in the order of the topology, as the Engine does,
+ * so the results are the ones of a single process. The order is split in
+ * runs, the longest ranges of components of the same partition, and a turn
+ * counter in shared memory acts as the barrier: a process waits for the turn
+ * of its run, clocks it and passes the turn on. Partitions therefore give
+ * isolation (a crash, a leak or a corrupted table stays in its process) and
+ * address spaces of their own, not speed.
+ *
+ * Only cycle mode is supported. Components that call each other directly,
+ * e.g. a TraceFetch and its BTB, must be in the same partition, since a
+ * process only finishes its own components.
+ */
+
+#include <vector>
+
+#include "configLoader.hpp"
+
+namespace sinuca {
+namespace partition {
+
+struct PartitionControl;
+
+/**
+ * @brief Runs a topology split in partitions, one process each.
+ */
+class PartitionedEngine {
+  protected:
+    struct Run {
+        int partition;
+        long first; /**< First component. */
+        long end;   /**< One past the last component. */
+    };
+
+    config::Topology* topology;
+    std::vector<int> partitions; /**< Of each component. */
+    int numberOfPartitions;
+    std::vector<Run> runs;
+    /** Per partition, the connections it receives requests from another
+     * partition on. */
+    std::vector<std::vector<engine::Connection*> > inbound;
+    PartitionControl* control;
+    unsigned long controlMapped;
+
+    /**
+     * @brief Assigns the components to partitions and splits the order of
+     * the topology in runs, see SetPartitions.
+     * @returns Non-zero on error, 0 otherwise.
+     */
+    int AssignPartitions(int numberOfPartitions);
+
+    /**
+     * @brief Maps the turn counter shared by the processes, once, and resets
+     * it.
+     * @returns Non-zero on error, 0 otherwise.
+     */
+    int MapControl();
+
+    /**
+     * @brief Blocks until the turn comes, or another process failed.
+     * @returns Non-zero if another process failed.
+     */
+    int WaitTurn(unsigned long turn);
+
+    void PassTurn(unsigned long turn);
+
+    /**
+     * @brief Reports that a process failed, so the others stop.
+     */
+    void Fail();
+
+    bool HasFailed() const;
+
+  private:
+    /**
+     * @brief The body of the process of a partition.
+     * @returns Its exit status.
+     */
+    int RunPartition(int partition, unsigned long cycles);
+
+  public:
+    /**
+     * @param topology Built with shared connections and without FinishSetup.
+     */
+    PartitionedEngine(config::Topology* topology)
+        : topology(topology),
+          numberOfPartitions(0),
+          control(NULL),
+          controlMapped(0){};
+
+    /**
+     * @brief Assigns the components to partitions. Components given a
+     * partition in the topology keep it, and the others follow the component
+     * before them. When none was given, the components are split in
+     * numberOfPartitions ranges of the same size.
+     * @returns Non-zero on error, 0 otherwise.
+     */
+    int SetPartitions(int numberOfPartitions);
+
+    /**
+     * @brief Self-explanatory
+     */
+    inline int GetNumberOfPartitions() const {
+        return this->numberOfPartitions;
+    };
+
+    /**
+     * @brief Self-explanatory
+     */
+    inline long GetNumberOfRuns() const { return this->runs.size(); };
+
+    /**
+     * @brief Forks the processes, which finish their components, simulate the
+     * given number of cycles and print the statistics, and waits for them.
+     * @details Statistics are printed in the order of the topology, as
+     * sinuca3 does. When a process fails or dies, the others stop at their
+     * next turn.
+     * @returns Non-zero if a process failed, 0 otherwise.
+     */
+    int Simulate(unsigned long cycles);
+
+    ~PartitionedEngine();
+};
+
+}  // namespace partition
+}  // namespace sinuca
+
+#endif  // SINUCA3_ENGINE_PARTITION_HPP_
@@ -0,0 +1,370 @@
+//
+// Copyright (C) 2024  HiPES - Universidade Federal do Paraná
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/**
+ * @file replay.cpp
+ * @brief Replays recorded connections into a component, in isolation.
+ * @details The topology file holds the component under test, configured as
+ * when the capture was recorded (sinuca3 -r). Each recorded connection whose
+ * recipient is in the topology is connected to a replay port instead of its
+ * source. The port sends the recorded messages towards the component in the
+ * cycles they were sent, and checks what the component sends back against
+ * the recording, byte for byte, in order.
+ */
+
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "capture.hpp"
+#include "configLoader.hpp"
+#include "engine.hpp"
+
+using sinuca::capture::CaptureReader;
+using sinuca::capture::CaptureRecordHeader;
+using sinuca::capture::CaptureStream;
+
+/**
+ * @brief Stands for the source of one recorded connection.
+ */
+class ReplayPort : public sinuca::engine::Linkable {
+  private:
+    /** Messages the component sent, checked in order. */
+    struct Expected {
+        std::vector<CaptureRecordHeader*> records;
+        unsigned long next;
+    };
+
+    sinuca::engine::Linkable* component;
+    int connectionID;
+    unsigned long recordSize;
+    std::vector<char> message;
+    std::vector<char> record;
+    unsigned long nextInput;
+
+    void Compare(Expected& expected, unsigned long cycle) {
+        this->component->EncodeMessage(this->message.data(),
+                                       this->record.data());
+        ++this->messagesOut;
+        if (expected.next == expected.records.size()) {
+            ++this->extra;
+            return;
+        }
+
+        CaptureRecordHeader* header = expected.records[expected.next++];
+        if (memcmp(this->record.data(), CaptureReader::GetRecord(header),
+                   this->recordSize) == 0) {
+            ++this->matched;
+        } else {
+            ++this->mismatched;
+        }
+
+        unsigned long shift = (cycle > header->cycle) ? cycle - header->cycle
+                                                      : header->cycle - cycle;
+        if (shift > this->maxCycleShift) this->maxCycleShift = shift;
+    };
+
+  public:
+    const CaptureStream* stream;
+    std::vector<CaptureRecordHeader*> inputs; /**< Sent to the component. */
+    Expected responses;
+    Expected requests;
+
+    unsigned long messagesIn;
+    unsigned long delayedIn; /**< Sent after their cycle, the buffer was
+                                 full. */
+    unsigned long messagesOut;
+    unsigned long matched;
+    unsigned long mismatched;
+    unsigned long extra;
+    unsigned long maxCycleShift;
+
+    ReplayPort(const CaptureStream* stream)
+        : sinuca::engine::Linkable(stream->messageSize),
+          component(NULL),
+          connectionID(0),
+          recordSize(stream->recordSize),
+          message(stream->messageSize),
+          record(stream->recordSize),
+          nextInput(0),
+          stream(stream),
+          messagesIn(0),
+          delayedIn(0),
+          messagesOut(0),
+          matched(0),
+          mismatched(0),
+          extra(0),
+          maxCycleShift(0) {
+        this->responses.next = 0;
+        this->requests.next = 0;
+    };
+
+    void ConnectTo(sinuca::engine::Linkable* component) {
+        this->component = component;
+        this->connectionID =
+            component->ConnectPreallocated(this->stream->bufferSize, NULL);
+    };
+
+    int FinishSetup() { return 0; };
+    void Clock(){};
+
+    /**
+     * @brief Sends the messages of the cycle, and those still waiting for
+     * room, in the recorded order.
+     */
+    void Inject(unsigned long cycle) {
+        while (this->nextInput < this->inputs.size()) {
+            CaptureRecordHeader* header = this->inputs[this->nextInput];
+            if (header->cycle > cycle) break;
+
+            this->component->DecodeMessage(CaptureReader::GetRecord(header),
+                                           this->message.data());
+            bool sent =
+                (header->direction ==
+                 sinuca::engine::MessageRequestToDestination)
+                    ? this->SendRequestToLinkable(this->component,
+                                                  this->connectionID,
+                                                  this->message.data())
+                    : this->SendResponseToLinkable(this->component,
+                                                   this->connectionID,
+                                                   this->message.data());
+            if (!sent) break;
+
+            ++this->messagesIn;
+            if (header->cycle < cycle) ++this->delayedIn;
+            ++this->nextInput;
+        }
+    };
+
+    /**
+     * @brief Takes what the component sent and checks it.
+     */
+    void Check(unsigned long cycle) {
+        while (this->ReceiveResponseFromLinkable(
+            this->component, this->connectionID, this->message.data()))
+            this->Compare(this->responses, cycle);
+        while (this->ReceiveRequestFromLinkable(
+            this->component, this->connectionID, this->message.data()))
+            this->Compare(this->requests, cycle);
+    };
+
+    inline bool IsDone() const {
+        return this->nextInput == this->inputs.size() &&
+               this->responses.next == this->responses.records.size() &&
+               this->requests.next == this->requests.records.size();
+    };
+
+    inline unsigned long GetMissing() const {
+        return (this->responses.records.size() - this->responses.next) +
+               (this->requests.records.size() - this->requests.next);
+    };
+};
+
+static void Usage(const char* program) {
+    fprintf(stderr,
+            "Usage: %s -c <topology> -r <capture> [-d <drain cycles>] "
+            "[-p <component>.<parameter>=<value>]...\n",
+            program);
+};
+
+int main(int argc, char** argv) {
+    const char* topologyFile = NULL;
+    const char* captureFile = NULL;
+    unsigned long drain = 10000;
+    std::vector<const char*> overrides;
+    int option;
+
+    while ((option = getopt(argc, argv, "c:r:d:p:h")) != -1) {
+        switch (option) {
+            case 'c':
+                topologyFile = optarg;
+                break;
+            case 'r':
+                captureFile = optarg;
+                break;
+            case 'd':
+                drain = strtoul(optarg, NULL, 0);
+                break;
+            case 'p':
+                overrides.push_back(optarg);
+                break;
+            default:
+                Usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (!topologyFile || !captureFile) {
+        Usage(argv[0]);
+        return 1;
+    }
+
+    CaptureReader capture;
+    if (capture.Open(captureFile)) return 1;
+
+    sinuca::config::Topology topology;
+    if (topology.ReadFile(topologyFile)) return 1;
+    for (unsigned long i = 0; i < overrides.size(); ++i) {
+        if (topology.SetOverride(overrides[i])) return 1;
+    }
+    if (topology.Build(false)) return 1;
+
+    /* Ports connect before FinishSetup, as the sources they stand for. */
+    std::vector<ReplayPort*> ports(capture.GetNumberOfStreams(), NULL);
+    std::vector<sinuca::engine::Linkable*> components(ports.size(), NULL);
+    for (unsigned long i = 0; i < ports.size(); ++i) {
+        const CaptureStream& stream = capture.GetStream(i);
+        components[i] = topology.FindComponent(stream.destination);
+        if (!components[i]) continue;
+
+        if ((unsigned long)components[i]->GetMessageSize() !=
+            stream.messageSize) {
+            fprintf(stderr, "%s does not take the messages of %s.\n",
+                    stream.destination, stream.connection);
+            return 1;
+        }
+        ports[i] = new ReplayPort(&stream);
+        ports[i]->ConnectTo(components[i]);
+    }
+
+    for (long i = 0; i < topology.GetNumberOfComponents(); ++i) {
+        if (topology.FinishSetup(i)) return 1;
+    }
+
+    long replayed = 0;
+    for (unsigned long i = 0; i < ports.size(); ++i) {
+        if (!ports[i]) continue;
+        if (components[i]->GetMessageRecordSize() !=
+            capture.GetStream(i).recordSize) {
+            fprintf(stderr,
+                    "%s is not configured as when %s was recorded.\n",
+                    capture.GetStream(i).destination,
+                    capture.GetStream(i).connection);
+            return 1;
+        }
+        ++replayed;
+    }
+    if (!replayed) {
+        fprintf(stderr, "No recorded connection goes to %s.\n", topologyFile);
+        return 1;
+    }
+
+    unsigned long firstCycle = ~0UL, lastCycle = 0;
+    for (CaptureRecordHeader* header = capture.GetNextRecord(NULL); header;
+         header = capture.GetNextRecord(header)) {
+        ReplayPort* port = ports[header->stream];
+        if (!port) continue;
+
+        switch (header->direction) {
+            case sinuca::engine::MessageRequestToDestination:
+            case sinuca::engine::MessageResponseToDestination:
+                port->inputs.push_back(header);
+                break;
+            case sinuca::engine::MessageResponseToSource:
+                port->responses.records.push_back(header);
+                break;
+            case sinuca::engine::MessageRequestToSource:
+                port->requests.records.push_back(header);
+                break;
+        }
+        if (header->cycle < firstCycle) firstCycle = header->cycle;
+        if (header->cycle > lastCycle) lastCycle = header->cycle;
+    }
+    if (firstCycle > lastCycle) firstCycle = lastCycle = 0;
+
+    sinuca::engine::Engine engine;
+    for (long i = 0; i < topology.GetNumberOfComponents(); ++i) {
+        engine.AddComponent(topology.GetComponent(i));
+    }
+
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+
+    unsigned long cycle = firstCycle;
+    for (;; ++cycle) {
+        for (unsigned long i = 0; i < ports.size(); ++i) {
+            if (ports[i] && ports[i]->stream->sourceFirst)
+                ports[i]->Inject(cycle);
+        }
+        engine.Clock();
+        for (unsigned long i = 0; i < ports.size(); ++i) {
+            if (!ports[i]) continue;
+            if (!ports[i]->stream->sourceFirst) ports[i]->Inject(cycle);
+            ports[i]->Check(cycle);
+        }
+
+        bool done = true;
+        for (unsigned long i = 0; i < ports.size() && done; ++i) {
+            if (ports[i] && !ports[i]->IsDone()) done = false;
+        }
+        if (done || cycle >= lastCycle + drain) break;
+    }
+
+    double elapsed = std::chrono::duration<double, std::milli>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+
+    unsigned long messagesIn = 0, delayedIn = 0, messagesOut = 0, matched = 0,
+                  mismatched = 0, missing = 0, extra = 0, maxCycleShift = 0;
+    for (unsigned long i = 0; i < ports.size(); ++i) {
+        ReplayPort* port = ports[i];
+        if (!port) continue;
+        messagesIn += port->messagesIn;
+        delayedIn += port->delayedIn;
+        messagesOut += port->messagesOut;
+        matched += port->matched;
+        mismatched += port->mismatched;
+        missing += port->GetMissing();
+        extra += port->extra;
+        if (port->maxCycleShift > maxCycleShift)
+            maxCycleShift = port->maxCycleShift;
+    }
+
+    unsigned long cycles = cycle - firstCycle + 1;
+    fprintf(stderr,
+            "Replay: %ld connections, %lu messages, %lu cycles, %.3f ms "
+            "(%.0f cycles/s)\n",
+            replayed, messagesIn + messagesOut, cycles, elapsed,
+            elapsed > 0 ? cycles / (elapsed / 1e3) : 0.0);
+
+    printf("# replay\n");
+    printf("replay.cycles: %lu\n", cycles);
+    printf("replay.messages_in: %lu\n", messagesIn);
+    printf("replay.delayed_in: %lu\n", delayedIn);
+    printf("replay.messages_out: %lu\n", messagesOut);
+    printf("replay.matched: %lu\n", matched);
+    printf("replay.mismatched: %lu\n", mismatched);
+    printf("replay.missing: %lu\n", missing);
+    printf("replay.extra: %lu\n", extra);
+    printf("replay.max_cycle_shift: %lu\n", maxCycleShift);
+    for (long i = 0; i < topology.GetNumberOfComponents(); ++i) {
+        printf("# %s\n", topology.GetComponentName(i));
+        topology.GetComponent(i)->PrintStatistics();
+    }
+
+    for (unsigned long i = 0; i < ports.size(); ++i) delete ports[i];
+
+    if (mismatched || missing || extra) {
+        fprintf(stderr, "Replay diverged from %s.\n", captureFile);
+        return 1;
+    }
+    return 0;
+}
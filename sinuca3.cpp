@@ -0,0 +1,333 @@
+//
+// Copyright (C) 2024  HiPES - Universidade Federal do Paraná
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/**
+ * @file sinuca3.cpp
+ * @brief Simulator entry point: loads a topology file and clocks it.
+ */
+
+#include <unistd.h>
+
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include "capture.hpp"
+#include "configLoader.hpp"
+#include "engine.hpp"
+#include "latency.hpp"
+#include "partition.hpp"
+#include "timeWarp.hpp"
+#include "trace.hpp"
+
+static void Usage(const char* program) {
+    fprintf(stderr,
+            "Usage: %s -c <topology> [-n <cycles>] [-t <trace.json>] "
+            "[-H default|thp|2m|1g] [-L] [-B] "
+            "[-p <component>.<parameter>=<value>]... "
+            "[-b <source>.<parameter>=<size>]...\n"
+            "       %s -c <topology> [-w <warm-up instructions>] "
+            "[-i <detailed instructions> [-s <skipped instructions>]] ...\n"
+            "       %s -c <topology> -r <capture> [-R <source>.<parameter>]... "
+            "...\n"
+            "       %s -c <topology> -P <partitions> [-O <snapshot interval>] "
+            "[-n <cycles>] ...\n",
+            program, program, program, program);
+};
+
+int main(int argc, char** argv) {
+    const char* topologyFile = NULL;
+    const char* traceFile = NULL;
+    unsigned long cycles = 0;
+    unsigned long warmUp = 0;
+    unsigned long interval = 0;
+    unsigned long skip = 0;
+    std::vector<const char*> overrides;
+    std::vector<const char*> resizes;
+    const char* captureFile = NULL;
+    std::vector<std::string> captured;
+    int partitions = 0;
+    unsigned long snapshotInterval = 0;
+    bool latency = false;
+    bool bufferSizing = false;
+    sinuca::memory::PagePolicy pagePolicy = sinuca::memory::PagePolicyDefault;
+    int option;
+
+    while ((option = getopt(argc, argv, "c:n:p:b:t:w:i:s:H:r:R:P:O:LBh")) != -1) {
+        switch (option) {
+            case 'c':
+                topologyFile = optarg;
+                break;
+            case 'n':
+                cycles = strtoul(optarg, NULL, 0);
+                break;
+            case 'p':
+                overrides.push_back(optarg);
+                break;
+            case 'b':
+                resizes.push_back(optarg);
+                break;
+            case 't':
+                traceFile = optarg;
+                break;
+            case 'w':
+                warmUp = strtoul(optarg, NULL, 0);
+                break;
+            case 'i':
+                interval = strtoul(optarg, NULL, 0);
+                break;
+            case 's':
+                skip = strtoul(optarg, NULL, 0);
+                break;
+            case 'H':
+                if (sinuca::memory::ParsePagePolicy(optarg, &pagePolicy))
+                    return 1;
+                break;
+            case 'r':
+                captureFile = optarg;
+                break;
+            case 'R':
+                captured.push_back(optarg);
+                break;
+            case 'P':
+                partitions = atoi(optarg);
+                if (partitions < 1) {
+                    Usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'O':
+                snapshotInterval = strtoul(optarg, NULL, 0);
+                if (!snapshotInterval) {
+                    Usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'L':
+                latency = true;
+                break;
+            case 'B':
+                bufferSizing = true;
+                break;
+            default:
+                Usage(argv[0]);
+                return 1;
+        }
+    }
+
+    bool instructionMode = (warmUp || interval);
+    if (!topologyFile || (instructionMode && cycles) || (skip && !interval) ||
+        (!captured.empty() && !captureFile) ||
+        (snapshotInterval && !partitions)) {
+        Usage(argv[0]);
+        return 1;
+    }
+    if (latency && (captureFile || partitions)) {
+        fprintf(stderr, "Latencies are not measured with -r or -P.\n");
+        return 1;
+    }
+    if (partitions && (instructionMode || captureFile || traceFile)) {
+        fprintf(stderr, "Partitions only run in cycle mode, without -r or "
+                        "-t.\n");
+        return 1;
+    }
+
+#ifndef SINUCA3_TRACE
+    if (traceFile) {
+        fprintf(stderr, "Tracing was not compiled in, rebuild with TRACE=1.\n");
+        return 1;
+    }
+#endif
+
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+
+    sinuca::memory::SetPagePolicy(pagePolicy);
+    sinuca::config::Topology topology;
+    if (topology.ReadFile(topologyFile)) return 1;
+    for (unsigned long i = 0; i < overrides.size(); ++i) {
+        if (topology.SetOverride(overrides[i])) return 1;
+    }
+    for (unsigned long i = 0; i < resizes.size(); ++i) {
+        if (topology.SetResize(resizes[i])) return 1;
+    }
+    /* Partitions finish their own components, in their own process.
+     * Optimistic ones keep private copies of the connections. */
+    topology.SetSharedConnections(partitions > 0 && !snapshotInterval);
+    if (topology.Build(partitions == 0)) return 1;
+
+    sinuca::partition::PartitionedEngine partitionedEngine(&topology);
+    sinuca::partition::OptimisticEngine optimisticEngine(&topology);
+    if (snapshotInterval) {
+        optimisticEngine.SetSnapshotInterval(snapshotInterval);
+        if (optimisticEngine.SetPartitions(partitions)) return 1;
+    } else if (partitions && partitionedEngine.SetPartitions(partitions)) {
+        return 1;
+    }
+
+    sinuca::engine::Engine engine;
+    for (long i = 0; i < topology.GetNumberOfComponents(); ++i) {
+        engine.AddComponent(topology.GetComponent(i));
+    }
+
+    double setupTime = std::chrono::duration<double, std::milli>(
+                           std::chrono::steady_clock::now() - start)
+                           .count();
+    fprintf(stderr, "Setup: %ld components, %ld bytes of connections, %.3f ms\n",
+            topology.GetNumberOfComponents(),
+            topology.GetConnectionStorageSize(), setupTime);
+    topology.PrintMemoryUsage(stderr, "setup");
+
+    if (snapshotInterval) {
+        fprintf(stderr,
+                "Partitions: %d optimistic processes, %lu buffers between "
+                "them, snapshots every %lu cycles\n",
+                optimisticEngine.GetNumberOfPartitions(),
+                optimisticEngine.GetNumberOfCrossBuffers(),
+                optimisticEngine.GetSnapshotInterval());
+        return optimisticEngine.Simulate(cycles);
+    }
+    if (partitions) {
+        fprintf(stderr, "Partitions: %d processes, %ld runs per cycle\n",
+                partitionedEngine.GetNumberOfPartitions(),
+                partitionedEngine.GetNumberOfRuns());
+        return partitionedEngine.Simulate(cycles);
+    }
+
+    /* Every connection, unless some were selected with -R. */
+    sinuca::capture::MessageRecorder recorder;
+    if (captureFile) {
+        std::vector<bool> found(captured.size(), false);
+        for (long i = 0; i < topology.GetNumberOfConnections(); ++i) {
+            std::string name = topology.GetConnectionName(i);
+            bool selected = captured.empty();
+            for (unsigned long c = 0; c < captured.size(); ++c) {
+                if (captured[c] == name) selected = found[c] = true;
+            }
+            if (!selected) continue;
+
+            long source = topology.GetConnectionSource(i);
+            long destination = topology.GetConnectionDestination(i);
+            if (recorder.AddStream(name.c_str(),
+                                   topology.GetComponentName(destination),
+                                   topology.GetConnection(i),
+                                   topology.GetComponent(destination),
+                                   topology.GetConnectionBufferSize(i),
+                                   source < destination))
+                return 1;
+        }
+        for (unsigned long c = 0; c < captured.size(); ++c) {
+            if (!found[c]) {
+                fprintf(stderr, "No connection %s to record.\n",
+                        captured[c].c_str());
+                return 1;
+            }
+        }
+        if (recorder.Start(captureFile, &engine)) return 1;
+    }
+
+    /* Every connection of fixed-size messages. */
+    sinuca::latency::LatencyMonitor latencyMonitor;
+    if (latency) {
+        for (long i = 0; i < topology.GetNumberOfConnections(); ++i) {
+            sinuca::engine::Connection* connection = topology.GetConnection(i);
+            if (connection->IsVariableLength()) continue;
+            if (latencyMonitor.AddStream(
+                    topology.GetConnectionName(i).c_str(), connection,
+                    topology.GetComponent(topology.GetConnectionSource(i)),
+                    topology.GetComponent(
+                        topology.GetConnectionDestination(i))))
+                return 1;
+        }
+        latencyMonitor.Start(&engine);
+    }
+
+    std::string traceBinary;
+    if (traceFile) {
+        traceBinary = std::string(traceFile) + ".bin";
+        if (sinuca::trace::Start(traceBinary.c_str())) return 1;
+        for (long i = 0; i < topology.GetNumberOfComponents(); ++i) {
+            sinuca::trace::NameComponent(i, topology.GetComponentName(i));
+        }
+    }
+
+    if (instructionMode) {
+        /* Functional warm-up, then detailed intervals separated by skipped
+         * (fast-forwarded) ones until the input ends. */
+        unsigned long functional = 0, detailed = 0;
+        double functionalTime = 0, detailedTime = 0;
+        unsigned long skipped = warmUp;
+
+        do {
+            start = std::chrono::steady_clock::now();
+            if (skipped) functional += engine.FastForward(skipped);
+            std::chrono::steady_clock::time_point middle =
+                std::chrono::steady_clock::now();
+            detailed +=
+                engine.SimulateInstructions(interval ? interval : ULONG_MAX);
+            std::chrono::steady_clock::time_point end =
+                std::chrono::steady_clock::now();
+
+            functionalTime +=
+                std::chrono::duration<double, std::milli>(middle - start)
+                    .count();
+            detailedTime +=
+                std::chrono::duration<double, std::milli>(end - middle)
+                    .count();
+            skipped = skip;
+        } while (skip && !engine.IsFinished());
+        /* The last interval may end with instructions in flight. */
+        engine.Drain();
+
+        fprintf(stderr,
+                "Functional: %lu instructions, %.3f ms\n"
+                "Detailed: %lu instructions, %lu cycles, %.3f ms\n",
+                functional, functionalTime, detailed, engine.GetCycle(),
+                detailedTime);
+    } else {
+        engine.Simulate(cycles);
+    }
+
+    for (long i = 0; i < topology.GetNumberOfComponents(); ++i) {
+        printf("# %s\n", topology.GetComponentName(i));
+        topology.GetComponent(i)->PrintStatistics();
+    }
+    if (latency) {
+        latencyMonitor.Stop();
+        printf("# latency\n");
+        latencyMonitor.PrintStatistics(stdout);
+    }
+    topology.PrintMemoryUsage(stderr, "exit");
+    if (bufferSizing) topology.PrintBufferSizing(stderr);
+
+    if (captureFile) {
+        recorder.Stop();
+        fprintf(stderr, "Recorded %lu messages to %s\n",
+                recorder.GetNumberOfMessages(), captureFile);
+    }
+
+    if (traceFile) {
+        sinuca::trace::Stop();
+        if (sinuca::trace::ConvertToChromeTrace(traceBinary.c_str(),
+                                                traceFile))
+            return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,320 @@
+#ifndef SINUCA3_ENGINE_STATIC_GRAPH_HPP_
+#define SINUCA3_ENGINE_STATIC_GRAPH_HPP_
+
+//
+// Copyright (C) 2024  HiPES - Universidade Federal do Paraná
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/**
+ * @file staticGraph.hpp
+ * @brief Component graphs fixed at compile time, clocked without virtual
+ * calls.
+ * @details The Engine clocks Linkables through a virtual Clock and moves
+ * messages through void* buffers of a size known at run time, which keeps
+ * topologies configurable but hides every call from the compiler. A
+ * StaticGraph instead holds its components and connections by value in
+ * tuples, with their concrete types:
+ *
+ *     typedef StaticConnection<Request, Response, 8> Link;
+ *     StaticGraph<StaticList<Core, Cache>, StaticList<Link> > graph;
+ *     graph.GetComponent<0>().port = &graph.GetConnection<0>();
+ *     graph.GetComponent<1>().port = &graph.GetConnection<0>();
+ *     graph.Simulate(cycles);
+ *
+ * The clock loop is unrolled over the components in order, calling
+ * Type::Clock by its qualified name, so the call is direct even if Clock is
+ * virtual and the compiler may inline it. StaticConnection buffers are typed
+ * rings whose capacity is a constant power of two, so sending and receiving
+ * are a few inlined loads and stores. Linkables can be members of a static
+ * graph too, they are clocked directly but still talk through their
+ * Connections. Topologies read from a file keep using the Engine.
+ */
+
+#include <cstddef>
+#include <tuple>
+#include <utility>
+
+namespace sinuca {
+namespace engine {
+
+/**
+ * @brief A list of types, the parameters of StaticGraph.
+ */
+template <typename... Types>
+struct StaticList {};
+
+/**
+ * @brief A ring of Capacity messages of type Message, held by value.
+ * @details head and tail run freely, so the occupation is their difference
+ * and the index their remainder by the capacity, a mask.
+ */
+template <typename Message, unsigned long Capacity>
+class StaticBuffer {
+    static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0,
+                  "The capacity of a StaticBuffer must be a power of two.");
+
+  private:
+    Message slots[Capacity];
+    unsigned long head; /**< Messages dequeued so far. */
+    unsigned long tail; /**< Messages enqueued so far. */
+
+  public:
+    StaticBuffer() : head(0), tail(0){};
+
+    static constexpr unsigned long GetCapacity() { return Capacity; };
+
+    inline unsigned long GetOccupation() const {
+        return this->tail - this->head;
+    };
+
+    inline bool IsEmpty() const { return this->tail == this->head; };
+
+    inline bool IsFull() const {
+        return this->tail - this->head == Capacity;
+    };
+
+    /**
+     * @return False if the buffer is full.
+     */
+    inline bool Enqueue(const Message& message) {
+        if (this->IsFull()) return false;
+        this->slots[this->tail++ & (Capacity - 1)] = message;
+        return true;
+    };
+
+    /**
+     * @return False if the buffer is empty.
+     */
+    inline bool Dequeue(Message* message) {
+        if (this->IsEmpty()) return false;
+        *message = this->slots[this->head++ & (Capacity - 1)];
+        return true;
+    };
+
+    /**
+     * @return The oldest message, to be read in place, or NULL.
+     */
+    inline const Message* Front() const {
+        return this->IsEmpty() ? NULL
+                               : &this->slots[this->head & (Capacity - 1)];
+    };
+
+    /**
+     * @brief Drops the oldest message, after Front.
+     */
+    inline void Pop() { ++this->head; };
+};
+
+/**
+ * @brief A typed connection of a StaticGraph: requests go from the source to
+ * the recipient and responses back, each in a StaticBuffer of Capacity
+ * messages.
+ * @details Like a Connection, the recipient sees a message as soon as it is
+ * sent, so the order of the components in the graph decides which messages
+ * cross in the same cycle.
+ */
+template <typename Request, typename Response, unsigned long Capacity>
+class StaticConnection {
+  private:
+    StaticBuffer<Request, Capacity> requests;
+    StaticBuffer<Response, Capacity> responses;
+
+  public:
+    typedef Request RequestType;
+    typedef Response ResponseType;
+
+    /**
+     * @brief Called by the source.
+     * @return False if there is no room.
+     */
+    inline bool SendRequest(const Request& request) {
+        return this->requests.Enqueue(request);
+    };
+
+    /**
+     * @brief Called by the source.
+     * @return False if there is no response.
+     */
+    inline bool ReceiveResponse(Response* response) {
+        return this->responses.Dequeue(response);
+    };
+
+    /**
+     * @brief Called by the recipient.
+     * @return False if there is no request.
+     */
+    inline bool ReceiveRequest(Request* request) {
+        return this->requests.Dequeue(request);
+    };
+
+    /**
+     * @brief Called by the recipient.
+     * @return False if there is no room.
+     */
+    inline bool SendResponse(const Response& response) {
+        return this->responses.Enqueue(response);
+    };
+
+    /**
+     * @brief Self-explanatory
+     */
+    inline StaticBuffer<Request, Capacity>& GetRequests() {
+        return this->requests;
+    };
+
+    /**
+     * @brief Self-explanatory
+     */
+    inline StaticBuffer<Response, Capacity>& GetResponses() {
+        return this->responses;
+    };
+};
+
+template <typename ComponentList, typename ConnectionList>
+class StaticGraph;
+
+/**
+ * @brief Owns and clocks a graph of components whose types are known at
+ * compile time.
+ * @details Components need a Clock method. Components are wired after
+ * construction, e.g. by pointing their members at the connections of the
+ * graph, which never move.
+ */
+template <typename... Components, typename... Connections>
+class StaticGraph<StaticList<Components...>, StaticList<Connections...> > {
+  private:
+    std::tuple<Connections...> connections;
+    std::tuple<Components...> components;
+    unsigned long cycle;
+
+    template <typename Type>
+    static inline void ClockComponent(Type& component) {
+        /* Qualified, so never dispatched through the vtable. */
+        component.Type::Clock();
+    };
+
+    template <std::size_t... Indices>
+    inline void ClockAll(std::index_sequence<Indices...>) {
+        (ClockComponent(std::get<Indices>(this->components)), ...);
+    };
+
+    template <typename Tuple, typename Function, std::size_t... Indices>
+    static inline void ForEach(Tuple& tuple, Function& function,
+                               std::index_sequence<Indices...>) {
+        (function(Indices, std::get<Indices>(tuple)), ...);
+    };
+
+  public:
+    StaticGraph(StaticGraph const&) = delete;
+    StaticGraph& operator=(StaticGraph const&) = delete;
+    StaticGraph() : cycle(0){};
+
+    static constexpr std::size_t GetNumberOfComponents() {
+        return sizeof...(Components);
+    };
+
+    static constexpr std::size_t GetNumberOfConnections() {
+        return sizeof...(Connections);
+    };
+
+    /**
+     * @brief Self-explanatory
+     */
+    template <std::size_t Index>
+    inline typename std::tuple_element<Index,
+                                       std::tuple<Components...> >::type&
+    GetComponent() {
+        return std::get<Index>(this->components);
+    };
+
+    /**
+     * @brief Self-explanatory
+     */
+    template <std::size_t Index>
+    inline typename std::tuple_element<Index,
+                                       std::tuple<Connections...> >::type&
+    GetConnection() {
+        return std::get<Index>(this->connections);
+    };
+
+    /**
+     * @brief Calls function(index, component) on every component, in order,
+     * e.g. to wire graphs of many components or to print their statistics.
+     * @details function is instantiated for every type, so it is usually a
+     * generic lambda.
+     */
+    template <typename Function>
+    void ForEachComponent(Function function) {
+        ForEach(this->components, function,
+                std::index_sequence_for<Components...>());
+    };
+
+    /**
+     * @brief Same as ForEachComponent, over the connections.
+     */
+    template <typename Function>
+    void ForEachConnection(Function function) {
+        ForEach(this->connections, function,
+                std::index_sequence_for<Connections...>());
+    };
+
+    /**
+     * @brief Self-explanatory
+     */
+    inline unsigned long GetCycle() const { return this->cycle; };
+
+    /**
+     * @brief Simulates a single clock cycle, clocking the components in
+     * order.
+     */
+    inline void Clock() {
+        this->ClockAll(std::index_sequence_for<Components...>());
+        ++this->cycle;
+    };
+
+    /**
+     * @brief Simulates the given number of cycles.
+     */
+    void Simulate(unsigned long cycles) {
+        for (unsigned long i = 0; i < cycles; ++i) this->Clock();
+    };
+};
+
+/**
+ * @brief Helper of StaticRepeat.
+ */
+template <std::size_t Index, typename Type>
+using StaticRepeated = Type;
+
+template <typename Type, typename Sequence>
+struct StaticRepeatHelper;
+
+template <typename Type, std::size_t... Indices>
+struct StaticRepeatHelper<Type, std::index_sequence<Indices...> > {
+    typedef StaticList<StaticRepeated<Indices, Type>...> List;
+};
+
+/**
+ * @brief StaticList of Count times Type, e.g. for a ring of equal stages.
+ */
+template <typename Type, std::size_t Count>
+using StaticRepeat = typename StaticRepeatHelper<
+    Type, std::make_index_sequence<Count> >::List;
+
+}  // namespace engine
+}  // namespace sinuca
+
+#endif  // SINUCA3_ENGINE_STATIC_GRAPH_HPP_
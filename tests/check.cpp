@@ -0,0 +1,151 @@
+//
+// Copyright (C) 2024  HiPES - Universidade Federal do Paraná
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/**
+ * @file check.cpp
+ * @brief Runs the registered unit tests.
+ * @details ./unitTests runs every test, ./unitTests <name>... only the given
+ * ones. The exit status is non-zero if a check failed.
+ */
+
+#include "check.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+struct RegisteredTest {
+    const char* name;
+    sinuca::test::TestFunction function;
+};
+
+/**
+ * @details Function-local so registration from other translation units does
+ * not depend on static initialization order.
+ */
+std::vector<RegisteredTest>& GetTests() {
+    static std::vector<RegisteredTest> tests;
+    return tests;
+};
+
+unsigned long failures = 0;
+
+}  // namespace
+
+int sinuca::test::Register(const char* name, TestFunction function) {
+    RegisteredTest test;
+    test.name = name;
+    test.function = function;
+    GetTests().push_back(test);
+    return 0;
+};
+
+void sinuca::test::Fail(const char* file, int line, const char* expression) {
+    printf("%s:%d: check failed: %s\n", file, line, expression);
+    ++failures;
+};
+
+void sinuca::test::FailEqual(const char* file, int line, const char* expected,
+                             const char* actual, long long expectedValue,
+                             long long actualValue) {
+    printf("%s:%d: check failed: %s == %s, %lld != %lld\n", file, line,
+           expected, actual, expectedValue, actualValue);
+    ++failures;
+};
+
+sinuca::test::QuietStderr::QuietStderr() {
+    fflush(stderr);
+    this->saved = dup(STDERR_FILENO);
+    int null = open("/dev/null", O_WRONLY);
+    if (null >= 0) {
+        dup2(null, STDERR_FILENO);
+        close(null);
+    }
+};
+
+sinuca::test::QuietStderr::~QuietStderr() {
+    fflush(stderr);
+    if (this->saved >= 0) {
+        dup2(this->saved, STDERR_FILENO);
+        close(this->saved);
+    }
+};
+
+sinuca::test::CaptureStdout::CaptureStdout() {
+    fflush(stdout);
+    this->file = tmpfile();
+    this->saved = -1;
+    if (this->file) {
+        this->saved = dup(STDOUT_FILENO);
+        dup2(fileno(this->file), STDOUT_FILENO);
+    }
+};
+
+sinuca::test::CaptureStdout::~CaptureStdout() {
+    this->Release();
+    if (this->file) fclose(this->file);
+};
+
+std::string sinuca::test::CaptureStdout::Release() {
+    std::string text;
+    if (this->saved < 0) return text;
+
+    fflush(stdout);
+    dup2(this->saved, STDOUT_FILENO);
+    close(this->saved);
+    this->saved = -1;
+
+    rewind(this->file);
+    char buffer[4096];
+    size_t read;
+    while ((read = fread(buffer, 1, sizeof(buffer), this->file)) > 0)
+        text.append(buffer, read);
+    return text;
+};
+
+int main(int argc, char* argv[]) {
+    const std::vector<RegisteredTest>& tests = GetTests();
+    unsigned long run = 0;
+    unsigned long failed = 0;
+
+    for (unsigned long i = 0; i < tests.size(); ++i) {
+        bool selected = (argc == 1);
+        for (int j = 1; j < argc; ++j) {
+            if (strcmp(argv[j], tests[i].name) == 0) selected = true;
+        }
+        if (!selected) continue;
+
+        unsigned long before = failures;
+        tests[i].function();
+        ++run;
+        if (failures != before) {
+            ++failed;
+            printf("%s: FAILED\n", tests[i].name);
+        } else {
+            printf("%s: ok\n", tests[i].name);
+        }
+        fflush(stdout);
+    }
+
+    printf("%lu of %lu tests passed.\n", run - failed, run);
+    return (failed || !run) ? 1 : 0;
+};
@@ -0,0 +1,120 @@
+#ifndef SINUCA3_TESTS_CHECK_HPP_
+#define SINUCA3_TESTS_CHECK_HPP_
+
+//
+// Copyright (C) 2024  HiPES - Universidade Federal do Paraná
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/**
+ * @file check.hpp
+ * @brief The unit tests run by make check.
+ * @details Each file in tests/ defines its tests with SINUCA3_TEST, which
+ * registers them the way SINUCA3_REGISTER_COMPONENT registers components, and
+ * checks with SINUCA3_CHECK and SINUCA3_CHECK_EQUAL. A failed check is
+ * reported and the test goes on, so one run shows every failure.
+ */
+
+#include <cstdio>
+#include <string>
+
+namespace sinuca {
+namespace test {
+
+typedef void (*TestFunction)();
+
+/**
+ * @brief Used by SINUCA3_TEST.
+ * @return Always 0, so it can initialize a static variable.
+ */
+int Register(const char* name, TestFunction function);
+
+/**
+ * @brief Used by the check macros.
+ */
+void Fail(const char* file, int line, const char* expression);
+
+/**
+ * @brief Used by SINUCA3_CHECK_EQUAL.
+ */
+void FailEqual(const char* file, int line, const char* expected,
+               const char* actual, long long expectedValue,
+               long long actualValue);
+
+/**
+ * @brief Sends stderr to /dev/null while alive, for the checks that expect
+ * an error message.
+ */
+class QuietStderr {
+  private:
+    int saved;
+
+  public:
+    QuietStderr();
+    ~QuietStderr();
+};
+
+/**
+ * @brief Keeps what is printed to stdout while alive, for the checks on the
+ * statistics of a component.
+ */
+class CaptureStdout {
+  private:
+    FILE* file;
+    int saved;
+
+  public:
+    CaptureStdout();
+    ~CaptureStdout();
+
+    /**
+     * @brief Gives stdout back.
+     * @return What was printed since the construction.
+     */
+    std::string Release();
+};
+
+}  // namespace test
+}  // namespace sinuca
+
+/**
+ * @brief Defines and registers a test, a function without parameters.
+ */
+#define SINUCA3_TEST(Name)                                         \
+    static void Name();                                            \
+    static const int sinuca3Test##Name =                           \
+        sinuca::test::Register(#Name, Name);                       \
+    static void Name()
+
+#define SINUCA3_CHECK(expression)                                  \
+    do {                                                           \
+        if (!(expression))                                         \
+            sinuca::test::Fail(__FILE__, __LINE__, #expression);   \
+    } while (0)
+
+/**
+ * @brief Checks two integers, printing both when they differ.
+ */
+#define SINUCA3_CHECK_EQUAL(expected, actual)                      \
+    do {                                                           \
+        long long sinuca3Expected = (long long)(expected);         \
+        long long sinuca3Actual = (long long)(actual);             \
+        if (sinuca3Expected != sinuca3Actual)                      \
+            sinuca::test::FailEqual(__FILE__, __LINE__, #expected, \
+                                    #actual, sinuca3Expected,      \
+                                    sinuca3Actual);                \
+    } while (0)
+
+#endif  // SINUCA3_TESTS_CHECK_HPP_
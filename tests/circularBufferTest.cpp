@@ -0,0 +1,105 @@
+//
+// Copyright (C) 2024  HiPES - Universidade Federal do Paraná
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/**
+ * @file circularBufferTest.cpp
+ * @brief Tests of CircularBuffer::Resize.
+ */
+
+#include "../circularBuffer.hpp"
+#include "check.hpp"
+
+/**
+ * @brief Leaves 3, 4 and 5 queued in a buffer of 4, with 5 wrapped to the
+ * beginning of the storage.
+ */
+static void FillWrapped(CircularBuffer* buffer) {
+    buffer->Allocate(4, sizeof(int));
+    int message;
+    for (message = 1; message <= 3; ++message) buffer->Enqueue(&message);
+    buffer->Dequeue(&message);
+    buffer->Dequeue(&message);
+    for (message = 4; message <= 5; ++message) buffer->Enqueue(&message);
+}
+
+/**
+ * @brief Checks that the buffer holds first, first + 1, ..., last, in order,
+ * and leaves it empty.
+ */
+static void CheckContents(CircularBuffer* buffer, int first, int last) {
+    SINUCA3_CHECK_EQUAL(last - first + 1, buffer->GetOccupation());
+    int message;
+    for (int expected = first; expected <= last; ++expected) {
+        SINUCA3_CHECK(buffer->Dequeue(&message));
+        SINUCA3_CHECK_EQUAL(expected, message);
+    }
+    SINUCA3_CHECK(buffer->IsEmpty());
+}
+
+SINUCA3_TEST(CircularBufferGrowsWrapped) {
+    CircularBuffer buffer;
+    FillWrapped(&buffer);
+
+    SINUCA3_CHECK(buffer.Resize(6));
+    SINUCA3_CHECK_EQUAL(6, buffer.GetSize());
+    int message;
+    for (message = 6; message <= 8; ++message)
+        SINUCA3_CHECK(buffer.Enqueue(&message));
+    SINUCA3_CHECK(!buffer.Enqueue(&message));
+    CheckContents(&buffer, 3, 8);
+}
+
+SINUCA3_TEST(CircularBufferShrinksWrapped) {
+    CircularBuffer buffer;
+    FillWrapped(&buffer);
+    int message;
+    buffer.Dequeue(&message);
+
+    SINUCA3_CHECK(buffer.Resize(3));
+    message = 6;
+    SINUCA3_CHECK(buffer.Enqueue(&message));
+    SINUCA3_CHECK(buffer.IsFull());
+    CheckContents(&buffer, 4, 6);
+}
+
+SINUCA3_TEST(CircularBufferShrinksToItsOccupation) {
+    CircularBuffer buffer;
+    FillWrapped(&buffer);
+
+    /* Full, nothing lost, and still a ring afterwards. */
+    SINUCA3_CHECK(buffer.Resize(3));
+    SINUCA3_CHECK(buffer.IsFull());
+    int message = 6;
+    SINUCA3_CHECK(!buffer.Enqueue(&message));
+    CheckContents(&buffer, 3, 5);
+    for (message = 1; message <= 3; ++message) buffer.Enqueue(&message);
+    CheckContents(&buffer, 1, 3);
+}
+
+SINUCA3_TEST(CircularBufferRefusesSizesBelowOccupation) {
+    CircularBuffer buffer;
+    FillWrapped(&buffer);
+
+    SINUCA3_CHECK(!buffer.Resize(2));
+    SINUCA3_CHECK(!buffer.Resize(0));
+    SINUCA3_CHECK(!buffer.Resize(-1));
+    SINUCA3_CHECK_EQUAL(4, buffer.GetSize());
+    CheckContents(&buffer, 3, 5);
+
+    CircularBuffer unallocated;
+    SINUCA3_CHECK(!unallocated.Resize(4));
+}
@@ -0,0 +1,386 @@
+//
+// Copyright (C) 2024  HiPES - Universidade Federal do Paraná
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/**
+ * @file configLoaderTest.cpp
+ * @brief Tests of the topology loader: what it rejects, where it places the
+ * connections, how overrides replace parameters and resizes connections.
+ */
+
+#include <cstring>
+
+#include "../component.hpp"
+#include "../configLoader.hpp"
+#include "../partition.hpp"
+#include "check.hpp"
+
+namespace {
+
+/** Odd on purpose, so the rings do not end on cache lines. */
+struct WideMessage {
+    char bytes[13];
+};
+
+/**
+ * @brief Accepts an integer "value" and connections named target<n>,
+ * rejects everything else.
+ */
+template <typename MessageType>
+class Probe : public sinuca::Component<MessageType> {
+  public:
+    long value;
+    int setups;
+
+    Probe() : value(0), setups(0){};
+
+    int SetConfigParameter(const char* parameter,
+                           sinuca::config::ConfigValue value) {
+        if (strcmp(parameter, "value") == 0 &&
+            value.type == sinuca::config::ConfigValueTypeInteger) {
+            this->value = value.value.integer;
+            return 0;
+        }
+        if (strncmp(parameter, "target", 6) == 0 &&
+            value.type == sinuca::config::ConfigValueTypeComponentReference) {
+            return 0;
+        }
+        return sinuca::engine::Linkable::SetConfigParameter(parameter, value);
+    };
+
+    int FinishSetup() {
+        ++this->setups;
+        return 0;
+    };
+
+    void Clock(){};
+};
+
+typedef Probe<WideMessage> WideProbe;
+typedef Probe<char> NarrowProbe;
+
+}  // namespace
+
+SINUCA3_REGISTER_COMPONENT(WideProbe);
+SINUCA3_REGISTER_COMPONENT(NarrowProbe);
+
+/**
+ * @brief Adds lines to a topology, up to a NULL one.
+ * @returns The result of the first line that failed, 0 otherwise.
+ */
+static int AddLines(sinuca::config::Topology* topology,
+                    const char* const* lines) {
+    for (; *lines; ++lines) {
+        if (topology->AddLine(*lines)) return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Adds two probes, a and b, then one more line.
+ * @returns The result of the last line.
+ */
+static int AddToPair(sinuca::config::Topology* topology, const char* line) {
+    const char* lines[] = {"component WideProbe a", "component WideProbe b",
+                           NULL};
+    if (AddLines(topology, lines)) return -1;
+    return topology->AddLine(line);
+}
+
+SINUCA3_TEST(LoaderRejectsUnknownType) {
+    sinuca::test::QuietStderr quiet;
+    sinuca::config::Topology topology;
+
+    /* Types are only looked up when the graph is built. */
+    SINUCA3_CHECK_EQUAL(0, topology.AddLine("component Missing a"));
+    SINUCA3_CHECK(topology.Build() != 0);
+}
+
+SINUCA3_TEST(LoaderRejectsDuplicateName) {
+    sinuca::test::QuietStderr quiet;
+    sinuca::config::Topology topology;
+
+    SINUCA3_CHECK_EQUAL(0, topology.AddLine("component WideProbe a"));
+    SINUCA3_CHECK(topology.AddLine("component NarrowProbe a") != 0);
+    SINUCA3_CHECK_EQUAL(1, topology.GetNumberOfComponents());
+}
+
+SINUCA3_TEST(LoaderRejectsMalformedLines) {
+    sinuca::test::QuietStderr quiet;
+    const char* lines[] = {"component WideProbe", "component WideProbe a b",
+                           "wire a b", "component WideProbe c \"open"};
+
+    for (unsigned long i = 0; i < sizeof(lines) / sizeof(*lines); ++i) {
+        sinuca::config::Topology topology;
+        SINUCA3_CHECK(topology.AddLine(lines[i]) != 0);
+    }
+}
+
+SINUCA3_TEST(LoaderRejectsBadConnect) {
+    sinuca::test::QuietStderr quiet;
+    const char* lines[] = {
+        "connect a b 4",          "connect a.target0 b",
+        "connect .target0 b 4",   "connect a. b 4",
+        "connect a.target0 c 4",  "connect c.target0 b 4",
+        "connect a.target0 b 0",  "connect a.target0 b -1",
+        "connect a.target0 b 4X", "connect a.target0 b 0B",
+        "connect a.target0 b x",  "connect a.target0 b 4 5",
+    };
+
+    for (unsigned long i = 0; i < sizeof(lines) / sizeof(*lines); ++i) {
+        sinuca::config::Topology topology;
+        if (AddToPair(&topology, lines[i]) == 0) {
+            printf("accepted \"%s\"\n", lines[i]);
+            SINUCA3_CHECK(!"bad connect accepted");
+        }
+    }
+
+    sinuca::config::Topology good;
+    SINUCA3_CHECK_EQUAL(0, AddToPair(&good, "connect a.target0 b 4"));
+    SINUCA3_CHECK_EQUAL(0, good.Build());
+    SINUCA3_CHECK_EQUAL(1, good.GetNumberOfConnections());
+    SINUCA3_CHECK_EQUAL(4, good.GetConnectionBufferSize(0));
+}
+
+SINUCA3_TEST(LoaderRejectsConflictingConnections) {
+    sinuca::test::QuietStderr quiet;
+
+    /* Both are found when the graph is validated. */
+    sinuca::config::Topology twice;
+    SINUCA3_CHECK_EQUAL(0, AddToPair(&twice, "connect a.target0 b 4"));
+    SINUCA3_CHECK_EQUAL(0, twice.AddLine("connect a.target0 b 2"));
+    SINUCA3_CHECK(twice.Build() != 0);
+
+    sinuca::config::Topology valueToo;
+    SINUCA3_CHECK_EQUAL(0, AddToPair(&valueToo, "connect a.target0 b 4"));
+    SINUCA3_CHECK_EQUAL(0, valueToo.SetOverride("a.target0=1"));
+    SINUCA3_CHECK(valueToo.Build() != 0);
+
+    /* A connection the source does not take. */
+    sinuca::config::Topology rejected;
+    SINUCA3_CHECK_EQUAL(0, AddToPair(&rejected, "connect a.output b 4"));
+    SINUCA3_CHECK(rejected.Build() != 0);
+}
+
+SINUCA3_TEST(LoaderRejectsParameter) {
+    sinuca::test::QuietStderr quiet;
+    const char* lines[] = {"component WideProbe a value=high",
+                           "component WideProbe a size=4",
+                           "component WideProbe a value=1.5"};
+
+    for (unsigned long i = 0; i < sizeof(lines) / sizeof(*lines); ++i) {
+        sinuca::config::Topology topology;
+        SINUCA3_CHECK_EQUAL(0, topology.AddLine(lines[i]));
+        SINUCA3_CHECK(topology.Build() != 0);
+    }
+
+    sinuca::config::Topology noValue;
+    SINUCA3_CHECK(noValue.AddLine("component WideProbe a value=") != 0);
+
+    sinuca::config::Topology good;
+    SINUCA3_CHECK_EQUAL(0, good.AddLine("component WideProbe a value=0x10"));
+    SINUCA3_CHECK_EQUAL(0, good.Build());
+    WideProbe* probe = static_cast<WideProbe*>(good.FindComponent("a"));
+    SINUCA3_CHECK_EQUAL(16, probe->value);
+    SINUCA3_CHECK_EQUAL(1, probe->setups);
+}
+
+SINUCA3_TEST(LoaderRejectsPartitionOutOfRange) {
+    sinuca::test::QuietStderr quiet;
+    const char* lines[] = {"partition a -1", "partition a 65536",
+                           "partition a x", "partition a", "partition c 0"};
+
+    for (unsigned long i = 0; i < sizeof(lines) / sizeof(*lines); ++i) {
+        sinuca::config::Topology topology;
+        SINUCA3_CHECK(AddToPair(&topology, lines[i]) != 0);
+    }
+
+    /* In range for the file, but not for the partitions of the run. */
+    sinuca::config::Topology topology;
+    SINUCA3_CHECK_EQUAL(0, AddToPair(&topology, "partition b 2"));
+    SINUCA3_CHECK_EQUAL(2, topology.GetComponentPartition(1));
+    SINUCA3_CHECK_EQUAL(-1, topology.GetComponentPartition(0));
+    topology.SetSharedConnections(true);
+    SINUCA3_CHECK_EQUAL(0, topology.Build(false));
+
+    sinuca::partition::PartitionedEngine tooFew(&topology);
+    SINUCA3_CHECK(tooFew.SetPartitions(2) != 0);
+    sinuca::partition::PartitionedEngine enough(&topology);
+    SINUCA3_CHECK(enough.SetPartitions(3) != 0); /* More than components. */
+
+    sinuca::config::Topology fits;
+    SINUCA3_CHECK_EQUAL(0, AddToPair(&fits, "partition b 1"));
+    fits.SetSharedConnections(true);
+    SINUCA3_CHECK_EQUAL(0, fits.Build(false));
+    sinuca::partition::PartitionedEngine engine(&fits);
+    SINUCA3_CHECK_EQUAL(0, engine.SetPartitions(2));
+}
+
+/**
+ * @brief Checks that the buffers of every connection start on a cache line,
+ * in order and without overlapping, inside the storage of the topology.
+ */
+static void CheckLayout(const sinuca::config::Topology& topology) {
+    const char* previousEnd = NULL;
+    const char* first = NULL;
+
+    for (long i = 0; i < topology.GetNumberOfConnections(); ++i) {
+        sinuca::engine::Connection* connection = topology.GetConnection(i);
+        sinuca::engine::ConnectionHandle handle =
+            connection->GetHandle(SOURCE_ID);
+        /* requestBuffers[SOURCE_ID] is the first of the four, at the start
+         * of the storage of the connection. */
+        const char* start =
+            static_cast<const char*>(handle.requestInput->Peek(0));
+        long size = sinuca::engine::Connection::GetStorageSize(
+            handle.requestInput->GetSize(),
+            handle.requestInput->GetMessageSize());
+
+        SINUCA3_CHECK_EQUAL(0, (unsigned long)start % 64);
+        if (previousEnd) SINUCA3_CHECK(start >= previousEnd);
+        if (connection->IsExternal()) {
+            const char* placed = reinterpret_cast<const char*>(connection);
+            SINUCA3_CHECK(placed + sizeof(*connection) <= start);
+            if (previousEnd) SINUCA3_CHECK(placed >= previousEnd);
+        }
+        if (!first) first = start;
+        previousEnd = start + size;
+    }
+
+    SINUCA3_CHECK_EQUAL(0, topology.GetConnectionStorageSize() % 64);
+    SINUCA3_CHECK(previousEnd - first <= topology.GetConnectionStorageSize());
+}
+
+SINUCA3_TEST(LoaderAlignsConnections) {
+    const char* lines[] = {"component WideProbe a",
+                           "component NarrowProbe b",
+                           "component WideProbe c",
+                           "connect a.target0 b 3",
+                           "connect a.target1 c 5",
+                           "connect c.target0 b 1",
+                           "connect b.target0 c 7",
+                           "connect b.target1 a 64",
+                           NULL};
+
+    sinuca::config::Topology topology;
+    SINUCA3_CHECK_EQUAL(0, AddLines(&topology, lines));
+    SINUCA3_CHECK_EQUAL(0, topology.Build());
+    /* Messages are the ones of the recipient. */
+    SINUCA3_CHECK_EQUAL(1, topology.GetConnection(0)
+                               ->GetHandle(SOURCE_ID)
+                               .requestInput->GetMessageSize());
+    SINUCA3_CHECK_EQUAL(13, topology.GetConnection(3)
+                                ->GetHandle(SOURCE_ID)
+                                .requestInput->GetMessageSize());
+    CheckLayout(topology);
+
+    /* Shared connections are constructed right before their buffers. */
+    sinuca::config::Topology shared;
+    shared.SetSharedConnections(true);
+    SINUCA3_CHECK_EQUAL(0, AddLines(&shared, lines));
+    SINUCA3_CHECK_EQUAL(0, shared.Build());
+    SINUCA3_CHECK(shared.GetConnection(0)->IsExternal());
+    CheckLayout(shared);
+}
+
+SINUCA3_TEST(LoaderOverridesParameters) {
+    sinuca::test::QuietStderr quiet;
+    sinuca::config::Topology topology;
+
+    SINUCA3_CHECK_EQUAL(0, topology.AddLine("component WideProbe a value=7"));
+    SINUCA3_CHECK_EQUAL(0, topology.AddLine("component NarrowProbe b"));
+    SINUCA3_CHECK_EQUAL(0, topology.SetOverride("a.value=9"));
+    SINUCA3_CHECK_EQUAL(0, topology.SetOverride("b.value=3"));
+    SINUCA3_CHECK_EQUAL(0, topology.SetOverride("b.value=4"));
+    SINUCA3_CHECK(topology.SetOverride("value=1") != 0);
+    SINUCA3_CHECK(topology.SetOverride(".value=1") != 0);
+    SINUCA3_CHECK(topology.SetOverride("c.value=1") != 0);
+    SINUCA3_CHECK(topology.SetOverride("a.value") != 0);
+    SINUCA3_CHECK_EQUAL(0, topology.Build());
+
+    SINUCA3_CHECK_EQUAL(
+        9, static_cast<WideProbe*>(topology.FindComponent("a"))->value);
+    SINUCA3_CHECK_EQUAL(
+        4, static_cast<NarrowProbe*>(topology.FindComponent("b"))->value);
+
+    /* Accepted by name, rejected by the component. */
+    sinuca::config::Topology unknown;
+    SINUCA3_CHECK_EQUAL(0, unknown.AddLine("component WideProbe a"));
+    SINUCA3_CHECK_EQUAL(0, unknown.SetOverride("a.bogus=1"));
+    SINUCA3_CHECK(unknown.Build() != 0);
+}
+
+SINUCA3_TEST(LoaderResizesConnections) {
+    sinuca::config::Topology topology;
+    SINUCA3_CHECK_EQUAL(0, AddToPair(&topology, "connect a.target0 b 4"));
+    SINUCA3_CHECK_EQUAL(0, topology.SetResize("a.target0=8"));
+    SINUCA3_CHECK_EQUAL(0, topology.Build());
+    SINUCA3_CHECK_EQUAL(8, topology.GetConnectionBufferSize(0));
+
+    /* Wraps the requests of the source, then resizes with three queued. */
+    sinuca::engine::Connection* connection = topology.GetConnection(0);
+    sinuca::engine::ConnectionHandle source =
+        connection->GetHandle(SOURCE_ID);
+    sinuca::engine::ConnectionHandle recipient =
+        connection->GetHandle(DEST_ID);
+    WideProbe* a = static_cast<WideProbe*>(topology.FindComponent("a"));
+    WideProbe* b = static_cast<WideProbe*>(topology.FindComponent("b"));
+    WideMessage message;
+    for (int i = 0; i < 10; ++i) {
+        message.bytes[0] = i;
+        SINUCA3_CHECK(a->SendRequestByHandle(source, &message));
+        if (i < 7)
+            SINUCA3_CHECK(b->ReceiveRequestByHandle(recipient, &message));
+    }
+
+    {
+        sinuca::test::QuietStderr quiet;
+        SINUCA3_CHECK(topology.ResizeConnection(0, 2) != 0);
+    }
+    SINUCA3_CHECK_EQUAL(8, topology.GetConnectionBufferSize(0));
+    SINUCA3_CHECK_EQUAL(0, topology.ResizeConnection(0, 3));
+    SINUCA3_CHECK_EQUAL(3, topology.GetConnectionBufferSize(0));
+    SINUCA3_CHECK(!a->SendRequestByHandle(source, &message));
+    for (int i = 7; i < 10; ++i) {
+        SINUCA3_CHECK(b->ReceiveRequestByHandle(recipient, &message));
+        SINUCA3_CHECK_EQUAL(i, message.bytes[0]);
+    }
+    SINUCA3_CHECK(!b->ReceiveRequestByHandle(recipient, &message));
+}
+
+SINUCA3_TEST(LoaderRefusesResizes) {
+    sinuca::test::QuietStderr quiet;
+    sinuca::config::Topology syntax;
+    SINUCA3_CHECK_EQUAL(0, AddToPair(&syntax, "connect a.target0 b 4"));
+    SINUCA3_CHECK(syntax.SetResize("a.target0=0") != 0);
+    SINUCA3_CHECK(syntax.SetResize("a.target0=x") != 0);
+    SINUCA3_CHECK(syntax.SetResize("a.target1=4") != 0);
+    SINUCA3_CHECK(syntax.SetResize("=4") != 0);
+
+    /* Rings of bytes keep their capacity. */
+    sinuca::config::Topology variable;
+    SINUCA3_CHECK_EQUAL(0, AddToPair(&variable, "connect a.target0 b 256B"));
+    SINUCA3_CHECK_EQUAL(0, variable.SetResize("a.target0=8"));
+    SINUCA3_CHECK(variable.Build() != 0);
+
+    /* Other processes map the storage of shared connections. */
+    sinuca::config::Topology shared;
+    SINUCA3_CHECK_EQUAL(0, AddToPair(&shared, "connect a.target0 b 4"));
+    shared.SetSharedConnections(true);
+    SINUCA3_CHECK_EQUAL(0, shared.SetResize("a.target0=8"));
+    SINUCA3_CHECK(shared.Build() != 0);
+    SINUCA3_CHECK_EQUAL(4, shared.GetConnectionBufferSize(0));
+}
@@ -0,0 +1,82 @@
+//
+// Copyright (C) 2024  HiPES - Universidade Federal do Paraná
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/**
+ * @file coroutineComponentTest.cpp
+ * @brief Tests of CoroutineComponent. Compiled in with COROUTINES=1, empty
+ * otherwise.
+ */
+
+#ifdef SINUCA3_COROUTINES
+
+#include "../coroutineComponent.hpp"
+#include "check.hpp"
+
+namespace {
+
+/** Asks dest once and keeps the response. */
+class Asker : public sinuca::CoroutineComponent<long> {
+  public:
+    sinuca::engine::Linkable* dest;
+    int connectionID;
+    long response;
+
+    Asker() : dest(NULL), connectionID(0), response(0){};
+    int FinishSetup() { return 0; };
+
+    sinuca::Task Run() {
+        this->response =
+            co_await this->SendRequest(this->dest, this->connectionID, 5);
+    };
+};
+
+/** Answers each request with its value plus one. */
+class Answerer : public sinuca::Component<long> {
+  public:
+    int FinishSetup() { return 0; };
+    void Clock() {
+        this->ForEachReadyRequest([&](int id) {
+            long message;
+            this->ReceiveRequestForAConnection(id, &message);
+            ++message;
+            this->SendResponseForConnection(id, &message);
+        });
+    };
+};
+
+}  // namespace
+
+SINUCA3_TEST(CoroutineRequestOutlivesNewConnections) {
+    Asker asker;
+    Answerer answerer;
+    asker.dest = &answerer;
+    asker.connectionID = answerer.ConnectToComponent(1);
+
+    asker.Clock(); /* Sends the request. */
+    SINUCA3_CHECK_EQUAL(1, asker.GetNumberOfTasks());
+
+    /* Moves the handles kept by the answerer while the response is
+     * awaited. */
+    for (int i = 0; i < 200; ++i) answerer.ConnectToComponent(1);
+
+    answerer.Clock();
+    asker.Clock(); /* Receives the response and finishes. */
+    SINUCA3_CHECK_EQUAL(6, asker.response);
+    SINUCA3_CHECK_EQUAL(0, asker.GetNumberOfTasks());
+}
+
+#endif  // SINUCA3_COROUTINES
@@ -0,0 +1,128 @@
+//
+// Copyright (C) 2024  HiPES - Universidade Federal do Paraná
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/**
+ * @file interleavedBTBTest.cpp
+ * @brief Tests of the banks and ports of the interleaved BTB.
+ */
+
+#include <cstdlib>
+#include <string>
+
+#include "../interleavedBTB.hpp"
+#include "check.hpp"
+
+namespace {
+
+/** A component that does nothing by itself, driven by the tests. */
+class Fetcher : public sinuca::Component<BTBMessage> {
+  public:
+    int FinishSetup() { return 0; };
+    void Clock(){};
+};
+
+sinuca::config::ConfigValue Integer(long integer) {
+    sinuca::config::ConfigValue value;
+    value.type = sinuca::config::ConfigValueTypeInteger;
+    value.value.integer = integer;
+    return value;
+}
+
+}  // namespace
+
+/**
+ * @return The value printed for a statistic, or -1 if it is missing.
+ */
+static double GetStatistic(const std::string& output, const char* name) {
+    std::string key = std::string(name) + ": ";
+    unsigned long position = output.find(key);
+    if (position == std::string::npos) return -1;
+    return atof(output.c_str() + position + key.size());
+}
+
+SINUCA3_TEST(BTBClaimsEveryBankOfARow) {
+    BranchTargetBuffer btb;
+    Fetcher fetcher;
+    SINUCA3_CHECK_EQUAL(0, btb.SetConfigParameter("numBanks", Integer(2)));
+    SINUCA3_CHECK_EQUAL(0, btb.SetConfigParameter("numEntries", Integer(4)));
+    SINUCA3_CHECK_EQUAL(0, btb.SetConfigParameter("readPorts", Integer(1)));
+    SINUCA3_CHECK_EQUAL(0, btb.SetConfigParameter("writePorts", Integer(1)));
+    int id = btb.ConnectToComponent(4);
+    SINUCA3_CHECK_EQUAL(0, btb.FinishSetup());
+    sinuca::engine::ConnectionHandle handle =
+        fetcher.ResolveConnectionToComponent(&btb, id);
+
+    /* Starts at the last bank, but the block fills the whole row. */
+    uint64_t targets[4] = {0x200, 0x300, 0x400, 0x500};
+    BTBMessage message = BTBMessage();
+    message.fetchAddress = 0x1003;
+    message.fetchTargets = targets;
+    message.messageType = BTB_ALLOCATION_REQUEST;
+    SINUCA3_CHECK(fetcher.SendRequestByHandle(handle, &message));
+    btb.Clock();
+
+    message.messageType = BTB_REQUEST;
+    SINUCA3_CHECK(fetcher.SendRequestByHandle(handle, &message));
+    btb.Clock();
+
+    BTBMessage response;
+    SINUCA3_CHECK(fetcher.ReceiveResponseByHandle(handle, &response));
+    SINUCA3_CHECK_EQUAL(ALLOCATED_ENTRY, response.messageType);
+
+    sinuca::test::CaptureStdout capture;
+    btb.PrintStatistics();
+    std::string output = capture.Release();
+
+    /* Four banks, one port of each kind, two cycles: each request took a
+     * port in all four banks. */
+    SINUCA3_CHECK_EQUAL(2, GetStatistic(output, "btb.cycles"));
+    SINUCA3_CHECK_EQUAL(0, GetStatistic(output, "btb.bank_conflicts"));
+    SINUCA3_CHECK(GetStatistic(output, "btb.read_port_utilization") == 0.5);
+    SINUCA3_CHECK(GetStatistic(output, "btb.write_port_utilization") == 0.5);
+}
+
+SINUCA3_TEST(BTBDefersRequestsOnBusyBanks) {
+    BranchTargetBuffer btb;
+    Fetcher fetcher;
+    SINUCA3_CHECK_EQUAL(0, btb.SetConfigParameter("numBanks", Integer(2)));
+    SINUCA3_CHECK_EQUAL(0, btb.SetConfigParameter("numEntries", Integer(4)));
+    SINUCA3_CHECK_EQUAL(0, btb.SetConfigParameter("writePorts", Integer(1)));
+    int id = btb.ConnectToComponent(4);
+    SINUCA3_CHECK_EQUAL(0, btb.FinishSetup());
+    sinuca::engine::ConnectionHandle handle =
+        fetcher.ResolveConnectionToComponent(&btb, id);
+
+    /* Rows starting in different banks still share all of them. */
+    uint64_t targets[4] = {0x200, 0x300, 0x400, 0x500};
+    BTBMessage message = BTBMessage();
+    message.fetchTargets = targets;
+    message.messageType = BTB_ALLOCATION_REQUEST;
+    message.fetchAddress = 0x1000;
+    SINUCA3_CHECK(fetcher.SendRequestByHandle(handle, &message));
+    message.fetchAddress = 0x2001;
+    SINUCA3_CHECK(fetcher.SendRequestByHandle(handle, &message));
+    btb.Clock();
+    btb.Clock();
+
+    sinuca::test::CaptureStdout capture;
+    btb.PrintStatistics();
+    std::string output = capture.Release();
+
+    SINUCA3_CHECK_EQUAL(2, GetStatistic(output, "btb.served_writes"));
+    SINUCA3_CHECK_EQUAL(1, GetStatistic(output, "btb.bank_conflicts"));
+    SINUCA3_CHECK(GetStatistic(output, "btb.write_port_utilization") == 1.0);
+}
@@ -0,0 +1,126 @@
+//
+// Copyright (C) 2024  HiPES - Universidade Federal do Paraná
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/**
+ * @file linkableTest.cpp
+ * @brief Tests of the connections of a Linkable and their handles.
+ */
+
+#include <type_traits>
+
+#include "../component.hpp"
+#include "check.hpp"
+
+namespace {
+
+/** A component that does nothing by itself, driven by the tests. */
+class Endpoint : public sinuca::Component<long> {
+  public:
+    using sinuca::engine::Linkable::ResolveConnection;
+    using sinuca::engine::Linkable::ResolveConnectionToLinkable;
+    using sinuca::engine::Linkable::FindReadyRequest;
+    using sinuca::engine::Linkable::GetNumberOfReadyRequests;
+
+    int FinishSetup() { return 0; };
+    void Clock(){};
+};
+
+}  // namespace
+
+SINUCA3_TEST(ComponentHandlesOutliveNewConnections) {
+    Endpoint source;
+    Endpoint recipient;
+    int id = recipient.ConnectToComponent(2);
+
+    sinuca::engine::ConnectionHandle toRecipient =
+        source.ResolveConnectionToComponent(&recipient, id);
+    sinuca::engine::ConnectionHandle toSource =
+        recipient.ResolveConnectionForAConnection(id);
+
+    /* Moves the handles kept by the recipient. */
+    for (int i = 0; i < 200; ++i) recipient.ConnectToComponent(1);
+
+    long message = 42;
+    long received = 0;
+    SINUCA3_CHECK_EQUAL(id, toRecipient.connectionID);
+    SINUCA3_CHECK(source.SendRequestByHandle(toRecipient, &message));
+    SINUCA3_CHECK(recipient.ReceiveRequestByHandle(toSource, &received));
+    SINUCA3_CHECK_EQUAL(42, received);
+
+    message = 43;
+    SINUCA3_CHECK(recipient.SendResponseByHandle(toSource, &message));
+    SINUCA3_CHECK(source.ReceiveResponseByHandle(toRecipient, &received));
+    SINUCA3_CHECK_EQUAL(43, received);
+}
+
+SINUCA3_TEST(LinkableHandlesAreCopies) {
+    static_assert(!std::is_reference<decltype(
+                      Endpoint::ResolveConnectionToLinkable(NULL, 0))>::value,
+                  "handles are kept by value");
+    static_assert(!std::is_reference<decltype(
+                      std::declval<Endpoint>().ResolveConnection(0))>::value,
+                  "handles are kept by value");
+
+    Endpoint source;
+    Endpoint recipient;
+    int first = recipient.ConnectToComponent(1);
+    int second = recipient.ConnectToComponent(1);
+    sinuca::engine::ConnectionHandle toRecipient =
+        Endpoint::ResolveConnectionToLinkable(&recipient, second);
+    sinuca::engine::ConnectionHandle toSource =
+        recipient.ResolveConnection(second);
+
+    for (int i = 0; i < 200; ++i) recipient.ConnectToComponent(1);
+
+    /* The copies still reach the second connection, not the first. */
+    long message = 7;
+    long received = 0;
+    SINUCA3_CHECK(source.SendRequestByHandle(toRecipient, &message));
+    SINUCA3_CHECK(!recipient.ReceiveRequestForAConnection(first, &received));
+    SINUCA3_CHECK(recipient.ReceiveRequestByHandle(toSource, &received));
+    SINUCA3_CHECK_EQUAL(7, received);
+    SINUCA3_CHECK_EQUAL(second, toSource.connectionID);
+
+    /* Full after one message: the copy sees the same buffer. */
+    SINUCA3_CHECK(source.SendRequestByHandle(toRecipient, &message));
+    SINUCA3_CHECK(!source.SendRequestByHandle(toRecipient, &message));
+}
+
+SINUCA3_TEST(ReadyRequestsFollowReservedConnections) {
+    Endpoint source;
+    Endpoint recipient;
+    int first = recipient.ConnectToComponent(1);
+    int second = recipient.ConnectToComponent(1);
+
+    /* Reserving after connecting moves the ready words. */
+    recipient.ReserveConnections(200);
+    for (int i = 0; i < 70; ++i) recipient.ConnectToComponent(1);
+
+    long message = 3;
+    SINUCA3_CHECK(source.SendRequestByHandle(
+        source.ResolveConnectionToComponent(&recipient, second), &message));
+    SINUCA3_CHECK(source.SendRequestByHandle(
+        source.ResolveConnectionToComponent(&recipient, 70), &message));
+    SINUCA3_CHECK_EQUAL(2, recipient.GetNumberOfReadyRequests());
+    SINUCA3_CHECK_EQUAL(second, recipient.FindReadyRequest(first));
+    SINUCA3_CHECK_EQUAL(70, recipient.FindReadyRequest(second + 1));
+
+    long received = 0;
+    SINUCA3_CHECK(recipient.ReceiveRequestForAConnection(second, &received));
+    SINUCA3_CHECK_EQUAL(3, received);
+    SINUCA3_CHECK_EQUAL(1, recipient.GetNumberOfReadyRequests());
+}
@@ -0,0 +1,93 @@
+//
+// Copyright (C) 2024  HiPES - Universidade Federal do Paraná
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/**
+ * @file traceFetchTest.cpp
+ * @brief Tests of the trace-driven fetch across functional and detailed
+ * intervals.
+ */
+
+#include <unistd.h>
+
+#include <cstdlib>
+#include <string>
+
+#include "../branchTrace.hpp"
+#include "../configLoader.hpp"
+#include "../engine.hpp"
+#include "check.hpp"
+
+/**
+ * @return The value printed for a statistic, or -1 if it is missing.
+ */
+static long GetStatistic(const std::string& output, const char* name) {
+    std::string key = std::string(name) + ": ";
+    unsigned long position = output.find(key);
+    if (position == std::string::npos) return -1;
+    return atol(output.c_str() + position + key.size());
+}
+
+SINUCA3_TEST(FastForwardSplitsInstructionsExactly) {
+    char traceFile[] = "/tmp/sinuca3BranchesXXXXXX";
+    int descriptor = mkstemp(traceFile);
+    SINUCA3_CHECK(descriptor >= 0);
+    if (descriptor < 0) return;
+    close(descriptor);
+    SINUCA3_CHECK_EQUAL(
+        0, sinuca::WriteSyntheticBranchTrace(traceFile, 5000, 64, 1));
+
+    sinuca::config::Topology topology;
+    std::string fetch =
+        std::string("component TraceFetch fetch trace=") + traceFile;
+    SINUCA3_CHECK_EQUAL(0, topology.AddLine(fetch.c_str()));
+    SINUCA3_CHECK_EQUAL(0, topology.AddLine(
+                               "component BranchTargetBuffer btb numBanks=2 "
+                               "numEntries=4 readPorts=1 writePorts=1"));
+    SINUCA3_CHECK_EQUAL(0, topology.AddLine("connect fetch.btb btb 4"));
+    SINUCA3_CHECK_EQUAL(0, topology.Build());
+    unlink(traceFile);
+    if (topology.GetNumberOfComponents() != 2) return;
+
+    sinuca::engine::Engine engine;
+    engine.AddComponent(topology.GetComponent(0));
+    engine.AddComponent(topology.GetComponent(1));
+
+    /* As ./sinuca3 -w 500 -i 100 -s 400 does. */
+    unsigned long functional = 0, detailed = 0;
+    unsigned long skipped = 500;
+    do {
+        functional += engine.FastForward(skipped);
+        detailed += engine.SimulateInstructions(100);
+        skipped = 400;
+    } while (!engine.IsFinished());
+    engine.Drain();
+
+    SINUCA3_CHECK_EQUAL(4100, functional);
+    SINUCA3_CHECK_EQUAL(900, detailed);
+    SINUCA3_CHECK(engine.IsFinished());
+
+    /* Every lookup of the detailed intervals reached the BTB and came back. */
+    sinuca::test::CaptureStdout capture;
+    topology.GetComponent(0)->PrintStatistics();
+    topology.GetComponent(1)->PrintStatistics();
+    std::string output = capture.Release();
+
+    SINUCA3_CHECK_EQUAL(900, GetStatistic(output, "fetch.blocks"));
+    SINUCA3_CHECK_EQUAL(4100,
+                        GetStatistic(output, "fetch.fast_forwarded_blocks"));
+    SINUCA3_CHECK_EQUAL(900, GetStatistic(output, "btb.served_reads"));
+}
@@ -0,0 +1,98 @@
+//
+// Copyright (C) 2024  HiPES - Universidade Federal do Paraná
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/**
+ * @file traceTest.cpp
+ * @brief Tests of the Chrome trace export.
+ */
+
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include "../trace.hpp"
+#include "check.hpp"
+
+/**
+ * @return Whether text is one JSON value: strings closed and free of raw
+ * control characters, brackets balanced.
+ */
+static bool IsWellFormedJson(const std::string& text) {
+    std::string open;
+    bool inString = false;
+
+    for (unsigned long i = 0; i < text.size(); ++i) {
+        char character = text[i];
+        if (inString) {
+            if (character == '\\') {
+                ++i;
+            } else if (character == '"') {
+                inString = false;
+            } else if ((unsigned char)character < 0x20) {
+                return false;
+            }
+        } else if (character == '"') {
+            inString = true;
+        } else if (character == '{' || character == '[') {
+            open += character;
+        } else if (character == '}' || character == ']') {
+            if (open.empty() || open.back() != (character == '}' ? '{' : '['))
+                return false;
+            open.pop_back();
+        }
+    }
+
+    return !inString && open.empty();
+}
+
+SINUCA3_TEST(TraceEscapesComponentNames) {
+    char binaryFile[] = "/tmp/sinuca3TraceXXXXXX";
+    int descriptor = mkstemp(binaryFile);
+    SINUCA3_CHECK(descriptor >= 0);
+    if (descriptor < 0) return;
+    close(descriptor);
+    std::string jsonFile = std::string(binaryFile) + ".json";
+
+    SINUCA3_CHECK_EQUAL(0, sinuca::trace::Start(binaryFile));
+    sinuca::trace::NameComponent(0, "cpu\"0\\a\tb");
+    sinuca::trace::Record(sinuca::trace::TraceEventClockBegin, 0, 0);
+    sinuca::trace::Record(sinuca::trace::TraceEventSendRequest, 0, 1);
+    sinuca::trace::Record(sinuca::trace::TraceEventClockEnd, 0, 0);
+    sinuca::trace::Stop();
+    SINUCA3_CHECK_EQUAL(0, sinuca::trace::ConvertToChromeTrace(
+                               binaryFile, jsonFile.c_str()));
+
+    std::string json;
+    FILE* file = fopen(jsonFile.c_str(), "r");
+    SINUCA3_CHECK(file != NULL);
+    if (file) {
+        char buffer[4096];
+        size_t read;
+        while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0)
+            json.append(buffer, read);
+        fclose(file);
+    }
+
+    SINUCA3_CHECK(IsWellFormedJson(json));
+    SINUCA3_CHECK(json.find("\"cpu\\\"0\\\\a\\u0009b\"") != std::string::npos);
+    SINUCA3_CHECK(json.find("cpu\"0") == std::string::npos);
+
+    unlink(binaryFile);
+    unlink(jsonFile.c_str());
+}
@@ -0,0 +1,900 @@
+//
+// Copyright (C) 2024  HiPES - Universidade Federal do Paraná
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/**
+ * @file timeWarp.cpp
+ * @brief Implementation of the OptimisticEngine.
+ */
+
+#include "timeWarp.hpp"
+
+#include <poll.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+namespace sinuca {
+namespace partition {
+
+struct alignas(64) TimeWarpControl {
+    std::atomic<unsigned long> gvt;
+
+    TimeWarpControl() : gvt(0){};
+};
+
+/**
+ * @brief Shared state of a partition, which outlives its processes.
+ */
+struct alignas(64) TimeWarpPartition {
+    /** No event of the partition, sent or to be sent, is older. Lowered
+     * before the events that roll it back are marked as read. */
+    std::atomic<unsigned long> lvt;
+    std::atomic<pid_t> running; /**< The process that is not a snapshot. */
+    std::atomic<int> finished;
+    std::atomic<unsigned long> rollbacks;
+    std::atomic<unsigned long> rolledBackTicks;
+    std::atomic<unsigned long> snapshots;
+    std::atomic<unsigned long> events;
+    std::atomic<unsigned long> antiMessages;
+
+    TimeWarpPartition()
+        : lvt(0),
+          running(0),
+          finished(0),
+          rollbacks(0),
+          rolledBackTicks(0),
+          snapshots(0),
+          events(0),
+          antiMessages(0){};
+};
+
+/**
+ * @brief The counters of the log of events from a partition to another.
+ * @details The entries from read to written are the events in transit. A
+ * rolled back reader reads again from an older entry, so read only grows.
+ * The writer overwrites entries before released only.
+ */
+struct TimeWarpChannel {
+    alignas(64) std::atomic<unsigned long> written;
+    alignas(64) std::atomic<unsigned long> read;
+    alignas(64) std::atomic<unsigned long> released;
+
+    TimeWarpChannel() : written(0), read(0), released(0){};
+};
+
+}  // namespace partition
+}  // namespace sinuca
+
+enum EventKind {
+    EventEnqueue, /**< A message, to the consumer. */
+    EventDequeue, /**< count messages dequeued, to the producer. */
+    EventCancel,  /**< Cancels the events of the sender after tick. */
+};
+
+/** Starts each entry of a log, followed by the message. */
+struct EventHeader {
+    unsigned long tick;
+    int kind;
+    int buffer;
+    int count;
+};
+
+/** Exit status of a process stopped because another one failed. */
+static const int STOPPED = 2;
+/** Checks before yielding the CPU. */
+static const int SPINS_BEFORE_YIELD = 64;
+/** Entries of each log. The window below keeps far fewer in use. */
+static const unsigned long LOG_ENTRIES = 1UL << 16;
+/** Entries read from a log after which a snapshot is taken early, so the
+ * log is released even when snapshots are far apart. */
+static const unsigned long SNAPSHOT_LOG_ENTRIES = LOG_ENTRIES / 4;
+/** A writer waits this long on a full log while the GVT does not move. */
+static const long LOG_FULL_TIMEOUT_NS = 2000000000;
+/** Snapshot intervals a partition may run ahead of the GVT. */
+static const unsigned long WINDOW_INTERVALS = 8;
+/** Between two computations of the GVT. */
+static const long GVT_PERIOD_NS = 20000;
+/** Between two checks of a snapshot that the run goes on. */
+static const int SNAPSHOT_POLL_MS = 50;
+
+static int ReadAll(int fd, void* data, unsigned long bytes) {
+    char* position = static_cast<char*>(data);
+    while (bytes > 0) {
+        ssize_t count = read(fd, position, bytes);
+        if (count < 0 && errno == EINTR) continue;
+        if (count <= 0) return 1;
+        position += count;
+        bytes -= count;
+    }
+    return 0;
+};
+
+static int WriteAll(int fd, const void* data, unsigned long bytes) {
+    const char* position = static_cast<const char*>(data);
+    while (bytes > 0) {
+        ssize_t count = write(fd, position, bytes);
+        if (count < 0 && errno == EINTR) continue;
+        if (count <= 0) return 1;
+        position += count;
+        bytes -= count;
+    }
+    return 0;
+};
+
+int sinuca::partition::OptimisticEngine::Pause(int* spins) const {
+    if (++*spins < SPINS_BEFORE_YIELD) return 0;
+    *spins = 0;
+    sched_yield();
+    return this->HasFailed() ||
+           (kill(this->simulator, 0) && errno == ESRCH);
+};
+
+int sinuca::partition::OptimisticEngine::GetChannel(int source,
+                                                    int destination) {
+    for (unsigned long i = 0; i < this->channelSources.size(); ++i) {
+        if (this->channelSources[i] == source &&
+            this->channelDestinations[i] == destination)
+            return i;
+    }
+    this->channelSources.push_back(source);
+    this->channelDestinations.push_back(destination);
+    return this->channelSources.size() - 1;
+};
+
+int sinuca::partition::OptimisticEngine::AddCrossBuffer(CircularBuffer* buffer,
+                                                        int messageSize,
+                                                        long producer,
+                                                        long consumer) {
+    int source = this->partitions[producer];
+    int destination = this->partitions[consumer];
+
+    CrossBuffer cross;
+    cross.buffer = buffer;
+    cross.messageSize = messageSize;
+    cross.producerChannel = this->GetChannel(source, destination);
+    cross.consumerChannel = this->GetChannel(destination, source);
+
+    int id = this->crossBuffers.size();
+    this->crossBuffers.push_back(cross);
+    this->produced[producer].push_back(id);
+    this->consumed[consumer].push_back(id);
+    return id;
+};
+
+int sinuca::partition::OptimisticEngine::SetPartitions(
+    int numberOfPartitions) {
+    for (long i = 0; i < this->topology->GetNumberOfConnections(); ++i) {
+        if (this->topology->GetConnection(i)->IsExternal()) {
+            fprintf(stderr, "Optimistic partitions need a topology built "
+                            "with private connections.\n");
+            return 1;
+        }
+    }
+    if (this->AssignPartitions(numberOfPartitions)) return 1;
+
+    long count = this->topology->GetNumberOfComponents();
+    this->crossBuffers.clear();
+    this->channelSources.clear();
+    this->channelDestinations.clear();
+    this->produced.assign(count, std::vector<int>());
+    this->consumed.assign(count, std::vector<int>());
+
+    int largest = 0;
+    for (long i = 0; i < this->topology->GetNumberOfConnections(); ++i) {
+        long source = this->topology->GetConnectionSource(i);
+        long destination = this->topology->GetConnectionDestination(i);
+        if (this->partitions[source] == this->partitions[destination])
+            continue;
+
+        engine::Connection* connection = this->topology->GetConnection(i);
+        if (connection->IsVariableLength()) {
+            fprintf(stderr,
+                    "%s joins two partitions with variable-length messages, "
+                    "which optimistic partitions do not support.\n",
+                    this->topology->GetConnectionName(i).c_str());
+            return 1;
+        }
+
+        /* The source writes its outputs and the destination its inputs. */
+        engine::ConnectionHandle handle = connection->GetHandle(SOURCE_ID);
+        int size = handle.requestOutput->GetMessageSize();
+        this->AddCrossBuffer(handle.requestOutput, size, source, destination);
+        this->AddCrossBuffer(handle.responseOutput, size, source, destination);
+        this->AddCrossBuffer(handle.requestInput, size, destination, source);
+        this->AddCrossBuffer(handle.responseInput, size, destination, source);
+        if (size > largest) largest = size;
+    }
+
+    this->slotSize = (sizeof(EventHeader) + largest + 7) & ~7UL;
+    return 0;
+};
+
+char* sinuca::partition::OptimisticEngine::GetSlot(int channel,
+                                                   unsigned long entry) const {
+    return this->slots +
+           (channel * LOG_ENTRIES + entry % LOG_ENTRIES) * this->slotSize;
+};
+
+int sinuca::partition::OptimisticEngine::Send(int channel, unsigned long tick,
+                                              int kind, int buffer, int count,
+                                              const void* message) {
+    TimeWarpChannel& log = this->channels[channel];
+    unsigned long entry = log.written.load(std::memory_order_relaxed);
+
+    /* The reader frees entries when the GVT moves only. It stops moving when
+     * the writer is the oldest process, or when writers wait on each other
+     * without reading their own events. */
+    int spins = 0;
+    unsigned long gvt = ULONG_MAX;
+    struct timespec since = {0, 0};
+    while (entry - log.released.load(std::memory_order_acquire) >=
+           LOG_ENTRIES) {
+        if (this->Pause(&spins)) return 1;
+        if (spins != 0) continue;
+
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        unsigned long current =
+            this->shared->gvt.load(std::memory_order_acquire);
+        if (current != gvt) {
+            gvt = current;
+            since = now;
+        } else if ((now.tv_sec - since.tv_sec) * 1000000000L +
+                       (now.tv_nsec - since.tv_nsec) >=
+                   LOG_FULL_TIMEOUT_NS) {
+            fprintf(stderr,
+                    "The log from partition %d to partition %d is full at "
+                    "tick %lu. Use a shorter snapshot interval.\n",
+                    this->channelSources[channel],
+                    this->channelDestinations[channel], tick);
+            this->Fail();
+            return 1;
+        }
+    }
+
+    char* slot = this->GetSlot(channel, entry);
+    EventHeader* header = reinterpret_cast<EventHeader*>(slot);
+    header->tick = tick;
+    header->kind = kind;
+    header->buffer = buffer;
+    header->count = count;
+    if (message)
+        memcpy(slot + sizeof(EventHeader), message,
+               this->crossBuffers[buffer].messageSize);
+
+    log.written.store(entry + 1, std::memory_order_release);
+    if (kind != EventCancel)
+        this->state->events.fetch_add(1, std::memory_order_relaxed);
+    return 0;
+};
+
+int sinuca::partition::OptimisticEngine::SendAntiMessages(unsigned long tick) {
+    for (unsigned long i = 0; i < this->outputs.size(); ++i) {
+        if (this->Send(this->outputs[i], tick, EventCancel, 0, 0, NULL))
+            return 1;
+    }
+    this->state->antiMessages.fetch_add(1, std::memory_order_relaxed);
+    return 0;
+};
+
+int sinuca::partition::OptimisticEngine::ReadInputs() {
+    unsigned long straggler = ULONG_MAX;
+    /* While coasting, the oldest event the rolled back process did not know
+     * of: what it sent after that tick is wrong. */
+    unsigned long unknown = ULONG_MAX;
+
+    for (unsigned long i = 0; i < this->inputs.size(); ++i) {
+        Input& input = this->inputs[i];
+        unsigned long written = this->channels[input.channel].written.load(
+            std::memory_order_acquire);
+
+        for (; input.cursor < written; ++input.cursor) {
+            const char* slot = this->GetSlot(input.channel, input.cursor);
+            const EventHeader* header =
+                reinterpret_cast<const EventHeader*>(slot);
+            bool known = (input.cursor < input.known);
+
+            if (header->kind == EventCancel) {
+                while (!input.pending.empty() &&
+                       input.pending.back().tick > header->tick) {
+                    if (!known && input.pending.back().tick < unknown)
+                        unknown = input.pending.back().tick;
+                    input.pending.pop_back();
+                }
+                std::deque<unsigned long>::iterator cancelled =
+                    std::upper_bound(input.applied.begin(),
+                                     input.applied.end(), header->tick);
+                if (cancelled != input.applied.end())
+                    straggler = std::min(straggler, *cancelled);
+                continue;
+            }
+
+            if (header->tick < this->lastTick) {
+                straggler = std::min(straggler, header->tick);
+                continue;
+            }
+            if (!known) unknown = std::min(unknown, header->tick);
+
+            PendingEvent event;
+            event.tick = header->tick;
+            event.kind = header->kind;
+            event.buffer = header->buffer;
+            event.count = header->count;
+            if (header->kind == EventEnqueue) {
+                const char* message = slot + sizeof(EventHeader);
+                event.message.assign(
+                    message,
+                    message + this->crossBuffers[header->buffer].messageSize);
+            }
+            input.pending.push_back(event);
+        }
+    }
+
+    /* After every straggler is known, so the snapshot has to coast up to
+     * the oldest one only. */
+    if (straggler != ULONG_MAX) this->RollBack(straggler);
+
+    for (unsigned long i = 0; i < this->inputs.size(); ++i) {
+        TimeWarpChannel& log = this->channels[this->inputs[i].channel];
+        if (this->inputs[i].cursor > log.read.load(std::memory_order_relaxed))
+            log.read.store(this->inputs[i].cursor, std::memory_order_release);
+    }
+
+    if (this->coasting && unknown < this->coastUntil) {
+        this->coastUntil = unknown;
+        return this->SendAntiMessages(unknown);
+    }
+    return 0;
+};
+
+void sinuca::partition::OptimisticEngine::ApplyPending(unsigned long tick) {
+    for (unsigned long i = 0; i < this->inputs.size(); ++i) {
+        Input& input = this->inputs[i];
+        while (!input.pending.empty() && input.pending.front().tick < tick) {
+            PendingEvent& event = input.pending.front();
+            CircularBuffer* buffer = this->crossBuffers[event.buffer].buffer;
+
+            /* Either fails only in a state built on events that are being
+             * cancelled, which is rolled back when the cancel arrives. */
+            if (event.kind == EventEnqueue) {
+                buffer->Enqueue(event.message.data());
+            } else {
+                for (int n = 0; n < event.count; ++n)
+                    buffer->Dequeue(this->discarded.data());
+            }
+
+            input.applied.push_back(event.tick);
+            input.pending.pop_front();
+        }
+    }
+};
+
+int sinuca::partition::OptimisticEngine::Clock(long component,
+                                               unsigned long tick) {
+    this->ApplyPending(tick);
+
+    const std::vector<int>& produced = this->produced[component];
+    const std::vector<int>& consumed = this->consumed[component];
+    unsigned long count = produced.size();
+    this->occupations.resize(count + consumed.size());
+    for (unsigned long i = 0; i < count; ++i)
+        this->occupations[i] =
+            this->crossBuffers[produced[i]].buffer->GetOccupation();
+    for (unsigned long i = 0; i < consumed.size(); ++i)
+        this->occupations[count + i] =
+            this->crossBuffers[consumed[i]].buffer->GetOccupation();
+
+    engine::Linkable* linkable = this->topology->GetComponent(component);
+    linkable->PreClock();
+    linkable->Clock();
+    linkable->PosClock();
+    this->lastTick = tick;
+
+    if (this->coasting) {
+        if (tick <= this->coastUntil) return 0;
+        this->coasting = false;
+    }
+
+    /* Only the component writes the buffers it produces while it clocks, so
+     * the new messages are the newest ones. */
+    for (unsigned long i = 0; i < count; ++i) {
+        const CrossBuffer& cross = this->crossBuffers[produced[i]];
+        int occupation = cross.buffer->GetOccupation();
+        for (int m = this->occupations[i]; m < occupation; ++m) {
+            if (this->Send(cross.producerChannel, tick, EventEnqueue,
+                           produced[i], 1, cross.buffer->Peek(m)))
+                return 1;
+        }
+    }
+    for (unsigned long i = 0; i < consumed.size(); ++i) {
+        const CrossBuffer& cross = this->crossBuffers[consumed[i]];
+        int dequeued =
+            this->occupations[count + i] - cross.buffer->GetOccupation();
+        if (dequeued > 0 && this->Send(cross.consumerChannel, tick,
+                                       EventDequeue, consumed[i], dequeued,
+                                       NULL))
+            return 1;
+    }
+
+    return 0;
+};
+
+int sinuca::partition::OptimisticEngine::TakeSnapshot(unsigned long tick) {
+    int command[2];
+    if (pipe(command)) {
+        fprintf(stderr, "Could not create the pipe of a snapshot: %s.\n",
+                strerror(errno));
+        return 1;
+    }
+
+    /* stdout is a memory stream by then, saved with the snapshot. */
+    pid_t pid = fork();
+    if (pid < 0) {
+        fprintf(stderr, "Could not fork a snapshot: %s.\n", strerror(errno));
+        close(command[0]);
+        close(command[1]);
+        return 1;
+    }
+
+    if (pid == 0) {
+        close(command[1]);
+
+        /* Left behind if the running process dies, so the snapshot checks
+         * that the run goes on while it waits. */
+        struct pollfd waiting = {command[0], POLLIN, 0};
+        while (poll(&waiting, 1, SNAPSHOT_POLL_MS) <= 0) {
+            if (this->HasFailed() ||
+                (kill(this->simulator, 0) && errno == ESRCH))
+                _exit(STOPPED);
+        }
+
+        /* The straggler, the oldest snapshot left and the cursors of the
+         * rolled back process. */
+        std::vector<unsigned long> resume(2 + this->inputs.size());
+        if (ReadAll(command[0], resume.data(),
+                    resume.size() * sizeof(unsigned long)))
+            _exit(STOPPED);
+        close(command[0]);
+
+        this->coasting = true;
+        this->coastUntil = resume[0];
+        while (!this->snapshots.empty() &&
+               this->snapshots.front().tick < resume[1]) {
+            close(this->snapshots.front().command);
+            this->snapshots.erase(this->snapshots.begin());
+        }
+        for (unsigned long i = 0; i < this->inputs.size(); ++i)
+            this->inputs[i].known = resume[2 + i];
+        this->state->running.store(getpid());
+
+        /* The state is saved again, or a second straggler as old would
+         * have nothing to roll back to. */
+        return this->TakeSnapshot(tick);
+    }
+
+    close(command[0]);
+    Snapshot snapshot;
+    snapshot.process = pid;
+    snapshot.command = command[1];
+    snapshot.tick = tick;
+    for (unsigned long i = 0; i < this->inputs.size(); ++i)
+        snapshot.cursors.push_back(this->inputs[i].cursor);
+    this->snapshots.push_back(snapshot);
+    this->state->snapshots.fetch_add(1, std::memory_order_relaxed);
+
+    return 0;
+};
+
+void sinuca::partition::OptimisticEngine::KillSnapshot(
+    const Snapshot& snapshot) {
+    kill(snapshot.process, SIGKILL);
+    close(snapshot.command);
+    /* Snapshots of an earlier process were adopted by the parent. */
+    waitpid(snapshot.process, NULL, 0);
+};
+
+void sinuca::partition::OptimisticEngine::RollBack(unsigned long straggler) {
+    /* The snapshot clocked the ticks before its own, and the straggler is
+     * applied before the first tick after it. */
+    long target = this->snapshots.size() - 1;
+    while (target >= 0 && this->snapshots[target].tick > straggler + 1)
+        --target;
+    if (target < 0) {
+        fprintf(stderr, "No snapshot to roll back to tick %lu.\n", straggler);
+        this->Fail();
+        _exit(1);
+    }
+    const Snapshot& snapshot = this->snapshots[target];
+
+    this->state->rollbacks.fetch_add(1, std::memory_order_relaxed);
+    this->state->rolledBackTicks.fetch_add(this->nextTick - snapshot.tick,
+                                           std::memory_order_relaxed);
+    this->state->lvt.store(snapshot.tick, std::memory_order_release);
+    for (unsigned long i = 0; i < this->inputs.size(); ++i) {
+        TimeWarpChannel& log = this->channels[this->inputs[i].channel];
+        if (this->inputs[i].cursor > log.read.load(std::memory_order_relaxed))
+            log.read.store(this->inputs[i].cursor, std::memory_order_release);
+    }
+    if (this->SendAntiMessages(straggler)) _exit(STOPPED);
+
+    for (unsigned long i = target + 1; i < this->snapshots.size(); ++i)
+        this->KillSnapshot(this->snapshots[i]);
+
+    std::vector<unsigned long> resume;
+    resume.push_back(straggler);
+    resume.push_back(this->snapshots.front().tick);
+    for (unsigned long i = 0; i < this->inputs.size(); ++i)
+        resume.push_back(this->inputs[i].cursor);
+    if (WriteAll(snapshot.command, resume.data(),
+                 resume.size() * sizeof(unsigned long))) {
+        fprintf(stderr, "Could not resume a snapshot: %s.\n",
+                strerror(errno));
+        this->Fail();
+        _exit(1);
+    }
+
+    _exit(0);
+};
+
+bool sinuca::partition::OptimisticEngine::IsLogFilling() const {
+    const Snapshot& newest = this->snapshots.back();
+    for (unsigned long i = 0; i < this->inputs.size(); ++i) {
+        if (this->inputs[i].cursor - newest.cursors[i] >= SNAPSHOT_LOG_ENTRIES)
+            return true;
+    }
+    return false;
+};
+
+void sinuca::partition::OptimisticEngine::CollectFossils(unsigned long gvt) {
+    this->collected = gvt;
+
+    /* The newest snapshot at or before the GVT is kept: rollbacks go no
+     * further. */
+    unsigned long kept = 0;
+    while (kept + 1 < this->snapshots.size() &&
+           this->snapshots[kept + 1].tick <= gvt)
+        ++kept;
+    for (unsigned long i = 0; i < kept; ++i)
+        this->KillSnapshot(this->snapshots[i]);
+    this->snapshots.erase(this->snapshots.begin(),
+                          this->snapshots.begin() + kept);
+
+    for (unsigned long i = 0; i < this->inputs.size(); ++i) {
+        Input& input = this->inputs[i];
+        while (!input.applied.empty() && input.applied.front() < gvt)
+            input.applied.pop_front();
+
+        if (this->snapshots.empty()) continue;
+        TimeWarpChannel& log = this->channels[input.channel];
+        unsigned long released = this->snapshots.front().cursors[i];
+        if (released > log.released.load(std::memory_order_relaxed))
+            log.released.store(released, std::memory_order_release);
+    }
+};
+
+unsigned long sinuca::partition::OptimisticEngine::ComputeGVT() const {
+    unsigned long numberOfChannels = this->channelSources.size();
+    std::vector<unsigned long> read(numberOfChannels);
+
+    /* The processes publish their lower LVT before marking the events that
+     * lowered it as read, so the LVTs read between two equal reads of the
+     * counters account for every event read in between. */
+    for (;;) {
+        for (unsigned long i = 0; i < numberOfChannels; ++i)
+            read[i] = this->channels[i].read.load(std::memory_order_acquire);
+
+        unsigned long gvt = ULONG_MAX;
+        for (int i = 0; i < this->numberOfPartitions; ++i)
+            gvt = std::min(
+                gvt, this->states[i].lvt.load(std::memory_order_acquire));
+
+        for (unsigned long i = 0; i < numberOfChannels; ++i) {
+            unsigned long written =
+                this->channels[i].written.load(std::memory_order_acquire);
+            for (unsigned long entry = read[i]; entry < written; ++entry) {
+                const EventHeader* header =
+                    reinterpret_cast<const EventHeader*>(
+                        this->GetSlot(i, entry));
+                gvt = std::min(gvt, header->tick);
+            }
+        }
+
+        bool moved = false;
+        for (unsigned long i = 0; i < numberOfChannels; ++i) {
+            if (this->channels[i].read.load(std::memory_order_acquire) !=
+                read[i])
+                moved = true;
+        }
+        if (!moved) return gvt;
+    }
+};
+
+int sinuca::partition::OptimisticEngine::RunPartition(int partition,
+                                                      unsigned long cycles) {
+    std::vector<long> ownRuns;
+    for (unsigned long i = 0; i < this->runs.size(); ++i) {
+        if (this->runs[i].partition == partition) ownRuns.push_back(i);
+    }
+    unsigned long numberOfRuns = this->runs.size();
+
+    for (unsigned long r = 0; r < ownRuns.size(); ++r) {
+        if (this->WaitTurn(ownRuns[r])) return STOPPED;
+        const Run& run = this->runs[ownRuns[r]];
+        for (long i = run.first; i < run.end; ++i) {
+            if (this->topology->FinishSetup(i)) {
+                this->Fail();
+                return 1;
+            }
+        }
+        fflush(stdout);
+        this->PassTurn(ownRuns[r]);
+    }
+
+    this->state = &this->states[partition];
+    this->state->running.store(getpid());
+    for (unsigned long i = 0; i < this->channelSources.size(); ++i) {
+        if (this->channelDestinations[i] == partition) {
+            Input input;
+            input.channel = i;
+            input.cursor = 0;
+            input.known = 0;
+            this->inputs.push_back(input);
+        }
+        if (this->channelSources[i] == partition) this->outputs.push_back(i);
+    }
+    this->discarded.resize(this->slotSize);
+
+    /* What components print while they clock is rolled back with them, so
+     * it is kept in memory until the end. */
+    char* clockOutput = NULL;
+    size_t clockOutputSize = 0;
+    FILE* console = stdout;
+    FILE* memoryStream = open_memstream(&clockOutput, &clockOutputSize);
+    if (!memoryStream) {
+        fprintf(stderr, "Could not open the output stream of partition %d: "
+                        "%s.\n",
+                partition, strerror(errno));
+        this->Fail();
+        return 1;
+    }
+    stdout = memoryStream;
+
+    std::vector<long> own;
+    unsigned long count = this->topology->GetNumberOfComponents();
+    for (unsigned long i = 0; i < count; ++i) {
+        if (this->partitions[i] == partition) own.push_back(i);
+    }
+
+    unsigned long end = cycles * count;
+    unsigned long window = WINDOW_INTERVALS * this->snapshotInterval * count;
+    unsigned long cycle = 0;
+    unsigned long position = 0;
+    unsigned long snapshotCycle = ULONG_MAX;
+    int spins = 0;
+
+    for (;;) {
+        if (this->HasFailed()) return STOPPED;
+        if (this->ReadInputs()) return STOPPED;
+
+        this->nextTick = (cycle == cycles) ? end : cycle * count + own[position];
+        this->state->lvt.store(this->nextTick, std::memory_order_release);
+        unsigned long gvt = this->shared->gvt.load(std::memory_order_acquire);
+        if (gvt != this->collected) this->CollectFossils(gvt);
+
+        if (cycle == cycles || cycle * count > gvt + window) {
+            /* Stragglers may still come until every partition is done. */
+            if (cycle == cycles && gvt >= end) break;
+            if (this->Pause(&spins)) return STOPPED;
+            continue;
+        }
+
+        if (position == 0 && snapshotCycle != cycle &&
+            (cycle % this->snapshotInterval == 0 || this->IsLogFilling())) {
+            snapshotCycle = cycle;
+            if (this->TakeSnapshot(cycle * count)) {
+                this->Fail();
+                return 1;
+            }
+            /* A resumed snapshot reads the inputs again. */
+            continue;
+        }
+
+        if (this->Clock(own[position], this->nextTick)) return STOPPED;
+        if (++position == own.size()) {
+            position = 0;
+            ++cycle;
+        }
+    }
+
+    fclose(memoryStream);
+    stdout = console;
+
+    /* The output of the partitions, in their order, then the statistics in
+     * the order of the topology. */
+    if (this->WaitTurn(numberOfRuns + partition)) return STOPPED;
+    fwrite(clockOutput, 1, clockOutputSize, stdout);
+    fflush(stdout);
+    free(clockOutput);
+    this->PassTurn(numberOfRuns + partition);
+
+    for (unsigned long r = 0; r < ownRuns.size(); ++r) {
+        unsigned long turn =
+            numberOfRuns + this->numberOfPartitions + ownRuns[r];
+        if (this->WaitTurn(turn)) return STOPPED;
+        const Run& run = this->runs[ownRuns[r]];
+        for (long i = run.first; i < run.end; ++i) {
+            printf("# %s\n", this->topology->GetComponentName(i));
+            this->topology->GetComponent(i)->PrintStatistics();
+        }
+        fflush(stdout);
+        this->PassTurn(turn);
+    }
+
+    this->state->finished.store(1);
+    return 0;
+};
+
+int sinuca::partition::OptimisticEngine::Simulate(unsigned long cycles) {
+    if (!this->numberOfPartitions) {
+        fprintf(stderr, "No partitions were set.\n");
+        return 1;
+    }
+    if (this->MapControl()) return 1;
+
+    unsigned long numberOfChannels = this->channelSources.size();
+    if (!this->shared) {
+        unsigned long bytes =
+            sizeof(TimeWarpControl) +
+            this->numberOfPartitions * sizeof(TimeWarpPartition) +
+            numberOfChannels * sizeof(TimeWarpChannel) +
+            numberOfChannels * LOG_ENTRIES * this->slotSize;
+        void* pages = memory::MapSharedPages(bytes, &this->sharedMapped);
+        if (!pages) return 1;
+        char* position = static_cast<char*>(pages);
+        this->shared = reinterpret_cast<TimeWarpControl*>(position);
+        position += sizeof(TimeWarpControl);
+        this->states = reinterpret_cast<TimeWarpPartition*>(position);
+        position += this->numberOfPartitions * sizeof(TimeWarpPartition);
+        this->channels = reinterpret_cast<TimeWarpChannel*>(position);
+        position += numberOfChannels * sizeof(TimeWarpChannel);
+        this->slots = position;
+    }
+    new (this->shared) TimeWarpControl();
+    for (int i = 0; i < this->numberOfPartitions; ++i)
+        new (&this->states[i]) TimeWarpPartition();
+    for (unsigned long i = 0; i < numberOfChannels; ++i)
+        new (&this->channels[i]) TimeWarpChannel();
+
+    fflush(stdout);
+    fflush(stderr);
+
+    /* Rolled back processes exit before the snapshots they resumed, which
+     * are then adopted here. */
+    prctl(PR_SET_CHILD_SUBREAPER, 1);
+    this->simulator = getpid();
+    int error = 0;
+    for (int i = 0; i < this->numberOfPartitions; ++i) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            int status = this->RunPartition(i, cycles);
+            fflush(stdout);
+            for (unsigned long s = 0; s < this->snapshots.size(); ++s)
+                this->KillSnapshot(this->snapshots[s]);
+            _exit(status);
+        }
+        if (pid < 0) {
+            fprintf(stderr, "Could not fork partition %d: %s.\n", i,
+                    strerror(errno));
+            this->Fail();
+            error = 1;
+            break;
+        }
+    }
+
+    while (!error) {
+        int finished = 0;
+        for (int i = 0; i < this->numberOfPartitions; ++i)
+            finished += this->states[i].finished.load();
+        if (finished == this->numberOfPartitions) break;
+
+        unsigned long gvt = this->ComputeGVT();
+        if (gvt > this->shared->gvt.load(std::memory_order_relaxed))
+            this->shared->gvt.store(gvt, std::memory_order_release);
+
+        int status;
+        pid_t pid;
+        while (!error && (pid = waitpid(-1, &status, WNOHANG)) > 0) {
+            int partition = -1;
+            for (int i = 0; i < this->numberOfPartitions; ++i) {
+                if (this->states[i].running.load() == pid) partition = i;
+            }
+
+            /* Snapshots are killed when freed or discarded, and rolled back
+             * processes exit. */
+            if (WIFEXITED(status) && (WEXITSTATUS(status) == 0 ||
+                                      WEXITSTATUS(status) == STOPPED))
+                continue;
+            if (WIFSIGNALED(status) && WTERMSIG(status) == SIGKILL &&
+                partition < 0)
+                continue;
+
+            error = 1;
+            if (WIFSIGNALED(status)) {
+                fprintf(stderr, "Partition %d was killed by signal %d (%s).\n",
+                        partition, WTERMSIG(status),
+                        strsignal(WTERMSIG(status)));
+            } else {
+                fprintf(stderr, "Partition %d failed.\n", partition);
+            }
+        }
+        if (this->HasFailed()) error = 1;
+
+        struct timespec period = {0, GVT_PERIOD_NS};
+        nanosleep(&period, NULL);
+    }
+
+    /* Processes kill their snapshots as they exit, and the snapshots of a
+     * process that died exit once they see the failure. */
+    if (error) this->Fail();
+    for (;;) {
+        int status;
+        pid_t pid = waitpid(-1, &status, 0);
+        if (pid < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if ((WIFEXITED(status) && WEXITSTATUS(status) != 0 &&
+             WEXITSTATUS(status) != STOPPED) ||
+            (WIFSIGNALED(status) && WTERMSIG(status) != SIGKILL))
+            error = 1;
+    }
+    prctl(PR_SET_CHILD_SUBREAPER, 0);
+
+    unsigned long rollbacks = 0, rolledBack = 0, snapshots = 0, events = 0,
+                  antiMessages = 0;
+    for (int i = 0; i < this->numberOfPartitions; ++i) {
+        rollbacks += this->states[i].rollbacks.load();
+        rolledBack += this->states[i].rolledBackTicks.load();
+        snapshots += this->states[i].snapshots.load();
+        events += this->states[i].events.load();
+        antiMessages += this->states[i].antiMessages.load();
+    }
+    unsigned long count = this->topology->GetNumberOfComponents();
+    fprintf(stderr,
+            "Time Warp: %lu rollbacks, %lu cycles rolled back, %lu "
+            "snapshots, %lu events, %lu anti-messages\n",
+            rollbacks, count ? rolledBack / count : 0, snapshots, events,
+            antiMessages);
+
+    return error;
+};
+
+sinuca::partition::OptimisticEngine::~OptimisticEngine() {
+    if (this->shared) memory::UnmapPages(this->shared, this->sharedMapped);
+};
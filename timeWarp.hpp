@@ -0,0 +1,305 @@
+#ifndef SINUCA3_ENGINE_TIME_WARP_HPP_
+#define SINUCA3_ENGINE_TIME_WARP_HPP_
+
+//
+// Copyright (C) 2024  HiPES - Universidade Federal do Paraná
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/**
+ * @file timeWarp.hpp
+ * @brief Clocks the partitions of a topology optimistically, in the manner of
+ * Time Warp.
+ * @details Unlike the PartitionedEngine, the processes do not take turns:
+ * each one clocks its components as fast as it can and repairs the cycles it
+ * got wrong. The topology is built with private connections, so every
+ * process has its own copy of every buffer. A buffer whose producer and
+ * consumer are in different partitions is kept in sync by events, written to
+ * a log in shared memory per pair of partitions: the messages the producer
+ * enqueued and the number of messages the consumer dequeued, each stamped
+ * with its tick. The tick of component i in cycle c is c * components + i,
+ * the position of its clock in the order of the Engine, and an event is
+ * applied to the copy before the first component with a later tick.
+ *
+ * An event with a tick older than the last component the process clocked is
+ * a straggler: the process rolls back. Its state is saved every
+ * snapshotInterval cycles by forking, and sooner when it read a quarter of a
+ * log since the last time, so a snapshot is a stopped copy of the process
+ * that shares its unchanged pages. Rolling back sends an
+ * anti-message to the other partitions, which cancels every event of the
+ * process after the straggler, resumes the newest snapshot old enough and
+ * exits. The snapshot clocks again up to the straggler without sending the
+ * events it already sent, then goes on. An anti-message that cancels an
+ * event already applied rolls the receiver back in turn.
+ *
+ * The parent computes the global virtual time (GVT), the oldest tick any
+ * process may still roll back to, from the progress of the processes and the
+ * events not read yet. Snapshots and log entries older than it are fossils
+ * and freed, and processes do not run more than a few snapshot intervals
+ * ahead of it. The run ends when the GVT passes the last cycle, and the
+ * statistics are the ones of a single process, given that components only
+ * interact through their connections.
+ *
+ * What components print while they clock is kept in memory with the state
+ * of the process and printed at the end, per partition, before the
+ * statistics. The restrictions of the PartitionedEngine apply, and each
+ * component is clocked as a whole (PreClock, Clock and PosClock) at its
+ * tick. Connections
+ * between partitions must carry fixed-size messages. Only weakly coupled
+ * topologies, whose partitions rarely exchange messages, roll back rarely
+ * enough to run in parallel: dequeue events come from the consumer of every
+ * such buffer, and a late one rolls the producer back whether or not it
+ * looked at the occupancy. Coupled topologies clock each cycle many times.
+ */
+
+#include <sys/types.h>
+
+#include <deque>
+#include <vector>
+
+#include "partition.hpp"
+
+namespace sinuca {
+namespace partition {
+
+struct TimeWarpControl;
+struct TimeWarpPartition;
+struct TimeWarpChannel;
+
+/** Default cycles between the snapshots of a partition. */
+static const unsigned long TIME_WARP_SNAPSHOT_INTERVAL = 256;
+
+/**
+ * @brief Runs a topology split in partitions, one optimistic process each.
+ */
+class OptimisticEngine : public PartitionedEngine {
+  private:
+    /** A buffer written in a partition and read in another. */
+    struct CrossBuffer {
+        CircularBuffer* buffer;
+        int messageSize;
+        int producerChannel; /**< Carries its messages to the consumer. */
+        int consumerChannel; /**< Carries its dequeues to the producer. */
+    };
+
+    /** An event read from a channel and not applied yet. */
+    struct PendingEvent {
+        unsigned long tick;
+        int kind;
+        int buffer;
+        int count;
+        std::vector<char> message;
+    };
+
+    /** A channel the running partition reads. */
+    struct Input {
+        int channel;
+        unsigned long cursor; /**< Next entry of the log to read. */
+        unsigned long known;  /**< Entries read before the last rollback. */
+        std::deque<PendingEvent> pending;
+        std::deque<unsigned long> applied; /**< Ticks, since the GVT. */
+    };
+
+    /** A stopped copy of the running partition. */
+    struct Snapshot {
+        pid_t process;
+        int command;        /**< Write end of the pipe it waits on. */
+        unsigned long tick; /**< Of the first cycle it has not clocked. */
+        std::vector<unsigned long> cursors; /**< Of the inputs. */
+    };
+
+    unsigned long snapshotInterval;
+    std::vector<CrossBuffer> crossBuffers;
+    std::vector<std::vector<int> > produced; /**< Per component. */
+    std::vector<std::vector<int> > consumed; /**< Per component. */
+    std::vector<int> channelSources;         /**< Partitions. */
+    std::vector<int> channelDestinations;    /**< Partitions. */
+    unsigned long slotSize;
+
+    TimeWarpControl* shared;
+    unsigned long sharedMapped;
+    TimeWarpPartition* states; /**< Per partition, in shared. */
+    TimeWarpChannel* channels; /**< In shared. */
+    char* slots;               /**< The logs, in shared. */
+    pid_t simulator;           /**< Outlives the processes. */
+
+    /* The state of the running process, saved with its snapshots. */
+    TimeWarpPartition* state;
+    std::vector<Input> inputs;
+    std::vector<int> outputs; /**< Channels. */
+    std::vector<Snapshot> snapshots;
+    unsigned long lastTick; /**< Of the last component clocked. */
+    unsigned long nextTick; /**< Of the next one. */
+    bool coasting;          /**< Clocking again what was already sent. */
+    unsigned long coastUntil;
+    unsigned long collected; /**< GVT of the last CollectFossils. */
+    std::vector<int> occupations;
+    std::vector<char> discarded; /**< Dequeued messages. */
+
+    /**
+     * @brief Spins, and now and then yields.
+     * @returns Non-zero if another process failed or the simulator is gone.
+     */
+    int Pause(int* spins) const;
+
+    int AddCrossBuffer(CircularBuffer* buffer, int messageSize, long producer,
+                       long consumer);
+
+    /**
+     * @returns The channel from a partition to another, added if needed.
+     */
+    int GetChannel(int source, int destination);
+
+    char* GetSlot(int channel, unsigned long entry) const;
+
+    /**
+     * @brief Appends an event to a log, waiting while it is full.
+     * @details The reader frees the log up to its oldest snapshot kept, as
+     * the GVT moves. The run fails when the log is full and the GVT stops
+     * moving, as it does when the writer is the oldest process.
+     * @returns Non-zero if the log stays full or another process failed.
+     */
+    int Send(int channel, unsigned long tick, int kind, int buffer, int count,
+             const void* message);
+
+    /**
+     * @brief Cancels the events sent after a tick, on every output.
+     * @returns Non-zero if another process failed.
+     */
+    int SendAntiMessages(unsigned long tick);
+
+    /**
+     * @brief Reads every new event, rolling back (and never returning) on a
+     * straggler.
+     * @returns Non-zero if another process failed.
+     */
+    int ReadInputs();
+
+    void ApplyPending(unsigned long tick);
+
+    /**
+     * @brief Clocks a component and sends the changes to its buffers
+     * between partitions.
+     * @returns Non-zero if another process failed.
+     */
+    int Clock(long component, unsigned long tick);
+
+    /**
+     * @brief Forks a snapshot. Returns in the running process and, when a
+     * rollback resumes it, in the snapshot.
+     * @returns Non-zero on error.
+     */
+    int TakeSnapshot(unsigned long tick);
+
+    /**
+     * @brief Resumes the newest snapshot that did not clock past the
+     * straggler and exits.
+     */
+    void RollBack(unsigned long straggler);
+
+    void KillSnapshot(const Snapshot& snapshot);
+
+    /**
+     * @returns If an input was read far past the newest snapshot, which
+     * keeps its log from being freed.
+     */
+    bool IsLogFilling() const;
+
+    /**
+     * @brief Frees the snapshots and log entries older than the GVT.
+     */
+    void CollectFossils(unsigned long gvt);
+
+    /**
+     * @returns The GVT, or a tick before it when the processes moved while it
+     * was computed.
+     */
+    unsigned long ComputeGVT() const;
+
+    /**
+     * @brief The body of the process of a partition.
+     * @returns Its exit status.
+     */
+    int RunPartition(int partition, unsigned long cycles);
+
+  public:
+    /**
+     * @param topology Built with private connections and without
+     * FinishSetup.
+     */
+    OptimisticEngine(config::Topology* topology)
+        : PartitionedEngine(topology),
+          snapshotInterval(TIME_WARP_SNAPSHOT_INTERVAL),
+          slotSize(0),
+          shared(NULL),
+          sharedMapped(0),
+          states(NULL),
+          channels(NULL),
+          slots(NULL),
+          simulator(0),
+          state(NULL),
+          lastTick(0),
+          nextTick(0),
+          coasting(false),
+          coastUntil(0),
+          collected(0){};
+
+    /**
+     * @brief Assigns the components to partitions, as
+     * PartitionedEngine::SetPartitions does, and finds the buffers between
+     * them.
+     * @returns Non-zero on error, 0 otherwise.
+     */
+    int SetPartitions(int numberOfPartitions);
+
+    /**
+     * @brief Sets the cycles between the snapshots of a partition. Longer
+     * intervals fork less and roll back further.
+     */
+    inline void SetSnapshotInterval(unsigned long cycles) {
+        this->snapshotInterval = cycles ? cycles : 1;
+    };
+
+    /**
+     * @brief Self-explanatory
+     */
+    inline unsigned long GetSnapshotInterval() const {
+        return this->snapshotInterval;
+    };
+
+    /**
+     * @brief Self-explanatory
+     */
+    inline unsigned long GetNumberOfCrossBuffers() const {
+        return this->crossBuffers.size();
+    };
+
+    /**
+     * @brief Forks the processes, which finish their components, simulate the
+     * given number of cycles and print the statistics, and computes the GVT
+     * until they are done.
+     * @details Rollbacks, snapshots and events are reported to stderr. When a
+     * process fails or dies, the others stop.
+     * @returns Non-zero if a process failed, 0 otherwise.
+     */
+    int Simulate(unsigned long cycles);
+
+    ~OptimisticEngine();
+};
+
+}  // namespace partition
+}  // namespace sinuca
+
+#endif  // SINUCA3_ENGINE_TIME_WARP_HPP_
@@ -0,0 +1,337 @@
+//
+// Copyright (C) 2024  HiPES - Universidade Federal do Paraná
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/**
+ * @file trace.cpp
+ * @brief Implementation of the trace rings, flusher and JSON converter.
+ * @details The binary file starts with a TraceFileHeader, followed by blocks.
+ * Each block is a TraceBlockHeader followed by either count TraceEvents of
+ * one thread or a component name of count bytes.
+ */
+
+#include "trace.hpp"
+
+#include <cerrno>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+static const char TRACE_MAGIC[8] = {'S', 'N', 'C', '3', 'T', 'R', 'C', '1'};
+static const uint32_t TRACE_BLOCK_EVENTS = 1;
+static const uint32_t TRACE_BLOCK_NAME = 2;
+static const int FLUSH_INTERVAL_US = 200;
+
+struct TraceFileHeader {
+    char magic[8];
+    uint64_t baseTimestamp; /**< Timestamp of Start. */
+    double nsPerTick;       /**< Filled by Stop. */
+};
+
+struct TraceBlockHeader {
+    uint32_t kind;
+    uint32_t id; /**< Thread for events, component for names. */
+    uint32_t count;
+    uint32_t reserved;
+};
+
+std::atomic<bool> sinuca::trace::traceEnabled(false);
+thread_local sinuca::trace::TraceRing* sinuca::trace::threadRing = NULL;
+
+static std::mutex traceMutex; /**< Protects rings and traceFile. */
+static std::vector<sinuca::trace::TraceRing*> rings;
+static FILE* traceFile = NULL;
+static std::thread flusher;
+static std::atomic<bool> flusherRunning(false);
+static TraceFileHeader fileHeader;
+static std::chrono::steady_clock::time_point startTime;
+
+sinuca::trace::TraceRing* sinuca::trace::GetThreadRing() {
+    /* Rings are never freed, so a thread keeps a valid pointer forever. */
+    TraceRing* ring = new TraceRing();
+    ring->head.store(0);
+    ring->tail.store(0);
+    ring->dropped = 0;
+
+    std::lock_guard<std::mutex> lock(traceMutex);
+    ring->thread = rings.size();
+    rings.push_back(ring);
+
+    return ring;
+};
+
+static void WriteBlock(uint32_t kind, uint32_t id, uint32_t count,
+                       const void* data, size_t size) {
+    TraceBlockHeader header;
+    header.kind = kind;
+    header.id = id;
+    header.count = count;
+    header.reserved = 0;
+
+    fwrite(&header, sizeof(header), 1, traceFile);
+    fwrite(data, size, 1, traceFile);
+};
+
+/**
+ * @details Called with traceMutex held.
+ */
+static void DrainRing(sinuca::trace::TraceRing* ring) {
+    unsigned long head = ring->head.load(std::memory_order_acquire);
+    unsigned long tail = ring->tail.load(std::memory_order_relaxed);
+
+    while (tail != head) {
+        unsigned long index = tail & (sinuca::trace::TRACE_RING_SIZE - 1);
+        unsigned long count = head - tail;
+        if (index + count > sinuca::trace::TRACE_RING_SIZE)
+            count = sinuca::trace::TRACE_RING_SIZE - index;
+
+        WriteBlock(TRACE_BLOCK_EVENTS, ring->thread, count,
+                   &ring->events[index],
+                   count * sizeof(sinuca::trace::TraceEvent));
+        tail += count;
+    }
+
+    ring->tail.store(tail, std::memory_order_release);
+};
+
+static void FlusherLoop() {
+    while (flusherRunning.load(std::memory_order_acquire)) {
+        {
+            std::lock_guard<std::mutex> lock(traceMutex);
+            for (unsigned long i = 0; i < rings.size(); ++i)
+                DrainRing(rings[i]);
+        }
+        std::this_thread::sleep_for(
+            std::chrono::microseconds(FLUSH_INTERVAL_US));
+    }
+};
+
+int sinuca::trace::Start(const char* binaryFile) {
+    std::lock_guard<std::mutex> lock(traceMutex);
+
+    if (traceFile) return 1;
+    traceFile = fopen(binaryFile, "wb");
+    if (!traceFile) {
+        fprintf(stderr, "Could not open trace file %s: %s\n", binaryFile,
+                strerror(errno));
+        return 1;
+    }
+
+    /* Anything recorded while tracing was off is discarded. */
+    for (unsigned long i = 0; i < rings.size(); ++i) {
+        rings[i]->tail.store(rings[i]->head.load());
+        rings[i]->dropped = 0;
+    }
+
+    memcpy(fileHeader.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC));
+    startTime = std::chrono::steady_clock::now();
+    fileHeader.baseTimestamp = ReadTimestamp();
+    fileHeader.nsPerTick = 1;
+    fwrite(&fileHeader, sizeof(fileHeader), 1, traceFile);
+
+    flusherRunning.store(true);
+    flusher = std::thread(FlusherLoop);
+    traceEnabled.store(true);
+
+    return 0;
+};
+
+void sinuca::trace::NameComponent(uint32_t component, const char* name) {
+    std::lock_guard<std::mutex> lock(traceMutex);
+    if (!traceFile) return;
+    WriteBlock(TRACE_BLOCK_NAME, component, strlen(name), name, strlen(name));
+};
+
+void sinuca::trace::Stop() {
+    if (!traceEnabled.exchange(false)) return;
+
+    flusherRunning.store(false);
+    flusher.join();
+
+    uint64_t endTimestamp = ReadTimestamp();
+    double elapsed = std::chrono::duration<double, std::nano>(
+                         std::chrono::steady_clock::now() - startTime)
+                         .count();
+
+    std::lock_guard<std::mutex> lock(traceMutex);
+    unsigned long dropped = 0;
+    for (unsigned long i = 0; i < rings.size(); ++i) {
+        DrainRing(rings[i]);
+        dropped += rings[i]->dropped;
+    }
+
+    if (endTimestamp > fileHeader.baseTimestamp)
+        fileHeader.nsPerTick =
+            elapsed / (double)(endTimestamp - fileHeader.baseTimestamp);
+    fseek(traceFile, 0, SEEK_SET);
+    fwrite(&fileHeader, sizeof(fileHeader), 1, traceFile);
+    fclose(traceFile);
+    traceFile = NULL;
+
+    if (dropped) {
+        fprintf(stderr, "Trace: %lu events dropped, rings were full.\n",
+                dropped);
+    }
+};
+
+static const char* EventName(uint32_t type) {
+    switch (type) {
+        case sinuca::trace::TraceEventSendRequest:
+            return "send request";
+        case sinuca::trace::TraceEventSendResponse:
+            return "send response";
+        case sinuca::trace::TraceEventReceiveRequest:
+            return "receive request";
+        case sinuca::trace::TraceEventReceiveResponse:
+            return "receive response";
+        case sinuca::trace::TraceEventBTBHit:
+            return "btb hit";
+        case sinuca::trace::TraceEventBTBMiss:
+            return "btb miss";
+    }
+    return "unknown";
+};
+
+/**
+ * @brief Escapes a component name for a JSON string: names come from the
+ * topology file and may hold quotes, backslashes or control characters.
+ */
+static std::string EscapeJson(const std::string& text) {
+    std::string escaped;
+    escaped.reserve(text.size());
+
+    for (unsigned long i = 0; i < text.size(); ++i) {
+        unsigned char character = text[i];
+        if (character == '"' || character == '\\') {
+            escaped += '\\';
+            escaped += character;
+        } else if (character < 0x20) {
+            char code[8];
+            snprintf(code, sizeof(code), "\\u%04x", character);
+            escaped += code;
+        } else {
+            escaped += character;
+        }
+    }
+
+    return escaped;
+};
+
+int sinuca::trace::ConvertToChromeTrace(const char* binaryFile,
+                                        const char* jsonFile) {
+    FILE* input = fopen(binaryFile, "rb");
+    if (!input) {
+        fprintf(stderr, "Could not open trace file %s: %s\n", binaryFile,
+                strerror(errno));
+        return 1;
+    }
+
+    TraceFileHeader header;
+    if (fread(&header, sizeof(header), 1, input) != 1 ||
+        memcmp(header.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC)) != 0) {
+        fprintf(stderr, "%s is not a trace file.\n", binaryFile);
+        fclose(input);
+        return 1;
+    }
+
+    FILE* output = fopen(jsonFile, "w");
+    if (!output) {
+        fprintf(stderr, "Could not open %s: %s\n", jsonFile, strerror(errno));
+        fclose(input);
+        return 1;
+    }
+
+    std::unordered_map<uint32_t, std::string> names;
+    std::unordered_map<uint32_t, uint64_t> cycles; /**< Per thread. */
+    std::vector<TraceEvent> events;
+    TraceBlockHeader block;
+    bool first = true;
+
+    fprintf(output, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n");
+    while (fread(&block, sizeof(block), 1, input) == 1) {
+        if (block.kind == TRACE_BLOCK_NAME) {
+            std::string name(block.count, '\0');
+            if (fread(&name[0], 1, block.count, input) != block.count) break;
+            names[block.id] = EscapeJson(name);
+            continue;
+        }
+
+        events.resize(block.count);
+        if (fread(events.data(), sizeof(TraceEvent), block.count, input) !=
+            block.count)
+            break;
+
+        for (unsigned long i = 0; i < events.size(); ++i) {
+            const TraceEvent& event = events[i];
+            double ts = (double)(event.timestamp - header.baseTimestamp) *
+                        header.nsPerTick / 1e3;
+
+            if (event.type == TraceEventCycle) {
+                cycles[block.id] = event.argument;
+                continue;
+            }
+
+            std::unordered_map<uint32_t, std::string>::iterator name =
+                names.find(event.component);
+            std::string component = (name != names.end())
+                                        ? name->second
+                                        : std::to_string(event.component);
+
+            fprintf(output, "%s", first ? "" : ",\n");
+            first = false;
+
+            if (event.type == TraceEventClockBegin ||
+                event.type == TraceEventClockEnd) {
+                fprintf(output,
+                        "{\"name\": \"%s\", \"ph\": \"%s\", \"ts\": %.3f, "
+                        "\"pid\": 0, \"tid\": %u, \"args\": {\"cycle\": "
+                        "%" PRIu64 "}}",
+                        component.c_str(),
+                        (event.type == TraceEventClockBegin) ? "B" : "E", ts,
+                        block.id, cycles[block.id]);
+            } else if (event.type == TraceEventBTBHit ||
+                       event.type == TraceEventBTBMiss) {
+                fprintf(output,
+                        "{\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"i\", "
+                        "\"s\": \"t\", \"ts\": %.3f, \"pid\": 0, \"tid\": %u, "
+                        "\"args\": {\"address\": \"0x%" PRIx64
+                        "\", \"cycle\": %" PRIu64 "}}",
+                        EventName(event.type), component.c_str(), ts,
+                        block.id, event.argument, cycles[block.id]);
+            } else {
+                fprintf(output,
+                        "{\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"i\", "
+                        "\"s\": \"t\", \"ts\": %.3f, \"pid\": 0, \"tid\": %u, "
+                        "\"args\": {\"connection\": %" PRIu64
+                        ", \"cycle\": %" PRIu64 "}}",
+                        EventName(event.type), component.c_str(), ts,
+                        block.id, event.argument, cycles[block.id]);
+            }
+        }
+    }
+    fprintf(output, "\n]}\n");
+
+    fclose(output);
+    fclose(input);
+
+    return 0;
+};
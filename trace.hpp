@@ -0,0 +1,160 @@
+#ifndef SINUCA3_UTILS_TRACE_HPP_
+#define SINUCA3_UTILS_TRACE_HPP_
+
+//
+// Copyright (C) 2024  HiPES - Universidade Federal do Paraná
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/**
+ * @file trace.hpp
+ * @brief Cycle-level event tracing.
+ * @details Events are only recorded when the simulator is built with
+ * SINUCA3_TRACE defined (make TRACE=1); otherwise the SINUCA3_TRACE_* macros
+ * expand to nothing. Each thread appends fixed-size binary events to its own
+ * single-producer ring, which a background thread drains to a file while the
+ * simulation runs. The producer never blocks: if its ring is full the event is
+ * dropped and counted. After Stop, the binary file can be converted to the
+ * Chrome trace JSON format, readable by chrome://tracing and Perfetto.
+ */
+
+#include <atomic>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+
+namespace sinuca {
+namespace trace {
+
+enum TraceEventType {
+    TraceEventCycle,        /**< argument: the cycle that starts. */
+    TraceEventClockBegin,   /**< A component Clock() starts. */
+    TraceEventClockEnd,     /**< A component Clock() ends. */
+    TraceEventSendRequest,  /**< argument: the connection ID. */
+    TraceEventSendResponse, /**< argument: the connection ID. */
+    TraceEventReceiveRequest,
+    TraceEventReceiveResponse,
+    TraceEventBTBHit, /**< argument: the fetch address. */
+    TraceEventBTBMiss,
+};
+
+struct TraceEvent {
+    uint64_t timestamp; /**< Raw timestamp counter value. */
+    uint64_t argument;  /**< Meaning depends on type. */
+    uint32_t component; /**< Trace ID of the component. */
+    uint32_t type;      /**< A TraceEventType. */
+};
+
+static const unsigned long TRACE_RING_SIZE = 1UL << 18; /**< Events per
+                                                           thread, power of 2.
+                                                         */
+
+/**
+ * @brief Single-producer single-consumer ring of one thread.
+ */
+struct TraceRing {
+    std::atomic<unsigned long> head; /**< Written by the producer. */
+    char padding[64 - sizeof(std::atomic<unsigned long>)];
+    std::atomic<unsigned long> tail; /**< Written by the flusher. */
+    unsigned long dropped;           /**< Written by the producer. */
+    uint32_t thread;
+    TraceEvent events[TRACE_RING_SIZE];
+};
+
+extern std::atomic<bool> traceEnabled;
+extern thread_local TraceRing* threadRing; /**< NULL until the first event. */
+
+/**
+ * @brief Returns the ring of the calling thread, creating it if needed.
+ */
+TraceRing* GetThreadRing();
+
+static inline uint64_t ReadTimestamp() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+#endif
+};
+
+/**
+ * @brief Appends an event to the ring of the calling thread.
+ * @details Use the SINUCA3_TRACE_EVENT macro instead, so the call disappears
+ * when tracing is compiled out.
+ */
+inline void Record(TraceEventType type, uint32_t component,
+                   uint64_t argument) {
+    if (!traceEnabled.load(std::memory_order_relaxed)) return;
+
+    TraceRing* ring = threadRing;
+    if (!ring) ring = threadRing = GetThreadRing();
+
+    unsigned long head = ring->head.load(std::memory_order_relaxed);
+    if (head - ring->tail.load(std::memory_order_acquire) ==
+        TRACE_RING_SIZE) {
+        ++ring->dropped;
+        return;
+    }
+
+    TraceEvent& event = ring->events[head & (TRACE_RING_SIZE - 1)];
+    event.timestamp = ReadTimestamp();
+    event.argument = argument;
+    event.component = component;
+    event.type = type;
+    ring->head.store(head + 1, std::memory_order_release);
+};
+
+/**
+ * @brief Starts recording to a binary trace file.
+ * @returns Non-zero on error, 0 otherwise.
+ */
+int Start(const char* binaryFile);
+
+/**
+ * @brief Gives a name to a component trace ID, shown (escaped) in the JSON
+ * output.
+ */
+void NameComponent(uint32_t component, const char* name);
+
+/**
+ * @brief Stops recording, drains every ring and closes the binary file.
+ * @details Prints the number of dropped events, if any.
+ */
+void Stop();
+
+/**
+ * @brief Converts a binary trace file to Chrome trace JSON.
+ * @returns Non-zero on error, 0 otherwise.
+ */
+int ConvertToChromeTrace(const char* binaryFile, const char* jsonFile);
+
+}  // namespace trace
+}  // namespace sinuca
+
+#ifdef SINUCA3_TRACE
+#define SINUCA3_TRACE_EVENT(type, component, argument)               \
+    sinuca::trace::Record(sinuca::trace::type, (uint32_t)(component), \
+                          (uint64_t)(argument))
+#else
+#define SINUCA3_TRACE_EVENT(type, component, argument) ((void)0)
+#endif
+
+#endif  // SINUCA3_UTILS_TRACE_HPP_
@@ -0,0 +1,203 @@
+#include "traceFetch.hpp"
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <sys/types.h>
+#include "configLoader.hpp"
+
+SINUCA3_REGISTER_COMPONENT(TraceFetch);
+
+/* ==========================================================================
+    Trace Fetch Methods
+   ========================================================================== */
+
+TraceFetch::TraceFetch() : sinuca::Component<BTBMessage>(), btbComponent(nullptr), btb(nullptr),
+    btbConnection(0), totalBanks(0), position(0), waitingResponse(false), draining(false), numPendingWrites(0),
+    writeTargets(nullptr), writeExecuted(nullptr), nextWriteSlot(0), fetchedBlocks(0), fastForwardedBlocks(0),
+    cycles(0), stallCycles(0), hits(0), mispredictions(0) {};
+
+int TraceFetch::SetConfigParameter(const char* parameter, sinuca::config::ConfigValue value) {
+    if (strcmp(parameter, "trace") == 0) {
+        if (value.type != sinuca::config::ConfigValueTypeString) {
+            fprintf(stderr, "TraceFetch: trace must be a file name.\n");
+            return 1;
+        }
+        traceFile = value.value.string;
+        return 0;
+    }
+
+    if (strcmp(parameter, "btb") == 0) {
+        if (value.type != sinuca::config::ConfigValueTypeComponentReference) {
+            fprintf(stderr, "TraceFetch: btb must be a connection.\n");
+            return 1;
+        }
+
+        btb = dynamic_cast<BTBFunctionalInterface*>(value.value.reference.component);
+        if (!btb) {
+            fprintf(stderr, "TraceFetch: btb must be connected to a BranchTargetBuffer or HierarchicalBTB.\n");
+            return 1;
+        }
+        btbComponent = value.value.reference.component;
+        btbConnection = value.value.reference.connectionID;
+        return 0;
+    }
+
+    return Linkable::SetConfigParameter(parameter, value);
+};
+
+int TraceFetch::FinishSetup() {
+    if (traceFile.empty() || !btb) {
+        fprintf(stderr, "TraceFetch: trace and btb are required.\n");
+        return 1;
+    }
+
+    if (trace.Open(traceFile.c_str())) {
+        return 1;
+    }
+
+    /* The BTB may keep a write waiting for its ports, so the arrays it points to live for a while. */
+    totalBanks = btb->getTotalBanks();
+    writeTargets = AllocateArray<uint64_t>(BTB_RESPONSE_SLOTS * totalBanks);
+    writeExecuted = AllocateArray<bool>(BTB_RESPONSE_SLOTS * totalBanks);
+
+    return 0;
+};
+
+void TraceFetch::retireBlock(BTBMessage& response) {
+    const sinuca::BranchRecord& record = inflightRecord;
+    uint bank = record.address & (totalBanks - 1);
+    uint64_t* targets = &writeTargets[nextWriteSlot * totalBanks];
+    bool* executed = &writeExecuted[nextWriteSlot * totalBanks];
+    nextWriteSlot = (nextWriteSlot + 1) % BTB_RESPONSE_SLOTS;
+
+    BTBMessage& update = pendingWrites[numPendingWrites];
+    update.fetchAddress = record.address;
+    update.channelID = 0;
+    update.asid = record.asid;
+
+    if (response.messageType == ALLOCATED_ENTRY) {
+        ++hits;
+        if (response.validBits[bank] != (bool)record.taken || (record.taken && response.nextBlock != record.target)) {
+            ++mispredictions;
+        }
+    } else {
+        if (record.taken) {
+            ++mispredictions;
+        }
+
+        for (uint i = 0; i < totalBanks; ++i) {
+            targets[i] = record.target;
+        }
+        update.messageType = BTB_ALLOCATION_REQUEST;
+        update.fetchTargets = targets;
+        ++numPendingWrites;
+    }
+
+    for (uint i = 0; i < totalBanks; ++i) {
+        executed[i] = true;
+    }
+    executed[bank] = record.taken;
+
+    BTBMessage& train = pendingWrites[numPendingWrites];
+    train.fetchAddress = record.address;
+    train.channelID = 0;
+    train.asid = record.asid;
+    train.messageType = BTB_UPDATE_REQUEST;
+    train.executedInstructions = executed;
+    ++numPendingWrites;
+};
+
+void TraceFetch::Clock() {
+    const sinuca::engine::ConnectionHandle& handle = ResolveConnectionToComponent(btbComponent, btbConnection);
+    BTBMessage message;
+    ++cycles;
+
+    if (waitingResponse) {
+        if (!ReceiveResponseByHandle(handle, &message)) {
+            ++stallCycles;
+            return;
+        }
+        waitingResponse = false;
+        retireBlock(message);
+    }
+
+    /* Writes go in order, before the next lookup, so the lookup sees them. */
+    uint sent = 0;
+    while (sent < numPendingWrites && SendRequestByHandle(handle, &pendingWrites[sent])) {
+        ++sent;
+    }
+    if (sent < numPendingWrites) {
+        for (uint i = sent; i < numPendingWrites; ++i) {
+            pendingWrites[i - sent] = pendingWrites[i];
+        }
+        numPendingWrites -= sent;
+        ++stallCycles;
+        return;
+    }
+    numPendingWrites = 0;
+
+    if (draining || position >= trace.GetCount()) {
+        return;
+    }
+
+    inflightRecord = trace.GetRecords()[position];
+    message.channelID = 0;
+    message.fetchAddress = inflightRecord.address;
+    message.messageType = BTB_REQUEST;
+    message.asid = inflightRecord.asid;
+    if (SendRequestByHandle(handle, &message)) {
+        ++position;
+        ++fetchedBlocks;
+        waitingResponse = true;
+    } else {
+        ++stallCycles;
+    }
+};
+
+unsigned long TraceFetch::FastForward(unsigned long instructions) {
+    unsigned long end = position + instructions;
+    if (end > trace.GetCount()) {
+        end = trace.GetCount();
+    }
+
+    const sinuca::BranchRecord* records = trace.GetRecords();
+    unsigned long skipped = end - position;
+    for (; position < end; ++position) {
+        btb->warmUpBranch(records[position].address, records[position].target, records[position].taken,
+                          records[position].asid);
+    }
+    fastForwardedBlocks += skipped;
+
+    return skipped;
+};
+
+unsigned long TraceFetch::GetInstructionCount() const {
+    return fetchedBlocks + fastForwardedBlocks;
+};
+
+bool TraceFetch::IsFinished() const {
+    return position >= trace.GetCount() && !waitingResponse && !numPendingWrites;
+};
+
+bool TraceFetch::IsDrained() const {
+    return !waitingResponse && !numPendingWrites;
+};
+
+void TraceFetch::SetDraining(bool draining) {
+    this->draining = draining;
+};
+
+void TraceFetch::PrintStatistics() {
+    printf("fetch.cycles: %lu\n", cycles);
+    printf("fetch.blocks: %lu\n", fetchedBlocks);
+    printf("fetch.fast_forwarded_blocks: %lu\n", fastForwardedBlocks);
+    printf("fetch.stall_cycles: %lu\n", stallCycles);
+    printf("fetch.btb_hits: %lu\n", hits);
+    printf("fetch.mispredictions: %lu\n", mispredictions);
+    printf("fetch.blocks_per_cycle: %.4f\n", cycles ? (double)fetchedBlocks / cycles : 0.0);
+};
+
+TraceFetch::~TraceFetch() {
+    sinuca::memory::Free(writeTargets);
+    sinuca::memory::Free(writeExecuted);
+};
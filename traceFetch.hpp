@@ -0,0 +1,91 @@
+#ifndef TRACE_FETCH
+#define TRACE_FETCH
+
+/**
+ * @file traceFetch.hpp
+ * @brief Fetch stage driven by a branch trace, the front-end of the BTB models
+ */
+#include <cstdint>
+#include <string>
+#include <sys/types.h>
+#include "branchTrace.hpp"
+#include "interleavedBTB.hpp"
+
+/**
+ * @brief Fetches the blocks of a branch trace through a BTB
+ * @details In timing mode, each trace record is a fetch block: a lookup is sent to the BTB, and once its response
+ * arrives the block is allocated (on a miss) and the predictor updated with more messages. Only one lookup is in
+ * flight, so the BTB latency and port conflicts show up as fetch cycles. In functional mode (FastForward) the
+ * records go straight to BTBFunctionalInterface::warmUpBranch. An instruction, for the engine, is a trace record,
+ * counted when its lookup is sent; while draining, the lookup in flight and its writes finish but no new one is sent.
+ * Every message carries the ASID of its record, so the threads of a trace share one BTB in a single pass.
+ */
+class TraceFetch : public sinuca::Component<BTBMessage> {
+    private:
+        sinuca::BranchTraceReader trace;
+        std::string traceFile;            /**< Copied, config strings only live during the call. */
+        sinuca::engine::Linkable* btbComponent;
+        BTBFunctionalInterface* btb;
+        int btbConnection;
+        uint totalBanks;
+
+        unsigned long position;           /**< Next record of the trace. */
+        bool waitingResponse;
+        bool draining;                    /**< No new lookups, see Linkable::SetDraining. */
+        sinuca::BranchRecord inflightRecord;
+        BTBMessage pendingWrites[2];      /**< Allocation and update waiting for room in the connection. */
+        uint numPendingWrites;
+        uint64_t* writeTargets;           /**< BTB_RESPONSE_SLOTS arrays of one target per bank. */
+        bool* writeExecuted;              /**< BTB_RESPONSE_SLOTS arrays of one bit per bank. */
+        uint nextWriteSlot;
+
+        unsigned long fetchedBlocks;      /**< Records looked up in timing mode. */
+        unsigned long fastForwardedBlocks;
+        unsigned long cycles;
+        unsigned long stallCycles;        /**< Cycles waiting for the BTB. */
+        unsigned long hits;
+        unsigned long mispredictions;
+
+        /**
+         * @brief Accounts a BTB response and queues the writes it requires
+         */
+        void retireBlock(BTBMessage& response);
+
+    public:
+        TraceFetch();
+
+        /**
+         * @brief Reads trace (file name) and btb (connection to a BranchTargetBuffer or HierarchicalBTB)
+         */
+        int SetConfigParameter(const char* parameter, sinuca::config::ConfigValue value) override;
+
+        /**
+         * @brief Opens the trace
+         */
+        int FinishSetup() override;
+
+        void Clock() override;
+
+        unsigned long FastForward(unsigned long instructions) override;
+        unsigned long GetInstructionCount() const override;
+
+        /**
+         * @return True when the trace is over and nothing is left to send
+         */
+        bool IsFinished() const override;
+
+        /**
+         * @return True when no lookup is in flight and no write waits to be sent
+         */
+        bool IsDrained() const override;
+        void SetDraining(bool draining) override;
+
+        /**
+         * @brief Prints the fetched blocks of each mode, stalls, hits and mispredictions
+         */
+        void PrintStatistics() override;
+
+        ~TraceFetch();
+};
+
+#endif
@@ -0,0 +1,334 @@
+//
+// Copyright (C) 2024  HiPES - Universidade Federal do Paraná
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/**
+ * @file traffic.cpp
+ * @brief Implementation of the traffic components.
+ */
+
+#include "traffic.hpp"
+
+#include <cstdio>
+#include <cstring>
+
+#include "configLoader.hpp"
+
+using sinuca::TrafficGenerator;
+using sinuca::TrafficSink;
+SINUCA3_REGISTER_COMPONENT(TrafficSink);
+SINUCA3_REGISTER_COMPONENT(TrafficGenerator);
+
+/**
+ * @brief Reads an integer or a number.
+ * @returns Non-zero if the value is neither.
+ */
+static int ReadNumber(sinuca::config::ConfigValue value, double* number) {
+    if (value.type == sinuca::config::ConfigValueTypeInteger) {
+        *number = value.value.integer;
+        return 0;
+    }
+    if (value.type == sinuca::config::ConfigValueTypeNumber) {
+        *number = value.value.number;
+        return 0;
+    }
+    return 1;
+};
+
+sinuca::TrafficSink::TrafficSink()
+    : bandwidth(0),
+      cycle(0),
+      receivedRequests(0),
+      receivedBytes(0),
+      sentResponses(0){};
+
+int sinuca::TrafficSink::SetConfigParameter(const char* parameter,
+                                            config::ConfigValue value) {
+    if (strcmp(parameter, "bandwidth") == 0) {
+        if (value.type != config::ConfigValueTypeInteger ||
+            value.value.integer < 0) {
+            fprintf(stderr, "TrafficSink: bandwidth must be an integer >= "
+                            "0.\n");
+            return 1;
+        }
+        this->bandwidth = value.value.integer;
+        return 0;
+    }
+
+    return engine::Linkable::SetConfigParameter(parameter, value);
+};
+
+int sinuca::TrafficSink::FinishSetup() { return 0; };
+
+void sinuca::TrafficSink::Consume() {
+    long taken = 0;
+
+    this->ForEachReadyRequest([&](int id) {
+        if (this->bandwidth && taken >= this->bandwidth) return;
+        const engine::ConnectionHandle& handle = this->ResolveConnection(id);
+
+        if (handle.requestInputRing) {
+            int length;
+            const TrafficMessage* request = static_cast<TrafficMessage*>(
+                this->PeekRequestByHandle(handle, &length));
+            if (request->wantsResponse) {
+                void* response =
+                    this->ReserveResponseByHandle(handle, sizeof(*request));
+                if (!response) return;
+                memcpy(response, request, sizeof(*request));
+                this->CommitResponseByHandle(handle, sizeof(*request));
+                ++this->sentResponses;
+            }
+            this->receivedBytes += length;
+            this->ReleaseRequestByHandle(handle);
+        } else {
+            /* A fixed-size request cannot go back once received. */
+            if (handle.responseOutput->IsFullForSender()) return;
+
+            TrafficMessage request;
+            this->ReceiveRequestByHandle(handle, &request);
+            if (request.wantsResponse) {
+                this->SendResponseByHandle(handle, &request);
+                ++this->sentResponses;
+            }
+            this->receivedBytes += request.size;
+        }
+
+        ++this->receivedRequests;
+        ++taken;
+    });
+};
+
+void sinuca::TrafficSink::Clock() {
+    ++this->cycle;
+    this->Consume();
+};
+
+void sinuca::TrafficSink::PrintStatistics() {
+    printf("traffic.received_requests: %lu\n", this->receivedRequests);
+    printf("traffic.received_bytes: %lu\n", this->receivedBytes);
+    printf("traffic.sent_responses: %lu\n", this->sentResponses);
+};
+
+bool sinuca::TrafficSink::ExpectsResponse(const void* request) const {
+    return static_cast<const TrafficMessage*>(request)->wantsResponse;
+};
+
+sinuca::TrafficGenerator::TrafficGenerator()
+    : rate(0.1),
+      size(sizeof(TrafficMessage)),
+      responseRatio(1.0),
+      maxOutstanding(16),
+      messages(0),
+      blocked(false),
+      blockedTarget(0),
+      outstanding(0),
+      sentRequests(0),
+      sentBytes(0),
+      receivedResponses(0),
+      latencySum(0),
+      stallCycles(0) {
+    this->random.state = 1;
+};
+
+int sinuca::TrafficGenerator::SetConfigParameter(const char* parameter,
+                                                 config::ConfigValue value) {
+    if (strncmp(parameter, "target", 6) == 0) {
+        if (value.type != config::ConfigValueTypeComponentReference) {
+            fprintf(stderr, "TrafficGenerator: %s must be a connection.\n",
+                    parameter);
+            return 1;
+        }
+        Target target;
+        target.component = value.value.reference.component;
+        target.connectionID = value.value.reference.connectionID;
+        this->targets.push_back(target);
+        return 0;
+    }
+
+    if (strcmp(parameter, "rate") == 0 ||
+        strcmp(parameter, "responseRatio") == 0) {
+        double number;
+        if (ReadNumber(value, &number) || number < 0) {
+            fprintf(stderr, "TrafficGenerator: %s must be a number >= 0.\n",
+                    parameter);
+            return 1;
+        }
+        if (parameter[0] == 'r' && parameter[1] == 'a') {
+            this->rate = number;
+        } else {
+            this->responseRatio = number;
+        }
+        return 0;
+    }
+
+    if (strcmp(parameter, "size") == 0) {
+        if (value.type != config::ConfigValueTypeInteger ||
+            value.value.integer < (long)sizeof(TrafficMessage) ||
+            value.value.integer > 0x7fffffffL) {
+            fprintf(stderr, "TrafficGenerator: size must be at least %lu.\n",
+                    sizeof(TrafficMessage));
+            return 1;
+        }
+        this->size = value.value.integer;
+        return 0;
+    }
+
+    if (strcmp(parameter, "outstanding") == 0 ||
+        strcmp(parameter, "messages") == 0 ||
+        strcmp(parameter, "seed") == 0) {
+        if (value.type != config::ConfigValueTypeInteger ||
+            value.value.integer < 0) {
+            fprintf(stderr, "TrafficGenerator: %s must be an integer >= 0.\n",
+                    parameter);
+            return 1;
+        }
+        if (parameter[0] == 'o') {
+            this->maxOutstanding = value.value.integer;
+        } else if (parameter[0] == 'm') {
+            this->messages = value.value.integer;
+        } else {
+            this->random.state = value.value.integer;
+        }
+        return 0;
+    }
+
+    return TrafficSink::SetConfigParameter(parameter, value);
+};
+
+int sinuca::TrafficGenerator::FinishSetup() {
+    if (this->rate > 0 && this->targets.empty()) {
+        fprintf(stderr, "TrafficGenerator: a rate needs a target.\n");
+        return 1;
+    }
+
+    for (unsigned long i = 0; i < this->targets.size(); ++i) {
+        Target& target = this->targets[i];
+        target.handle = this->ResolveConnectionToComponent(
+            target.component, target.connectionID);
+        if (target.handle.requestOutputRing &&
+            target.handle.requestOutputRing->GetMaxLength() < this->size) {
+            fprintf(stderr,
+                    "TrafficGenerator: a request of %d bytes does not fit "
+                    "in a ring of %d bytes.\n",
+                    this->size,
+                    target.handle.requestOutputRing->GetCapacity());
+            return 1;
+        }
+    }
+
+    return TrafficSink::FinishSetup();
+};
+
+bool sinuca::TrafficGenerator::Send(int target, TrafficMessage* message) {
+    const engine::ConnectionHandle& handle = this->targets[target].handle;
+
+    if (handle.requestOutputRing) {
+        void* record = this->ReserveRequestByHandle(handle, message->size);
+        if (!record) return false;
+        memcpy(record, message, sizeof(*message));
+        this->CommitRequestByHandle(handle, message->size);
+    } else if (!this->SendRequestByHandle(handle, message)) {
+        return false;
+    }
+
+    ++this->sentRequests;
+    this->sentBytes += message->size;
+    return true;
+};
+
+void sinuca::TrafficGenerator::ReceiveResponses(
+    const engine::ConnectionHandle& handle) {
+    if (handle.responseInputRing) {
+        int length;
+        const TrafficMessage* response;
+        while ((response = static_cast<TrafficMessage*>(
+                    this->PeekResponseByHandle(handle, &length)))) {
+            this->latencySum += this->cycle - response->cycle;
+            this->ReleaseResponseByHandle(handle);
+            ++this->receivedResponses;
+            --this->outstanding;
+        }
+        return;
+    }
+
+    TrafficMessage response;
+    while (this->ReceiveResponseByHandle(handle, &response)) {
+        this->latencySum += this->cycle - response.cycle;
+        ++this->receivedResponses;
+        --this->outstanding;
+    }
+};
+
+void sinuca::TrafficGenerator::Clock() {
+    ++this->cycle;
+    this->Consume();
+    for (unsigned long i = 0; i < this->targets.size(); ++i)
+        this->ReceiveResponses(this->targets[i].handle);
+
+    if (this->blocked) {
+        if (!this->Send(this->blockedTarget, &this->blockedMessage)) {
+            ++this->stallCycles;
+            return;
+        }
+        this->blocked = false;
+    }
+
+    long injections = (long)this->rate;
+    if (this->random.NextUnit() < this->rate - injections) ++injections;
+
+    for (long i = 0; i < injections; ++i) {
+        if (this->messages && this->sentRequests >= this->messages) break;
+        if (this->outstanding >= this->maxOutstanding) {
+            ++this->stallCycles;
+            break;
+        }
+
+        TrafficMessage message;
+        memset(&message, 0, sizeof(message));
+        message.id = this->sentRequests;
+        message.cycle = this->cycle;
+        message.size = this->size;
+        message.wantsResponse =
+            this->random.NextUnit() < this->responseRatio;
+        int target = this->random.Next() % this->targets.size();
+
+        if (message.wantsResponse) ++this->outstanding;
+        if (!this->Send(target, &message)) {
+            this->blocked = true;
+            this->blockedMessage = message;
+            this->blockedTarget = target;
+            ++this->stallCycles;
+            break;
+        }
+    }
+};
+
+bool sinuca::TrafficGenerator::IsFinished() const {
+    return this->messages && this->sentRequests >= this->messages &&
+           !this->outstanding;
+};
+
+void sinuca::TrafficGenerator::PrintStatistics() {
+    printf("traffic.sent_requests: %lu\n", this->sentRequests);
+    printf("traffic.sent_bytes: %lu\n", this->sentBytes);
+    printf("traffic.received_responses: %lu\n", this->receivedResponses);
+    printf("traffic.average_latency: %.2f\n", this->receivedResponses
+               ? (double)this->latencySum / this->receivedResponses
+               : 0.0);
+    printf("traffic.stall_cycles: %lu\n", this->stallCycles);
+    TrafficSink::PrintStatistics();
+};
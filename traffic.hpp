@@ -0,0 +1,225 @@
+#ifndef SINUCA3_TRAFFIC_TRAFFIC_HPP_
+#define SINUCA3_TRAFFIC_TRAFFIC_HPP_
+
+//
+// Copyright (C) 2024  HiPES - Universidade Federal do Paraná
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/**
+ * @file traffic.hpp
+ * @brief Synthetic traffic components, to load-test the message passing of
+ * the engine without a real model.
+ * @details A TrafficGenerator injects requests into its targets at a given
+ * rate, and a TrafficSink consumes them and answers those that ask for a
+ * response. Generators are sinks too, so they can be wired in any graph (see
+ * trafficTopology.hpp). Everything random comes from a seeded generator, so
+ * two runs of the same topology are identical.
+ */
+
+#include <string>
+#include <vector>
+
+#include "component.hpp"
+
+namespace sinuca {
+
+/**
+ * @brief The message of the traffic components.
+ * @details On a variable-length connection it leads a record of size bytes,
+ * the rest being padding. On a fixed one, size is only accounted.
+ */
+struct TrafficMessage {
+    unsigned long id;
+    unsigned long cycle; /**< Injection cycle, for the latency. */
+    int size;            /**< Bytes of the request. */
+    bool wantsResponse;
+};
+
+/**
+ * @brief Deterministic random numbers (splitmix64).
+ */
+struct TrafficRandom {
+    unsigned long state;
+
+    inline unsigned long Next() {
+        unsigned long z = (this->state += 0x9e3779b97f4a7c15UL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9UL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebUL;
+        return z ^ (z >> 31);
+    };
+
+    /**
+     * @return A number in [0, 1).
+     */
+    inline double NextUnit() { return (this->Next() >> 11) * 0x1.0p-53; };
+};
+
+/**
+ * @brief Consumes the requests of its connections and answers those that
+ * want a response.
+ * @details Takes at most one request per connection and bandwidth requests
+ * in total per cycle (0 for no limit), so a hub with a large fan-in becomes
+ * a bottleneck the way a real shared resource would. A request is left
+ * waiting while its response has no room.
+ */
+class TrafficSink : public Component<TrafficMessage> {
+  private:
+    long bandwidth;
+
+  protected:
+    unsigned long cycle;
+    unsigned long receivedRequests;
+    unsigned long receivedBytes;
+    unsigned long sentResponses;
+
+    /**
+     * @brief Handles the requests of one cycle.
+     */
+    void Consume();
+
+  public:
+    TrafficSink();
+
+    /**
+     * @brief Reads bandwidth.
+     */
+    int SetConfigParameter(const char* parameter,
+                           config::ConfigValue value) override;
+
+    int FinishSetup() override;
+
+    void Clock() override;
+
+    void PrintStatistics() override;
+
+    /**
+     * @return Whether the request wants a response.
+     */
+    bool ExpectsResponse(const void* request) const override;
+
+    /**
+     * @brief Self-explanatory
+     */
+    inline unsigned long GetReceivedRequests() const {
+        return this->receivedRequests;
+    };
+
+    /**
+     * @brief Self-explanatory
+     */
+    inline unsigned long GetSentResponses() const {
+        return this->sentResponses;
+    };
+};
+
+/**
+ * @brief Injects requests into its targets, and consumes the requests sent
+ * to it like a TrafficSink.
+ * @details Parameters, besides those of TrafficSink:
+ *  - target<anything>: connections, each request goes to one of them at
+ *    random;
+ *  - rate: requests injected per cycle, fractions are drawn (default 0.1);
+ *  - size: bytes of a request (default sizeof(TrafficMessage));
+ *  - responseRatio: fraction of the requests that want a response
+ *    (default 1);
+ *  - outstanding: responses awaited at most, injection stalls beyond it
+ *    (default 16);
+ *  - messages: requests to inject, 0 for no end (default 0);
+ *  - seed (default 1).
+ *
+ * A request that finds its connection full is retried the next cycles, and
+ * nothing else is injected meanwhile.
+ */
+class TrafficGenerator : public TrafficSink {
+  private:
+    struct Target {
+        Linkable* component;
+        int connectionID;
+        engine::ConnectionHandle handle;
+    };
+
+    std::vector<Target> targets;
+    double rate;
+    int size;
+    double responseRatio;
+    long maxOutstanding;
+    unsigned long messages;
+    TrafficRandom random;
+
+    bool blocked; /**< Whether blockedMessage waits for room. */
+    TrafficMessage blockedMessage;
+    int blockedTarget;
+    long outstanding;
+
+    unsigned long sentRequests;
+    unsigned long sentBytes;
+    unsigned long receivedResponses;
+    unsigned long latencySum; /**< Cycles, over the received responses. */
+    unsigned long stallCycles;
+
+    /**
+     * @return Whether the request left.
+     */
+    bool Send(int target, TrafficMessage* message);
+
+    void ReceiveResponses(const engine::ConnectionHandle& handle);
+
+  public:
+    TrafficGenerator();
+
+    /**
+     * @brief Reads the parameters listed in the class description.
+     */
+    int SetConfigParameter(const char* parameter,
+                           config::ConfigValue value) override;
+
+    /**
+     * @brief Resolves the targets.
+     */
+    int FinishSetup() override;
+
+    void Clock() override;
+
+    /**
+     * @return True when messages is reached and every response arrived.
+     */
+    bool IsFinished() const override;
+
+    void PrintStatistics() override;
+
+    /**
+     * @brief Self-explanatory
+     */
+    inline unsigned long GetSentRequests() const {
+        return this->sentRequests;
+    };
+
+    /**
+     * @brief Self-explanatory
+     */
+    inline unsigned long GetReceivedResponses() const {
+        return this->receivedResponses;
+    };
+
+    /**
+     * @brief Self-explanatory
+     */
+    inline unsigned long GetLatencySum() const { return this->latencySum; };
+};
+
+}  // namespace sinuca
+
+#endif  // SINUCA3_TRAFFIC_TRAFFIC_HPP_
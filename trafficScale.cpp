@@ -0,0 +1,267 @@
+//
+// Copyright (C) 2024  HiPES - Universidade Federal do Paraná
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/**
+ * @file trafficScale.cpp
+ * @brief Measures how the engine scales with the number of components, the
+ * fan-in and the threads, using generated traffic topologies.
+ * @details Every point of the run (shape, nodes, threads) builds the
+ * topology once per thread and clocks the copies at the same time, each
+ * thread building its own so its pages are local. The engine clocks a
+ * topology on one thread, so threads measure how independent simulations
+ * share the machine, e.g. the memory bandwidth, rather than a parallel
+ * engine. Messages count the requests consumed and the responses received.
+ */
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "engine.hpp"
+#include "memory.hpp"
+#include "traffic.hpp"
+#include "trafficTopology.hpp"
+
+/** Aligned so that threads never write to the same cache line. */
+struct alignas(64) ScaleReplica {
+    double milliseconds;
+    unsigned long messages;
+    unsigned long responses;
+    unsigned long latencySum;
+    long connections;
+    bool failed;
+};
+
+static void Usage(const char* program) {
+    fprintf(stderr,
+            "Usage: %s [-s <shape>[,<shape>]...] [-n <nodes>[,<nodes>]...] "
+            "[-j <threads>[,<threads>]...] [-c <cycles>] [-k <tree fan-in>] "
+            "[-b <buffer size> | -B <ring bytes>] [-S <seed>] "
+            "[-H default|thp|2m|1g] [-g <parameter>=<value>]... "
+            "[-p <component>.<parameter>=<value>]...\n"
+            "Shapes are ring, mesh, tree and hub, whose nodes are n0, n1, "
+            "...; -g parameters go to every TrafficGenerator, e.g. -g "
+            "rate=0.5, and -p to one node, e.g. -p n0.bandwidth=4.\n",
+            program);
+};
+
+/**
+ * @brief Splits a comma-separated list of positive integers.
+ * @returns Non-zero on error, 0 otherwise.
+ */
+static int ParseList(const char* text, std::vector<long>* values) {
+    values->clear();
+    while (*text) {
+        char* end;
+        long value = strtol(text, &end, 0);
+        if (end == text || value <= 0 || (*end && *end != ',')) {
+            fprintf(stderr, "Invalid list \"%s\".\n", text);
+            return 1;
+        }
+        values->push_back(value);
+        text = *end ? end + 1 : end;
+    }
+    return values->empty();
+};
+
+/**
+ * @brief Builds a copy of the topology, waits for the other threads and
+ * clocks it.
+ */
+static void RunReplica(sinuca::TrafficShape shape,
+                       const sinuca::TrafficOptions* options,
+                       const std::vector<const char*>* overrides,
+                       unsigned long cycles, std::atomic<long>* ready,
+                       long threads, ScaleReplica* replica) {
+    sinuca::config::Topology topology;
+    sinuca::engine::Engine engine;
+
+    replica->failed = sinuca::AddTrafficTopology(&topology, shape, *options);
+    for (unsigned long i = 0; i < overrides->size() && !replica->failed; ++i)
+        replica->failed = topology.SetOverride((*overrides)[i]);
+    if (!replica->failed) replica->failed = topology.Build();
+    if (!replica->failed) {
+        for (long i = 0; i < topology.GetNumberOfComponents(); ++i)
+            engine.AddComponent(topology.GetComponent(i));
+    }
+    replica->connections = topology.GetNumberOfConnections();
+
+    /* Starts together, so the threads contend during the whole run. */
+    ready->fetch_add(1);
+    while (ready->load() < threads) std::this_thread::yield();
+    if (replica->failed) return;
+
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    engine.Simulate(cycles);
+    replica->milliseconds = std::chrono::duration<double, std::milli>(
+                                std::chrono::steady_clock::now() - start)
+                                .count();
+
+    replica->messages = 0;
+    replica->responses = 0;
+    replica->latencySum = 0;
+    for (long i = 0; i < topology.GetNumberOfComponents(); ++i) {
+        sinuca::engine::Linkable* component = topology.GetComponent(i);
+        sinuca::TrafficSink* sink =
+            dynamic_cast<sinuca::TrafficSink*>(component);
+        sinuca::TrafficGenerator* generator =
+            dynamic_cast<sinuca::TrafficGenerator*>(component);
+        if (sink) replica->messages += sink->GetReceivedRequests();
+        if (generator) {
+            replica->responses += generator->GetReceivedResponses();
+            replica->latencySum += generator->GetLatencySum();
+        }
+    }
+    replica->messages += replica->responses;
+};
+
+int main(int argc, char** argv) {
+    std::vector<sinuca::TrafficShape> shapes;
+    std::vector<long> sizes;
+    std::vector<long> threadCounts(1, 1);
+    unsigned long cycles = 10000;
+    sinuca::TrafficOptions options;
+    std::vector<const char*> overrides;
+    sinuca::memory::PagePolicy pagePolicy = sinuca::memory::PagePolicyDefault;
+    int option;
+
+    sizes.push_back(64);
+    sizes.push_back(1024);
+    sizes.push_back(4096);
+
+    while ((option = getopt(argc, argv, "s:n:j:c:k:b:B:S:H:g:p:h")) != -1) {
+        switch (option) {
+            case 's': {
+                std::string list(optarg);
+                shapes.clear();
+                for (size_t begin = 0; begin <= list.size();) {
+                    size_t end = list.find(',', begin);
+                    if (end == std::string::npos) end = list.size();
+                    sinuca::TrafficShape shape;
+                    if (sinuca::ParseTrafficShape(
+                            list.substr(begin, end - begin).c_str(), &shape))
+                        return 1;
+                    shapes.push_back(shape);
+                    begin = end + 1;
+                }
+                break;
+            }
+            case 'n':
+                if (ParseList(optarg, &sizes)) return 1;
+                break;
+            case 'j':
+                if (ParseList(optarg, &threadCounts)) return 1;
+                break;
+            case 'c':
+                cycles = strtoul(optarg, NULL, 0);
+                break;
+            case 'k':
+                options.fanIn = atoi(optarg);
+                break;
+            case 'b':
+            case 'B':
+                options.bufferSize = atoi(optarg);
+                options.variableLength = (option == 'B');
+                break;
+            case 'S':
+                options.seed = strtoul(optarg, NULL, 0);
+                break;
+            case 'H':
+                if (sinuca::memory::ParsePagePolicy(optarg, &pagePolicy))
+                    return 1;
+                break;
+            case 'g':
+                options.parameters += std::string(" ") + optarg;
+                break;
+            case 'p':
+                overrides.push_back(optarg);
+                break;
+            default:
+                Usage(argv[0]);
+                return 1;
+        }
+    }
+    if (optind != argc || options.bufferSize <= 0) {
+        Usage(argv[0]);
+        return 1;
+    }
+    if (shapes.empty()) {
+        shapes.push_back(sinuca::TrafficShapeRing);
+        shapes.push_back(sinuca::TrafficShapeMesh);
+        shapes.push_back(sinuca::TrafficShapeTree);
+        shapes.push_back(sinuca::TrafficShapeHub);
+    }
+    sinuca::memory::SetPagePolicy(pagePolicy);
+
+    printf("%-6s %8s %11s %7s %9s %14s %14s %10s %9s\n", "shape",
+           "nodes", "connections", "threads", "ms", "cycles/s", "msgs/s",
+           "msgs/cycle", "latency");
+
+    for (unsigned long s = 0; s < shapes.size(); ++s) {
+        for (unsigned long n = 0; n < sizes.size(); ++n) {
+            for (unsigned long t = 0; t < threadCounts.size(); ++t) {
+                long threads = threadCounts[t];
+                options.nodes = sizes[n];
+
+                std::vector<ScaleReplica> replicas(threads);
+                std::vector<std::thread> workers;
+                std::atomic<long> ready(0);
+                for (long i = 0; i < threads; ++i) {
+                    workers.push_back(std::thread(
+                        RunReplica, shapes[s], &options, &overrides, cycles,
+                        &ready, threads, &replicas[i]));
+                }
+                for (long i = 0; i < threads; ++i) workers[i].join();
+
+                /* Rates are over the slowest copy, the wall time of the
+                 * point. */
+                double milliseconds = 0;
+                unsigned long messages = 0, responses = 0, latencySum = 0;
+                for (long i = 0; i < threads; ++i) {
+                    if (replicas[i].failed) return 1;
+                    milliseconds =
+                        std::max(milliseconds, replicas[i].milliseconds);
+                    messages += replicas[i].messages;
+                    responses += replicas[i].responses;
+                    latencySum += replicas[i].latencySum;
+                }
+                double seconds = milliseconds / 1000.0;
+
+                printf("%-6s %8ld %11ld %7ld %9.1f %14.0f %14.0f %10.3f "
+                       "%9.2f\n",
+                       sinuca::GetTrafficShapeName(shapes[s]), sizes[n],
+                       replicas[0].connections, threads, milliseconds,
+                       seconds > 0 ? cycles / seconds : 0.0,
+                       seconds > 0 ? messages / seconds : 0.0,
+                       cycles ? (double)messages / threads / cycles : 0.0,
+                       responses ? (double)latencySum / responses : 0.0);
+                fflush(stdout);
+            }
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,126 @@
+//
+// Copyright (C) 2024  HiPES - Universidade Federal do Paraná
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/**
+ * @file trafficTopology.cpp
+ * @brief Implementation of the traffic topology builders.
+ */
+
+#include "trafficTopology.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+static const char* const SHAPE_NAMES[] = {"ring", "mesh", "tree", "hub"};
+
+int sinuca::ParseTrafficShape(const char* name, TrafficShape* shape) {
+    for (int i = 0; i < 4; ++i) {
+        if (strcmp(name, SHAPE_NAMES[i]) == 0) {
+            *shape = static_cast<TrafficShape>(i);
+            return 0;
+        }
+    }
+
+    fprintf(stderr, "Unknown traffic shape \"%s\", expected ring, mesh, tree "
+                    "or hub.\n",
+            name);
+    return 1;
+};
+
+const char* sinuca::GetTrafficShapeName(TrafficShape shape) {
+    return SHAPE_NAMES[shape];
+};
+
+static std::string NodeName(long node) { return "n" + std::to_string(node); };
+
+static int AddNode(sinuca::config::Topology* topology,
+                   const sinuca::TrafficOptions& options, long node,
+                   bool generator) {
+    if (!generator) return topology->AddLine("component TrafficSink n0");
+
+    return topology->AddLine("component TrafficGenerator " + NodeName(node) +
+                             " seed=" + std::to_string(options.seed + node) +
+                             " " + options.parameters);
+};
+
+static int AddConnection(sinuca::config::Topology* topology,
+                         const sinuca::TrafficOptions& options, long source,
+                         const char* parameter, long destination) {
+    return topology->AddLine(
+        "connect " + NodeName(source) + "." + parameter + " " +
+        NodeName(destination) + " " + std::to_string(options.bufferSize) +
+        (options.variableLength ? "B" : ""));
+};
+
+int sinuca::AddTrafficTopology(config::Topology* topology, TrafficShape shape,
+                               const TrafficOptions& options) {
+    long nodes = options.nodes;
+    if (nodes < 2 || options.fanIn < 1) {
+        fprintf(stderr, "A traffic topology needs at least 2 nodes and a "
+                        "fan-in of 1.\n");
+        return 1;
+    }
+
+    /* Trees and hubs gather at a sink, the other shapes have none. */
+    bool sinkRoot = (shape == TrafficShapeTree || shape == TrafficShapeHub);
+    for (long i = 0; i < nodes; ++i) {
+        if (AddNode(topology, options, i, !(sinkRoot && i == 0))) return 1;
+    }
+
+    int error = 0;
+    switch (shape) {
+        case TrafficShapeRing:
+            for (long i = 0; i < nodes && !error; ++i)
+                error = AddConnection(topology, options, i, "target0",
+                                      (i + 1) % nodes);
+            break;
+
+        case TrafficShapeMesh: {
+            long width = (long)ceil(sqrt((double)nodes));
+            for (long i = 0; i < nodes && !error; ++i) {
+                long column = i % width;
+                if (column + 1 < width && i + 1 < nodes)
+                    error |= AddConnection(topology, options, i, "targetE",
+                                           i + 1);
+                if (column > 0)
+                    error |= AddConnection(topology, options, i, "targetW",
+                                           i - 1);
+                if (i + width < nodes)
+                    error |= AddConnection(topology, options, i, "targetS",
+                                           i + width);
+                if (i >= width)
+                    error |= AddConnection(topology, options, i, "targetN",
+                                           i - width);
+            }
+            break;
+        }
+
+        case TrafficShapeTree:
+            for (long i = 1; i < nodes && !error; ++i)
+                error = AddConnection(topology, options, i, "target0",
+                                      (i - 1) / options.fanIn);
+            break;
+
+        case TrafficShapeHub:
+            for (long i = 1; i < nodes && !error; ++i)
+                error = AddConnection(topology, options, i, "target0", 0);
+            break;
+    }
+
+    return error;
+};
@@ -0,0 +1,79 @@
+#ifndef SINUCA3_TRAFFIC_TRAFFIC_TOPOLOGY_HPP_
+#define SINUCA3_TRAFFIC_TRAFFIC_TOPOLOGY_HPP_
+
+//
+// Copyright (C) 2024  HiPES - Universidade Federal do Paraná
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/**
+ * @file trafficTopology.hpp
+ * @brief Generates topologies of traffic components of any size.
+ * @details The nodes are named n0, n1, ... and added to a config::Topology
+ * line by line, as a topology file would, so the result is built, overridden
+ * and inspected like any other topology.
+ */
+
+#include <string>
+
+#include "configLoader.hpp"
+
+namespace sinuca {
+
+enum TrafficShape {
+    TrafficShapeRing, /**< Each generator sends to the next one. */
+    TrafficShapeMesh, /**< A square grid, generators send to their up to four
+                          neighbors. */
+    TrafficShapeTree, /**< Generators send to their parent, the root is a
+                          TrafficSink with fanIn children. */
+    TrafficShapeHub,  /**< Every generator sends to n0, a TrafficSink. */
+};
+
+struct TrafficOptions {
+    long nodes;
+    int fanIn;          /**< Children of each node of a tree. */
+    int bufferSize;     /**< Of each connection, in bytes when
+                            variableLength. */
+    bool variableLength;
+    unsigned long seed; /**< Of n0, the next nodes get seed + index. */
+    std::string parameters; /**< Added to every generator, e.g. "rate=0.5
+                                size=64". */
+
+    TrafficOptions()
+        : nodes(64), fanIn(4), bufferSize(8), variableLength(false), seed(1){};
+};
+
+/**
+ * @brief Parses "ring", "mesh", "tree" or "hub".
+ * @returns Non-zero on error, 0 otherwise.
+ */
+int ParseTrafficShape(const char* name, TrafficShape* shape);
+
+/**
+ * @brief Self-explanatory
+ */
+const char* GetTrafficShapeName(TrafficShape shape);
+
+/**
+ * @brief Adds the components and connections of a shape to a topology, which
+ * is then built by the caller.
+ * @returns Non-zero on error, 0 otherwise.
+ */
+int AddTrafficTopology(config::Topology* topology, TrafficShape shape,
+                       const TrafficOptions& options);
+
+}  // namespace sinuca
+
+#endif  // SINUCA3_TRAFFIC_TRAFFIC_TOPOLOGY_HPP_